@@ -559,3 +559,40 @@ void DoTopologyPlot(const ConfigParameters& config)
 
 template void DoTopologyPlot<float>(const ConfigParameters& config);
 template void DoTopologyPlot<double>(const ConfigParameters& config);
+
+// ===========================================================================
+// DoConvertToBinary() - implements CNTK "convertToBinary" command
+// ===========================================================================
+
+// Converts the data described by the deserializers of a reader section into the CNTK binary format, e.g.
+//   convert = [
+//       action = "convertToBinary"
+//       outputFile = "train.bin"
+//       numThreads = 0   # all cores
+//       reader = [ deserializers = ( [ type = "CNTKTextFormatDeserializer" ; module = "CNTKTextFormatReader" ; ... ] ) ]
+//   ]
+// The resulting file can be read with the CNTKBinaryReader.
+template <typename ElemType>
+void DoConvertToBinary(const ConfigParameters& config)
+{
+    typedef void (*ConvertToBinaryProc)(const ConfigParameters* config);
+
+    ConfigParameters readerConfig(config(L"reader"));
+    std::string outputFile = config(L"outputFile");
+    size_t numThreads = config(L"numThreads", (size_t)0);
+    readerConfig.Insert("outputFile", outputFile);
+    readerConfig.Insert("numThreads", std::to_string(numThreads));
+    readerConfig.Insert("precision", sizeof(ElemType) == sizeof(double) ? "double" : "float");
+
+    Plugin plugin;
+    ConvertToBinaryProc convert = (ConvertToBinaryProc)plugin.Load(std::string("Cntk.Deserializers.Binary"), "ConvertToCNTKBinaryFormat");
+
+    auto start = std::chrono::system_clock::now();
+    convert(&readerConfig);
+    auto end = std::chrono::system_clock::now();
+    auto elapsed = end - start;
+    fprintf(stderr, "Converted the data to '%s' in %f seconds.\n", outputFile.c_str(), (float) (std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count()) / 1000);
+}
+
+template void DoConvertToBinary<float>(const ConfigParameters& config);
+template void DoConvertToBinary<double>(const ConfigParameters& config);
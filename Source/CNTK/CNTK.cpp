@@ -24,6 +24,7 @@
 #include "ModelEditLanguage.h"
 #include "CPUMatrix.h" // used for SetNumThreads()
 #include "CommonMatrix.h"
+#include "ConvolutionEngine.h" // used for SetCpuConvolutionAutotuning()
 #include "SGD.h"
 #include "MPIWrapper.h"
 #include "Config.h"
@@ -339,6 +340,10 @@ void DoCommands(const ConfigParameters& config, const shared_ptr<MPIWrapper>& mp
                 {
                     DoParameterSVD<ElemType>(commandParams);
                 }
+                else if (thisAction == "convertToBinary")
+                {
+                    DoConvertToBinary<ElemType>(commandParams);
+                }
                 else
                 {
                     RuntimeError("unknown action: %s  in command set: %s", thisAction.c_str(), command[i].c_str());
@@ -470,6 +475,11 @@ int wmainWithBS(int argc, wchar_t* argv[]) // called from wmain which is a wrapp
         Globals::ForceDeterministicAlgorithms();
     if (config(L"forceConstantRandomSeed", false))
         Globals::ForceConstantRandomSeed();
+    if (config(L"cpuConvolutionAutotuning", false))
+    {
+        wstring tuningCacheFile = config(L"cpuConvolutionTuningCache", L"");
+        SetCpuConvolutionAutotuning(true, tuningCacheFile);
+    }
 
 #ifndef CPUONLY
     auto valpp = config.Find(L"deviceId");
@@ -510,6 +520,11 @@ int wmainWithBS(int argc, wchar_t* argv[]) // called from wmain which is a wrapp
 
     Globals::SetShareNodeValueMatrices(config(L"shareNodeValueMatrices", true));
     Globals::SetGradientAccumulationOptimization(config(L"optimizeGradientAccumulation", true));
+    Globals::SetMemoryArena(config(L"memoryArena", false));
+    Globals::SetInterOpThreads(config(L"interOpThreads", 0));
+    Globals::SetElementwiseFusion(config(L"fuseElementwiseOps", false));
+    Globals::SetLoopInvariantHoisting(config(L"hoistLoopInvariants", false));
+    Globals::SetMinibatchSizeBucketing(config(L"bucketMinibatchSizes", false));
 
     TracingGPUMemoryAllocator::SetTraceLevel(config(L"traceGPUMemoryAllocations", 0));
 
@@ -635,6 +650,11 @@ int wmainOldCNTKConfig(int argc, wchar_t* argv[])
         Globals::ForceDeterministicAlgorithms();
     if (config(L"forceConstantRandomSeed", false))
         Globals::ForceConstantRandomSeed();
+    if (config(L"cpuConvolutionAutotuning", false))
+    {
+        wstring tuningCacheFile = config(L"cpuConvolutionTuningCache", L"");
+        SetCpuConvolutionAutotuning(true, tuningCacheFile);
+    }
 
     // get the command param set they want
     wstring logpath = config(L"stderr", L"");
@@ -658,6 +678,11 @@ int wmainOldCNTKConfig(int argc, wchar_t* argv[])
 
     Globals::SetShareNodeValueMatrices(config(L"shareNodeValueMatrices", true));
     Globals::SetGradientAccumulationOptimization(config(L"optimizeGradientAccumulation", true));
+    Globals::SetMemoryArena(config(L"memoryArena", false));
+    Globals::SetInterOpThreads(config(L"interOpThreads", 0));
+    Globals::SetElementwiseFusion(config(L"fuseElementwiseOps", false));
+    Globals::SetLoopInvariantHoisting(config(L"hoistLoopInvariants", false));
+    Globals::SetMinibatchSizeBucketing(config(L"bucketMinibatchSizes", false));
 
     TracingGPUMemoryAllocator::SetTraceLevel(config(L"traceGPUMemoryAllocations", 0));
 
@@ -5342,6 +5342,7 @@ namespace CNTK
     /// Note that this is a per compute operation limit and if the user performs multiple compute operations concurrently
     /// by launching multiple threads and performing a compute operation inside, it will result in each of those concurrently
     /// executing operations to use the specified number of CPU threads limit.
+    /// On machines with several NUMA nodes the threads are spread over the nodes and pinned to them.
     ///
     CNTK_API void SetMaxNumCPUThreads(size_t numCPUThreads);
 
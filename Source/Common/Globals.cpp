@@ -16,6 +16,11 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 
     std::atomic<bool> Globals::m_enableShareNodeValueMatrices(true);
     std::atomic<bool> Globals::m_optimizeGradientAccumulation(true);
+    std::atomic<bool> Globals::m_useMemoryArena(false);
+    std::atomic<int> Globals::m_interOpThreads(0);
+    std::atomic<bool> Globals::m_fuseElementwiseOps(false);
+    std::atomic<bool> Globals::m_hoistLoopInvariants(false);
+    std::atomic<bool> Globals::m_bucketMinibatchSizes(false);
 
     // Note: this is a map that transfers the old reader and writer names to
     //       the new naming scheme
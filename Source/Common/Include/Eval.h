@@ -355,6 +355,29 @@ public:
     // resetRNN - flags whether to reset memory cells of RNN. 
     //
     virtual void ForwardPass(const ValueRefs<ElemType>& inputs, ValueRefs<ElemType>& output, bool resetRNN) = 0;
+
+    //
+    // ForwardPassBatch - Evaluate several independent sequences in a single forward pass, which is more efficient
+    // than one ForwardPass() per sequence for small inputs.
+    // inputs[r] and outputs[r] are the input and output buffers of sequence r, as for ForwardPass().
+    // Sequences may differ in length. Each one is evaluated from its start, i.e. RNN state is reset.
+    //
+    virtual void ForwardPassBatch(const std::vector<Values<ElemType>>& inputs, std::vector<Values<ElemType>>& outputs) = 0;
+
+    //
+    // Same as above, but takes references to static arrays instead of std::vector 
+    //
+    virtual void ForwardPassBatch(const std::vector<ValueRefs<ElemType>>& inputs, std::vector<ValueRefs<ElemType>>& outputs) = 0;
+
+    //
+    // CreateSession - create another evaluator for the model given to CreateNetwork(), to evaluate concurrently.
+    // The session shares the model parameters with this object, but has its own state for ForwardPass(), so that
+    // this object and any number of sessions can evaluate at the same time, each from its own thread.
+    // Call StartForwardEvaluation() on the session before evaluating, and Destroy() when done with it.
+    // This must not be called while ForwardPass() runs on this object. Sessions may outlive this object.
+    // With interOpThreads, each session runs its nodes on a pool of threads of its own.
+    //
+    virtual IEvaluateModelExtended<ElemType>* CreateSession() = 0;
 };
 
 template <typename ElemType>
@@ -0,0 +1,179 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// EvalBatching.h -- a front-end to the extended evaluation interface that batches concurrent requests
+//
+// Serving many small requests with one ForwardPass() each leaves the matrix products with a single column.
+// BatchingEvaluator queues the requests of concurrent callers instead, and evaluates up to maxBatchSize of them
+// in one ForwardPassBatch(). A request waits at most maxWait for others to join it, which bounds the latency
+// added by batching.
+//
+// Usage:
+//     IEvaluateModelExtended<float>* eval;
+//     GetEvalExtendedF(&eval);
+//     eval->CreateNetwork(...);
+//     eval->StartForwardEvaluation(...);
+//     BatchingEvaluator<float> batching(eval, /*maxBatchSize=*/32, std::chrono::milliseconds(2));
+//     ... from any number of threads:
+//     batching.ForwardPass(inputs, outputs);
+//
+
+#pragma once
+
+#include "Eval.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+template <typename ElemType>
+class BatchingEvaluator
+{
+public:
+    // eval must be started (StartForwardEvaluation()). It is not owned, and must not be used otherwise while
+    // this object exists.
+    BatchingEvaluator(IEvaluateModelExtended<ElemType>* eval, size_t maxBatchSize, std::chrono::microseconds maxWait) :
+        m_eval(eval), m_maxBatchSize(maxBatchSize > 0 ? maxBatchSize : 1), m_maxWait(maxWait), m_stop(false)
+    {
+        m_thread = std::thread(&BatchingEvaluator::Run, this);
+    }
+
+    // pending requests are completed first
+    ~BatchingEvaluator()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        m_thread.join();
+    }
+
+    BatchingEvaluator(const BatchingEvaluator&) = delete;
+    BatchingEvaluator& operator=(const BatchingEvaluator&) = delete;
+
+    //
+    // ForwardPass - Evaluate one sequence, like IEvaluateModelExtended::ForwardPass() with resetRNN.
+    // This may be called from many threads at once. It blocks until the batch that contains the request has been
+    // evaluated, and throws what the evaluation of that batch threw.
+    //
+    void ForwardPass(const Values<ElemType>& inputs, Values<ElemType>& outputs)
+    {
+        Request request(inputs, outputs);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_queue.push_back(&request);
+        m_wake.notify_all();
+        m_done.wait(lock, [&] { return request.done; });
+        if (request.error)
+            std::rethrow_exception(request.error);
+    }
+
+private:
+    struct Request
+    {
+        Request(const Values<ElemType>& inputs, Values<ElemType>& outputs) :
+            inputs(inputs), outputs(outputs), arrival(std::chrono::steady_clock::now()), done(false)
+        {}
+        const Values<ElemType>& inputs;
+        Values<ElemType>& outputs;
+        std::chrono::steady_clock::time_point arrival;
+        bool done;
+        std::exception_ptr error;
+    };
+
+    void Run()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;)
+        {
+            m_wake.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+            if (m_queue.empty()) // stopped, and nothing left to do
+                return;
+
+            // wait for more requests until the batch is full or the oldest one has waited long enough
+            auto deadline = m_queue.front()->arrival + m_maxWait;
+            m_wake.wait_until(lock, deadline, [this] { return m_stop || m_queue.size() >= m_maxBatchSize; });
+
+            std::vector<Request*> batch;
+            while (!m_queue.empty() && batch.size() < m_maxBatchSize)
+            {
+                batch.push_back(m_queue.front());
+                m_queue.pop_front();
+            }
+            lock.unlock();
+
+            Evaluate(batch);
+
+            lock.lock();
+            for (auto request : batch)
+                request->done = true;
+            m_done.notify_all();
+        }
+    }
+
+    // runs one ForwardPassBatch() on references to the requests' buffers
+    void Evaluate(const std::vector<Request*>& batch)
+    {
+        try
+        {
+            std::vector<ValueRefs<ElemType>> inputs(batch.size()), outputs(batch.size());
+            for (size_t r = 0; r < batch.size(); r++)
+            {
+                // const cast: the references are only read from, see ForwardPass()
+                auto& requestInputs = const_cast<Values<ElemType>&>(batch[r]->inputs);
+                inputs[r].resize(requestInputs.size());
+                for (size_t i = 0; i < requestInputs.size(); i++)
+                {
+                    inputs[r][i].m_buffer.InitFrom(requestInputs[i].m_buffer);
+                    inputs[r][i].m_indices.InitFrom(requestInputs[i].m_indices);
+                    inputs[r][i].m_colIndices.InitFrom(requestInputs[i].m_colIndices);
+                }
+                // outputs are written up to their capacity, as with ForwardPass()
+                auto& requestOutputs = batch[r]->outputs;
+                outputs[r].resize(requestOutputs.size());
+                for (size_t o = 0; o < requestOutputs.size(); o++)
+                {
+                    requestOutputs[o].m_buffer.resize(requestOutputs[o].m_buffer.capacity());
+                    outputs[r][o].m_buffer.InitFrom(requestOutputs[o].m_buffer);
+                }
+            }
+
+            m_eval->ForwardPassBatch(inputs, outputs);
+
+            for (size_t r = 0; r < batch.size(); r++)
+            {
+                for (size_t o = 0; o < outputs[r].size(); o++)
+                    batch[r]->outputs[o].m_buffer.resize(outputs[r][o].m_buffer.size());
+            }
+        }
+        catch (...)
+        {
+            // one bad request must not fail the others, so retry them one by one
+            if (batch.size() > 1)
+            {
+                for (auto request : batch)
+                    Evaluate({ request });
+            }
+            else
+                batch[0]->error = std::current_exception();
+        }
+    }
+
+    IEvaluateModelExtended<ElemType>* m_eval;
+    const size_t m_maxBatchSize;
+    const std::chrono::microseconds m_maxWait;
+
+    std::thread m_thread;           // evaluates the batches
+    std::mutex m_mutex;             // protects the members below, and the 'done' flags of the requests
+    std::condition_variable m_wake; // signals a new request, or m_stop
+    std::condition_variable m_done; // signals completed requests
+    std::deque<Request*> m_queue;
+    bool m_stop;
+};
+
+}}}
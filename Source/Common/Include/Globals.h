@@ -28,11 +28,37 @@ namespace Microsoft { namespace MSR { namespace CNTK {
         static void SetShareNodeValueMatrices(bool enable) { m_enableShareNodeValueMatrices = enable; }
         static bool ShouldEnableShareNodeValueMatrices() { return m_enableShareNodeValueMatrices; }
 
+        // place the shared node matrices at planned offsets of one memory arena per device (see MatrixPool)
+        static void SetMemoryArena(bool enable) { m_useMemoryArena = enable; }
+        static bool ShouldUseMemoryArena() { return m_useMemoryArena; }
+
+        // number of threads that run independent nodes of a network concurrently on the CPU (0 or 1: one node at a time)
+        // They share the CPU threads of the Math kernels (numCPUThreads): the kernels of each get numCPUThreads / interOpThreads.
+        static void SetInterOpThreads(int numThreads) { m_interOpThreads = numThreads; }
+        static int GetInterOpThreads() { return m_interOpThreads; }
+
+        // replace Plus nodes that feed a single activation by one node that computes both (see ComputationNetwork::FuseElementwiseOps())
+        static void SetElementwiseFusion(bool enable) { m_fuseElementwiseOps = enable; }
+        static bool ShouldFuseElementwiseOps() { return m_fuseElementwiseOps; }
+
+        // compute the loop-invariant parts of products inside recurrent loops for all frames at once (see ComputationNetwork::HoistLoopInvariantProducts())
+        static void SetLoopInvariantHoisting(bool enable) { m_hoistLoopInvariants = enable; }
+        static bool ShouldHoistLoopInvariants() { return m_hoistLoopInvariants; }
+
+        // allocate minibatch-sized matrices for the next power of two of time steps when they grow (see ComputationNode::UpdateDataSize())
+        static void SetMinibatchSizeBucketing(bool enable) { m_bucketMinibatchSizes = enable; }
+        static bool ShouldBucketMinibatchSizes() { return m_bucketMinibatchSizes; }
+
     private:
         static std::atomic<bool> m_forceDeterministicAlgorithms;
         // The global flag to enable matrices values in forward and backward prop
         static std::atomic<bool> m_enableShareNodeValueMatrices;
         static std::atomic<bool> m_forceConstantRandomSeed;
         static std::atomic<bool> m_optimizeGradientAccumulation;
+        static std::atomic<bool> m_useMemoryArena;
+        static std::atomic<int> m_interOpThreads;
+        static std::atomic<bool> m_fuseElementwiseOps;
+        static std::atomic<bool> m_hoistLoopInvariants;
+        static std::atomic<bool> m_bucketMinibatchSizes;
     };
 }}}
@@ -10,6 +10,8 @@
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+class NodeProfiler;
+
 // ===========================================================================
 // ComputationEnvironment -- global network properties of interest to nodes
 // ===========================================================================
@@ -46,6 +48,9 @@ struct ComputationEnvironment
 
     bool isV2Library = false;
 
+    // when inferring on the CPU, Times nodes with a constant left operand quantize it once and multiply in 16-bit fixed point
+    bool quantizeTimes = false;
+
     // traceLevel
     int traceLevel = 0;
 
@@ -56,6 +61,9 @@ struct ComputationEnvironment
 
     bool IsV2Library() const { return isV2Library; }
 
+    // per-node profiling, see ComputationNetwork::EnableNodeProfiler()
+    std::shared_ptr<NodeProfiler> nodeProfiler;
+
     // more properties should be added here as needed
 };
 typedef std::shared_ptr<ComputationEnvironment> ComputationEnvironmentPtr;
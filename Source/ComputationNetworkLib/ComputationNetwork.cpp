@@ -47,6 +47,18 @@ vector<MemRequestInfo<double>>& MatrixPool::GetMemRequestInfoVec<double>()
     return m_memRequestInfoDoubleVec;
 }
 
+template <>
+map<DEVICEID_TYPE, shared_ptr<Matrix<float>>>& MatrixPool::GetMemArenas<float>()
+{
+    return m_memArenasFloat;
+}
+
+template <>
+map<DEVICEID_TYPE, shared_ptr<Matrix<double>>>& MatrixPool::GetMemArenas<double>()
+{
+    return m_memArenasDouble;
+}
+
 // -----------------------------------------------------------------------
 // construction
 // -----------------------------------------------------------------------
@@ -57,6 +69,7 @@ void ComputationNetwork::ClearNetwork()
 {
     // release all references to nodes
     InvalidateCompiledNetwork();
+    m_nodesBeforeRewrites.clear();
 
     for (auto groupIter : GetAllNodeGroups())
         groupIter->clear();
@@ -115,13 +128,21 @@ void ComputationNetwork::SaveToFileImpl(const wstring& fileName, const FileOptio
     fstream << (size_t) CURRENT_CNTK_MODEL_VERSION;
     fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EVersion");
 
-    fstream << (size_t) m_nameToNodeMap.size();
+    // the nodes with their inputs; as they were before CompileNetwork() rewrote them for execution, if it did
+    auto nodesToSave = m_nodesBeforeRewrites;
+    if (nodesToSave.empty())
+    {
+        for (const auto& iter : m_nameToNodeMap)
+            nodesToSave[iter.first] = make_pair(iter.second, iter.second->GetInputs());
+    }
+
+    fstream << (size_t) nodesToSave.size();
 
     // put all node info first
     fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BNodeList");
-    for (auto nodeIter = m_nameToNodeMap.begin(); nodeIter != m_nameToNodeMap.end(); nodeIter++)
+    for (auto nodeIter = nodesToSave.begin(); nodeIter != nodesToSave.end(); nodeIter++)
     {
-        ComputationNodeBasePtr nodePtr = nodeIter->second;
+        ComputationNodeBasePtr nodePtr = nodeIter->second.first;
         // type
 #if CURRENT_CNTK_MODEL_VERSION >= CNTK_MODEL_VERSION_7
         wstring precision;
@@ -143,16 +164,17 @@ void ComputationNetwork::SaveToFileImpl(const wstring& fileName, const FileOptio
 
     // put relationship
     fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BRelation");
-    for (auto nodeIter = m_nameToNodeMap.begin(); nodeIter != m_nameToNodeMap.end(); nodeIter++)
+    for (auto nodeIter = nodesToSave.begin(); nodeIter != nodesToSave.end(); nodeIter++)
     {
-        ComputationNodeBasePtr nodePtr = nodeIter->second;
-        fstream << nodePtr->NodeName() << nodePtr->GetNumInputs();
-        for (size_t i = 0; i < nodePtr->GetNumInputs(); i++)
+        ComputationNodeBasePtr nodePtr = nodeIter->second.first;
+        const auto& inputs = nodeIter->second.second;
+        fstream << nodePtr->NodeName() << inputs.size();
+        for (size_t i = 0; i < inputs.size(); i++)
         {
-            if (!nodePtr->Input(i))
+            if (!inputs[i])
                 fprintf(stderr, "Warning: node %ls 's child is null, please check your ndl/mel file.\n", nodePtr->NodeName().c_str());
             else
-                fstream << nodePtr->Input(i)->NodeName();
+                fstream << inputs[i]->NodeName();
         }
     }
     fstream.PutMarker(FileMarker::fileMarkerEndSection, L"ERelation");
@@ -235,8 +257,11 @@ void ComputationNetwork::ReadPersistableParameters(size_t modelVersion, File& fs
         fstream >> opName >> nodeName;
 
         ComputationNodeBasePtr node;
-        if (!create) // reloading existing
-            node = GetNodeFromName(nodeName);
+        if (!create) // reloading existing; the model has the nodes as they were before CompileNetwork() rewrote them, see Save()
+        {
+            auto original = m_nodesBeforeRewrites.find(nodeName);
+            node = original != m_nodesBeforeRewrites.end() ? original->second.first : GetNodeFromName(nodeName);
+        }
         else if (precision == L"float")
             node = ComputationNetworkBuilder<float>::NewNode(opName, m_deviceId, nodeName);
         else if (precision == L"double")
@@ -250,7 +275,7 @@ void ComputationNetwork::ReadPersistableParameters(size_t modelVersion, File& fs
 
         if (create) // loaded from scratch
             AddNodeToNet(node);
-        else                      // reloaded existing
+        else if (NodeNameExists(nodeName) && GetNodeFromName(nodeName) == node) // reloaded existing, unless it was rewritten away
         {
             let old = node->GetSampleLayout();
             let changed = ValidateNode(node, /*isFinalValidationPass=*/true);
@@ -526,7 +551,10 @@ void ComputationNetwork::CollectInputAndLearnableParametersRec(const Computation
 {
     if (visited.find(node) != visited.end())    // allready got this one
         return;
-    else if (node->OperationName() == OperationNameOf(InputValue) || node->OperationName() == OperationNameOf(SparseInputValue))
+    // Also the inputs and parameters are visited once. A parameter with several consumers, e.g. a weight used by two
+    // products, is listed once, so that SGD updates it once and keeps one smoothed gradient for it.
+    visited.insert(node);
+    if (node->OperationName() == OperationNameOf(InputValue) || node->OperationName() == OperationNameOf(SparseInputValue))
         inputs.push_back(node);
     else if (node->OperationName() == OperationNameOf(LearnableParameter) && node->IsParameterUpdateRequired())
         learnableParameters.push_back(node);
@@ -537,7 +565,6 @@ void ComputationNetwork::CollectInputAndLearnableParametersRec(const Computation
         if (pcnode && pcnode->HasComputed())
             return;
         // recurse
-        visited.insert(node);
         for (const auto & input : node->GetInputs())
             CollectInputAndLearnableParametersRec(input, visited, inputs, learnableParameters);
     }
@@ -1154,6 +1181,333 @@ void ComputationNetwork::PerformSVDecomposition(const map<wstring, float>& SVDCo
     CompileNetwork();
 }
 
+// ========================================
+// This function simplifies a network that is only going to be evaluated:
+//  - Nodes that only depend on parameters (e.g. a transposed or scaled weight matrix) are computed once,
+//    and the outermost ones are replaced by constant parameters of the same name.
+//  - A BatchNormalization with its running statistics is an affine map per output element or channel.
+//    If it follows a Times or Convolution, optionally with a bias Plus in between, it is folded into the
+//    weights, and replaced by a Plus of a new bias under the BatchNormalization's name.
+// Weights are modified in place, so the network must not be trained afterwards. Nodes that are folded away
+// can no longer be requested as outputs, unless they are in a node group.
+// ========================================
+// BUGBUG: like PerformSVDecomposition(), this only works for networks of a single ElemType
+template <class ElemType>
+void ComputationNetwork::OptimizeForInference()
+{
+    VerifyIsCompiled("OptimizeForInference");
+    if (AreMatricesAllocated())
+        LogicError("OptimizeForInference: This must be called before the network is evaluated for the first time.");
+
+    // constants first, so that a weight computed from parameters can take part in BatchNormalization folding
+    size_t numConstantNodes = FoldConstantNodes<ElemType>();
+
+    size_t numBatchNormalizations = 0;
+    for (auto& node : GetNodesWithType(OperationNameOf(BatchNormalizationNode)))
+    {
+        if (FoldBatchNormalization<ElemType>(node))
+            numBatchNormalizations++;
+    }
+
+    fprintf(stderr, "OptimizeForInference: %d nodes computed from parameters, %d BatchNormalization nodes folded into weights.\n",
+            (int) numConstantNodes, (int) numBatchNormalizations);
+
+    // redo necessary post-processing
+    CompileNetwork();
+}
+
+// helper for OptimizeForInference(): computes all nodes whose inputs are parameters or such nodes themselves,
+// and replaces those used by other nodes (or listed in a node group) by parameters with their value
+// Returns the number of nodes computed.
+template <class ElemType>
+size_t ComputationNetwork::FoldConstantNodes()
+{
+    set<ComputationNodeBasePtr> groupedNodes;
+    for (auto group : GetAllNodeGroups())
+        groupedNodes.insert(group->begin(), group->end());
+
+    // find the constant nodes, in evaluation order
+    set<ComputationNodeBasePtr> constantNodes;
+    list<ComputationNodeBasePtr> constantNodesInOrder;
+    for (auto& node : GetEvalOrder(nullptr))
+    {
+        if (node->IsLeaf() || node->HasMBLayout() || node->RequiresPreCompute() || !node->CanRecomputeForwardProp() ||
+            !dynamic_pointer_cast<ComputationNode<ElemType>>(node) || dynamic_pointer_cast<MultiOutputNode<ElemType>>(node))
+            continue;
+        bool isConstant = true;
+        for (auto& input : node->GetInputs())
+            isConstant &= input->OperationName() == OperationNameOf(LearnableParameter) || constantNodes.find(input) != constantNodes.end();
+        if (isConstant)
+        {
+            constantNodes.insert(node);
+            constantNodesInOrder.push_back(node);
+        }
+    }
+    if (constantNodes.empty())
+        return 0;
+
+    // compute them, each into a matrix of its own
+    // (The pool is released last, after the nodes that are folded away.)
+    MatrixPool matrixPool;
+    for (auto& node : constantNodesInOrder)
+    {
+        node->MarkValueNonSharable();
+        node->RequestMatricesBeforeForwardProp(matrixPool);
+    }
+    matrixPool.OptimizedMemoryAllocation();
+    for (auto& node : constantNodesInOrder)
+    {
+        node->BeginForwardProp();
+        node->ForwardProp(FrameRange(node->GetMBLayout()));
+        node->EndForwardProp();
+    }
+
+    // replace those at the boundary to the rest of the network by parameters
+    vector<ComputationNodeBasePtr> replacedNodes;
+    for (auto& node : constantNodesInOrder)
+    {
+        bool isUsedOutside = groupedNodes.find(node) != groupedNodes.end();
+        for (auto& parent : GetParentNodes(node->NodeName()))
+            isUsedOutside |= constantNodes.find(parent) == constantNodes.end();
+        if (isUsedOutside)
+            replacedNodes.push_back(node);
+    }
+    vector<ComputationNodeBasePtr> unusedCandidates;
+    for (auto& node : replacedNodes)
+    {
+        auto value = New<LearnableParameter<ElemType>>(node->GetDeviceId(), node->NodeName(), node->GetSampleLayout());
+        InitLearnableParameters(value, L"fixedValue", 0); // follow protocol, otherwise validation would initialize it again
+        value->Value().SetValue(dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value());
+        auto inputs = node->GetInputs();
+        unusedCandidates.insert(unusedCandidates.end(), inputs.begin(), inputs.end());
+        SubstituteNode(node, value);
+    }
+    RemoveUnusedNodes(unusedCandidates);
+    return constantNodes.size();
+}
+
+// helper for OptimizeForInference(): folds a BatchNormalization node into the weights of the Times or Convolution
+// that computes its input, with an optional bias Plus in between
+// Returns false if the node does not match that pattern.
+template <class ElemType>
+bool ComputationNetwork::FoldBatchNormalization(const ComputationNodeBasePtr& node)
+{
+    auto bn = dynamic_pointer_cast<BatchNormalizationNode<ElemType>>(node);
+    if (!bn || node->HasMBLayout() != node->Input(0)->HasMBLayout())
+        return false;
+
+    // all nodes of the pattern must be used by the next one only, since their values change
+    auto isUsedOnlyBy = [&](const ComputationNodeBasePtr& input, const ComputationNodeBasePtr& parent)
+    {
+        auto parents = GetParentNodes(input->NodeName());
+        if (parents.size() != 1 || parents[0] != parent)
+            return false;
+        for (auto group : GetAllNodeGroups())
+        {
+            if (find(group->begin(), group->end(), input) != group->end())
+                return false;
+        }
+        return true;
+    };
+    auto isProduct = [](const ComputationNodeBasePtr& product)
+    {
+        return product->OperationName() == OperationNameOf(TimesNode) || product->OperationName() == OperationNameOf(ConvolutionNode);
+    };
+    auto isParameter = [](const ComputationNodeBasePtr& parameter)
+    {
+        return parameter->OperationName() == OperationNameOf(LearnableParameter) && dynamic_pointer_cast<ComputationNode<ElemType>>(parameter);
+    };
+
+    ComputationNodeBasePtr product = node->Input(0), sum, bias;
+    if (product->OperationName() == OperationNameOf(PlusNode))
+    {
+        sum = product;
+        for (size_t i = 0; i < 2 && !bias; i++) // the bias may be either operand
+        {
+            if (isParameter(sum->Input(i)) && isProduct(sum->Input(1 - i)))
+            {
+                bias = sum->Input(i);
+                product = sum->Input(1 - i);
+            }
+        }
+        if (!bias || !isUsedOnlyBy(sum, bn) || !isUsedOnlyBy(bias, sum))
+            return false;
+    }
+    if (!isProduct(product) || !isUsedOnlyBy(product, sum ? sum : bn))
+        return false;
+    auto weight = product->Input(0);
+    if (!isParameter(weight) || !isUsedOnlyBy(weight, product))
+        return false;
+
+    // the scale and shift apply per output element, or per channel (last dimension) if spatial
+    const auto& outputShape = node->GetSampleLayout();
+    size_t outputSize = outputShape.GetNumElements();
+    size_t numChannels = node->Input(1)->GetSampleLayout().GetNumElements();
+    if (outputShape.GetRank() == 0 || outputSize == 0 ||
+        numChannels != (bn->Spatial() ? outputShape[outputShape.GetRank() - 1] : outputSize))
+        return false;
+
+    // map each weight element to the channel of the outputs it contributes to
+    auto& weightValue = dynamic_pointer_cast<ComputationNode<ElemType>>(weight)->Value();
+    size_t weightSize = weightValue.GetNumElements();
+    function<size_t(size_t)> channelOfWeight;
+    if (auto times = dynamic_pointer_cast<TimesNode<ElemType>>(product))
+    {
+        // the leading OutputRank() dimensions of the weight are the output dimensions
+        const auto& weightShape = weight->GetSampleLayout();
+        size_t weightOutputSize = 1;
+        for (size_t k = 0; k < times->OutputRank() && k < weightShape.GetRank(); k++)
+            weightOutputSize *= weightShape[k];
+        if (times->OutputRank() > weightShape.GetRank() || weightOutputSize != outputSize || weightSize % outputSize != 0)
+            return false;
+        size_t outputsPerChannel = outputSize / numChannels;
+        channelOfWeight = [=](size_t e) { return (e % outputSize) / outputsPerChannel; };
+    }
+    else
+    {
+        // the convolution engines for the CHW layout store the kernel of each output map contiguously
+        auto convolution = dynamic_pointer_cast<ConvolutionNode<ElemType>>(product);
+        auto sharing = convolution->Sharing();
+        if (!bn->Spatial() || convolution->Transpose() || convolution->IsConvolution2D() || convolution->ImageLayout() != ImageLayoutKind::CHW ||
+            convolution->MapCount().GetNumElements() != numChannels || weightSize % numChannels != 0 ||
+            find(sharing.begin(), sharing.end(), false) != sharing.end())
+            return false;
+        size_t kernelSize = weightSize / numChannels;
+        channelOfWeight = [=](size_t e) { return e / kernelSize; };
+    }
+
+    // y = scale * (x - mean) / sqrt(var + eps) + shift = a * x + c
+    auto valueOf = [](const ComputationNodeBasePtr& input)
+    {
+        return unique_ptr<ElemType[]>(dynamic_pointer_cast<ComputationNode<ElemType>>(input)->Value().CopyToArray());
+    };
+    auto scale = valueOf(node->Input(1)), shift = valueOf(node->Input(2)), mean = valueOf(node->Input(3)), var = valueOf(node->Input(4));
+    double epsilon = bn->UseCNTKEngine() ? bn->Epsilon() : max(bn->Epsilon(), 1e-5); // cuDNN does not accept a smaller one
+    vector<double> a(numChannels), c(numChannels);
+    for (size_t k = 0; k < numChannels; k++)
+    {
+        a[k] = scale[k] / sqrt((double) var[k] + epsilon);
+        c[k] = shift[k] - a[k] * mean[k];
+    }
+
+    // the new bias is a * bias + c, broadcast like the old bias, or like the BatchNormalization's parameters
+    SmallVector<size_t> biasDims(outputShape.GetRank(), 1), oldBiasDims(outputShape.GetRank(), 1);
+    if (!bn->Spatial())
+        biasDims = outputShape.GetDims();
+    biasDims.back() = outputShape[outputShape.GetRank() - 1];
+    unique_ptr<ElemType[]> oldBias;
+    if (bias)
+    {
+        const auto& oldBiasShape = bias->GetSampleLayout();
+        if (oldBiasShape.GetRank() > outputShape.GetRank())
+            return false;
+        for (size_t k = 0; k < oldBiasShape.GetRank(); k++)
+        {
+            oldBiasDims[k] = oldBiasShape[k];
+            biasDims[k] = max(biasDims[k], oldBiasDims[k]);
+        }
+        oldBias = valueOf(bias);
+    }
+    auto w = unique_ptr<ElemType[]>(weightValue.CopyToArray());
+    for (size_t e = 0; e < weightSize; e++)
+        w[e] = (ElemType) (w[e] * a[channelOfWeight(e)]);
+    weightValue.SetValue(weightValue.GetNumRows(), weightValue.GetNumCols(), weightValue.GetDeviceId(), w.get());
+
+    TensorShape biasShape(biasDims);
+    vector<ElemType> newBias(biasShape.GetNumElements());
+    for (size_t j = 0; j < newBias.size(); j++)
+    {
+        // j -> channel, and -> offset in the old bias
+        size_t rest = j, oldBiasOffset = 0, oldBiasStride = 1, channel = j;
+        for (size_t k = 0; k < biasDims.size(); k++)
+        {
+            size_t index = rest % biasDims[k];
+            rest /= biasDims[k];
+            if (oldBiasDims[k] != 1)
+                oldBiasOffset += index * oldBiasStride;
+            oldBiasStride *= oldBiasDims[k];
+            if (bn->Spatial() && k + 1 == biasDims.size())
+                channel = index;
+        }
+        newBias[j] = (ElemType) ((oldBias ? a[channel] * oldBias[oldBiasOffset] : 0) + c[channel]);
+    }
+
+    // relink: product -> Plus(product, new bias) under the BatchNormalization's name
+    auto deviceId = node->GetDeviceId();
+    auto newBiasNode = New<LearnableParameter<ElemType>>(deviceId, node->NodeName() + L".foldedBias", biasShape);
+    InitLearnableParameters(newBiasNode, L"fixedValue", 0);
+    auto& newBiasValue = newBiasNode->Value();
+    newBiasValue.SetValue(newBiasValue.GetNumRows(), newBiasValue.GetNumCols(), deviceId, newBias.data());
+    AddNodeToNetIfNotYet(newBiasNode, /*makeUniqueName=*/true);
+
+    auto plus = New<PlusNode<ElemType>>(deviceId, node->NodeName());
+    plus->AttachInputs({ product, newBiasNode });
+    auto unusedCandidates = node->GetInputs();
+    SubstituteNode(node, plus);
+    RemoveUnusedNodes(unusedCandidates);
+    return true;
+}
+
+// ========================================
+// This function creates another network for evaluating the same model concurrently, e.g. from another thread.
+// It has its own copy of every node and allocates its own matrices for the computation, but its LearnableParameter
+// nodes share their values with this network, so that the copy only costs the memory of the activations.
+// The networks may run ForwardProp() concurrently as long as nobody modifies the parameters, i.e. no training.
+// This must not be called while this network itself is being evaluated.
+// ========================================
+template <class ElemType>
+ComputationNetworkPtr ComputationNetwork::CloneWithSharedParameters()
+{
+    VerifyIsCompiled("CloneWithSharedParameters");
+
+    auto net = make_shared<ComputationNetwork>(GetDeviceId());
+    net->SetTraceLevel(TraceLevel());
+    net->SetQuantizeTimes(GetQuantizeTimes());
+    net->SetRandomSeedOffset(GetRandomSeedOffset());
+
+    // copy the nodes without their inputs
+    map<ComputationNodeBasePtr, ComputationNodeBasePtr> clones;
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        const auto& node = iter.second;
+        ComputationNodeBasePtr clone;
+        auto parameter = node->OperationName() == OperationNameOf(LearnableParameter) ? dynamic_pointer_cast<ComputationNode<ElemType>>(node) : nullptr;
+        if (parameter)
+        {
+            // hide the value from Duplicate(), which would copy it, and share it instead
+            shared_ptr<Matrix<ElemType>> value;
+            swap(value, parameter->ValuePtrRef());
+            clone = node->Duplicate(node->NodeName(), CopyNodeFlags::copyNodeValue);
+            swap(value, parameter->ValuePtrRef());
+            dynamic_pointer_cast<ComputationNode<ElemType>>(clone)->ValuePtrRef() = parameter->ValuePtrRef();
+        }
+        else
+            clone = node->Duplicate(node->NodeName(), CopyNodeFlags::copyNodeValue);
+        net->AddNodeToNet(clone);
+        clones[node] = clone;
+    }
+
+    // relink them, and recreate the node groups
+    for (const auto& iter : clones)
+    {
+        vector<ComputationNodeBasePtr> inputs;
+        for (const auto& input : iter.first->GetInputs())
+            inputs.push_back(clones.at(input));
+        if (!inputs.empty())
+            iter.second->AttachInputs(inputs);
+    }
+    auto groups = GetAllNodeGroups();
+    auto cloneGroups = net->GetAllNodeGroups();
+    for (size_t i = 0; i < groups.size(); i++)
+    {
+        for (const auto& node : *groups[i])
+            cloneGroups[i]->push_back(clones.at(node));
+    }
+
+    net->CompileNetwork();
+    return net;
+}
+
 // Helper class to form a logical DBN layer while exporting the network (used by SaveToDbnFile)
 class DbnLayer
 {
@@ -1521,6 +1875,8 @@ template void ComputationNetwork::InitLearnableParametersWithBilinearFill<float>
 template void ComputationNetwork::Read<float>(const wstring& fileName);
 template void ComputationNetwork::ReadPersistableParameters<float>(size_t modelVersion, File& fstream, bool create);
 template void ComputationNetwork::PerformSVDecomposition<float>(const map<wstring, float>& SVDConfig, size_t alignedsize);
+template void ComputationNetwork::OptimizeForInference<float>();
+template ComputationNetworkPtr ComputationNetwork::CloneWithSharedParameters<float>();
 template /*static*/ void ComputationNetwork::SetBatchNormalizationTimeConstants<float>(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const double normalizationTimeConstant, double& prevNormalizationTimeConstant, double blendTimeConstant, double& prevBlendTimeConstant);
 template void ComputationNetwork::SetSeqParam<float>(ComputationNetworkPtr net, const ComputationNodeBasePtr criterionNode, const double& hsmoothingWeight, const double& frameDropThresh, const bool& doreferencealign,
                                                      const double& amf, const double& lmf, const double& wp, const double& bMMIfactor, const bool& sMBR);
@@ -1530,6 +1886,8 @@ template void ComputationNetwork::InitLearnableParametersWithBilinearFill<double
 template void ComputationNetwork::Read<double>(const wstring& fileName);
 template void ComputationNetwork::ReadPersistableParameters<double>(size_t modelVersion, File& fstream, bool create);
 template void ComputationNetwork::PerformSVDecomposition<double>(const map<wstring, float>& SVDConfig, size_t alignedsize);
+template void ComputationNetwork::OptimizeForInference<double>();
+template ComputationNetworkPtr ComputationNetwork::CloneWithSharedParameters<double>();
 template /*static*/ void ComputationNetwork::SetBatchNormalizationTimeConstants<double>(ComputationNetworkPtr net, const ComputationNodeBasePtr& criterionNode, const double normalizationTimeConstant, double& prevNormalizationTimeConstant, double blendTimeConstant, double& prevBlendTimeConstant);
 template void ComputationNetwork::SetSeqParam<double>(ComputationNetworkPtr net, const ComputationNodeBasePtr criterionNode, const double& hsmoothingWeight, const double& frameDropThresh, const bool& doreferencealign,
                                                       const double& amf, const double& lmf, const double& wp, const double& bMMIfactor, const bool& sMBR);
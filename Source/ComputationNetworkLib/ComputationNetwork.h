@@ -13,6 +13,8 @@
 #include "ComputationNode.h"
 #include "ScriptableObjects.h"
 #include "ComputationEnvironment.h"
+#include "TaskGraphExecutor.h"
+#include "LowPrecision.h"
 
 #include <map>
 #include <string>
@@ -53,7 +55,10 @@ public:
         m_isCompiled(false),
         m_areMatricesAllocated(false),
         m_pMBLayoutOfNetwork(make_shared<MBLayout>(1, 0, ComputationNodeBase::DefaultDynamicAxisName)),
-        m_environment(make_shared<ComputationEnvironment>())
+        m_environment(make_shared<ComputationEnvironment>()),
+        m_activationCheckpointing(false),
+        m_bfloat16Checkpoints(false),
+        m_nodeProfilerInputTimeStamp(0)
     {
         //m_pMBLayoutOfNetwork->SetAxisName(L"T");
     }
@@ -174,6 +179,7 @@ public:
     template <class NODESET> // version that takes multiple nodes
     void ForwardProp(const NODESET& nodes)
     {
+        UpdateMemArena();
         TravserseInSortedGlobalEvalOrder(nodes, [](const ComputationNodeBasePtr& node) {
             PARTraversalFlowControlNode::ForwardProp(node, FrameRange(nullptr));
         });
@@ -246,6 +252,17 @@ private:
     bool ValidateNode(ComputationNodeBasePtr node, bool isFinalValidationPass) const;
     void MarkValueNonSharableNodes();
     void ChangeNodeInputs(ComputationNodeBasePtr fromNode, ComputationNodeBasePtr toNode);
+    void SubstituteNode(ComputationNodeBasePtr oldNode, ComputationNodeBasePtr newNode);
+    void RemoveUnusedNodes(const vector<ComputationNodeBasePtr>& candidates);
+    void RecordNodesBeforeRewrites();
+    size_t FuseElementwiseOps();
+    size_t HoistLoopInvariantProducts();
+    template <class ElemType>
+    ComputationNodeBasePtr NewSumOfPartialProducts(const ComputationNodeBasePtr& product, const vector<pair<ComputationNodeBasePtr, size_t>>& parts);
+    template <class ElemType>
+    size_t FoldConstantNodes();
+    template <class ElemType>
+    bool FoldBatchNormalization(const ComputationNodeBasePtr& node);
 
 private:
     void DetermineSetOfAllRoots();
@@ -258,6 +275,25 @@ private:
 public:
     void AllocateAllMatrices(const std::vector<ComputationNodeBasePtr>& evalRootNodes, const std::vector<ComputationNodeBasePtr>& outValueRootNodes, ComputationNodeBasePtr trainRootNode);
 
+    // Activation checkpointing: instead of keeping the output values of all nodes for backprop, only those of checkpoint nodes are
+    // kept, and the segments in between are recomputed from them during backprop. Checkpoints are the named nodes, or, if none
+    // are given, every sqrt(n)-th node. Must be set before AllocateAllMatrices(), and requires node value sharing.
+    // With bfloat16Checkpoints, a checkpoint that is only needed to recompute others is kept in bfloat16 rather than in its
+    // value matrix, and widened again before that (float networks on the CPU only).
+    void SetActivationCheckpointing(bool enable, const std::vector<std::wstring>& checkpointNodeNames = std::vector<std::wstring>(), bool bfloat16Checkpoints = false)
+    {
+        m_activationCheckpointing = enable;
+        m_checkpointNodeNames = checkpointNodeNames;
+        m_bfloat16Checkpoints = bfloat16Checkpoints;
+    }
+
+    // (re-)plan the memory arena of the matrix pool if it is outdated and nothing computed so far needs to be kept
+    void UpdateMemArena();
+
+    // Per-node profiling: collect the time and memory of the ForwardProp() and Backprop() of every node over the next
+    // numMinibatches minibatches, then write a table to path + ".txt" and a Chrome trace to path + ".json" (see NodeProfiler).
+    void EnableNodeProfiler(const std::wstring& path, size_t numMinibatches);
+
     // From the set of nodes extract all nodes which are used as accumulator nodes.
     std::set<ComputationNodeBasePtr> ExtractNodesWhichAccumulateResult(std::set<ComputationNodeBasePtr> nodes);
 
@@ -265,6 +301,15 @@ private:
     void PrintMemorySharingStructure(const std::vector<ComputationNodeBasePtr>& nodes);
     void ReleaseMatricesAfterEvalForChildren(ComputationNodeBasePtr n, std::unordered_map<ComputationNodeBasePtr, std::unordered_set<ComputationNodeBasePtr>>& parentsMap);
     void AllocateGradientMatricesForInputs(ComputationNodeBasePtr parentNode);
+    std::set<ComputationNodeBasePtr> PlanActivationCheckpointing(const ComputationNodeBasePtr& trainRootNode);
+    void PlanBFloat16Checkpoints(const ComputationNodeBasePtr& trainRootNode, std::set<ComputationNodeBasePtr>& recomputedNodes);
+    void StoreBFloat16Checkpoint(const ComputationNodeBasePtr& node);
+    bool RestoreBFloat16Checkpoint(const ComputationNodeBasePtr& node);
+
+    // [node] -> range of matrix pool requests made on its behalf, see AllocateAllMatrices()
+    typedef std::map<ComputationNodeBasePtr, std::pair<MatrixPool::RequestMark, MatrixPool::RequestMark>> NodeRequestRanges;
+    void PlanInterOpParallelism(const std::vector<ComputationNodeBasePtr>& roots, const NodeRequestRanges& forwardRequests, const NodeRequestRanges& backpropRequests);
+    TaskGraphExecutor* GetInterOpExecutor();
 
 public:
     // -----------------------------------------------------------------------
@@ -843,6 +888,12 @@ public:
     template <class ElemType>
     void PerformSVDecomposition(const map<wstring, float>& SVDConfig, size_t AlignedSize);
 
+    template <class ElemType>
+    void OptimizeForInference();
+
+    template <class ElemType>
+    ComputationNetworkPtr CloneWithSharedParameters();
+
     template <class ElemType>
     void SaveToDbnFile(ComputationNetworkPtr net, const std::wstring& fileName) const;
 
@@ -967,6 +1018,12 @@ public:
     }
     bool GetIsV2Library() const { return m_environment->isV2Library; }
 
+    void SetQuantizeTimes(bool enable)
+    {
+        m_environment->quantizeTimes = enable;
+    }
+    bool GetQuantizeTimes() const { return m_environment->quantizeTimes; }
+
     void SetTraceLevel(int traceLevel)
     {
         m_environment->traceLevel = traceLevel;
@@ -1182,6 +1239,7 @@ protected:
         }
 
         static void ForwardProp(const ComputationNodeBasePtr& node, const FrameRange& fr);
+        static void Backprop(const ComputationNodeBasePtr& node, const FrameRange& fr);
         static void PostForwardAndBackProp(const ComputationNodeBasePtr& node);
 
         virtual void BeginForwardProp() override {}
@@ -1207,8 +1265,17 @@ protected:
     public:
         // this special constructor constructs the top-level network node
         // There is currently no other constructor for inner nested PAR-traversed sub-networks, but there will be.
-        PARTraversalFlowControlNode(const std::vector<shared_ptr<SEQTraversalFlowControlNode>>& recurrentInfo, const std::list<ComputationNodeBasePtr>& allNodes);
+        PARTraversalFlowControlNode(ComputationNetwork& network, const std::vector<shared_ptr<SEQTraversalFlowControlNode>>& recurrentInfo, const std::list<ComputationNodeBasePtr>& allNodes);
         // Base::m_nestedNodes contains all top-level nodes, in evaluation order
+
+        // activation checkpointing: [last node of a segment] -> nodes whose values are recomputed before its backprop, in evaluation order
+        // These are nodes of the segment, and the bfloat16 checkpoints that are widened again for them (see PlanBFloat16Checkpoints()).
+        std::unordered_map<ComputationNodeBasePtr, std::vector<ComputationNodeBasePtr>> m_recomputeBeforeBackprop;
+
+        // inter-op parallelism: task i is m_nestedNodes[i]; empty if the nodes are to run one at a time
+        TaskGraph m_forwardGraph;
+        TaskGraph m_backpropGraph;
+        ComputationNetwork& m_network; // owns the executor that runs them
     };
 
 public:
@@ -1270,6 +1337,22 @@ private:
     bool m_isCompiled; // CompileNetwork has been called
     bool m_areMatricesAllocated; // AllocateAllMatrices has been called
 
+    // activation checkpointing, see SetActivationCheckpointing()
+    bool m_activationCheckpointing;
+    std::vector<std::wstring> m_checkpointNodeNames;
+    bool m_bfloat16Checkpoints;
+    std::unordered_map<ComputationNodeBasePtr, std::shared_ptr<CPUMatrix<bfloat16>>> m_bfloat16CheckpointValues; // [node] -> its value while it is not kept
+
+    // the nodes and their inputs as they were before CompileNetwork() rewrote the network for execution, which is the
+    // form that Save() writes; empty if there was no rewrite. See RecordNodesBeforeRewrites().
+    std::map<const std::wstring, std::pair<ComputationNodeBasePtr, std::vector<ComputationNodeBasePtr>>, nocase_compare> m_nodesBeforeRewrites;
+
+    // newest input time stamp the node profiler has seen, to tell when a new minibatch starts, see ForwardProp()
+    uint64_t m_nodeProfilerInputTimeStamp;
+
+    // the pool that runs independent nodes concurrently, see GetInterOpExecutor(); one per network, so that networks evaluated from different threads do not wait for each other
+    std::unique_ptr<TaskGraphExecutor> m_interOpExecutor;
+
     // cached network iterations
     std::map<const ComputationNodeBasePtr, std::list<ComputationNodeBasePtr>> m_evalOrders; // [out node] flat depth-first traversal starting from out node
     std::map<const ComputationNodeBasePtr, ComputationNodeBasePtr> m_nestedNetworks;        // [out node] network rewritten as recursive traveral, potentially optimized; execution plan
@@ -167,6 +167,30 @@ void ComputationNetwork::DeleteNode(const std::wstring& nodeName)
     RemoveNodeFromNet(nodeToDelete);
 }
 
+// deletes those of the given nodes that no longer feed into anything and are not in a node group, and then the same
+// for their inputs, and so on
+// This cleans up after edits that leave parts of the network unconnected.
+void ComputationNetwork::RemoveUnusedNodes(const vector<ComputationNodeBasePtr>& candidates)
+{
+    list<ComputationNodeBasePtr> workList(candidates.begin(), candidates.end());
+    while (!workList.empty())
+    {
+        auto node = workList.front();
+        workList.pop_front();
+        auto iter = m_nameToNodeMap.find(node->NodeName());
+        if (iter == m_nameToNodeMap.end() || iter->second != node) // already gone
+            continue;
+        bool isUsed = !GetParentNodes(node->NodeName()).empty();
+        for (auto groupIter : GetAllNodeGroups())
+            isUsed |= find(groupIter->begin(), groupIter->end(), node) != groupIter->end();
+        if (isUsed)
+            continue;
+        auto inputs = node->GetInputs(); // (DeleteNode() detaches them)
+        DeleteNode(node->NodeName());
+        workList.insert(workList.end(), inputs.begin(), inputs.end());
+    }
+}
+
 // replace a named node by newNode of the same type under the same name, including moving over all network links
 // This is used in 
 // 1. Update nodes to quantized versions.
@@ -240,6 +264,23 @@ void ComputationNetwork::ChangeNodeInputs(ComputationNodeBasePtr fromNode, Compu
     }
 }
 
+// let newNode take the place of oldNode: it becomes the input of all of oldNode's consumers and replaces it in the
+// node groups, while oldNode is removed from the network
+// Unlike ReplaceNode(), this does not touch newNode's inputs, which must be set up by the caller; oldNode's inputs are
+// detached, so that they may end up unused.
+void ComputationNetwork::SubstituteNode(ComputationNodeBasePtr oldNode, ComputationNodeBasePtr newNode)
+{
+    InvalidateCompiledNetwork();
+
+    ChangeNodeInputs(oldNode, newNode);
+    for (auto groupIter : GetAllNodeGroups())
+        replace(groupIter->begin(), groupIter->end(), oldNode, newNode);
+
+    RemoveNodeFromNet(oldNode);
+    oldNode->DetachInputs();
+    AddNodeToNet(newNode);
+}
+
 // replace the old node with the current node, assuming the old node is a leaf node
 // need to update those nodes who use oldNode as their child
 // TODO: Can this be called with a node that's already part of the network? This is currently allowed, but should it?
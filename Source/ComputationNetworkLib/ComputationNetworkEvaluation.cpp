@@ -11,12 +11,19 @@
 #include "RecurrentNodes.h"
 #include "InputAndParamNodes.h"
 #include "LinearAlgebraNodes.h"
+#include "NonlinearityNodes.h"
+#include "ReshapingNodes.h"
+#include "NodeProfiler.h"
+#include "CPUMatrixLowPrecision.h"
 #include <string>
 #include <vector>
 #include <list>
 #include <set>
 #include <algorithm>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 
 using namespace std;
 
@@ -39,11 +46,120 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 void ComputationNetwork::ForwardProp(const ComputationNodeBasePtr rootNode)
 {
     VerifyIsCompiled("ForwardProp");
+    UpdateMemArena();
+
+    // the node profiler counts a new minibatch whenever the inputs have changed since it last looked
+    if (m_environment->nodeProfiler)
+    {
+        uint64_t timeStamp = 0;
+        auto inputs = m_inputValues.find(rootNode);
+        if (inputs != m_inputValues.end())
+        {
+            for (const auto& input : inputs->second)
+                timeStamp = max(timeStamp, input->GetEvalTimeStamp());
+        }
+        if (timeStamp > m_nodeProfilerInputTimeStamp)
+        {
+            m_nodeProfilerInputTimeStamp = timeStamp;
+            m_environment->nodeProfiler->BeginMinibatch();
+        }
+    }
 
     // traverse all nodes in the pre-determined evaluation order
     GetNestedNetwork(rootNode)->ForwardProp(FrameRange(nullptr));
 }
 
+void ComputationNetwork::EnableNodeProfiler(const wstring& path, size_t numMinibatches)
+{
+    m_environment->nodeProfiler = make_shared<NodeProfiler>(path, numMinibatches);
+    m_nodeProfilerInputTimeStamp = 0;
+}
+
+// the node profiler that is collecting for the node's network, or nullptr
+static NodeProfiler* GetActiveNodeProfiler(const ComputationNodeBasePtr& node)
+{
+    if (!node->HasEnvironmentPtr())
+        return nullptr;
+    auto profiler = node->Environment().nodeProfiler.get();
+    return profiler && profiler->IsActive() ? profiler : nullptr;
+}
+
+template <class ElemType>
+static bool RecordNodeProfile(NodeProfiler& profiler, const ComputationNodeBasePtr& node, NodeProfiler::Phase phase,
+                              NodeProfiler::Clock::time_point start, NodeProfiler::Clock::duration duration, bool trace)
+{
+    auto typedNode = dynamic_pointer_cast<ComputationNode<ElemType>>(node);
+    if (!typedNode)
+        return false;
+
+    // the output is the value resp. gradient just computed; the memory is that of all matrices the node holds
+    const auto& output = phase == NodeProfiler::Phase::forward ? typedNode->ValuePtrRef() : typedNode->GradientPtrRef();
+    size_t outputBytes = 0, allocatedBytes = 0;
+    if (output)
+        outputBytes = (output->GetMatrixType() == MatrixType::DENSE ? output->GetNumElements() : output->GetAllocatedSize()) * sizeof(ElemType);
+    for (const auto& info : node->GetMatrixInfo())
+    {
+        auto matrix = dynamic_cast<const Matrix<ElemType>*>(info.first);
+        if (matrix)
+            allocatedBytes += matrix->GetAllocatedSize() * sizeof(ElemType);
+    }
+    profiler.Record(node->NodeName(), node->OperationName(), phase, start, duration, outputBytes, allocatedBytes, trace);
+    return true;
+}
+
+static void RecordNodeProfile(NodeProfiler& profiler, const ComputationNodeBasePtr& node, NodeProfiler::Phase phase,
+                              NodeProfiler::Clock::time_point start, NodeProfiler::Clock::duration duration, bool trace = true)
+{
+    RecordNodeProfile<float>(profiler, node, phase, start, duration, trace) || RecordNodeProfile<double>(profiler, node, phase, start, duration, trace);
+}
+
+// times of the nodes of a recurrent loop for the node profiler, summed up over the steps; does nothing without a profiler
+class LoopNodeTimes
+{
+    NodeProfiler* m_profiler;
+    const vector<ComputationNodeBasePtr>& m_nodes;
+    NodeProfiler::Phase m_phase;
+    NodeProfiler::Clock::time_point m_start;
+    vector<NodeProfiler::Clock::duration> m_times; // [node index]
+
+public:
+    LoopNodeTimes(NodeProfiler* profiler, const vector<ComputationNodeBasePtr>& nodes, NodeProfiler::Phase phase)
+        : m_profiler(profiler), m_nodes(nodes), m_phase(phase)
+    {
+        if (m_profiler)
+        {
+            m_start = NodeProfiler::Clock::now();
+            m_times.assign(m_nodes.size(), NodeProfiler::Clock::duration::zero());
+        }
+    }
+
+    // runs f() as a step of node i
+    template <class F>
+    void Run(size_t i, const F& f)
+    {
+        if (!m_profiler)
+            return f();
+        auto start = NodeProfiler::Clock::now();
+        f();
+        m_times[i] += NodeProfiler::Clock::now() - start;
+    }
+
+    // records the nodes, and the loop as a whole in the trace; with completesCalls, adds the times to the calls recorded before
+    void Record(const wstring& loopName, bool completesCalls = false)
+    {
+        if (!m_profiler)
+            return;
+        for (size_t i = 0; i < m_nodes.size(); i++)
+        {
+            if (completesCalls)
+                m_profiler->AddTime(m_nodes[i]->NodeName(), m_phase, m_times[i]);
+            else
+                RecordNodeProfile(*m_profiler, m_nodes[i], m_phase, m_start, m_times[i], /*trace=*/false);
+        }
+        m_profiler->Trace(loopName, m_phase == NodeProfiler::Phase::forward ? L"forward" : L"backward", m_start, NodeProfiler::Clock::now() - m_start);
+    }
+};
+
 void ComputationNetwork::PostForwardAndBackProp(const ComputationNodeBasePtr rootNode)
 {
     VerifyIsCompiled("PostForwardAndBackProp");
@@ -93,7 +209,7 @@ void ComputationNetwork::FormNestedNetwork(const ComputationNodeBasePtr& rootNod
     if (m_nestedNetworks.find(rootNode) != m_nestedNetworks.end())
         fprintf(stderr, "FormNestedNetwork: WARNING: Was called twice for %ls %ls operation\n", rootNode->NodeName().c_str(), rootNode->OperationName().c_str());
 
-    m_nestedNetworks[rootNode] = make_shared<PARTraversalFlowControlNode>(m_allSEQNodes, GetEvalOrder(rootNode));
+    m_nestedNetworks[rootNode] = make_shared<PARTraversalFlowControlNode>(*this, m_allSEQNodes, GetEvalOrder(rootNode));
 }
 
 ComputationNodeBasePtr ComputationNetwork::GetNestedNetwork(const ComputationNodeBasePtr& rootNode)
@@ -113,7 +229,8 @@ ComputationNodeBasePtr ComputationNetwork::GetNestedNetwork(const ComputationNod
 
 template<class ElemType> static bool DumpNode(ComputationNodeBasePtr nodep, bool dumpGradient);
 
-ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(const std::vector<shared_ptr<SEQTraversalFlowControlNode>>& recurrentInfo, const std::list<ComputationNodeBasePtr>& allNodes /*must be in eval order*/)
+ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(ComputationNetwork& network, const std::vector<shared_ptr<SEQTraversalFlowControlNode>>& recurrentInfo, const std::list<ComputationNodeBasePtr>& allNodes /*must be in eval order*/)
+    : m_network(network)
 {
     // traverse the network in evaluation order and create a new list that replaces all recurrence by a SEQTraversalFlowControlNode
     set<shared_ptr<IComputationNode>> loopsSeen; // for consistency check only
@@ -144,10 +261,16 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
 {
     if (node->IsOutOfDateWrtInputs())
     {
+        auto profiler = GetActiveNodeProfiler(node);
+        auto start = profiler ? NodeProfiler::Clock::now() : NodeProfiler::Clock::time_point();
+
         node->BeginForwardProp();
         node->ForwardProp(fr.WithLayout(node->GetMBLayout()));
         node->EndForwardProp();
 
+        if (profiler)
+            RecordNodeProfile(*profiler, node, NodeProfiler::Phase::forward, start, NodeProfiler::Clock::now() - start);
+
         node->BumpEvalTimeStamp();
 
         // Extreme Tracing, part 1/4
@@ -157,10 +280,37 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
 }
 
 
+// the pool that runs independent nodes concurrently, see Globals::GetInterOpThreads(); nullptr if that is off
+TaskGraphExecutor* ComputationNetwork::GetInterOpExecutor()
+{
+    size_t numThreads = (size_t) max(Globals::GetInterOpThreads(), 0);
+    if (numThreads <= 1)
+        return nullptr;
+    if (!m_interOpExecutor || m_interOpExecutor->NumThreads() != numThreads)
+        m_interOpExecutor.reset(new TaskGraphExecutor(numThreads));
+    return m_interOpExecutor.get();
+}
+
 /*virtual*/ void ComputationNetwork::PARTraversalFlowControlNode::ForwardProp(const FrameRange& fr) /*override*/
 {
-    for (auto& node : m_nestedNodes)
+    // (keeps the bfloat16 checkpoints of activation checkpointing, from any nested network that computes them)
+    auto forwardProp = [&](const ComputationNodeBasePtr& node)
+    {
+        bool isOutOfDate = node->IsOutOfDateWrtInputs();
         ForwardProp(node, fr);
+        if (isOutOfDate)
+            m_network.StoreBFloat16Checkpoint(node);
+    };
+
+    auto executor = m_forwardGraph.size() == m_nestedNodes.size() ? m_network.GetInterOpExecutor() : nullptr;
+    if (executor)
+    {
+        executor->Run(m_forwardGraph, [&](size_t i) { forwardProp(m_nestedNodes[i]); });
+        return;
+    }
+
+    for (auto& node : m_nestedNodes)
+        forwardProp(node);
 }
 
 /*static*/ void ComputationNetwork::PARTraversalFlowControlNode::PostForwardAndBackProp(const ComputationNodeBasePtr& node)
@@ -174,21 +324,55 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
         PostForwardAndBackProp(node);
 }
 
+/*static*/ void ComputationNetwork::PARTraversalFlowControlNode::Backprop(const ComputationNodeBasePtr& node, const FrameRange& fr)
+{
+    auto profiler = GetActiveNodeProfiler(node);
+    auto start = profiler ? NodeProfiler::Clock::now() : NodeProfiler::Clock::time_point();
+
+    node->BeginBackprop();
+    node->Backprop(fr.WithLayout(node->GetMBLayout()), true /*childrenInThisLoop*/, true /*childrenInOuterLoop*/);
+    node->EndBackprop();
+
+    if (profiler)
+        RecordNodeProfile(*profiler, node, NodeProfiler::Phase::backward, start, NodeProfiler::Clock::now() - start);
+
+    // Extreme Tracing, part 2/4
+    if (node->HasEnvironmentPtr() && node->Environment().ShouldDumpNode() && node->NeedsGradient())
+        DumpNode<float>(node, /*dumpGradient=*/true) || DumpNode<double>(node, true);
+}
+
 /*virtual*/ void ComputationNetwork::PARTraversalFlowControlNode::Backprop(const FrameRange& fr, bool childrenInThisLoop, bool childrenInOuterLoop) /*override*/
 {
     childrenInThisLoop, childrenInOuterLoop; // TODO: think through what these mean when coming from PAR mode
+
+    // the recomputation of activation checkpointing is not part of the planned graph, so it runs one node at a time
+    auto executor = m_backpropGraph.size() == m_nestedNodes.size() && m_recomputeBeforeBackprop.empty() ? m_network.GetInterOpExecutor() : nullptr;
+    if (executor)
+    {
+        executor->Run(m_backpropGraph, [&](size_t i) { Backprop(m_nestedNodes[i], fr); });
+        return;
+    }
+
     // process nodes in pre-determined order
     for (auto pnode = m_nestedNodes.rbegin(); pnode != m_nestedNodes.rend(); pnode++) // iterate backwards over evaluation order
     {
         auto& node = *pnode;
 
-        node->BeginBackprop();
-        node->Backprop(fr.WithLayout(node->GetMBLayout()), true /*childrenInThisLoop*/, true /*childrenInOuterLoop*/);
-        node->EndBackprop();
+        // activation checkpointing: recompute the values of the segment that ends here, from the values that were kept
+        auto recompute = m_recomputeBeforeBackprop.find(node);
+        if (recompute != m_recomputeBeforeBackprop.end())
+        {
+            for (auto& r : recompute->second)
+            {
+                if (m_network.RestoreBFloat16Checkpoint(r))
+                    continue;
+                r->BeginForwardProp();
+                r->ForwardProp(fr.WithLayout(r->GetMBLayout()));
+                r->EndForwardProp();
+            }
+        }
 
-        // Extreme Tracing, part 2/4
-        if (node->HasEnvironmentPtr() && node->Environment().ShouldDumpNode() && node->NeedsGradient())
-            DumpNode<float>(node, /*dumpGradient=*/true) || DumpNode<double>(node, true);
+        Backprop(node, fr);
     }
 }
 /*virtual*/ void ComputationNetwork::PARTraversalFlowControlNode::RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) /*override*/
@@ -266,14 +450,18 @@ static bool DumpNode(ComputationNodeBasePtr nodep, bool dumpGradient)
     // Note: Currently, this is limited to linear-time loops. But nothing stops the iteration below to, e.g., be a 2D iteration over an image
     // if we implement an according FrameRangeIteration.
     FrameRangeIteration range(GetMBLayout(), m_steppingDirection);
+    LoopNodeTimes times(GetActiveNodeProfiler(m_nestedNodes[0]), m_nestedNodes, NodeProfiler::Phase::forward);
     for (auto t = range.begin(); t != range.end(); t++)
     {
-        for (auto& node : m_nestedNodes)
-        {
-            node->ForwardProp(t);
-            node->BumpEvalTimeStamp();
-        }
+        for (size_t i = 0; i < m_nestedNodes.size(); i++)
+            times.Run(i, [&] { m_nestedNodes[i]->ForwardProp(t); });
     }
+    times.Record(NodeName());
+
+    // Time stamps are only compared before a loop runs, for the loop as a whole (see IsOutOfDateWrtInputs()), never between
+    // its steps. So they are bumped once after the last step, in the order of the nodes as before.
+    for (auto& node : m_nestedNodes)
+        node->BumpEvalTimeStamp();
 
     // Extreme Tracing, part 3/4
     for (auto& node : m_nestedNodes)
@@ -305,16 +493,18 @@ static bool DumpNode(ComputationNodeBasePtr nodep, bool dumpGradient)
     const auto& recurrentNodes = m_nestedNodes; // BUGBUG: -ForForward?? Does this mean we can remove non-ForForward?
     auto pMBLayout = recurrentNodes[0]->GetMBLayout();
     FrameRangeIteration range(pMBLayout, m_steppingDirection);
+    LoopNodeTimes times(GetActiveNodeProfiler(recurrentNodes[0]), recurrentNodes, NodeProfiler::Phase::backward);
     for (auto t = range.rbegin(); t != range.rend(); t++) // note: reverse iteration
     {
-        for (auto nodeIter2 = recurrentNodes.rbegin(); nodeIter2 != recurrentNodes.rend(); ++nodeIter2)
+        for (size_t i = recurrentNodes.size(); i-- > 0;)
         {
-            auto& node2 = *nodeIter2;
-            node2->Backprop(t, true /*childrenInThisLoop*/, false /*childrenInOuterLoop*/);
+            auto& node2 = recurrentNodes[i];
+            times.Run(i, [&] { node2->Backprop(t, true /*childrenInThisLoop*/, false /*childrenInOuterLoop*/); });
             // The above flags tell Backprop() to skip back-propagation from inside a node into
             // a node that is outside the loop, which is done later in EndBackprop() in PAR mode.
         }
     }
+    times.Record(NodeName());
 
     // Extreme Tracing, part 4
     for (auto& node : m_nestedNodes)
@@ -331,11 +521,13 @@ static bool DumpNode(ComputationNodeBasePtr nodep, bool dumpGradient)
 {
     // The following loop handles the case that a node inside the loop back-propagates a gradient into a node outside of the loop.
     // For efficiency, we perform this outside the loop in PAR mode. E.g., in one LSTM speech setup, we measured 12..14% overall speed-up.
-    for (auto nodeIter2 = m_nestedNodes.rbegin(); nodeIter2 != m_nestedNodes.rend(); ++nodeIter2)
+    LoopNodeTimes times(GetActiveNodeProfiler(m_nestedNodes[0]), m_nestedNodes, NodeProfiler::Phase::backward);
+    for (size_t i = m_nestedNodes.size(); i-- > 0;)
     {
-        auto& node2 = *nodeIter2;
-        node2->Backprop(FrameRange(m_nestedNodes[0]->GetMBLayout()), false /*childrenInThisLoop*/, true /*childrenInOuterLoop*/);
+        auto& node2 = m_nestedNodes[i];
+        times.Run(i, [&] { node2->Backprop(FrameRange(m_nestedNodes[0]->GetMBLayout()), false /*childrenInThisLoop*/, true /*childrenInOuterLoop*/); });
     }
+    times.Record(NodeName(), /*completesCalls=*/true); // (of the calls recorded by Backprop())
 
     // tell all nodes we are done for this iteraTion
     for (auto& node2 : m_nestedNodes)
@@ -447,6 +639,9 @@ void ComputationNetwork::PrintComputationTree(const ComputationNodeBasePtr& root
 // These invalidates any post-processed structures. If they are accessed, we will fail.
 void ComputationNetwork::InvalidateCompiledNetwork()
 {
+    // a compiled network is only modified by the user, and that is what the model has to keep; the rewrites happen while compiling
+    if (m_isCompiled)
+        m_nodesBeforeRewrites.clear();
     m_isCompiled = false;
     m_allSEQNodes.clear();
     m_evalOrders.clear();
@@ -475,6 +670,14 @@ void ComputationNetwork::CompileNetwork()
     // Or just invalidate it again, which is easier and safer.
     InvalidateCompiledNetwork();
 
+    // STEP: Fuse elementwise operations, if requested. This changes the set of nodes, so it comes first.
+    if (Globals::ShouldFuseElementwiseOps())
+    {
+        size_t numFused = FuseElementwiseOps();
+        if (TraceLevel() > 0 && numFused > 0)
+            fprintf(stderr, "\nFused %d Plus nodes into the activations that follow them.\n", (int) numFused);
+    }
+
     // all steps below have to be repeated for all root nodes (=nodes without parents and PreComputeNodes)
     DetermineSetOfAllRoots();
 
@@ -522,7 +725,18 @@ void ComputationNetwork::CompileNetwork()
     ValidateNetwork();
 
     // STEP: Optimize the network.
-    // :)
+    // Splitting products inside loops needs the loops and the dimensions, so the network is compiled again if it changed.
+    if (Globals::ShouldHoistLoopInvariants())
+    {
+        size_t numSplit = HoistLoopInvariantProducts();
+        if (numSplit > 0)
+        {
+            if (TraceLevel() > 0)
+                fprintf(stderr, "\nSplit %d products inside recurrent loops to compute their loop-invariant parts outside.\n", (int) numSplit);
+            CompileNetwork();
+            return;
+        }
+    }
 
     // STEP: Some final details.
     ResetEvalTimeStamps(); // invalidate all m_value fields. Really belongs into StartEvaluateMinibatchLoop()
@@ -533,6 +747,199 @@ void ComputationNetwork::CompileNetwork()
     m_isCompiled = true;
 }
 
+// helper for FuseElementwiseOps(): creates the node that computes the given activation of a sum, or returns nullptr if there is none
+template <class ElemType>
+static ComputationNodeBasePtr NewActivationOfSumNode(const wstring& activation, DEVICEID_TYPE deviceId, const wstring& name)
+{
+    if      (activation == OperationNameOf(RectifiedLinearNode)) return New<RectifiedLinearOfSumNode<ElemType>>(deviceId, name);
+    else if (activation == OperationNameOf(SigmoidNode))         return New<SigmoidOfSumNode<ElemType>>(deviceId, name);
+    else if (activation == OperationNameOf(TanhNode))            return New<TanhOfSumNode<ElemType>>(deviceId, name);
+    else                                                         return nullptr;
+}
+
+// RecordNodesBeforeRewrites() -- called by the rewrites of CompileNetwork() before they change the network, to keep the
+// nodes with their inputs as they are for Save(). The model thus stays what the user built, and can be loaded with or
+// without the options that enable the rewrites. Only the first call records; the node objects, and with them the
+// parameters, are the same as those of the rewritten network. An edit of the compiled network drops the record.
+void ComputationNetwork::RecordNodesBeforeRewrites()
+{
+    if (!m_nodesBeforeRewrites.empty())
+        return;
+    for (const auto& iter : m_nameToNodeMap)
+        m_nodesBeforeRewrites[iter.first] = make_pair(iter.second, iter.second->GetInputs());
+}
+
+// FuseElementwiseOps() -- replace each Plus node whose only consumer is an activation by a single node that computes both
+// (see ActivationOfSumNodeBase). This saves the sum's value and gradient matrices and a pass over the data each way,
+// e.g. for the bias and nonlinearity of a Times -> Plus -> ReLU layer. The fused node takes over the activation's name,
+// so that node groups and other nodes referring to it are unaffected. The sum stays in the network without consumers,
+// so that it can still be requested by name, which computes it separately; otherwise it is not evaluated. Sums that
+// are referenced in any other way (node groups, more consumers, activation checkpoints) are not fused. The model keeps
+// the unfused nodes, see RecordNodesBeforeRewrites(). Returns the number of fused pairs.
+size_t ComputationNetwork::FuseElementwiseOps()
+{
+    // count how often each node is used as an input
+    map<ComputationNodeBasePtr, size_t> numConsumers;
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        for (const auto& input : iter.second->GetInputs())
+            numConsumers[input]++;
+    }
+    set<ComputationNodeBasePtr> groupedNodes;
+    for (auto group : GetAllNodeGroups())
+        groupedNodes.insert(group->begin(), group->end());
+    set<wstring> checkpointNames(m_checkpointNodeNames.begin(), m_checkpointNodeNames.end());
+
+    // find the pairs first, since fusing changes m_nameToNodeMap
+    vector<pair<ComputationNodeBasePtr, ComputationNodeBasePtr>> pairs; // (Plus, activation)
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        const auto& activation = iter.second;
+        if (activation->GetNumInputs() != 1)
+            continue;
+        const auto& sum = activation->GetInputs()[0];
+        if (sum->OperationName() != OperationNameOf(PlusNode) || numConsumers[sum] != 1 ||
+            groupedNodes.find(sum) != groupedNodes.end() || checkpointNames.find(sum->NodeName()) != checkpointNames.end())
+            continue;
+        pairs.push_back(make_pair(sum, activation));
+    }
+
+    size_t numFused = 0;
+    for (const auto& p : pairs)
+    {
+        const auto& sum = p.first;
+        const auto& activation = p.second;
+        ComputationNodeBasePtr fused;
+        if (dynamic_pointer_cast<ComputationNode<float>>(activation) && dynamic_pointer_cast<ComputationNode<float>>(sum))
+            fused = NewActivationOfSumNode<float>(activation->OperationName(), activation->GetDeviceId(), activation->NodeName());
+        else if (dynamic_pointer_cast<ComputationNode<double>>(activation) && dynamic_pointer_cast<ComputationNode<double>>(sum))
+            fused = NewActivationOfSumNode<double>(activation->OperationName(), activation->GetDeviceId(), activation->NodeName());
+        if (!fused)
+            continue;
+
+        // the fused node takes the place of the activation, with the summands as its inputs
+        RecordNodesBeforeRewrites();
+        fused->AttachInputs(sum->GetInputs());
+        SubstituteNode(activation, fused);
+        numFused++;
+    }
+    return numFused;
+}
+
+// helper for HoistLoopInvariantProducts(): creates the sum of the products of the slices of the weights with the given
+// (input, first column) parts of the product's right operand, in this order. The sum is named like the product, and is
+// not added to the network; the nodes below it are.
+template <class ElemType>
+ComputationNodeBasePtr ComputationNetwork::NewSumOfPartialProducts(const ComputationNodeBasePtr& product, const vector<pair<ComputationNodeBasePtr, size_t>>& parts)
+{
+    auto deviceId = product->GetDeviceId();
+    const auto& name = product->NodeName();
+    ComputationNodeBasePtr sum;
+    for (size_t i = 0; i < parts.size(); i++)
+    {
+        const auto& input = parts[i].first;
+        int begin = (int) parts[i].second;
+        int end = begin + (int) input->GetSampleLayout()[0];
+        auto suffix = L"." + to_wstring(i);
+
+        auto weights = New<SliceNode<ElemType>>(deviceId, name + L".weights" + suffix, vector<int>{ begin }, vector<int>{ end }, vector<int>{ 2 });
+        weights->AttachInputs({ product->GetInputs()[0] });
+        AddNodeToNetIfNotYet(weights, /*makeUniqueName=*/true);
+        auto partialProduct = New<TimesNode<ElemType>>(deviceId, name + L".product" + suffix);
+        partialProduct->AttachInputs({ weights, input });
+        AddNodeToNetIfNotYet(partialProduct, /*makeUniqueName=*/true);
+
+        if (i == 0)
+            sum = partialProduct;
+        else
+        {
+            bool isLast = i + 1 == parts.size();
+            auto plus = New<PlusNode<ElemType>>(deviceId, isLast ? name : name + L".sum" + suffix);
+            plus->AttachInputs({ sum, partialProduct });
+            if (!isLast)
+                AddNodeToNetIfNotYet(plus, /*makeUniqueName=*/true);
+            sum = plus;
+        }
+    }
+    return sum;
+}
+
+// helper for HoistLoopInvariantProducts(): a vector, also in the [N x 1] form of parameters and of the nodes computed from them
+static bool IsColumnVector(const TensorShape& shape)
+{
+    return shape.GetRank() > 0 && shape.GetNumElements() == shape[0];
+}
+
+// HoistLoopInvariantProducts() -- split each product of a weight matrix with a spliced vector inside a recurrent loop,
+// like Times(W, RowStack(x, PastValue(h))) of an LSTM that projects input and state together, into the sum of the
+// products of the slices of W with the parts of the splice. The products with parts that do not depend on the loop, like
+// the input projection, then leave the loop and are computed for all frames by one matrix product, and only the
+// recurrent part is left to the products of the individual steps. The sum takes over the product's name. The model keeps
+// the products as they were, see RecordNodesBeforeRewrites(). This is called on a validated network, since it needs the
+// loops and the dimensions. Returns the number of split products.
+size_t ComputationNetwork::HoistLoopInvariantProducts()
+{
+    // find the products first, since splitting changes m_nameToNodeMap
+    vector<pair<ComputationNodeBasePtr, vector<pair<ComputationNodeBasePtr, size_t>>>> splits; // (product, parts with their first column)
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        const auto& product = iter.second;
+        if (product->OperationName() != OperationNameOf(TimesNode) || !product->IsPartOfLoop())
+            continue;
+
+        // only [M x K] weights times a splice of vectors of total dimension K
+        const auto& weights = product->GetInputs()[0];
+        const auto& stack = product->GetInputs()[1];
+        if (weights->OperationName() != OperationNameOf(LearnableParameter) || stack->OperationName() != OperationNameOf(RowStackNode) ||
+            weights->GetSampleLayout().GetRank() != 2 || !IsColumnVector(stack->GetSampleLayout()) || !IsColumnVector(product->GetSampleLayout()) ||
+            weights->GetSampleLayout()[1] != stack->GetSampleLayout()[0])
+            continue;
+
+        // parts that are not in the product's loop are loop-invariant; they go first, to be summed up outside the loop
+        auto loop = FindInRecurrentLoops(m_allSEQNodes, product);
+        vector<pair<ComputationNodeBasePtr, size_t>> invariantParts, recurrentParts;
+        size_t column = 0;
+        bool isSpliceOfVectors = true;
+        for (const auto& input : stack->GetInputs())
+        {
+            if (!IsColumnVector(input->GetSampleLayout()))
+            {
+                isSpliceOfVectors = false;
+                break;
+            }
+            bool isInvariant = !input->IsPartOfLoop() || FindInRecurrentLoops(m_allSEQNodes, input) != loop;
+            (isInvariant ? invariantParts : recurrentParts).push_back(make_pair(input, column));
+            column += input->GetSampleLayout()[0];
+        }
+        if (!isSpliceOfVectors || invariantParts.empty() || recurrentParts.empty())
+            continue;
+        invariantParts.insert(invariantParts.end(), recurrentParts.begin(), recurrentParts.end());
+        splits.push_back(make_pair(product, invariantParts));
+    }
+
+    if (!splits.empty())
+        RecordNodesBeforeRewrites();
+
+    size_t numSplit = 0;
+    for (const auto& split : splits)
+    {
+        const auto& product = split.first;
+        ComputationNodeBasePtr sum;
+        if (dynamic_pointer_cast<ComputationNode<float>>(product))
+            sum = NewSumOfPartialProducts<float>(product, split.second);
+        else if (dynamic_pointer_cast<ComputationNode<double>>(product))
+            sum = NewSumOfPartialProducts<double>(product, split.second);
+        if (!sum)
+            continue;
+
+        auto unusedCandidates = product->GetInputs();
+        SubstituteNode(product, sum);
+        RemoveUnusedNodes(unusedCandidates);
+        numSplit++;
+    }
+    return numSplit;
+}
+
 // determine the set of all root nodes
 // Roots are nodes that ForwardProp() may be called for.
 //  - training criterion, eval criteria
@@ -1027,6 +1434,32 @@ void ComputationNetwork::PrintMemorySharingStructure(const vector<ComputationNod
 }
 
 
+// Planning the memory arena moves the pooled matrices, so it must wait until no value computed so far will be used again.
+// That is the case when every node with a shared value is out of date: itself or, transitively, one of its inputs will be
+// recomputed. With a new minibatch that holds for all of them, since nodes that depend on parameters only are not shared.
+void ComputationNetwork::UpdateMemArena()
+{
+    if (!AreMatricesAllocated() || !m_matrixPool.IsMemArenaOutdated())
+        return;
+
+    map<ComputationNodeBasePtr, bool> isCurrent;
+    for (const auto& node : GetEvalOrder(nullptr))
+    {
+        bool current = node->IsLeaf() || !node->IsOutOfDateWrtInputs();
+        for (const auto& input : node->GetInputs())
+        {
+            auto iter = isCurrent.find(input);
+            if (iter != isCurrent.end()) // (inputs of delay nodes come later in the order)
+                current &= iter->second;
+        }
+        if (current && !node->IsLeaf() && node->IsValueSharable())
+            return; // try again with the next minibatch
+        isCurrent[node] = current;
+    }
+
+    m_matrixPool.UpdateMemArena(TraceLevel() > 0);
+}
+
 // this function will need to be called before actual validation and execution to
 // predetermine how to share matrices to reduce memory usage.
 // TODO: find a simple topological order and allocateEvalMatrices on that order directly
@@ -1108,9 +1541,32 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
         }
     }
 
+    // activation checkpointing: the values of the recomputed nodes are not kept for backprop, but the inputs they are recomputed from are
+    // (bfloat16 checkpoints are widened again rather than recomputed, so they do not need their inputs)
+    std::set<ComputationNodeBasePtr> recomputedNodes;
+    m_bfloat16CheckpointValues.clear();
+    if (trainRootNode != nullptr && m_activationCheckpointing)
+        recomputedNodes = PlanActivationCheckpointing(trainRootNode);
+    for (auto& node : recomputedNodes)
+    {
+        outputValueNeededDuringBackProp[node] = false;
+        if (m_bfloat16CheckpointValues.find(node) != m_bfloat16CheckpointValues.end())
+            continue;
+        for (auto& input : node->GetInputs())
+        {
+            if (!input->IsLeaf() && recomputedNodes.find(input) == recomputedNodes.end())
+                outputValueNeededDuringBackProp[input] = true;
+        }
+    }
+    // [node] -> range of the requests in the matrix pool made for its forward prop and backprop, respectively
+    // These tell which matrices a node uses, for reacquiring the recomputed ones, and for inter-op parallelism.
+    NodeRequestRanges forwardRequests;
+    NodeRequestRanges backpropRequests;
+
     m_matrixPool.ResetStepCounter();
 
-    TravserseInSortedGlobalEvalOrder(forwardPropRoots, [&outputValueNeededDuringBackProp, &parentsMap, this](const ComputationNodeBasePtr& node) {
+    TravserseInSortedGlobalEvalOrder(forwardPropRoots, [&outputValueNeededDuringBackProp, &parentsMap, &forwardRequests, this](const ComputationNodeBasePtr& node) {
+        auto requestsBegin = m_matrixPool.GetRequestMark();
         if (node->Is<SEQTraversalFlowControlNode>())
         {
             auto seqTraversalFlowControlNode = node->As<SEQTraversalFlowControlNode>();
@@ -1118,6 +1574,7 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
                 loopNode->SetOutputNeededDuringBackprop(outputValueNeededDuringBackProp[loopNode]);
 
             seqTraversalFlowControlNode->RequestMatricesBeforeForwardProp(m_matrixPool);
+            forwardRequests[node] = std::make_pair(requestsBegin, m_matrixPool.GetRequestMark());
 
             for (auto& loopNode : seqTraversalFlowControlNode->m_nestedNodes)
                 ReleaseMatricesAfterEvalForChildren(loopNode, parentsMap);
@@ -1126,6 +1583,7 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
         {
             node->SetOutputNeededDuringBackprop(outputValueNeededDuringBackProp[node]);
             node->RequestMatricesBeforeForwardProp(m_matrixPool);
+            forwardRequests[node] = std::make_pair(requestsBegin, m_matrixPool.GetRequestMark());
             // we only release matrices for the children since the root node's information will be used
             // and should not be shared with others
             ReleaseMatricesAfterEvalForChildren(node, parentsMap);
@@ -1135,6 +1593,7 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
     if (trainRootNode != nullptr)
     {
         const std::list<ComputationNodeBasePtr>& backPropNodes = GetEvalOrder(trainRootNode);
+        auto trainNetwork = dynamic_pointer_cast<PARTraversalFlowControlNode>(GetNestedNetwork(trainRootNode));
 
         // now, simulate the gradient computation order to determine how to allocate matrices
         set<ComputationNodeBasePtr> completedGradient;
@@ -1154,18 +1613,37 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
                     // SEQ mode: allocate all in loop first, then deallocate again
                     // TODO: next step: use PARTraversalFlowControlNode::AllocateGradientMatricesForInputs() and ReleaseMatricesAfterBackprop()...
                     // BUGBUG: naw, ^^ would not work! Wrong order! Need to rethink this. Need to make AllocateEvalMatrices() and AllocateGradientMatrices() the virtual functions.
+                    auto requestsBegin = m_matrixPool.GetRequestMark();
                     recInfo->AllocateGradientMatricesForInputs(m_matrixPool);
+                    backpropRequests[recInfo] = std::make_pair(requestsBegin, m_matrixPool.GetRequestMark());
                     // Loops are computed sample by sample so we have to allocate them all
                     recInfo->ReleaseMatricesAfterBackprop(m_matrixPool);
                 }
             }
             else
             {
+                // activation checkpointing: the values of the segment ending here are recomputed before its backprop,
+                // and kept until their own backprop
+                if (!recomputedNodes.empty())
+                {
+                    auto recompute = trainNetwork->m_recomputeBeforeBackprop.find(n);
+                    if (recompute != trainNetwork->m_recomputeBeforeBackprop.end())
+                    {
+                        for (auto& r : recompute->second)
+                            m_matrixPool.Reacquire(forwardRequests[r].first, forwardRequests[r].second);
+                    }
+                }
+
                 // PAR mode: we can allocate and immediately deallocate one by one
+                auto requestsBegin = m_matrixPool.GetRequestMark();
                 n->AllocateGradientMatricesForInputs(m_matrixPool);
+                backpropRequests[n] = std::make_pair(requestsBegin, m_matrixPool.GetRequestMark());
                 // Root node's information will be used and should not be shared with others, also it's small (1x1)
                 if ((n != trainRootNode) && n->NeedsGradient())
                     n->ReleaseMatricesAfterBackprop(m_matrixPool);
+
+                if (recomputedNodes.find(n) != recomputedNodes.end())
+                    m_matrixPool.ReleaseReacquired(forwardRequests[n].first, forwardRequests[n].second);
             }
         }
     }
@@ -1173,6 +1651,9 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
     m_matrixPool.OptimizedMemoryAllocation(); 
     m_areMatricesAllocated = true;
 
+    if (Globals::GetInterOpThreads() > 1)
+        PlanInterOpParallelism(forwardPropRoots, forwardRequests, backpropRequests);
+
     // TO DO: At the time of AllocateAllMatrices we don't know the minibatch size. In theory one may allocate memory again once we start to receive
     // data from the reader (and the minibatch size is known). For some problems, minibatch size can change constantly, and there needs to be a 
     // tradeoff in deciding how frequent to run optimized memory allocation. For now, we do it only once at the very beginning for speed concerns. 
@@ -1185,6 +1666,391 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
         PrintMemorySharingStructure(GetAllNodes());
 }
 
+// Plans activation checkpointing for the training criterion (see SetActivationCheckpointing()). The nodes that can be recomputed
+// are split into segments, at the named checkpoint nodes or else every ceil(sqrt(n)) nodes. Going backwards, a node of a segment
+// is recomputed unless it is a named checkpoint, or a node outside its segment needs its value after the segment has been
+// recomputed: a recomputed node (which is recomputed from it), or a node that uses it for its backprop (which runs before).
+// Fills the recompute lists of the nested network and returns the set of recomputed nodes.
+std::set<ComputationNodeBasePtr> ComputationNetwork::PlanActivationCheckpointing(const ComputationNodeBasePtr& trainRootNode)
+{
+    std::set<ComputationNodeBasePtr> recomputedNodes;
+    auto trainNetwork = dynamic_pointer_cast<PARTraversalFlowControlNode>(GetNestedNetwork(trainRootNode));
+    if (!trainNetwork)
+        return recomputedNodes;
+    trainNetwork->m_recomputeBeforeBackprop.clear();
+
+    // the recomputed values must not stay allocated in the first place
+    if (!Globals::ShouldEnableShareNodeValueMatrices())
+    {
+        fprintf(stderr, "WARNING: activationCheckpointing is ignored since it requires shareNodeValueMatrices.\n");
+        return recomputedNodes;
+    }
+
+    std::set<std::wstring> checkpointNames(m_checkpointNodeNames.begin(), m_checkpointNodeNames.end());
+    for (auto& name : checkpointNames)
+    {
+        if (!NodeNameExists(name))
+            InvalidArgument("PlanActivationCheckpointing: Checkpoint node '%ls' does not exist.", name.c_str());
+    }
+
+    const std::list<ComputationNodeBasePtr>& nodes = GetEvalOrder(trainRootNode);
+    std::unordered_map<ComputationNodeBasePtr, std::vector<std::pair<ComputationNodeBasePtr, size_t>>> parents; // [node] -> (parent, input index)
+    for (auto& node : nodes)
+    {
+        for (size_t i = 0; i < node->GetNumInputs(); i++)
+            parents[node->GetInputs()[i]].push_back(std::make_pair(node, i));
+    }
+
+    auto canRecompute = [&](const ComputationNodeBasePtr& node)
+    {
+        return !node->IsLeaf() && !node->IsPartOfLoop() && !node->RequiresPreCompute() && node != trainRootNode &&
+               node->IsValueSharable() && !node->IsValueSparse() && node->CanRecomputeForwardProp();
+    };
+
+    // split into segments of consecutive nodes that can be recomputed
+    size_t numCandidates = std::count_if(nodes.begin(), nodes.end(), canRecompute);
+    size_t segmentLength = checkpointNames.empty() ? std::max((size_t) 1, (size_t) ceil(sqrt((double) numCandidates))) : SIZE_MAX;
+    std::vector<std::vector<ComputationNodeBasePtr>> segments(1);
+    for (auto& node : nodes)
+    {
+        if (!canRecompute(node))
+        {
+            if (!segments.back().empty())
+                segments.emplace_back();
+            continue;
+        }
+        segments.back().push_back(node);
+        if (checkpointNames.find(node->NodeName()) != checkpointNames.end() || segments.back().size() >= segmentLength)
+            segments.emplace_back();
+    }
+
+    for (auto segment = segments.rbegin(); segment != segments.rend(); segment++)
+    {
+        std::set<ComputationNodeBasePtr> inSegment(segment->begin(), segment->end());
+        std::vector<ComputationNodeBasePtr> recomputed;
+        for (auto iter = segment->rbegin(); iter != segment->rend(); iter++)
+        {
+            auto& node = *iter;
+            bool keep = checkpointNames.find(node->NodeName()) != checkpointNames.end();
+            for (auto& parent : parents[node])
+            {
+                if (inSegment.find(parent.first) != inSegment.end())
+                    continue;
+                if (recomputedNodes.find(parent.first) != recomputedNodes.end() ||
+                    (parent.first->NeedsGradient() && parent.first->InputUsedInComputingInputNodesGradients(parent.second)))
+                    keep = true;
+            }
+            if (!keep)
+            {
+                recomputedNodes.insert(node);
+                recomputed.insert(recomputed.begin(), node);
+            }
+        }
+        if (!recomputed.empty())
+            trainNetwork->m_recomputeBeforeBackprop[segment->back()] = recomputed;
+    }
+
+    if (TraceLevel() > 0)
+        fprintf(stderr, "Activation checkpointing: %d of %d nodes are recomputed during backprop, in %d segments.\n",
+                (int) recomputedNodes.size(), (int) numCandidates, (int) trainNetwork->m_recomputeBeforeBackprop.size());
+
+    if (m_bfloat16Checkpoints)
+        PlanBFloat16Checkpoints(trainRootNode, recomputedNodes);
+    return recomputedNodes;
+}
+
+// Plans which checkpoints of activation checkpointing are kept in bfloat16 (see SetActivationCheckpointing()). A node that is kept
+// although it could be recomputed, and whose value during backprop is needed by recomputed nodes only, is stored in bfloat16 after its
+// forward prop. Its value is then released like that of a recomputed node, and it is widened again, in place of a recomputation,
+// before the first of the nodes that need it is recomputed. Adds these nodes to the recompute lists and to 'recomputedNodes'.
+void ComputationNetwork::PlanBFloat16Checkpoints(const ComputationNodeBasePtr& trainRootNode, std::set<ComputationNodeBasePtr>& recomputedNodes)
+{
+    auto trainNetwork = dynamic_pointer_cast<PARTraversalFlowControlNode>(GetNestedNetwork(trainRootNode));
+    if (!dynamic_pointer_cast<ComputationNode<float>>(trainRootNode) || GetDeviceId() != CPUDEVICE)
+    {
+        fprintf(stderr, "WARNING: checkpointPrecision=bfloat16 is ignored since it requires a float network on the CPU.\n");
+        return;
+    }
+
+    const std::list<ComputationNodeBasePtr>& nodes = GetEvalOrder(trainRootNode);
+    std::unordered_map<ComputationNodeBasePtr, size_t> evalIndex;
+    std::unordered_map<ComputationNodeBasePtr, std::vector<ComputationNodeBasePtr>> parents;
+    for (auto& node : nodes)
+    {
+        size_t index = evalIndex.size();
+        evalIndex[node] = index;
+        for (auto& input : node->GetInputs())
+            parents[input].push_back(node);
+    }
+    std::unordered_map<ComputationNodeBasePtr, ComputationNodeBasePtr> segmentEnds; // [recomputed node] -> key of its recompute list
+    for (auto& recompute : trainNetwork->m_recomputeBeforeBackprop)
+    {
+        for (auto& node : recompute.second)
+            segmentEnds[node] = recompute.first;
+    }
+
+    std::set<ComputationNodeBasePtr> changedLists;
+    for (auto& node : nodes)
+    {
+        if (node->IsLeaf() || node->IsPartOfLoop() || node->RequiresPreCompute() || node == trainRootNode || !node->IsValueSharable() ||
+            node->IsValueSparse() || recomputedNodes.find(node) != recomputedNodes.end() || parents[node].empty())
+            continue;
+
+        // widened before the recompute list that comes first in backprop, i.e. last in evaluation order
+        ComputationNodeBasePtr widenBefore;
+        for (auto& parent : parents[node])
+        {
+            auto segmentEnd = segmentEnds.find(parent);
+            if (segmentEnd == segmentEnds.end())
+            {
+                widenBefore = nullptr;
+                break;
+            }
+            if (!widenBefore || evalIndex[segmentEnd->second] > evalIndex[widenBefore])
+                widenBefore = segmentEnd->second;
+        }
+        if (!widenBefore)
+            continue;
+
+        m_bfloat16CheckpointValues[node] = make_shared<CPUMatrix<bfloat16>>();
+        trainNetwork->m_recomputeBeforeBackprop[widenBefore].push_back(node);
+        changedLists.insert(widenBefore);
+        recomputedNodes.insert(node);
+    }
+    for (auto& segmentEnd : changedLists)
+    {
+        auto& recomputed = trainNetwork->m_recomputeBeforeBackprop[segmentEnd];
+        std::sort(recomputed.begin(), recomputed.end(), [&](const ComputationNodeBasePtr& a, const ComputationNodeBasePtr& b) { return evalIndex[a] < evalIndex[b]; });
+    }
+
+    if (TraceLevel() > 0)
+        fprintf(stderr, "Activation checkpointing: %d checkpoints are kept in bfloat16.\n", (int) m_bfloat16CheckpointValues.size());
+}
+
+// bfloat16 checkpoints: keeps the value of the node in bfloat16 after its forward prop, if it is one, see PlanBFloat16Checkpoints()
+void ComputationNetwork::StoreBFloat16Checkpoint(const ComputationNodeBasePtr& node)
+{
+    if (m_bfloat16CheckpointValues.empty())
+        return;
+    auto stored = m_bfloat16CheckpointValues.find(node);
+    if (stored == m_bfloat16CheckpointValues.end())
+        return;
+
+    auto& value = node->As<ComputationNode<float>>()->Value();
+    CPUMatrix<float> view(value.GetNumRows(), value.GetNumCols(), value.Data(), matrixFlagDontOwnBuffer);
+    AssignToLowPrecision(view, *stored->second);
+}
+
+// bfloat16 checkpoints: widens the kept value of the node into its value matrix; returns false if the node is not one
+bool ComputationNetwork::RestoreBFloat16Checkpoint(const ComputationNodeBasePtr& node)
+{
+    auto stored = m_bfloat16CheckpointValues.find(node);
+    if (stored == m_bfloat16CheckpointValues.end())
+        return false;
+
+    node->BeginForwardProp(); // (sizes the value matrix, which may have been used by another node in the meantime)
+    auto& value = node->As<ComputationNode<float>>()->Value();
+    if (value.GetNumRows() != stored->second->GetNumRows() || value.GetNumCols() != stored->second->GetNumCols())
+        LogicError("RestoreBFloat16Checkpoint: The kept value of %ls %ls operation does not match its size.", node->NodeName().c_str(), node->OperationName().c_str());
+    CPUMatrix<float> view(value.GetNumRows(), value.GetNumCols(), value.Data(), matrixFlagDontOwnBuffer);
+    AssignFromLowPrecision(*stored->second, view);
+    node->EndForwardProp();
+    return true;
+}
+
+// helper for PlanInterOpParallelism(). Returns false if it was not able to dynamic-cast nodep to ComputationNode<ElemType>
+template <class ElemType>
+static bool GetValueAndGradient(const ComputationNodeBasePtr& nodep, const MatrixBase*& value, const MatrixBase*& gradient)
+{
+    let node = dynamic_pointer_cast<ComputationNode<ElemType>>(nodep);
+    if (!node)
+        return false;
+    value = node->ValuePtr().get();
+    gradient = node->GradientPtr().get();
+    return true;
+}
+
+// The matrices a task reads and writes, and the tasks it depends on through data flow.
+struct TaskAccess
+{
+    std::vector<const MatrixBase*> reads;
+    std::vector<const MatrixBase*> writes;
+    std::vector<size_t> predecessors;
+};
+
+// Builds the dependencies that make a concurrent run equivalent to running the tasks in the given order: the data flow,
+// plus an ordering between any two tasks that access the same matrix (thanks to memory sharing, unrelated nodes do),
+// unless both only read it.
+static void BuildTaskGraph(const std::vector<TaskAccess>& accesses, const std::vector<size_t>& order, TaskGraph& graph)
+{
+    struct MatrixUse
+    {
+        size_t lastWriter = SIZE_MAX;
+        std::vector<size_t> readers; // since the last write
+    };
+    std::unordered_map<const MatrixBase*, MatrixUse> uses;
+
+    graph.clear();
+    graph.resize(accesses.size());
+    for (size_t task : order)
+    {
+        const auto& access = accesses[task];
+        for (size_t predecessor : access.predecessors)
+            graph.AddDependency(predecessor, task);
+        for (auto matrix : access.reads)
+        {
+            auto& use = uses[matrix];
+            if (use.lastWriter != SIZE_MAX && use.lastWriter != task)
+                graph.AddDependency(use.lastWriter, task);
+            use.readers.push_back(task);
+        }
+        for (auto matrix : access.writes)
+        {
+            auto& use = uses[matrix];
+            if (use.lastWriter != SIZE_MAX && use.lastWriter != task)
+                graph.AddDependency(use.lastWriter, task);
+            for (size_t reader : use.readers)
+            {
+                if (reader != task)
+                    graph.AddDependency(reader, task);
+            }
+            use.readers.clear();
+            use.lastWriter = task;
+        }
+    }
+}
+
+// Plans inter-op parallelism (Globals::GetInterOpThreads()): for the nested network of each root, the graphs of the
+// tasks (top-level nodes or loops) that PARTraversalFlowControlNode runs concurrently in forward prop and backprop.
+// The matrices a task uses are the values and gradients of its nodes and of their inputs, plus the matrices requested
+// from the pool on their behalf; inputs that a node updates in place count as written. A node's temporary matrices for
+// backprop are requested by its parents, so it is conservatively taken to use those of all its parents.
+void ComputationNetwork::PlanInterOpParallelism(const std::vector<ComputationNodeBasePtr>& roots, const NodeRequestRanges& forwardRequests, const NodeRequestRanges& backpropRequests)
+{
+    // GPU kernels are already asynchronous, and the memory arena moves matrices after planning
+    if (GetDeviceId() != CPUDEVICE || Globals::ShouldUseMemoryArena())
+    {
+        fprintf(stderr, "WARNING: interOpThreads is ignored since it requires the CPU and no memoryArena.\n");
+        return;
+    }
+
+    auto getValueAndGradient = [](const ComputationNodeBasePtr& node, const MatrixBase*& value, const MatrixBase*& gradient)
+    {
+        value = gradient = nullptr;
+        GetValueAndGradient<float>(node, value, gradient) || GetValueAndGradient<double>(node, value, gradient);
+    };
+    auto addRequested = [this](const NodeRequestRanges& requests, const ComputationNodeBasePtr& node, std::vector<const MatrixBase*>& matrices)
+    {
+        auto range = requests.find(node);
+        if (range != requests.end())
+            m_matrixPool.GetRequestedMatrices(range->second.first, range->second.second, matrices);
+    };
+
+    for (auto& root : roots)
+    {
+        auto network = dynamic_pointer_cast<PARTraversalFlowControlNode>(GetNestedNetwork(root));
+        if (!network)
+            continue;
+        const auto& tasks = static_pointer_cast<FlowControlNode>(network)->m_nestedNodes; // (m_nestedNodes is private in PARTraversalFlowControlNode)
+        size_t numTasks = tasks.size();
+
+        // the nodes of each task; a loop is one task
+        std::vector<std::vector<ComputationNodeBasePtr>> taskNodes(numTasks);
+        std::unordered_map<ComputationNodeBasePtr, size_t> taskOf;
+        std::unordered_map<ComputationNodeBasePtr, std::vector<ComputationNodeBasePtr>> parents;
+        for (size_t i = 0; i < numTasks; i++)
+        {
+            if (tasks[i]->Is<SEQTraversalFlowControlNode>())
+                taskNodes[i] = tasks[i]->As<SEQTraversalFlowControlNode>()->m_nestedNodes;
+            else
+                taskNodes[i].push_back(tasks[i]);
+            for (auto& node : taskNodes[i])
+            {
+                taskOf[node] = i;
+                for (auto& input : node->GetInputs())
+                    parents[input].push_back(node);
+            }
+        }
+
+        std::vector<TaskAccess> forward(numTasks), backprop(numTasks);
+        for (size_t i = 0; i < numTasks; i++)
+        {
+            addRequested(forwardRequests, tasks[i], forward[i].writes);
+            addRequested(backpropRequests, tasks[i], backprop[i].writes);
+            for (auto& node : taskNodes[i])
+            {
+                const MatrixBase* value;
+                const MatrixBase* gradient;
+                getValueAndGradient(node, value, gradient);
+                forward[i].writes.push_back(value);
+                backprop[i].reads.push_back(value);
+                backprop[i].reads.push_back(gradient);
+
+                for (size_t k = 0; k < node->GetNumInputs(); k++)
+                {
+                    const auto& input = node->GetInputs()[k];
+                    // an input that is updated in place, e.g. the running statistics that batch normalization nodes may share,
+                    // is written even if it is a parameter
+                    bool updatesInput = node->ForwardPropUpdatesInput(k);
+                    if (updatesInput)
+                    {
+                        getValueAndGradient(input, value, gradient);
+                        forward[i].writes.push_back(value);
+                    }
+                    auto inputTask = taskOf.find(input);
+                    if (inputTask == taskOf.end() || inputTask->second == i)
+                        continue;
+                    getValueAndGradient(input, value, gradient);
+                    if (!updatesInput)
+                        forward[i].reads.push_back(value);
+                    forward[i].predecessors.push_back(inputTask->second);
+                    backprop[i].reads.push_back(value);
+                    if (input->NeedsGradient())
+                        backprop[i].writes.push_back(gradient);
+                }
+                for (auto& parent : parents[node])
+                {
+                    size_t parentTask = taskOf[parent];
+                    if (parentTask == i)
+                        continue;
+                    backprop[i].predecessors.push_back(parentTask);
+                    addRequested(backpropRequests, tasks[parentTask], backprop[i].writes);
+                }
+            }
+            for (auto* access : { &forward[i], &backprop[i] })
+            {
+                access->reads.erase(std::remove(access->reads.begin(), access->reads.end(), nullptr), access->reads.end());
+                access->writes.erase(std::remove(access->writes.begin(), access->writes.end(), nullptr), access->writes.end());
+            }
+        }
+
+        std::vector<size_t> order(numTasks);
+        for (size_t i = 0; i < numTasks; i++)
+            order[i] = i;
+        BuildTaskGraph(forward, order, network->m_forwardGraph);
+        std::reverse(order.begin(), order.end());
+        BuildTaskGraph(backprop, order, network->m_backpropGraph);
+
+        if (TraceLevel() > 0)
+        {
+            // the forward tasks by their depth in the graph, to show how much of it can run concurrently
+            std::vector<size_t> depth(numTasks, 0);
+            std::map<size_t, size_t> tasksAtDepth;
+            for (size_t i = 0; i < numTasks; i++)
+            {
+                for (size_t successor : network->m_forwardGraph.successors[i])
+                    depth[successor] = max(depth[successor], depth[i] + 1);
+                tasksAtDepth[depth[i]]++;
+            }
+            size_t width = 0;
+            for (auto& kv : tasksAtDepth)
+                width = max(width, kv.second);
+            fprintf(stderr, "Inter-op parallelism for %ls: %d tasks in %d steps, up to %d at once.\n",
+                    root->NodeName().c_str(), (int) numTasks, (int) tasksAtDepth.size(), (int) width);
+        }
+    }
+}
+
 void ComputationNetwork::ReleaseMatricesAfterEvalForChildren(ComputationNodeBasePtr n, std::unordered_map<ComputationNodeBasePtr, std::unordered_set<ComputationNodeBasePtr>>& parentsMap)
 {
     for (int i = 0; i < n->GetNumInputs(); i++)
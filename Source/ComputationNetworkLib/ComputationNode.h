@@ -810,6 +810,14 @@ public:
     // Base-class version makes conservative assumption that it is. Override if not.
     virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const { return true; }
 
+    // Can the output value be recomputed during backprop (activation checkpointing), i.e. does running ForwardProp()
+    // again on the same inputs give the same value without side effects? Override for nodes that are random or stateful.
+    virtual bool CanRecomputeForwardProp() const { return true; }
+
+    // Does ForwardProp() write to the value of the specified input, e.g. to update running statistics? Such an input is
+    // not read-only for inter-op parallelism. Override for nodes that update an input in place.
+    virtual bool ForwardPropUpdatesInput(size_t /*inputIndex*/) const { return false; }
+
     void SetOutputNeededDuringBackprop(bool f) { m_outputNeededDuringBackprop = f; }
     bool IsOutputNeededDuringBackprop() const 
     { 
@@ -1687,10 +1695,22 @@ protected:
 protected:
 
     // set the size of the underlying Matrix object to match node dimensions
+    // With Globals::ShouldBucketMinibatchSizes(), a dense matrix that must grow is allocated for the next power of two
+    // of time steps, so that minibatches of varying sequence lengths mostly reuse the allocation (and the memory arena plan)
+    // instead of reallocating whenever a longer one comes along. Resize() only grows, so it keeps the larger allocation.
     void UpdateDataSize(Matrix<ElemType>& m)
     {
         size_t rows, cols;
         DetermineDataSize(rows, cols);
+        if (Globals::ShouldBucketMinibatchSizes() && HasMBLayout() && m.GetMatrixType() == MatrixType::DENSE && rows * cols > m.GetAllocatedSize())
+        {
+            size_t numTimeSteps = GetMBLayout()->GetNumTimeSteps();
+            size_t bucket = 1;
+            while (bucket < numTimeSteps)
+                bucket *= 2;
+            if (numTimeSteps > 0 && cols % numTimeSteps == 0)
+                m.Resize(rows, cols / numTimeSteps * bucket);
+        }
         m.Resize(rows, cols);
     }
     // and verify the condition that UpdateDataSize() creates (used for sanity checking after loading parameters)
@@ -996,6 +996,31 @@ public:
     {
         AttachInputsFromConfig(configp, this->GetExpectedNumInputs());
     }
+
+    virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
+    {
+        // In the quantized inference mode (see ComputationEnvironment::quantizeTimes), the product with constant weights
+        // is computed in 16-bit fixed point like in QuantizedTimesNode. The weights are quantized and rewritten into the
+        // block order of the multiplier on the first pass only, so the multiplier is dropped whenever the mode is left
+        // (e.g. cross-validation during training), as the weights can change in between.
+        bool quantize = Environment().quantizeTimes && Environment().IsInferring() && m_deviceId == CPUDEVICE &&
+                        dynamic_pointer_cast<LearnableParameter<ElemType>>(Input(0));
+        if (quantize && !this->m_pQuantizedMultiplier)
+        {
+            shared_ptr<SymmetricQuantizer<ElemType, short>> pQA(new SymmetricQuantizer<ElemType, short>(QuantizedTimesBitShift));
+            shared_ptr<SymmetricQuantizer<ElemType, short>> pQB(new SymmetricQuantizer<ElemType, short>(QuantizedTimesBitShift));
+            this->m_pQuantizedMultiplier = make_shared<QuantizedMultiplier<ElemType>>(pQA, true, pQB, false);
+        }
+        else if (!quantize)
+            this->m_pQuantizedMultiplier.reset();
+
+        Base::ForwardProp(fr);
+    }
+
+private:
+    // bit shift of the quantizers in the quantized inference mode, one more than the default of QuantizedTimesNode
+    // to leave headroom for the sums over long inner dimensions
+    static const size_t QuantizedTimesBitShift = 2;
 };
 
 template class TimesNode<float>;
@@ -1845,6 +1870,8 @@ public:
 
     virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const override { return false; }
 
+    virtual bool CanRecomputeForwardProp() const override { return false; } // accumulates across calls
+
     virtual void OnEpochStart() override;
 
     virtual void /*ComputationNodeNonLooping::*/ ForwardPropNonLooping() override;
@@ -9,11 +9,13 @@
 #include <stdexcept>
 #include <vector>
 #include <set>
+#include <map>
 #include <utility>
 #include <algorithm>
 #include <stdlib.h>
 
 #include "Basics.h"
+#include "Globals.h"
 #include "Matrix.h"
 #include "ComputationNode.h"
 
@@ -27,14 +29,15 @@ struct MemRequestInfo
     size_t matrixSize;                          // memory size 
     bool mbScale;                               // whether the memory shall be scaled by minibatch size 
     bool isWorkSpace;                           // workspace memory or not, by workspace we indicate whether a memory space will be released very shortly after allocation 
-    int allocStep;                              // at what step counter memory allocation is requested 
-    int releaseStep;                            // at what step counter memory release is requested  
+    vector<pair<int, int>> occupancy;           // at what step counters memory allocation and release are requested; more than once if the memory is reacquired
     int memoryId;                               // integer indexing the memory buffer ID 
     MemRequestInfo(DEVICEID_TYPE deviceId, shared_ptr<Matrix<ElemType>>*pMatrixPtr, size_t matrixSize, bool mbScale, bool isWorkSpace, int allocStep)
-        :deviceId(deviceId), pMatrixPtr(pMatrixPtr), matrixSize(matrixSize), mbScale(mbScale), isWorkSpace(isWorkSpace), allocStep(allocStep), releaseStep(INT_MAX), memoryId(-1)
+        :deviceId(deviceId), pMatrixPtr(pMatrixPtr), matrixSize(matrixSize), mbScale(mbScale), isWorkSpace(isWorkSpace), occupancy(1, make_pair(allocStep, INT_MAX)), memoryId(-1)
     {
     }
-    void SetReleaseStep(int step) { releaseStep = step; }
+    void SetReleaseStep(int step) { occupancy.back().second = step; }
+    bool IsReleased() const { return occupancy.back().second != INT_MAX; }
+    void Reacquire(int step) { occupancy.push_back(make_pair(step, INT_MAX)); }
     void SetMemoryId(int id) { memoryId = id;  }
 };
 
@@ -47,6 +50,20 @@ struct greater_than_mem_req_size
     }
 };
 
+// whether two sets of [allocStep, releaseStep] intervals overlap
+static inline bool OccupanciesOverlap(const vector<pair<int, int>>& occVec1, const vector<pair<int, int>>& occVec2)
+{
+    for (auto& o1 : occVec1)
+    {
+        for (auto& o2 : occVec2)
+        {
+            if (o1.first <= o2.second && o1.second >= o2.first)
+                return true;
+        }
+    }
+    return false;
+}
+
 struct MemAllocInfo
 {
     int memoryId; 
@@ -58,6 +75,64 @@ struct MemAllocInfo
     }
 };
 
+// MemArenaBlock -- a buffer to be placed in a memory arena: its size in bytes, the steps of its lifetime(s), and the byte offset it is given
+struct MemArenaBlock
+{
+    size_t size;
+    vector<pair<int, int>> occupancy;
+    size_t offset;
+    MemArenaBlock(size_t size, const vector<pair<int, int>>& occupancy)
+        :size(size), occupancy(occupancy), offset(0)
+    {
+    }
+};
+
+// PlanMemArena -- assign byte offsets within one arena to buffers of known sizes and lifetimes
+// Blocks whose lifetimes overlap get disjoint byte ranges. Blocks are placed from the largest to the smallest; each goes into the
+// smallest gap (best fit) between the already placed blocks it overlaps in time, or right above them if no gap is large enough.
+// Sizes are rounded up to, and offsets are multiples of, 'alignment' bytes. Returns the size of the arena, i.e. the peak memory.
+static inline size_t PlanMemArena(vector<MemArenaBlock>& blocks, size_t alignment = 64)
+{
+    vector<size_t> order(blocks.size());
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        blocks[i].size = (blocks[i].size + alignment - 1) / alignment * alignment;
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&blocks](size_t a, size_t b) { return blocks[a].size > blocks[b].size; });
+
+    size_t peak = 0;
+    vector<pair<size_t, size_t>> occupied; // [begin, end) byte ranges of the placed blocks that overlap the current one in time
+    for (size_t k = 0; k < order.size(); k++)
+    {
+        auto& block = blocks[order[k]];
+        occupied.clear();
+        for (size_t j = 0; j < k; j++)
+        {
+            const auto& other = blocks[order[j]];
+            if (OccupanciesOverlap(block.occupancy, other.occupancy))
+                occupied.push_back(make_pair(other.offset, other.offset + other.size));
+        }
+        std::sort(occupied.begin(), occupied.end());
+
+        size_t bestOffset = SIZE_MAX;
+        size_t bestGap = SIZE_MAX;
+        size_t top = 0; // end of the occupied ranges seen so far
+        for (const auto& range : occupied)
+        {
+            if (range.first > top && range.first - top >= block.size && range.first - top < bestGap)
+            {
+                bestOffset = top;
+                bestGap = range.first - top;
+            }
+            top = max(top, range.second);
+        }
+        block.offset = bestOffset != SIZE_MAX ? bestOffset : top;
+        peak = max(peak, block.offset + block.size);
+    }
+    return peak;
+}
+
 // MatrixPool -- class to support memory sharing
 // Despite the gather general name of this class, it is specifically designed to support the memory sharing of ComputationNodes.
 // Note: see #define SUPRESS_MEMSHARING below as for how to temporarily disable memory sharing altogether, for debugging
@@ -68,9 +143,16 @@ class MatrixPool
     set<DEVICEID_TYPE> m_deviceIDSet; 
     int m_stepCounter; 
 
+    // memory arenas (see UpdateMemArena()), one per device
+    map<DEVICEID_TYPE, shared_ptr<Matrix<float>>> m_memArenasFloat;
+    map<DEVICEID_TYPE, shared_ptr<Matrix<double>>> m_memArenasDouble;
+
     template <class ElemType>
     vector<MemRequestInfo<ElemType>>& GetMemRequestInfoVec(); 
 
+    template <class ElemType>
+    map<DEVICEID_TYPE, shared_ptr<Matrix<ElemType>>>& GetMemArenas();
+
 public:
     void ResetStepCounter() { m_stepCounter = 0; };
 
@@ -109,6 +191,51 @@ public:
         *pMatrixPtr = make_shared<Matrix<ElemType>>(deviceId);
     }
 
+    // Marks delimit the requests made in between, e.g. those of one node's forward prop. A released range can be reacquired
+    // later, so that its memory is in use once more, e.g. when the forward prop of the node is recomputed during backprop.
+    struct RequestMark
+    {
+        size_t numFloat;
+        size_t numDouble;
+    };
+
+    RequestMark GetRequestMark() const
+    {
+        return RequestMark{ m_memRequestInfoFloatVec.size(), m_memRequestInfoDoubleVec.size() };
+    }
+
+    // Requests in [begin, end) that are released are in use again from now on, until ReleaseReacquired().
+    void Reacquire(const RequestMark& begin, const RequestMark& end)
+    {
+        for (size_t i = begin.numFloat; i < end.numFloat; i++)
+            if (m_memRequestInfoFloatVec[i].IsReleased())
+                m_memRequestInfoFloatVec[i].Reacquire(m_stepCounter);
+        for (size_t i = begin.numDouble; i < end.numDouble; i++)
+            if (m_memRequestInfoDoubleVec[i].IsReleased())
+                m_memRequestInfoDoubleVec[i].Reacquire(m_stepCounter);
+        m_stepCounter++;
+    }
+
+    void ReleaseReacquired(const RequestMark& begin, const RequestMark& end)
+    {
+        for (size_t i = begin.numFloat; i < end.numFloat; i++)
+            if (m_memRequestInfoFloatVec[i].occupancy.size() > 1 && !m_memRequestInfoFloatVec[i].IsReleased())
+                m_memRequestInfoFloatVec[i].SetReleaseStep(m_stepCounter);
+        for (size_t i = begin.numDouble; i < end.numDouble; i++)
+            if (m_memRequestInfoDoubleVec[i].occupancy.size() > 1 && !m_memRequestInfoDoubleVec[i].IsReleased())
+                m_memRequestInfoDoubleVec[i].SetReleaseStep(m_stepCounter);
+        m_stepCounter++;
+    }
+
+    // the matrices given to the requests in [begin, end) by OptimizedMemoryAllocation(); requests that share memory share the matrix
+    void GetRequestedMatrices(const RequestMark& begin, const RequestMark& end, vector<const MatrixBase*>& matrices) const
+    {
+        for (size_t i = begin.numFloat; i < end.numFloat; i++)
+            matrices.push_back(m_memRequestInfoFloatVec[i].pMatrixPtr->get());
+        for (size_t i = begin.numDouble; i < end.numDouble; i++)
+            matrices.push_back(m_memRequestInfoDoubleVec[i].pMatrixPtr->get());
+    }
+
     void OptimizedMemoryAllocation()
     {
         // MatrixPool is not templated, so we call both float and double versions here 
@@ -117,18 +244,29 @@ public:
         return; 
     }
 
+    // Memory arena (Globals::ShouldUseMemoryArena()): instead of one matrix per memory ID, all dense matrices of a device are views
+    // into one buffer, at 64-byte aligned addresses planned by PlanMemArena() from their lifetimes. The sizes are those the matrices have
+    // actually reached, so the arena is planned after the first minibatch has run with the matrices of OptimizedMemoryAllocation().
+    // A matrix that outgrows its slot moves to a buffer of its own (matrixFlagArenaBuffer), and the arena is planned again,
+    // grown with a single reallocation, the next time IsMemArenaOutdated() is checked at a point where no content needs to be kept.
+    // With minibatch size bucketing (see ComputationNode::UpdateDataSize()), this only happens when the number of time steps
+    // first exceeds a power of two.
+    bool IsMemArenaOutdated()
+    {
+        return Globals::ShouldUseMemoryArena() && (IsMemArenaOutdatedFunc<float>() || IsMemArenaOutdatedFunc<double>());
+    }
+
+    // The contents of all pooled matrices are lost.
+    void UpdateMemArena(bool trace)
+    {
+        UpdateMemArenaFunc<float>(trace);
+        UpdateMemArenaFunc<double>(trace);
+    }
+
 private: 
-    bool CheckOverlap(pair<int, int>occ, vector<pair<int, int>>&occVec)
+    bool CheckOverlap(const vector<pair<int, int>>& occ, const vector<pair<int, int>>& occVec)
     {
-        bool bRet = false;
-        for (auto& o : occVec)
-        {
-            if (occ.first <= o.second && occ.second >= o.first)
-            {
-                bRet = true;
-                break;
-            }
-        }
+        bool bRet = OccupanciesOverlap(occ, occVec);
 //#define SUPRESS_MEMSHARING // #define this to disable memory sharing by always return true 
 // TODO: Make this a runtime option.
 #ifdef SUPRESS_MEMSHARING
@@ -137,6 +275,93 @@ private:
         return bRet;
     }
 
+    template <class ElemType>
+    static bool IsMemArenaCandidate(const MemRequestInfo<ElemType>& memInfo)
+    {
+        // sparse matrices, and matrices that have been moved to another device, are left alone
+        const auto& matrixPtr = *memInfo.pMatrixPtr;
+        return matrixPtr && matrixPtr->GetMatrixType() == DENSE && matrixPtr->GetDeviceId() == memInfo.deviceId;
+    }
+
+    // outdated if a matrix has memory of its own: it has not been placed yet, or it outgrew its slot
+    template <class ElemType>
+    bool IsMemArenaOutdatedFunc()
+    {
+        for (auto& memInfo : GetMemRequestInfoVec<ElemType>())
+        {
+            if (IsMemArenaCandidate(memInfo) && (*memInfo.pMatrixPtr)->OwnBuffer() && (*memInfo.pMatrixPtr)->GetAllocatedSize() > 0)
+                return true;
+        }
+        return false;
+    }
+
+    template <class ElemType>
+    void UpdateMemArenaFunc(bool trace)
+    {
+        vector<MemRequestInfo<ElemType>>& memInfoVec = GetMemRequestInfoVec<ElemType>();
+        auto& memArenas = GetMemArenas<ElemType>();
+        for (auto& devId : m_deviceIDSet)
+        {
+            vector<MemArenaBlock> blocks;
+            vector<MemRequestInfo<ElemType>*> blockMemInfos;
+            map<pair<bool, int>, size_t> memoryIdSizes; // for the trace: what one matrix per memory ID would take
+            for (auto& memInfo : memInfoVec)
+            {
+                if (memInfo.deviceId != devId || !IsMemArenaCandidate(memInfo))
+                    continue;
+                // a slot never shrinks: a matrix's allocated size is either its slot or what it outgrew it with
+                blocks.push_back(MemArenaBlock((*memInfo.pMatrixPtr)->GetAllocatedSize() * sizeof(ElemType), memInfo.occupancy));
+                blockMemInfos.push_back(&memInfo);
+                auto& memoryIdSize = memoryIdSizes[make_pair(memInfo.isWorkSpace, memInfo.memoryId)];
+                memoryIdSize = max(memoryIdSize, blocks.back().size);
+            }
+            if (blocks.empty())
+                continue;
+
+            const size_t alignment = 64;
+            size_t peak = PlanMemArena(blocks, alignment);
+            if (peak == 0) // nothing has been used yet
+                continue;
+
+            // grow the arena if needed; the matrices that point into the old one are all rebound below
+            // It has room for one more alignment unit, so that the offsets can start at an aligned address.
+            auto& arena = memArenas[devId];
+            if (!arena || arena->GetNumElements() * sizeof(ElemType) < peak + alignment)
+            {
+                arena = nullptr;
+                arena = make_shared<Matrix<ElemType>>((peak + alignment) / sizeof(ElemType), 1, devId);
+            }
+            ElemType* base = arena->Data();
+            base += (alignment - reinterpret_cast<uintptr_t>(base) % alignment) % alignment / sizeof(ElemType);
+
+            set<Matrix<ElemType>*> rebound;
+            for (size_t i = 0; i < blocks.size(); i++)
+            {
+                auto& matrixPtr = *blockMemInfos[i]->pMatrixPtr;
+                // requests that shared a matrix (one per memory ID) each get a matrix of their own
+                if (!rebound.insert(matrixPtr.get()).second)
+                {
+                    matrixPtr = make_shared<Matrix<ElemType>>(devId);
+                    rebound.insert(matrixPtr.get());
+                }
+                size_t numRows = matrixPtr->GetNumRows();
+                size_t numCols = matrixPtr->GetNumCols();
+                matrixPtr->SetValue(blocks[i].size / sizeof(ElemType), 1, devId, base + blocks[i].offset / sizeof(ElemType),
+                                    matrixFlagDontOwnBuffer | matrixFlagArenaBuffer);
+                matrixPtr->Resize(numRows, numCols);
+            }
+
+            if (trace)
+            {
+                size_t memoryIdBytes = 0;
+                for (const auto& memoryIdSize : memoryIdSizes)
+                    memoryIdBytes += memoryIdSize.second;
+                fprintf(stderr, "MatrixPool: Memory arena on device %d: %d matrices planned into %.2f MB (%.2f MB as one matrix per memory ID), %.2f MB allocated.\n",
+                        (int) devId, (int) blocks.size(), peak / 1048576.0, memoryIdBytes / 1048576.0, arena->GetNumElements() * sizeof(ElemType) / 1048576.0);
+            }
+        }
+    }
+
     template <class ElemType>
     void OptimizedMemoryAllocationFunc()
     {
@@ -176,14 +401,12 @@ private:
                         // since we assign from highest memory to lowest, every memory that has been allocated can accommodate the 
                         // current memory request, unless there is a conflict (overlap) 
                         auto iter = memAllocInfoVec.begin();
-                        while (iter != memAllocInfoVec.end() && CheckOverlap(make_pair(memInfo.allocStep, memInfo.releaseStep), iter->occupancy))
+                        while (iter != memAllocInfoVec.end() && CheckOverlap(memInfo.occupancy, iter->occupancy))
                             iter++;
                         if (iter == memAllocInfoVec.end())
                         {
                             // no current memory can be assigned, need to create a new one 
-                            vector<pair<int, int>> occ;
-                            occ.push_back(make_pair(memInfo.allocStep, memInfo.releaseStep));
-                            MemAllocInfo ma(memoryCounter, memInfo.matrixSize, occ);
+                            MemAllocInfo ma(memoryCounter, memInfo.matrixSize, memInfo.occupancy);
                             // insert in the front of the vector to maintain sorted order 
                             memAllocInfoVec.insert(memAllocInfoVec.begin(), ma);
                             memInfo.SetMemoryId(memoryCounter);
@@ -191,15 +414,13 @@ private:
                         }
                         else
                         {
-                            iter->occupancy.push_back(make_pair(memInfo.allocStep, memInfo.releaseStep));
+                            iter->occupancy.insert(iter->occupancy.end(), memInfo.occupancy.begin(), memInfo.occupancy.end());
                             memInfo.SetMemoryId(iter->memoryId);
                         }
                     }
                     else
                     {
-                        vector<pair<int, int>> occ;
-                        occ.push_back(make_pair(memInfo.allocStep, memInfo.releaseStep));
-                        MemAllocInfo ma(memoryCounter, memInfo.matrixSize, occ);
+                        MemAllocInfo ma(memoryCounter, memInfo.matrixSize, memInfo.occupancy);
                         memAllocInfoVec.push_back(ma);
                         memInfo.SetMemoryId(memoryCounter);
                         memoryCounter++;
@@ -219,29 +440,25 @@ private:
                         auto workingAlloc = memAllocInfoVec.end();
                         for (auto iter = memAllocInfoVec.begin(); iter != memAllocInfoVec.end(); iter++)
                         {
-                            if (!CheckOverlap(make_pair(memInfo.allocStep, memInfo.releaseStep), iter->occupancy))
+                            if (!CheckOverlap(memInfo.occupancy, iter->occupancy))
                                 workingAlloc = iter;
                         }
                         if (workingAlloc == memAllocInfoVec.end())  // nothing works 
                         {
-                            vector<pair<int, int>> occ;
-                            occ.push_back(make_pair(memInfo.allocStep, memInfo.releaseStep));
-                            MemAllocInfo ma(memoryCounter, memInfo.matrixSize, occ);
+                            MemAllocInfo ma(memoryCounter, memInfo.matrixSize, memInfo.occupancy);
                             memAllocInfoVec.push_back(ma);  // add as the last one 
                             memInfo.SetMemoryId(memoryCounter);
                             memoryCounter++;
                         }
                         else
                         {
-                            workingAlloc->occupancy.push_back(make_pair(memInfo.allocStep, memInfo.releaseStep));
+                            workingAlloc->occupancy.insert(workingAlloc->occupancy.end(), memInfo.occupancy.begin(), memInfo.occupancy.end());
                             memInfo.SetMemoryId(workingAlloc->memoryId);
                         }
                     }
                     else
                     {
-                        vector<pair<int, int>> occ;
-                        occ.push_back(make_pair(memInfo.allocStep, memInfo.releaseStep));
-                        MemAllocInfo ma(memoryCounter, memInfo.matrixSize, occ);
+                        MemAllocInfo ma(memoryCounter, memInfo.matrixSize, memInfo.occupancy);
                         memAllocInfoVec.push_back(ma);
                         memInfo.SetMemoryId(memoryCounter);
                         memoryCounter++;
@@ -0,0 +1,195 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// NodeProfiler.cpp -- per-node time and memory profile of a ComputationNetwork
+//
+
+#include "stdafx.h"
+#include "Basics.h"
+#include "fileutil.h"
+#include "NodeProfiler.h"
+#include <algorithm>
+
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+NodeProfiler::NodeProfiler(const wstring& path, size_t numMinibatches)
+    : m_path(path), m_numMinibatches(max((size_t) 1, numMinibatches)), m_origin(Clock::now()), m_minibatch(0), m_isWritten(false)
+{
+}
+
+NodeProfiler::~NodeProfiler()
+{
+    if (!IsActive())
+        return;
+    try
+    {
+        WriteReports();
+    }
+    catch (const exception& e)
+    {
+        fprintf(stderr, "NodeProfiler: Failed to write the reports: %s\n", e.what());
+    }
+}
+
+void NodeProfiler::BeginMinibatch()
+{
+    if (m_isWritten)
+        return;
+    if (m_minibatch == m_numMinibatches) // the last one is complete
+        WriteReports();
+    else
+        m_minibatch++;
+}
+
+void NodeProfiler::Record(const wstring& nodeName, const wstring& operationName, Phase phase,
+                          Clock::time_point start, Clock::duration duration, size_t outputBytes, size_t allocatedBytes, bool trace)
+{
+    lock_guard<mutex> lock(m_mutex);
+    auto& stats = m_nodeStats[nodeName];
+    stats.operationName = operationName;
+    stats.time[(int) phase] += duration;
+    stats.numCalls[(int) phase]++;
+    stats.outputBytes += outputBytes;
+    stats.peakBytes = max(stats.peakBytes, allocatedBytes);
+    if (trace)
+        m_traceEvents.push_back(TraceEvent{ nodeName, phase == Phase::forward ? L"forward" : L"backward", start, duration, ThreadIndex() });
+}
+
+void NodeProfiler::AddTime(const wstring& nodeName, Phase phase, Clock::duration duration)
+{
+    lock_guard<mutex> lock(m_mutex);
+    m_nodeStats[nodeName].time[(int) phase] += duration;
+}
+
+size_t NodeProfiler::NumCalls(const wstring& nodeName, Phase phase) const
+{
+    lock_guard<mutex> lock(m_mutex);
+    auto stats = m_nodeStats.find(nodeName);
+    return stats != m_nodeStats.end() ? stats->second.numCalls[(int) phase] : 0;
+}
+
+NodeProfiler::Clock::duration NodeProfiler::Time(const wstring& nodeName, Phase phase) const
+{
+    lock_guard<mutex> lock(m_mutex);
+    auto stats = m_nodeStats.find(nodeName);
+    return stats != m_nodeStats.end() ? stats->second.time[(int) phase] : Clock::duration::zero();
+}
+
+void NodeProfiler::Trace(const wstring& name, const wstring& category, Clock::time_point start, Clock::duration duration)
+{
+    lock_guard<mutex> lock(m_mutex);
+    m_traceEvents.push_back(TraceEvent{ name, category, start, duration, ThreadIndex() });
+}
+
+size_t NodeProfiler::ThreadIndex()
+{
+    auto result = m_threadIndices.insert(make_pair(this_thread::get_id(), m_threadIndices.size()));
+    return result.first->second;
+}
+
+static double Milliseconds(NodeProfiler::Clock::duration d)
+{
+    return chrono::duration<double, milli>(d).count();
+}
+
+// table rows sorted by time, with the times, calls and sizes per minibatch
+void NodeProfiler::FormatTableRows(string& s, const vector<pair<wstring, Stats>>& rows, Clock::duration total, const char* what) const
+{
+    double numMinibatches = (double) max((size_t) 1, m_minibatch);
+    s += msra::strfun::strprintf("%12s %12s %8s %7s %12s %10s  %s\n", "forward ms", "backward ms", "%", "calls", "output MB", "peak MB", what);
+    for (const auto& row : rows)
+    {
+        const auto& stats = row.second;
+        s += msra::strfun::strprintf("%12.3f %12.3f %8.2f %7.1f %12.3f %10.3f  %s (%s)\n",
+                                     Milliseconds(stats.time[0]) / numMinibatches, Milliseconds(stats.time[1]) / numMinibatches,
+                                     total.count() > 0 ? 100.0 * stats.TotalTime().count() / total.count() : 0.0,
+                                     (stats.numCalls[0] + stats.numCalls[1]) / numMinibatches,
+                                     stats.outputBytes / numMinibatches / 1048576.0, stats.peakBytes / 1048576.0,
+                                     msra::strfun::utf8(row.first).c_str(), msra::strfun::utf8(stats.operationName).c_str());
+    }
+}
+
+string NodeProfiler::FormatTable() const
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    // by node, and summed up by operation type
+    vector<pair<wstring, Stats>> nodeRows(m_nodeStats.begin(), m_nodeStats.end());
+    map<wstring, Stats> operationStats;
+    map<wstring, size_t> numNodes;
+    Clock::duration total = Clock::duration::zero();
+    for (const auto& row : nodeRows)
+    {
+        const auto& stats = row.second;
+        auto& sum = operationStats[stats.operationName];
+        sum.operationName = msra::strfun::wstrprintf(L"%d nodes", (int) ++numNodes[stats.operationName]);
+        for (int phase = 0; phase < 2; phase++)
+        {
+            sum.time[phase] += stats.time[phase];
+            sum.numCalls[phase] += stats.numCalls[phase];
+        }
+        sum.outputBytes += stats.outputBytes;
+        sum.peakBytes += stats.peakBytes;
+        total += stats.TotalTime();
+    }
+    vector<pair<wstring, Stats>> operationRows(operationStats.begin(), operationStats.end());
+    auto byTime = [](const pair<wstring, Stats>& a, const pair<wstring, Stats>& b)
+    {
+        return a.second.TotalTime() > b.second.TotalTime();
+    };
+    sort(nodeRows.begin(), nodeRows.end(), byTime);
+    sort(operationRows.begin(), operationRows.end(), byTime);
+
+    string s = msra::strfun::strprintf("Node profile over %d minibatches: %.3f ms per minibatch in %d nodes. Times and sizes are per minibatch.\n",
+                                       (int) m_minibatch, Milliseconds(total) / max((size_t) 1, m_minibatch), (int) nodeRows.size());
+    s += "\nBy operation type (peak MB is the sum over the nodes):\n";
+    FormatTableRows(s, operationRows, total, "operation (nodes)");
+    s += "\nBy node:\n";
+    FormatTableRows(s, nodeRows, total, "node (operation)");
+    return s;
+}
+
+// escapes a name for a JSON string
+static string JsonString(const wstring& name)
+{
+    string s;
+    for (char c : msra::strfun::utf8(name))
+    {
+        if (c == '"' || c == '\\')
+            s += '\\';
+        if ((unsigned char) c >= 0x20)
+            s += c;
+    }
+    return s;
+}
+
+void NodeProfiler::WriteReports()
+{
+    m_isWritten = true;
+
+    string table = FormatTable();
+    auto f = fopenOrDie(m_path + L".txt", L"w");
+    fputstring(f, table);
+    fcloseOrDie(f);
+
+    // Chrome trace: complete events ("X") with times in microseconds
+    lock_guard<mutex> lock(m_mutex);
+    f = fopenOrDie(m_path + L".json", L"w");
+    fprintfOrDie(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for (size_t i = 0; i < m_traceEvents.size(); i++)
+    {
+        const auto& event = m_traceEvents[i];
+        fprintfOrDie(f, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,\"tid\":%d}",
+                     i > 0 ? "," : "", JsonString(event.name).c_str(), JsonString(event.category).c_str(),
+                     1000 * Milliseconds(event.start - m_origin), 1000 * Milliseconds(event.duration), (int) event.thread);
+    }
+    fprintfOrDie(f, "\n]}\n");
+    fcloseOrDie(f);
+
+    fprintf(stderr, "NodeProfiler: Wrote the profile of %d minibatches to %ls.txt and %ls.json.\n", (int) m_minibatch, m_path.c_str(), m_path.c_str());
+}
+
+}}}
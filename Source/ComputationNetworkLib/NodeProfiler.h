@@ -0,0 +1,113 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// NodeProfiler.h -- per-node time and memory profile of a ComputationNetwork
+//
+// Unlike the fixed SGD-level events of the PerformanceProfiler, this breaks a minibatch down by node, to find the
+// layers that are worth optimizing or fusing. It is enabled with ComputationNetwork::EnableNodeProfiler(), which
+// puts it into the network's ComputationEnvironment. The traversal nodes then time the ForwardProp() and Backprop()
+// of every node and record them here, together with the size of the node's output and of all matrices it holds.
+// After the requested number of minibatches, two reports are written:
+//  - <path>.txt: the nodes and the operation types sorted by time, per minibatch
+//  - <path>.json: all recorded calls in the Chrome trace format (load it in chrome://tracing)
+// Nodes inside recurrent loops are summed over the time steps of a minibatch, as one call per phase: their
+// back-propagation into the inputs outside the loop, which follows the loop, is added to that call. The trace shows the
+// loop as a whole.
+// The times are those seen by the CPU, so on the GPU they only include the kernels if the device is synchronized
+// (e.g. with CUDA_LAUNCH_BLOCKING=1).
+//
+
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+class NodeProfiler
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    enum class Phase
+    {
+        forward,
+        backward
+    };
+
+    // collect over the next numMinibatches minibatches, then write the reports to path + ".txt" and path + ".json"
+    NodeProfiler(const std::wstring& path, size_t numMinibatches);
+    ~NodeProfiler(); // writes the reports of the minibatches so far if that has not happened yet
+
+    NodeProfiler(const NodeProfiler&) = delete;
+    NodeProfiler& operator=(const NodeProfiler&) = delete;
+
+    // called by the network before the first node of each minibatch; writes the reports after the last one
+    void BeginMinibatch();
+    bool IsActive() const { return m_minibatch > 0 && !m_isWritten; }
+
+    // Records one ForwardProp() or Backprop() of a node. outputBytes is the size of the value resp. gradient it computed,
+    // allocatedBytes that of all the matrices it holds at that time. This may be called from many threads at once.
+    void Record(const std::wstring& nodeName, const std::wstring& operationName, Phase phase,
+                Clock::time_point start, Clock::duration duration, size_t outputBytes, size_t allocatedBytes, bool trace = true);
+
+    // Adds to the time of the last recorded call of a node, for work that completes it later; not a call of its own.
+    void AddTime(const std::wstring& nodeName, Phase phase, Clock::duration duration);
+
+    // the totals recorded so far for a node; 0 if it has none
+    size_t NumCalls(const std::wstring& nodeName, Phase phase) const;
+    Clock::duration Time(const std::wstring& nodeName, Phase phase) const;
+
+    // adds a span to the trace only, for one that contains recorded calls, like a recurrent loop
+    void Trace(const std::wstring& name, const std::wstring& category, Clock::time_point start, Clock::duration duration);
+
+    void WriteReports();
+    std::string FormatTable() const;
+
+private:
+    struct Stats
+    {
+        std::wstring operationName;
+        Clock::duration time[2];  // [phase]
+        size_t numCalls[2];       // [phase]
+        size_t outputBytes;       // sum over all calls
+        size_t peakBytes;         // largest allocatedBytes seen
+
+        Stats() : outputBytes(0), peakBytes(0)
+        {
+            time[0] = time[1] = Clock::duration::zero();
+            numCalls[0] = numCalls[1] = 0;
+        }
+        Clock::duration TotalTime() const { return time[0] + time[1]; }
+    };
+
+    struct TraceEvent
+    {
+        std::wstring name;
+        std::wstring category;
+        Clock::time_point start;
+        Clock::duration duration;
+        size_t thread;
+    };
+
+    size_t ThreadIndex(); // small number for the calling thread, for the trace; call with m_mutex held
+    void FormatTableRows(std::string& s, const std::vector<std::pair<std::wstring, Stats>>& rows, Clock::duration total, const char* what) const;
+
+    const std::wstring m_path;
+    const size_t m_numMinibatches;
+    const Clock::time_point m_origin; // time 0 of the trace
+    size_t m_minibatch;               // 1-based index of the current minibatch, 0 before the first
+    bool m_isWritten;
+
+    mutable std::mutex m_mutex; // protects the following
+    std::map<std::wstring, Stats> m_nodeStats; // [node name]
+    std::vector<TraceEvent> m_traceEvents;
+    std::map<std::thread::id, size_t> m_threadIndices;
+};
+
+}}}
@@ -163,6 +163,88 @@ DeclareUnaryElementWiseWithOpCodeNode(StableSigmoid,         StableSigmoid,
 
 #pragma pop_macro("DeclareUnaryElementWiseWithOpCodeNode")
 
+// -----------------------------------------------------------------------
+// ActivationOfSumNodeBase (summand1, summand2) -- base for a Plus followed
+// by an elementwise activation, computed in a single pass over the data
+// without materializing the sum. These nodes are not meant to be written
+// by users; ComputationNetwork::FuseElementwiseOps() creates them.
+// -----------------------------------------------------------------------
+
+template <class ElemType, ElementWiseOperator opForward, ElementWiseOperator opBackward>
+class ActivationOfSumNodeBase : public BinaryElementWiseNode<ElemType>
+{
+    typedef BinaryElementWiseNode<ElemType> Base;
+    UsingComputationNodeMembers;
+
+public:
+    ActivationOfSumNodeBase(DEVICEID_TYPE deviceId, const wstring& name)
+        : Base(deviceId, name)
+    {
+    }
+
+    virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
+    {
+        size_t rank = DetermineElementwiseTensorRank();
+        auto result =             ValueTensorFor(rank, fr);
+        auto input0 = InputRef(0).ValueTensorFor(rank, fr.AllowBroadcast());
+        auto input1 = InputRef(1).ValueTensorFor(rank, fr.AllowBroadcast());
+        result.DoBinaryOpOf(0, input0, input1, 1, opForward, opSum);
+    }
+
+    virtual void /*ComputationNode::*/ BackpropTo(const size_t inputIndex, const FrameRange& fr) override
+    {
+        size_t rank = DetermineElementwiseTensorRank();
+        auto gradient      =                    GradientTensorFor(rank, fr);
+        auto inputGradient = Input(inputIndex)->GradientTensorFor(rank, fr.AllowBroadcast());
+        auto output        =                       ValueTensorFor(rank, fr);
+
+        // if reduction then mask the respective input(s) (zero out the gaps)
+        if (Input(inputIndex)->ReducesInTimeWrt(shared_from_this()))
+            MaskMissingGradientColumnsToZero(fr);
+
+        // both summands get the gradient of the activation, which is computed from the output
+        inputGradient.DoBinaryOpOf(Input(inputIndex)->ParentOverwritesGradient() ? 0.0f : 1.0f, gradient, output, 1, opBackward, opSum);
+    }
+
+    virtual bool OutputUsedInComputingInputNodesGradients() const override { return true; }
+    virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const override { return false; }
+
+    virtual bool ImplementsGradientOverwriteOptimization() const override { return true; }
+};
+
+// -----------------------------------------------------------------------
+// RectifiedLinearOfSumNode (summand1, summand2)
+// SigmoidOfSumNode (summand1, summand2)
+// TanhOfSumNode (summand1, summand2)
+// -----------------------------------------------------------------------
+
+#pragma push_macro("DeclareActivationOfSumNode")
+#define DeclareActivationOfSumNode(Name, Forward, Backward)                                              \
+    template <class ElemType>                                                                            \
+    class Name##Node : public ActivationOfSumNodeBase<ElemType, op##Forward, op##Backward>               \
+    {                                                                                                    \
+        typedef ActivationOfSumNodeBase<ElemType, op##Forward, op##Backward> Base;                       \
+        UsingBinaryElementwiseNodeBaseMembers;                                                           \
+        static const std::wstring TypeName()                                                             \
+        {                                                                                                \
+            return L## #Name;                                                                            \
+        }                                                                                                \
+                                                                                                         \
+    public:                                                                                              \
+        DeclareConstructorFromConfigWithNumInputs(Name##Node);                                           \
+        Name##Node(DEVICEID_TYPE deviceId, const wstring& Name) :                                        \
+            Base(deviceId, Name)                                                                         \
+        {                                                                                                \
+        }                                                                                                \
+    }
+
+//                         Name                   Forward opcode        Backward opcode
+DeclareActivationOfSumNode(RectifiedLinearOfSum,  LinearRectifierOfSum, ElementwiseProductWithLinearRectifierDerivativeFromOutput);
+DeclareActivationOfSumNode(SigmoidOfSum,          SigmoidOfSum,         ElementwiseProductWithSigmoidDerivativeFromOutput);
+DeclareActivationOfSumNode(TanhOfSum,             TanhOfSum,            ElementwiseProductWithTanhDerivativeFromOutput);
+
+#pragma pop_macro("DeclareActivationOfSumNode")
+
 // -----------------------------------------------------------------------
 // SoftmaxNodeBase (input) -- shared base of Softmax and LogSoftmax
 // -----------------------------------------------------------------------
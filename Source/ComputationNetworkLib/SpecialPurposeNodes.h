@@ -1080,6 +1080,8 @@ public:
 
     virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
     virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const override { return false; }
+    virtual bool CanRecomputeForwardProp() const override { return false; } // writes to its target parameter
+    virtual bool ForwardPropUpdatesInput(size_t inputIndex) const override { return inputIndex == 0; }
 };
 
 template class AssignNode<float>;
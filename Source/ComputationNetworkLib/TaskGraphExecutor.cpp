@@ -0,0 +1,211 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// TaskGraphExecutor.cpp -- runs a graph of dependent tasks on a pool of worker threads
+//
+
+#include "stdafx.h"
+#include "TaskGraphExecutor.h"
+#include "CPUThreadPool.h"
+#include <algorithm>
+
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+TaskGraphExecutor::TaskGraphExecutor(size_t numThreads)
+    : m_graph(nullptr), m_task(nullptr), m_pendingCapacity(0), m_remaining(0), m_queued(0), m_failed(false),
+      m_generation(0), m_activeWorkers(0), m_intraOpThreads(1), m_stop(false)
+{
+    numThreads = max((size_t) 1, numThreads);
+    for (size_t i = 0; i < numThreads; i++)
+        m_queues.push_back(unique_ptr<Queue>(new Queue()));
+    for (size_t i = 1; i < numThreads; i++)
+        m_threads.emplace_back(&TaskGraphExecutor::WorkerLoop, this, i);
+}
+
+TaskGraphExecutor::~TaskGraphExecutor()
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (auto& thread : m_threads)
+        thread.join();
+}
+
+void TaskGraphExecutor::Run(const TaskGraph& graph, const function<void(size_t)>& task)
+{
+    size_t n = graph.size();
+    if (n == 0)
+        return;
+
+    lock_guard<mutex> runLock(m_runMutex);
+
+    // everything a worker may touch is set up before the first task is queued
+    if (n > m_pendingCapacity)
+    {
+        m_pendingPredecessors.reset(new atomic<size_t>[n]);
+        m_pendingCapacity = n;
+    }
+    for (size_t i = 0; i < n; i++)
+        m_pendingPredecessors[i] = graph.numPredecessors[i];
+    m_graph = &graph;
+    m_task = &task;
+    m_failed = false;
+    m_error = nullptr;
+    m_queued = 0;
+    m_remaining = n;
+
+    // the tasks that are ready from the start are dealt round to the workers
+    size_t worker = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (graph.numPredecessors[i] == 0)
+            Push(worker++ % NumThreads(), i);
+    }
+    // The workers start kernels concurrently, so each gets its share of the threads that would otherwise run one kernel.
+    int intraOpThreads = max(1, CPUThreadPool::Instance().NumThreads() / (int) NumThreads());
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_intraOpThreads = intraOpThreads;
+        m_generation++;
+    }
+    m_wake.notify_all();
+
+    CPUThreadPool::LimitCallingThread(intraOpThreads);
+    Work(0);
+    CPUThreadPool::LimitCallingThread(0);
+
+    {
+        unique_lock<mutex> lock(m_mutex);
+        m_idle.wait(lock, [this] { return m_activeWorkers == 0; });
+    }
+    m_graph = nullptr;
+    m_task = nullptr;
+    if (m_error)
+        rethrow_exception(m_error);
+}
+
+void TaskGraphExecutor::WorkerLoop(size_t worker)
+{
+    size_t generation = 0;
+    int intraOpThreads = 0;
+    for (;;)
+    {
+        int runIntraOpThreads;
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_stop || m_generation != generation; });
+            if (m_stop)
+                return;
+            generation = m_generation;
+            runIntraOpThreads = m_intraOpThreads;
+            m_activeWorkers++;
+        }
+        if (runIntraOpThreads != intraOpThreads)
+        {
+            intraOpThreads = runIntraOpThreads;
+            CPUThreadPool::LimitCallingThread(intraOpThreads);
+        }
+        Work(worker);
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_activeWorkers--;
+        }
+        m_idle.notify_all();
+    }
+}
+
+// executes tasks of the current run until all of them are done
+void TaskGraphExecutor::Work(size_t worker)
+{
+    for (;;)
+    {
+        size_t task;
+        if (TryPop(worker, task))
+        {
+            Execute(worker, task);
+            continue;
+        }
+        // nothing to do until a running task completes
+        unique_lock<mutex> lock(m_mutex);
+        m_workCond.wait(lock, [this] { return m_remaining == 0 || m_queued > 0; });
+        if (m_remaining == 0)
+            return;
+    }
+}
+
+void TaskGraphExecutor::Execute(size_t worker, size_t task)
+{
+    if (!m_failed)
+    {
+        try
+        {
+            (*m_task)(task);
+        }
+        catch (...)
+        {
+            lock_guard<mutex> lock(m_mutex);
+            if (!m_error)
+                m_error = current_exception();
+            m_failed = true;
+        }
+    }
+
+    // successors that become ready go to this worker's queue, they are likely to use what this task just computed
+    for (size_t successor : m_graph->successors[task])
+    {
+        if (--m_pendingPredecessors[successor] == 0)
+            Push(worker, successor);
+    }
+
+    if (--m_remaining == 0)
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_workCond.notify_all();
+    }
+}
+
+void TaskGraphExecutor::Push(size_t worker, size_t task)
+{
+    // counted first, so that m_queued never drops below the number of tasks in the queues
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_queued++;
+    }
+    {
+        lock_guard<mutex> lock(m_queues[worker]->mutex);
+        m_queues[worker]->tasks.push_back(task);
+    }
+    m_workCond.notify_one();
+}
+
+// Takes the newest task of the worker's own queue, or else steals the oldest task of another worker.
+bool TaskGraphExecutor::TryPop(size_t worker, size_t& task)
+{
+    for (size_t i = 0; i < m_queues.size(); i++)
+    {
+        auto& queue = *m_queues[(worker + i) % m_queues.size()];
+        lock_guard<mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+            continue;
+        if (i == 0)
+        {
+            task = queue.tasks.back();
+            queue.tasks.pop_back();
+        }
+        else
+        {
+            task = queue.tasks.front();
+            queue.tasks.pop_front();
+        }
+        m_queued--;
+        return true;
+    }
+    return false;
+}
+
+}}}
@@ -0,0 +1,102 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// TaskGraphExecutor.h -- runs a graph of dependent tasks on a pool of worker threads
+//
+// This is what executes independent branches of a network concurrently (inter-op parallelism, see
+// Globals::GetInterOpThreads()). A task is a whole node, so tasks are few and coarse: each worker has a
+// deque of ready tasks, runs the ones it made ready itself first (their inputs are still in its cache),
+// and steals from the other workers when it has nothing left to do.
+//
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// TaskGraph -- tasks 0..n-1 and their dependencies
+struct TaskGraph
+{
+    std::vector<std::vector<size_t>> successors; // [task] -> tasks that must not start before it has completed
+    std::vector<size_t> numPredecessors;         // [task] -> number of tasks that list it as a successor
+
+    size_t size() const { return numPredecessors.size(); }
+    void clear() { successors.clear(); numPredecessors.clear(); }
+    void resize(size_t n) { successors.resize(n); numPredecessors.resize(n); }
+
+    // adds the dependency 'from' -> 'to' unless it is already there
+    void AddDependency(size_t from, size_t to)
+    {
+        auto& s = successors[from];
+        for (size_t t : s)
+        {
+            if (t == to)
+                return;
+        }
+        s.push_back(to);
+        numPredecessors[to]++;
+    }
+};
+
+class TaskGraphExecutor
+{
+public:
+    // numThreads includes the thread that calls Run(), which works along
+    explicit TaskGraphExecutor(size_t numThreads);
+    ~TaskGraphExecutor();
+
+    size_t NumThreads() const { return m_queues.size(); }
+
+    // Runs task(i) for all tasks of the graph, each after all its predecessors, and returns when all are done.
+    // If a task throws, the tasks that have not started yet are skipped, and the first exception is rethrown.
+    // Meanwhile, the kernels of each worker, the calling thread included, run on an equal share of the CPU worker threads.
+    void Run(const TaskGraph& graph, const std::function<void(size_t)>& task);
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    void WorkerLoop(size_t worker);
+    void Work(size_t worker);
+    void Execute(size_t worker, size_t task);
+    void Push(size_t worker, size_t task);
+    bool TryPop(size_t worker, size_t& task);
+
+    std::vector<std::unique_ptr<Queue>> m_queues; // [worker]; worker 0 is the thread that calls Run()
+    std::vector<std::thread> m_threads;
+
+    // the current run
+    std::mutex m_runMutex; // one Run() at a time
+    const TaskGraph* m_graph;
+    const std::function<void(size_t)>* m_task;
+    std::unique_ptr<std::atomic<size_t>[]> m_pendingPredecessors;
+    size_t m_pendingCapacity;
+    std::atomic<size_t> m_remaining;
+    std::atomic<size_t> m_queued;
+    std::atomic<bool> m_failed;
+    std::exception_ptr m_error;
+
+    std::mutex m_mutex; // protects the following, and the waits on the condition variables
+    std::condition_variable m_wake;     // a new run has started, or the executor is being destroyed
+    std::condition_variable m_workCond; // a task was queued, or the run is complete
+    std::condition_variable m_idle;     // a worker has left the run
+    size_t m_generation;
+    size_t m_activeWorkers;
+    int m_intraOpThreads; // share of the CPU worker threads of each worker in the current run
+    bool m_stop;
+};
+
+}}}
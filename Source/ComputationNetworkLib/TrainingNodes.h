@@ -1293,6 +1293,7 @@ public:
 
     virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
     virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const override { return false; }
+    virtual bool CanRecomputeForwardProp() const override { return false; } // draws new random numbers
     virtual void /*ComputationNode::*/ ForwardProp(const FrameRange&) override;
     virtual void /*ComputationNode::*/ BackpropTo(const size_t /*inputIndex*/, const FrameRange&) override;
     virtual bool /*ComputationNodeBase::*/ IsOutOfDateWrtInputs() const override;
@@ -1368,6 +1369,7 @@ public:
     virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override;
     virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
     virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const override { return false;}
+    virtual bool CanRecomputeForwardProp() const override { return false; } // draws new samples
     virtual void /*ComputationNode::*/ ForwardPropNonLooping() override{}
     virtual bool GetAllowDuplicates() const { return m_allowDuplicates; }
     virtual size_t GetNumSamples() const { return m_sizeOfSampledSet; }
@@ -2262,6 +2264,7 @@ public:
 
     virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
     virtual bool InputUsedInComputingInputNodesGradients(size_t /*childIndex*/) const override { return false; }
+    virtual bool CanRecomputeForwardProp() const override { return false; } // draws a new mask
 
     virtual void UpdateFunctionMBSize() override
     {
@@ -2745,6 +2748,9 @@ public:
     }
 
     virtual bool OutputUsedInComputingInputNodesGradients() const override { return false; }
+    // updates the running statistics in training mode
+    virtual bool CanRecomputeForwardProp() const override { return false; }
+    virtual bool ForwardPropUpdatesInput(size_t inputIndex) const override { return inputIndex >= RUN_MEAN; }
 
     void Validate(bool isFinalValidationPass) override
     {
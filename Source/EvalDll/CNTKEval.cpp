@@ -41,6 +41,11 @@ void CNTKEvalBase<ElemType>::Init(const std::string& config)
     CPUMatrix<ElemType>::SetNumThreads(nThreads);
 
     Globals::SetShareNodeValueMatrices(m_config(L"shareNodeValueMatrices", true));
+    Globals::SetMemoryArena(m_config(L"memoryArena", false));
+    Globals::SetInterOpThreads(m_config(L"interOpThreads", 0));
+    Globals::SetElementwiseFusion(m_config(L"fuseElementwiseOps", false));
+    Globals::SetLoopInvariantHoisting(m_config(L"hoistLoopInvariants", false));
+    Globals::SetMinibatchSizeBucketing(m_config(L"bucketMinibatchSizes", false));
 }
 
 
@@ -59,6 +64,21 @@ void CNTKEvalBase<ElemType>::CreateNetwork(const std::string& networkDescription
     {
         LogicError("Unable to construct network from description");
     }
+
+    // CPU inference of products with constant weights in 16-bit fixed point, see ComputationEnvironment::quantizeTimes
+    this->m_net->SetQuantizeTimes(m_config(L"quantizeTimes", false));
+
+    // fold BatchNormalization and nodes that only depend on parameters into the weights
+    if (m_config(L"optimizeForInference", false))
+        this->m_net->template OptimizeForInference<ElemType>();
+
+    // per-node time and memory profile of the first evaluations, see ComputationNetwork::EnableNodeProfiler()
+    size_t nodeProfilerMinibatches = m_config(L"nodeProfilerMinibatches", (size_t) 0);
+    if (nodeProfilerMinibatches > 0)
+    {
+        wstring nodeProfilerPath = m_config(L"nodeProfilerPath", L"nodeProfile");
+        this->m_net->EnableNodeProfiler(nodeProfilerPath, nodeProfilerMinibatches);
+    }
 }
 
 
@@ -304,6 +324,47 @@ VariableSchema CNTKEvalExtended<ElemType>::GetInputSchema() const
     return inputLayouts;
 }
 
+// checks an input buffer against the input node, and returns its number of samples
+template<typename ElemType>
+template<template<typename> class ValueContainer>
+size_t CNTKEvalExtended<ElemType>::GetNumSamples(const ComputationNodeBasePtr& inputNode, const ValueBuffer<ElemType, ValueContainer>& buffer)
+{
+    auto matrix = dynamic_pointer_cast<Matrix<ElemType>>(inputNode->ValuePtr());
+    auto type = matrix->GetMatrixType();
+    size_t numRows = inputNode->GetSampleLayout().GetNumElements();
+
+    if (buffer.m_buffer.data() == nullptr)
+        RuntimeError("Input %ls: Buffer is not allocated.", inputNode->GetName().c_str());
+    if (type == MatrixType::DENSE)
+    {
+        if (buffer.m_buffer.size() % numRows != 0)
+            RuntimeError("Input %ls: Expected input data to be a multiple of %" PRIu64 ", but it is %" PRIu64 ".", 
+                         inputNode->GetName().c_str(), numRows, buffer.m_buffer.size());
+        if (buffer.m_buffer.size() == 0)
+            RuntimeError("Input %ls: Expected at least one element.", inputNode->GetName().c_str());
+    }
+    else if (type == MatrixType::SPARSE)
+    {
+        if (buffer.m_colIndices.data() == nullptr)
+            RuntimeError("Input %ls: Due to sparse input format, expected colIndices array, but was nullptr.", inputNode->GetName().c_str());
+        if (buffer.m_indices.data() == nullptr)
+            RuntimeError("Input %ls: Due to sparse input format, expected Indices array, but was nullptr.", inputNode->GetName().c_str());
+        if (buffer.m_colIndices.size() < 2)
+            RuntimeError("Input %ls: Expected at least one element (2 entries in colIndices array).", inputNode->GetName().c_str());
+        if (buffer.m_colIndices[0] != 0)
+            RuntimeError("Input %ls: First element of column indices must be 0", inputNode->GetName().c_str());
+        if (buffer.m_colIndices[buffer.m_colIndices.size() - 1] != buffer.m_indices.size())
+            RuntimeError("Input %ls: Last element of column indices must be equal to the size of indices (%ld), but was %d", 
+                         inputNode->GetName().c_str(), buffer.m_indices.size(), 
+                         buffer.m_colIndices[buffer.m_colIndices.size() - 1]);
+    }
+
+    int numCols = type == MatrixType::DENSE ? buffer.m_buffer.size() / numRows : buffer.m_colIndices.size() - 1;
+    if (numCols < 1)
+        RuntimeError("Input: the number of column must be greater than or equal to 1.");
+    return numCols;
+}
+
 template<typename ElemType>
 template<template<typename> class ValueContainer>
 void CNTKEvalExtended<ElemType>::ForwardPassT(const std::vector<ValueBuffer<ElemType, ValueContainer> >& inputs, std::vector<ValueBuffer<ElemType, ValueContainer> >& outputs, bool resetRNN)
@@ -326,36 +387,7 @@ void CNTKEvalExtended<ElemType>::ForwardPassT(const std::vector<ValueBuffer<Elem
         auto matrix = dynamic_pointer_cast<Matrix<ElemType>>(inputNode->ValuePtr());
         auto type = matrix->GetMatrixType();
         size_t numRows = inputNode->GetSampleLayout().GetNumElements();
-
-        if (buffer.m_buffer.data() == nullptr)
-            RuntimeError("Input %ls: Buffer is not allocated.", m_inputNodes[i]->GetName().c_str());
-        if (type == MatrixType::DENSE)
-        {
-            if (buffer.m_buffer.size() % numRows != 0)
-                RuntimeError("Input %ls: Expected input data to be a multiple of %" PRIu64 ", but it is %" PRIu64 ".", 
-                             m_inputNodes[i]->GetName().c_str(), numRows, buffer.m_buffer.size());
-            if (buffer.m_buffer.size() == 0)
-                RuntimeError("Input %ls: Expected at least one element.", m_inputNodes[i]->GetName().c_str());
-        }
-        else if (type == MatrixType::SPARSE)
-        {
-            if (buffer.m_colIndices.data() == nullptr)
-                RuntimeError("Input %ls: Due to sparse input format, expected colIndices array, but was nullptr.", m_inputNodes[i]->GetName().c_str());
-            if (buffer.m_indices.data() == nullptr)
-                RuntimeError("Input %ls: Due to sparse input format, expected Indices array, but was nullptr.", m_inputNodes[i]->GetName().c_str());
-            if (buffer.m_colIndices.size() < 2)
-                RuntimeError("Input %ls: Expected at least one element (2 entries in colIndices array).", m_inputNodes[i]->GetName().c_str());
-            if (buffer.m_colIndices[0] != 0)
-                RuntimeError("Input %ls: First element of column indices must be 0", m_inputNodes[i]->GetName().c_str());
-            if (buffer.m_colIndices[buffer.m_colIndices.size() - 1] != buffer.m_indices.size())
-                RuntimeError("Input %ls: Last element of column indices must be equal to the size of indices (%ld), but was %d", 
-                             m_inputNodes[i]->GetName().c_str(), buffer.m_indices.size(), 
-                             buffer.m_colIndices[buffer.m_colIndices.size() - 1]);
-        }
-
-        int numCols = type == MatrixType::DENSE ? buffer.m_buffer.size() / numRows : buffer.m_colIndices.size() - 1;
-        if (numCols < 1)
-            RuntimeError("Input: the number of column must be greater than or equal to 1.");
+        size_t numCols = GetNumSamples(inputNode, buffer);
         inputNode->GetMBLayout()->Init(1, numCols);
         
         // SentinelValueIndicatingUnspecifedSequenceBeginIdx is used to specify the lower bound of look-back step of recurrent nodes
@@ -409,6 +441,131 @@ void CNTKEvalExtended<ElemType>::ForwardPassT(const std::vector<ValueBuffer<Elem
     }
 }
 
+// evaluates independent sequences in one minibatch: sequence r is parallel sequence r of every input's MBLayout,
+// and the output columns are routed back to the request by sequence id
+template<typename ElemType>
+template<template<typename> class ValueContainer>
+void CNTKEvalExtended<ElemType>::ForwardPassBatchT(const std::vector<std::vector<ValueBuffer<ElemType, ValueContainer>>>& inputs,
+                                                   std::vector<std::vector<ValueBuffer<ElemType, ValueContainer>>>& outputs)
+{
+    if (!m_started)
+        RuntimeError("ForwardPassBatch() called before StartForwardEvaluation()");
+
+    size_t numSequences = inputs.size();
+    if (numSequences == 0)
+        return;
+    if (outputs.size() != numSequences)
+        RuntimeError("Expected outputs for %d sequences, but got %d.", (int)numSequences, (int)outputs.size());
+    for (size_t r = 0; r < numSequences; r++)
+    {
+        if (inputs[r].size() != m_inputNodes.size())
+            RuntimeError("Sequence %d: Expected %d inputs, but got %d.", (int)r, (int)m_inputNodes.size(), (int)inputs[r].size());
+        if (outputs[r].size() != m_outputNodes.size())
+            RuntimeError("Sequence %d: Expected %d outputs, but got %d.", (int)r, (int)m_outputNodes.size(), (int)outputs[r].size());
+    }
+
+    for (size_t i = 0; i < m_inputNodes.size(); i++)
+    {
+        const auto& inputNode = m_inputNodes[i];
+        auto matrix = dynamic_pointer_cast<Matrix<ElemType>>(inputNode->ValuePtr());
+        size_t numRows = inputNode->GetSampleLayout().GetNumElements();
+
+        // each sequence starts at time 0; shorter ones are padded with gaps
+        vector<size_t> lengths(numSequences);
+        for (size_t r = 0; r < numSequences; r++)
+            lengths[r] = GetNumSamples(inputNode, inputs[r][i]);
+        size_t numTimeSteps = *max_element(lengths.begin(), lengths.end());
+        auto pMBLayout = inputNode->GetMBLayout();
+        pMBLayout->Init(numSequences, numTimeSteps);
+        for (size_t r = 0; r < numSequences; r++)
+        {
+            pMBLayout->AddSequence(r, r, 0, lengths[r]);
+            pMBLayout->AddGap(r, lengths[r], numTimeSteps);
+        }
+
+        // sample t of sequence r goes into column t * numSequences + r
+        size_t numCols = numTimeSteps * numSequences;
+        if (matrix->GetMatrixType() == MatrixType::DENSE)
+        {
+            vector<ElemType> data(numRows * numCols, 0);
+            for (size_t r = 0; r < numSequences; r++)
+            {
+                const auto& buffer = inputs[r][i].m_buffer;
+                for (size_t t = 0; t < lengths[r]; t++)
+                    copy(buffer.data() + t * numRows, buffer.data() + (t + 1) * numRows, data.begin() + (t * numSequences + r) * numRows);
+            }
+            matrix->SetValue(numRows, numCols, matrix->GetDeviceId(), data.data(), matrixFlagNormal);
+        }
+        else
+        {
+            vector<int> colIndices(1, 0), indices;
+            vector<ElemType> data;
+            for (size_t t = 0; t < numTimeSteps; t++)
+            {
+                for (size_t r = 0; r < numSequences; r++)
+                {
+                    if (t < lengths[r]) // (gaps are empty columns)
+                    {
+                        const auto& buffer = inputs[r][i];
+                        for (int k = buffer.m_colIndices[t]; k < buffer.m_colIndices[t + 1]; k++)
+                        {
+                            indices.push_back(buffer.m_indices[k]);
+                            data.push_back(buffer.m_buffer[k]);
+                        }
+                    }
+                    colIndices.push_back((int)indices.size());
+                }
+            }
+            matrix->SetMatrixFromCSCFormat(colIndices.data(), indices.data(), data.data(), data.size(), numRows, numCols);
+        }
+    }
+
+    ComputationNetwork::BumpEvalTimeStamp(m_inputNodes);
+    this->m_net->ForwardProp(m_outputNodes);
+
+    for (size_t o = 0; o < m_outputNodes.size(); o++)
+    {
+        const auto& node = m_outputNodes[o];
+        shared_ptr<Matrix<ElemType>> outputMatrix = dynamic_pointer_cast<Matrix<ElemType>>(node->ValuePtr());
+        size_t numRows = outputMatrix->GetNumRows();
+        unique_ptr<ElemType[]> data(outputMatrix->CopyToArray());
+
+        // an output without MBLayout does not depend on the inputs' sequences, every request gets all of it
+        auto pMBLayout = node->GetMBLayout();
+        vector<vector<size_t>> columns(numSequences);
+        if (!pMBLayout)
+        {
+            for (auto& c : columns)
+                for (size_t j = 0; j < outputMatrix->GetNumCols(); j++)
+                    c.push_back(j);
+        }
+        else
+        {
+            for (const auto& seq : pMBLayout->GetAllSequences())
+            {
+                if (seq.seqId == GAP_SEQUENCE_ID)
+                    continue;
+                if (seq.seqId >= numSequences)
+                    LogicError("ForwardPassBatch: Output %ls has an unexpected sequence id %d.", node->GetName().c_str(), (int)seq.seqId);
+                for (size_t t = (size_t)max(seq.tBegin, (ptrdiff_t)0); t < min(seq.tEnd, pMBLayout->GetNumTimeSteps()); t++)
+                    columns[seq.seqId].push_back(t * pMBLayout->GetNumParallelSequences() + seq.s);
+            }
+        }
+
+        for (size_t r = 0; r < numSequences; r++)
+        {
+            ValueContainer<ElemType>& vec = outputs[r][o].m_buffer;
+            size_t numElements = columns[r].size() * numRows;
+            if (vec.capacity() < numElements)
+                RuntimeError("Not enough space in output buffer of sequence %d for output '%ls'.", (int)r, node->GetName().c_str());
+            vec.resize(numElements);
+            ElemType* out = const_cast<ElemType*>(vec.data());
+            for (size_t c = 0; c < columns[r].size(); c++)
+                copy(data.get() + columns[r][c] * numRows, data.get() + (columns[r][c] + 1) * numRows, out + c * numRows);
+        }
+    }
+}
+
 template<typename ElemType>
 void CNTKEvalExtended<ElemType>::ForwardPass(const Values<ElemType>& inputs, Values<ElemType>& outputs)
 {
@@ -433,6 +590,31 @@ void CNTKEvalExtended<ElemType>::ForwardPass(const ValueRefs<ElemType>& inputs,
     ForwardPassT(inputs, outputs, resetRNN);
 }
 
+template<typename ElemType>
+void CNTKEvalExtended<ElemType>::ForwardPassBatch(const std::vector<Values<ElemType>>& inputs, std::vector<Values<ElemType>>& outputs)
+{
+    ForwardPassBatchT(inputs, outputs);
+}
+
+template<typename ElemType>
+void CNTKEvalExtended<ElemType>::ForwardPassBatch(const std::vector<ValueRefs<ElemType>>& inputs, std::vector<ValueRefs<ElemType>>& outputs)
+{
+    ForwardPassBatchT(inputs, outputs);
+}
+
+template <typename ElemType>
+IEvaluateModelExtended<ElemType>* CNTKEvalExtended<ElemType>::CreateSession()
+{
+    if (this->m_net == nullptr)
+        RuntimeError("CreateSession() called before CreateNetwork()");
+
+    // the session's network shares the parameter values with ours, see ComputationNetwork::CloneWithSharedParameters()
+    auto session = new CNTKEvalExtended<ElemType>();
+    session->m_config = this->m_config;
+    session->m_net = this->m_net->template CloneWithSharedParameters<ElemType>();
+    return session;
+}
+
 template <typename ElemType>
 void CNTKEvalExtended<ElemType>::Destroy()
 {
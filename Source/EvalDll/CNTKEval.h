@@ -107,6 +107,12 @@ public:
 
     virtual void ForwardPass(const ValueRefs<ElemType>& inputs, ValueRefs<ElemType>& output, bool resetRNN) override;
 
+    virtual void ForwardPassBatch(const std::vector<Values<ElemType>>& inputs, std::vector<Values<ElemType>>& outputs) override;
+
+    virtual void ForwardPassBatch(const std::vector<ValueRefs<ElemType>>& inputs, std::vector<ValueRefs<ElemType>>& outputs) override;
+
+    virtual IEvaluateModelExtended<ElemType>* CreateSession() override;
+
     virtual void Destroy() override;
 
     virtual void CreateNetwork(const std::string& networkDescription) override
@@ -131,5 +137,12 @@ private:
     void ForwardPassT(const std::vector < ValueBuffer<ElemType, ValueContainer> >& inputs,
                       std::vector < ValueBuffer<ElemType, ValueContainer> >& outputs, bool resetRNN);
 
+    template<template<typename> class ValueContainer>
+    void ForwardPassBatchT(const std::vector<std::vector<ValueBuffer<ElemType, ValueContainer>>>& inputs,
+                           std::vector<std::vector<ValueBuffer<ElemType, ValueContainer>>>& outputs);
+
+    template<template<typename> class ValueContainer>
+    static size_t GetNumSamples(const ComputationNodeBasePtr& inputNode, const ValueBuffer<ElemType, ValueContainer>& buffer);
+
 };
 } } }
@@ -6,6 +6,8 @@
 #include "stdafx.h"
 #include "BatchNormalizationEngine.h"
 #include "CuDnnFactories.h"
+#include "CPUBatchNormKernels.h"
+#include <vector>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -114,6 +116,122 @@ protected:
 template class CntkBatchNormEngine<float>;
 template class CntkBatchNormEngine<double>;
 
+// Batch normalization on CPU with fused kernels (see CPUBatchNormKernels.h), for training and inference.
+template <class ElemType>
+class CpuBatchNormEngine : public BatchNormEngine<ElemType>
+{
+public:
+    using Base = BatchNormEngine<ElemType>;
+    using typename Base::Mat;
+
+public:
+    CpuBatchNormEngine(DEVICEID_TYPE deviceId, const TensorShape& inOutT,
+                       bool spatial, ImageLayoutKind imageLayout, bool fuseRelu)
+                       : Base(deviceId, inOutT, spatial, imageLayout), m_fuseRelu(fuseRelu)
+    {
+    }
+
+protected:
+    using Base::m_deviceId;
+    using Base::m_imageLayout;
+    using Base::m_inOutT;
+    using Base::m_spatial;
+
+    void EnsureCompatible() override
+    {
+        if (m_spatial && m_imageLayout == ImageLayoutKind::HWC)
+            InvalidArgument("CNTK batch normalization supports only cudnn(CHW) layout.");
+        if (m_deviceId >= 0)
+            LogicError("CPU batch normalization engine cannot be used on a GPU device.");
+    }
+
+    void ForwardCore(const Mat& in, const Mat& scale, const Mat& bias, bool inferenceOnly, double expAvgFactor, double blendFactor, Mat& runMean, Mat& runVariance,
+                     Mat& out, double epsilon, Mat& savedMean, Mat& savedInvStdDev) override
+    {
+        if (m_fuseRelu && !inferenceOnly)
+            LogicError("Batch normalization with fused ReLU is supported only for inference.");
+
+        int featureCount = (int)scale.GetNumRows();
+        int spatialSize = (int)(in.GetNumRows() / featureCount);
+        int batchSize = (int)in.GetNumCols();
+
+        // In inference mode the saved statistics are not produced, normalize with our own buffers.
+        ElemType* xMean;
+        ElemType* xInvStdDev;
+        if (inferenceOnly)
+        {
+            savedMean.Resize(0, 0);
+            savedInvStdDev.Resize(0, 0);
+            m_mean.resize(featureCount);
+            m_invStdDev.resize(featureCount);
+            xMean = m_mean.data();
+            xInvStdDev = m_invStdDev.data();
+        }
+        else
+        {
+            savedMean.Resize(runMean);
+            savedInvStdDev.Resize(runMean);
+            xMean = savedMean.Data();
+            xInvStdDev = savedInvStdDev.Data();
+        }
+
+        if (expAvgFactor == 0 && blendFactor == 1)
+        {
+            // Only the running statistics are used, no need to look at the minibatch.
+            const ElemType* rm = runMean.Data();
+            const ElemType* rv = runVariance.Data();
+            for (int f = 0; f < featureCount; f++)
+            {
+                xMean[f] = rm[f];
+                xInvStdDev[f] = (ElemType)(1.0 / std::sqrt(rv[f] + epsilon));
+            }
+        }
+        else
+        {
+            m_moments.resize(2 * featureCount);
+            double* mean = m_moments.data();
+            double* m2 = mean + featureCount;
+            BatchNormComputeMoments(in.Data(), featureCount, spatialSize, batchSize, mean, m2);
+            BatchNormUpdateStatistics(mean, m2, featureCount, (size_t)batchSize * spatialSize, expAvgFactor, blendFactor,
+                                      runMean.Data(), runVariance.Data(), epsilon, xMean, xInvStdDev);
+        }
+
+        m_coeffs.resize(2 * featureCount);
+        if (m_fuseRelu)
+            BatchNormNormalize<ElemType, true>(in.Data(), out.Data(), featureCount, spatialSize, batchSize, xMean, xInvStdDev, scale.Data(), bias.Data(), m_coeffs.data());
+        else
+            BatchNormNormalize<ElemType, false>(in.Data(), out.Data(), featureCount, spatialSize, batchSize, xMean, xInvStdDev, scale.Data(), bias.Data(), m_coeffs.data());
+    }
+
+    void BackwardCore(const Mat& in, const Mat& srcGrad, Mat& grad, const Mat& scale, double blendFactor, const Mat& savedMean, const Mat& savedInvStdDev,
+                      Mat& scaleGrad, Mat& biasGrad) override
+    {
+        int featureCount = (int)scale.GetNumRows();
+        int spatialSize = (int)(in.GetNumRows() / featureCount);
+        int batchSize = (int)in.GetNumCols();
+
+        BatchNormScaleAndBiasGradients(in.Data(), srcGrad.Data(), featureCount, spatialSize, batchSize,
+                                       savedMean.Data(), savedInvStdDev.Data(), scaleGrad.Data(), biasGrad.Data());
+
+        // Weight for the contribution of the minibatch statistics, 0 if only running statistics are used.
+        ElemType mbStatsWeight = (ElemType)(1 - blendFactor);
+        m_coeffs.resize(3 * featureCount);
+        BatchNormBackpropagateData(in.Data(), srcGrad.Data(), grad.Data(), featureCount, spatialSize, batchSize,
+                                   scale.Data(), mbStatsWeight, scaleGrad.Data(), biasGrad.Data(),
+                                   savedMean.Data(), savedInvStdDev.Data(), m_coeffs.data());
+    }
+
+private:
+    bool m_fuseRelu;
+    std::vector<ElemType> m_mean;
+    std::vector<ElemType> m_invStdDev;
+    std::vector<ElemType> m_coeffs;
+    std::vector<double> m_moments;
+};
+
+template class CpuBatchNormEngine<float>;
+template class CpuBatchNormEngine<double>;
+
 template <typename T> bool HasFlag(T src, T testFlag)
 {
     return ((int)src & (int)testFlag) != 0;
@@ -122,9 +240,20 @@ template <typename T> bool HasFlag(T src, T testFlag)
 template <class ElemType>
 std::unique_ptr<BatchNormEngine<ElemType>> BatchNormEngine<ElemType>::Create(DEVICEID_TYPE deviceId, const TensorShape& inOutT,
                                                                              bool spatial, ImageLayoutKind imageLayout,
-                                                                             BatchNormEngineKind enabledEngines)
+                                                                             BatchNormEngineKind enabledEngines, bool fuseRelu)
 {
-    // Use CNTK as default batch norm engine.
+    // Use CNTK as default batch norm engine. On CPU, it runs the fused kernels.
+    if (HasFlag(enabledEngines, BatchNormEngineKind::Cntk) && deviceId < 0)
+    {
+        if (GetMathLibTraceLevel() > 0)
+            fprintf(stderr, "Using CNTK fused CPU batch normalization engine.\n");
+
+        return std::make_unique<CpuBatchNormEngine<ElemType>>(deviceId, inOutT, spatial, imageLayout, fuseRelu);
+    }
+
+    if (fuseRelu)
+        InvalidArgument("Batch normalization with fused ReLU is supported only by the CNTK engine on CPU.");
+
     if (HasFlag(enabledEngines, BatchNormEngineKind::Cntk))
     {
         if (GetMathLibTraceLevel() > 0)
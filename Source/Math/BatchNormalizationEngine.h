@@ -40,9 +40,12 @@ public:
     void Backward(const Mat& in, const Mat& srcGrad, Mat& grad, const Mat& scale, double blendFactor, const Mat& saveMean, const Mat& saveInvStdDev,
                   Mat& scaleGrad, Mat& biasGrad);
 
+    // If fuseRelu is set, the engine applies ReLU to the normalized output. This is supported only
+    // by the CPU engine and only for inference, since the backpropagation does not see the output.
     static std::unique_ptr<BatchNormEngine<ElemType>> Create(DEVICEID_TYPE deviceId, const TensorShape& inOutT,
                                                              bool spatial, ImageLayoutKind imageLayout,
-                                                             BatchNormEngineKind enabledEngines = BatchNormEngineKind::All);
+                                                             BatchNormEngineKind enabledEngines = BatchNormEngineKind::All,
+                                                             bool fuseRelu = false);
 
     DISABLE_COPY_AND_MOVE(BatchNormEngine);
 
@@ -0,0 +1,300 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUBatchNormKernels.h : fused kernels of the CPU batch normalization engine
+//
+// A minibatch is a [vectorSize x batchSize] column-major matrix. For spatial batch normalization
+// the vector is [spatialSize x featureCount] (CHW layout, the channel is the outermost dimension),
+// otherwise spatialSize is 1 and every element of the vector is a feature of its own.
+//
+// Forward makes two passes over the data: the first one computes the mean and variance of all
+// features at once (Welford per chunk, merged with the parallel algorithm of Chan et al), the
+// second one normalizes, scales, shifts and optionally applies ReLU. Backward makes two passes
+// as well: the first one reduces the scale and bias gradients, the second one adds the data
+// gradient. All passes are threaded across features (channels) or samples and vectorize along
+// the innermost, contiguous dimension.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Number of non-spatial features reduced by one thread at a time.
+static const int BatchNormFeatureBlock = 64;
+
+// -----------------------------------------------------------------------
+// statistics
+// -----------------------------------------------------------------------
+
+// Computes the mean and the sum of squared deviations (m2) of every feature over the minibatch.
+template <class ElemType>
+void BatchNormComputeMoments(const ElemType* x, int featureCount, int spatialSize, int batchSize, double* mean, double* m2)
+{
+    size_t vectorSize = (size_t)featureCount * spatialSize;
+    if (spatialSize == 1)
+    {
+        // Feature blocks go to threads, the samples are accumulated with Welford's algorithm.
+        int numBlocks = (featureCount + BatchNormFeatureBlock - 1) / BatchNormFeatureBlock;
+#pragma omp parallel for
+        for (int ib = 0; ib < numBlocks; ib++)
+        {
+            int f0 = ib * BatchNormFeatureBlock;
+            int count = std::min(BatchNormFeatureBlock, featureCount - f0);
+            ElemType m[BatchNormFeatureBlock];
+            ElemType s[BatchNormFeatureBlock];
+            std::fill(m, m + count, (ElemType)0);
+            std::fill(s, s + count, (ElemType)0);
+            for (int n = 0; n < batchSize; n++)
+            {
+                const ElemType* px = x + n * vectorSize + f0;
+                ElemType invN = (ElemType)1 / (n + 1);
+                for (int k = 0; k < count; k++)
+                {
+                    ElemType d = px[k] - m[k];
+                    m[k] += d * invN;
+                    s[k] += d * (px[k] - m[k]);
+                }
+            }
+            for (int k = 0; k < count; k++)
+            {
+                mean[f0 + k] = m[k];
+                m2[f0 + k] = s[k];
+            }
+        }
+        return;
+    }
+
+    // Channels go to threads. The moments of a channel of a sample are computed in two passes over
+    // the (cached) chunk and merged into the running moments of the channel.
+#pragma omp parallel for
+    for (int c = 0; c < featureCount; c++)
+    {
+        double m = 0;
+        double s = 0;
+        for (int n = 0; n < batchSize; n++)
+        {
+            const ElemType* px = x + n * vectorSize + (size_t)c * spatialSize;
+            ElemType sum = 0;
+            for (int i = 0; i < spatialSize; i++)
+                sum += px[i];
+            ElemType chunkMean = sum / spatialSize;
+            ElemType chunkM2 = 0;
+            for (int i = 0; i < spatialSize; i++)
+            {
+                ElemType d = px[i] - chunkMean;
+                chunkM2 += d * d;
+            }
+            double d = chunkMean - m;
+            double total = (double)(n + 1) * spatialSize;
+            double scaled = d * spatialSize / total;
+            m += scaled;
+            s += chunkM2 + d * ((double)n * spatialSize) * scaled;
+        }
+        mean[c] = m;
+        m2[c] = s;
+    }
+}
+
+// Turns the moments into the mean and inverse standard deviation used for normalization and updates
+// the running statistics, with the same averaging and blending rules as the GPU implementation:
+//     runMean     = expAvgFactor * batch mean + (1 - expAvgFactor) * runMean
+//     runVariance = expAvgFactor * unbiased batch variance + (1 - expAvgFactor) * runVariance
+//     xMean       = blendFactor * runMean + (1 - blendFactor) * batch mean
+//     xInvStdDev  = blendFactor / sqrt(runVariance + eps) + (1 - blendFactor) / sqrt(batch variance + eps)
+template <class ElemType>
+void BatchNormUpdateStatistics(const double* mean, const double* m2, int featureCount, size_t count, double expAvgFactor, double blendFactor,
+                               ElemType* runMean, ElemType* runVariance, double epsilon, ElemType* xMean, ElemType* xInvStdDev)
+{
+    for (int f = 0; f < featureCount; f++)
+    {
+        runMean[f] = (ElemType)(expAvgFactor * mean[f] + (1.0 - expAvgFactor) * runMean[f]);
+        xMean[f] = (ElemType)(blendFactor * runMean[f] + (1.0 - blendFactor) * mean[f]);
+
+        double unbiased = count == 1 ? 0 : m2[f] / (count - 1);
+        runVariance[f] = (ElemType)(expAvgFactor * unbiased + (1.0 - expAvgFactor) * runVariance[f]);
+        double invStdDev = 1.0 / std::sqrt(m2[f] / count + epsilon);
+        if (blendFactor != 0)
+            invStdDev = blendFactor / std::sqrt(runVariance[f] + epsilon) + (1.0 - blendFactor) * invStdDev;
+        xInvStdDev[f] = (ElemType)invStdDev;
+    }
+}
+
+// -----------------------------------------------------------------------
+// normalization
+// -----------------------------------------------------------------------
+
+// out = (x - mean) * invStdDev * scale + bias, followed by ReLU if requested. coeffs must hold 2 * featureCount elements.
+template <class ElemType, bool Relu>
+void BatchNormNormalize(const ElemType* x, ElemType* out, int featureCount, int spatialSize, int batchSize,
+                        const ElemType* mean, const ElemType* invStdDev, const ElemType* scale, const ElemType* bias, ElemType* coeffs)
+{
+    // Fold the statistics into a single multiply-add per element.
+    ElemType* a = coeffs;
+    ElemType* b = coeffs + featureCount;
+    for (int f = 0; f < featureCount; f++)
+    {
+        a[f] = scale[f] * invStdDev[f];
+        b[f] = bias[f] - mean[f] * a[f];
+    }
+
+    size_t vectorSize = (size_t)featureCount * spatialSize;
+    if (spatialSize == 1)
+    {
+#pragma omp parallel for
+        for (int n = 0; n < batchSize; n++)
+        {
+            const ElemType* px = x + n * vectorSize;
+            ElemType* py = out + n * vectorSize;
+            for (int f = 0; f < featureCount; f++)
+            {
+                ElemType y = px[f] * a[f] + b[f];
+                py[f] = Relu ? std::max(y, (ElemType)0) : y;
+            }
+        }
+        return;
+    }
+
+    int numChunks = batchSize * featureCount;
+#pragma omp parallel for
+    for (int i = 0; i < numChunks; i++)
+    {
+        int c = i % featureCount;
+        size_t offset = (size_t)i * spatialSize;
+        const ElemType* px = x + offset;
+        ElemType* py = out + offset;
+        ElemType ac = a[c];
+        ElemType bc = b[c];
+        for (int k = 0; k < spatialSize; k++)
+        {
+            ElemType y = px[k] * ac + bc;
+            py[k] = Relu ? std::max(y, (ElemType)0) : y;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------
+// backpropagation
+// -----------------------------------------------------------------------
+
+// Computes scaleGrad = sum(dy * xHat) and biasGrad = sum(dy) per feature, overwriting them.
+template <class ElemType>
+void BatchNormScaleAndBiasGradients(const ElemType* x, const ElemType* dy, int featureCount, int spatialSize, int batchSize,
+                                    const ElemType* mean, const ElemType* invStdDev, ElemType* scaleGrad, ElemType* biasGrad)
+{
+    size_t vectorSize = (size_t)featureCount * spatialSize;
+    if (spatialSize == 1)
+    {
+        int numBlocks = (featureCount + BatchNormFeatureBlock - 1) / BatchNormFeatureBlock;
+#pragma omp parallel for
+        for (int ib = 0; ib < numBlocks; ib++)
+        {
+            int f0 = ib * BatchNormFeatureBlock;
+            int count = std::min(BatchNormFeatureBlock, featureCount - f0);
+            ElemType ds[BatchNormFeatureBlock];
+            ElemType db[BatchNormFeatureBlock];
+            std::fill(ds, ds + count, (ElemType)0);
+            std::fill(db, db + count, (ElemType)0);
+            const ElemType* m = mean + f0;
+            for (int n = 0; n < batchSize; n++)
+            {
+                const ElemType* px = x + n * vectorSize + f0;
+                const ElemType* pdy = dy + n * vectorSize + f0;
+                for (int k = 0; k < count; k++)
+                {
+                    ds[k] += pdy[k] * (px[k] - m[k]);
+                    db[k] += pdy[k];
+                }
+            }
+            for (int k = 0; k < count; k++)
+            {
+                scaleGrad[f0 + k] = ds[k] * invStdDev[f0 + k];
+                biasGrad[f0 + k] = db[k];
+            }
+        }
+        return;
+    }
+
+#pragma omp parallel for
+    for (int c = 0; c < featureCount; c++)
+    {
+        ElemType mc = mean[c];
+        double ds = 0;
+        double db = 0;
+        for (int n = 0; n < batchSize; n++)
+        {
+            size_t offset = n * vectorSize + (size_t)c * spatialSize;
+            const ElemType* px = x + offset;
+            const ElemType* pdy = dy + offset;
+            ElemType chunkDs = 0;
+            ElemType chunkDb = 0;
+            for (int k = 0; k < spatialSize; k++)
+            {
+                chunkDs += pdy[k] * (px[k] - mc);
+                chunkDb += pdy[k];
+            }
+            ds += chunkDs;
+            db += chunkDb;
+        }
+        scaleGrad[c] = (ElemType)(ds * invStdDev[c]);
+        biasGrad[c] = (ElemType)db;
+    }
+}
+
+// Adds the data gradient
+//     dx += scale * invStdDev * (dy - mbStatsWeight * (xHat * scaleGrad + biasGrad) / m)
+// where m is the number of values per feature. coeffs must hold 3 * featureCount elements.
+template <class ElemType>
+void BatchNormBackpropagateData(const ElemType* x, const ElemType* dy, ElemType* dx, int featureCount, int spatialSize, int batchSize,
+                                const ElemType* scale, ElemType mbStatsWeight, const ElemType* scaleGrad, const ElemType* biasGrad,
+                                const ElemType* mean, const ElemType* invStdDev, ElemType* coeffs)
+{
+    // Expand into dx += a * dy - c1 * x + c0 per element.
+    ElemType* a = coeffs;
+    ElemType* c1 = coeffs + featureCount;
+    ElemType* c0 = coeffs + 2 * featureCount;
+    ElemType invM = (ElemType)1 / ((ElemType)batchSize * spatialSize);
+    for (int f = 0; f < featureCount; f++)
+    {
+        a[f] = scale[f] * invStdDev[f];
+        c1[f] = a[f] * mbStatsWeight * invStdDev[f] * scaleGrad[f] * invM;
+        c0[f] = c1[f] * mean[f] - a[f] * mbStatsWeight * biasGrad[f] * invM;
+    }
+
+    size_t vectorSize = (size_t)featureCount * spatialSize;
+    if (spatialSize == 1)
+    {
+#pragma omp parallel for
+        for (int n = 0; n < batchSize; n++)
+        {
+            size_t offset = n * vectorSize;
+            const ElemType* px = x + offset;
+            const ElemType* pdy = dy + offset;
+            ElemType* pdx = dx + offset;
+            for (int f = 0; f < featureCount; f++)
+                pdx[f] += a[f] * pdy[f] - c1[f] * px[f] + c0[f];
+        }
+        return;
+    }
+
+    int numChunks = batchSize * featureCount;
+#pragma omp parallel for
+    for (int i = 0; i < numChunks; i++)
+    {
+        int c = i % featureCount;
+        size_t offset = (size_t)i * spatialSize;
+        const ElemType* px = x + offset;
+        const ElemType* pdy = dy + offset;
+        ElemType* pdx = dx + offset;
+        ElemType ac = a[c];
+        ElemType c1c = c1[c];
+        ElemType c0c = c0[c];
+        for (int k = 0; k < spatialSize; k++)
+            pdx[k] += ac * pdy[k] - c1c * px[k] + c0c;
+    }
+}
+
+}}}
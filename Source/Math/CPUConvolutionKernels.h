@@ -0,0 +1,565 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUConvolutionKernels.h : direct and Winograd kernels of the CPU convolution engines
+//
+// The kernels work on 2D convolutions with full sharing in CNTK's CHW layout, i.e. a sample is a
+// column of [W x H x C] elements and the weights are a [kW x kH x C] x K matrix. Unlike the GEMM
+// engine they don't unroll the input, so their workspace is at most a few times the size of a sample
+// instead of kW * kH times.
+//
+// The direct kernels keep activations in the CHW layout and repack the weights (and, for the kernel
+// gradient, the output gradient) into a channel-blocked layout where ConvChannelBlock consecutive
+// output (or input) channels are innermost. The innermost loops then run over a block of channels
+// with the same input value, which compilers vectorize, and accumulate a few output columns at a
+// time in registers.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Sizes of a 2D convolution. Pads are the (possibly negative) offsets of the first kernel application,
+// i.e. output (x, y) reads inputs from (x * strideW - padW, y * strideH - padH) onwards.
+struct ConvolutionDims2D
+{
+    int inW, inH, inC;
+    int outW, outH, outC;
+    int kW, kH;
+    int strideW, strideH;
+    int padW, padH;
+
+    size_t InSize() const { return (size_t)inW * inH * inC; }
+    size_t OutSize() const { return (size_t)outW * outH * outC; }
+    size_t KernelSize() const { return (size_t)kW * kH * inC; }
+};
+
+// Number of channels in a block of the blocked layouts, a 256-bit register.
+template <class ElemType>
+struct ConvChannelBlock
+{
+    static const int Size = 32 / sizeof(ElemType);
+};
+
+// Number of output columns accumulated at a time by the direct forward kernel.
+static const int ConvRegisterBlockW = 4;
+
+static inline int ConvNumBlocks(int n, int blockSize)
+{
+    return (n + blockSize - 1) / blockSize;
+}
+
+// -----------------------------------------------------------------------
+// weight packing
+// -----------------------------------------------------------------------
+
+// Repacks the weights into [ConvNumBlocks(V)][O][kH][kW][ConvChannelBlock] where V is the vectorized channel dimension
+// and O the other one: V = K (output maps) and O = C for the forward pass, V = C and O = K for the data gradient.
+// Channels past the end of the last block are zero.
+template <class ElemType>
+void PackConvolutionKernel(const ConvolutionDims2D& d, const ElemType* kernel, bool vectorizeInputChannels, ElemType* packed)
+{
+    const int cb = ConvChannelBlock<ElemType>::Size;
+    int numV = vectorizeInputChannels ? d.inC : d.outC;
+    int numO = vectorizeInputChannels ? d.outC : d.inC;
+    int numBlocks = ConvNumBlocks(numV, cb);
+    size_t kernelSize = d.KernelSize();
+
+#pragma omp parallel for
+    for (int vb = 0; vb < numBlocks; vb++)
+    {
+        for (int o = 0; o < numO; o++)
+        {
+            for (int ky = 0; ky < d.kH; ky++)
+            {
+                for (int kx = 0; kx < d.kW; kx++)
+                {
+                    ElemType* dst = packed + ((((size_t)vb * numO + o) * d.kH + ky) * d.kW + kx) * cb;
+                    for (int j = 0; j < cb; j++)
+                    {
+                        int v = vb * cb + j;
+                        int k = vectorizeInputChannels ? o : v;
+                        int c = vectorizeInputChannels ? v : o;
+                        dst[j] = v < numV ? kernel[k * kernelSize + kx + d.kW * (ky + (size_t)d.kH * c)] : 0;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// -----------------------------------------------------------------------
+// direct convolution
+// -----------------------------------------------------------------------
+
+// Accumulates numCols (up to ConvRegisterBlockW) consecutive output columns of one row of one block of output maps.
+// Checked is false if all inputs read by the block are inside the image, which skips the bounds checks.
+template <class ElemType, bool Checked>
+static inline void DirectConvolutionForwardBlock(const ConvolutionDims2D& d, const ElemType* packedKernel, const ElemType* in,
+                                                 int kb, int oy, int ox0, int numCols, ElemType (&acc)[ConvRegisterBlockW][ConvChannelBlock<ElemType>::Size])
+{
+    const int cb = ConvChannelBlock<ElemType>::Size;
+    // A local accumulator stays in registers, acc is only written at the end.
+    ElemType sum[ConvRegisterBlockW][ConvChannelBlock<ElemType>::Size] = {};
+
+    int iy0 = oy * d.strideH - d.padH;
+    int kyBegin = std::max(0, -iy0);
+    int kyEnd = std::min(d.kH, d.inH - iy0);
+    for (int c = 0; c < d.inC; c++)
+    {
+        const ElemType* plane = in + (size_t)c * d.inW * d.inH;
+        for (int ky = kyBegin; ky < kyEnd; ky++)
+        {
+            const ElemType* row = plane + (size_t)(iy0 + ky) * d.inW;
+            const ElemType* w = packedKernel + ((((size_t)kb * d.inC + c) * d.kH + ky) * d.kW) * cb;
+            for (int kx = 0; kx < d.kW; kx++, w += cb)
+            {
+                const ElemType* src = row + ox0 * d.strideW - d.padW + kx;
+                for (int r = 0; r < ConvRegisterBlockW; r++)
+                {
+                    ElemType v;
+                    if (Checked)
+                    {
+                        int ix = (ox0 + r) * d.strideW - d.padW + kx;
+                        v = r < numCols && ix >= 0 && ix < d.inW ? row[ix] : 0;
+                    }
+                    else
+                        v = src[r * d.strideW];
+                    for (int j = 0; j < cb; j++)
+                        sum[r][j] += v * w[j];
+                }
+            }
+        }
+    }
+
+    for (int r = 0; r < ConvRegisterBlockW; r++)
+        for (int j = 0; j < cb; j++)
+            acc[r][j] = sum[r][j];
+}
+
+// out = convolution of in with the kernel packed by PackConvolutionKernel(d, kernel, false, packedKernel).
+template <class ElemType>
+void DirectConvolutionForward(const ConvolutionDims2D& d, const ElemType* packedKernel, const ElemType* in, ElemType* out, int batchSize)
+{
+    const int cb = ConvChannelBlock<ElemType>::Size;
+    const int rw = ConvRegisterBlockW;
+    int numKBlocks = ConvNumBlocks(d.outC, cb);
+    int numTasks = batchSize * numKBlocks * d.outH;
+
+#pragma omp parallel for
+    for (int task = 0; task < numTasks; task++)
+    {
+        int oy = task % d.outH;
+        int kb = (task / d.outH) % numKBlocks;
+        int n = task / (d.outH * numKBlocks);
+        const ElemType* inSample = in + n * d.InSize();
+        ElemType* outSample = out + n * d.OutSize();
+        int numK = std::min(cb, d.outC - kb * cb);
+
+        ElemType acc[rw][cb];
+        for (int ox0 = 0; ox0 < d.outW; ox0 += rw)
+        {
+            int numCols = std::min(rw, d.outW - ox0);
+            int ixFirst = ox0 * d.strideW - d.padW;
+            int ixLast = (ox0 + rw - 1) * d.strideW - d.padW + d.kW - 1;
+            if (numCols == rw && ixFirst >= 0 && ixLast < d.inW)
+                DirectConvolutionForwardBlock<ElemType, false>(d, packedKernel, inSample, kb, oy, ox0, numCols, acc);
+            else
+                DirectConvolutionForwardBlock<ElemType, true>(d, packedKernel, inSample, kb, oy, ox0, numCols, acc);
+
+            for (int j = 0; j < numK; j++)
+            {
+                ElemType* dst = outSample + ((size_t)(kb * cb + j) * d.outH + oy) * d.outW + ox0;
+                for (int r = 0; r < numCols; r++)
+                    dst[r] = acc[r][j];
+            }
+        }
+    }
+}
+
+// grad += data gradient of the convolution, the kernel is packed by PackConvolutionKernel(d, kernel, true, packedKernel).
+// Each task scatters the output gradient of one sample into one block of input channels of a local blocked buffer.
+template <class ElemType>
+void DirectConvolutionBackwardData(const ConvolutionDims2D& d, const ElemType* packedKernel, const ElemType* srcGrad, ElemType* grad, int batchSize)
+{
+    const int cb = ConvChannelBlock<ElemType>::Size;
+    int numCBlocks = ConvNumBlocks(d.inC, cb);
+    int numTasks = batchSize * numCBlocks;
+    size_t planeSize = (size_t)d.inW * d.inH;
+
+#pragma omp parallel
+    {
+        std::vector<ElemType> buffer(planeSize * cb);
+#pragma omp for
+        for (int task = 0; task < numTasks; task++)
+        {
+            int cBlock = task % numCBlocks;
+            int n = task / numCBlocks;
+            const ElemType* srcGradSample = srcGrad + n * d.OutSize();
+            ElemType* gradSample = grad + n * d.InSize();
+            std::fill(buffer.begin(), buffer.end(), (ElemType)0);
+
+            for (int k = 0; k < d.outC; k++)
+            {
+                const ElemType* wk = packedKernel + (((size_t)cBlock * d.outC + k) * d.kH * d.kW) * cb;
+                for (int oy = 0; oy < d.outH; oy++)
+                {
+                    int iy0 = oy * d.strideH - d.padH;
+                    int kyBegin = std::max(0, -iy0);
+                    int kyEnd = std::min(d.kH, d.inH - iy0);
+                    const ElemType* srcRow = srcGradSample + ((size_t)k * d.outH + oy) * d.outW;
+                    for (int ox = 0; ox < d.outW; ox++)
+                    {
+                        ElemType g = srcRow[ox];
+                        if (g == 0)
+                            continue;
+                        int ix0 = ox * d.strideW - d.padW;
+                        int kxBegin = std::max(0, -ix0);
+                        int kxEnd = std::min(d.kW, d.inW - ix0);
+                        for (int ky = kyBegin; ky < kyEnd; ky++)
+                        {
+                            const ElemType* w = wk + ((size_t)ky * d.kW + kxBegin) * cb;
+                            ElemType* dst = buffer.data() + ((size_t)(iy0 + ky) * d.inW + ix0 + kxBegin) * cb;
+                            for (int kx = kxBegin; kx < kxEnd; kx++, w += cb, dst += cb)
+                                for (int j = 0; j < cb; j++)
+                                    dst[j] += g * w[j];
+                        }
+                    }
+                }
+            }
+
+            int numC = std::min(cb, d.inC - cBlock * cb);
+            for (int j = 0; j < numC; j++)
+            {
+                ElemType* dst = gradSample + (size_t)(cBlock * cb + j) * planeSize;
+                for (size_t i = 0; i < planeSize; i++)
+                    dst[i] += buffer[i * cb + j];
+            }
+        }
+    }
+}
+
+// Repacks the output gradient into [batchSize][ConvNumBlocks(K)][outH][outW][ConvChannelBlock] for DirectConvolutionBackwardKernel.
+template <class ElemType>
+void PackConvolutionOutput(const ConvolutionDims2D& d, const ElemType* srcGrad, ElemType* packed, int batchSize)
+{
+    const int cb = ConvChannelBlock<ElemType>::Size;
+    int numKBlocks = ConvNumBlocks(d.outC, cb);
+    size_t planeSize = (size_t)d.outW * d.outH;
+    int numTasks = batchSize * numKBlocks;
+
+#pragma omp parallel for
+    for (int task = 0; task < numTasks; task++)
+    {
+        int kb = task % numKBlocks;
+        int n = task / numKBlocks;
+        const ElemType* src = srcGrad + n * d.OutSize();
+        ElemType* dst = packed + (size_t)task * planeSize * cb;
+        for (size_t i = 0; i < planeSize; i++)
+        {
+            for (int j = 0; j < cb; j++)
+            {
+                int k = kb * cb + j;
+                dst[i * cb + j] = k < d.outC ? src[k * planeSize + i] : 0;
+            }
+        }
+    }
+}
+
+// kernelGrad += kernel gradient of the convolution, the output gradient is packed by PackConvolutionOutput.
+// Each task owns one input channel of one block of output maps, so the accumulation needs no synchronization.
+template <class ElemType>
+void DirectConvolutionBackwardKernel(const ConvolutionDims2D& d, const ElemType* packedSrcGrad, const ElemType* in, ElemType* kernelGrad, int batchSize)
+{
+    const int cb = ConvChannelBlock<ElemType>::Size;
+    int numKBlocks = ConvNumBlocks(d.outC, cb);
+    int numTasks = numKBlocks * d.inC;
+    size_t kernelSize = d.KernelSize();
+    size_t outPlaneSize = (size_t)d.outW * d.outH;
+
+#pragma omp parallel
+    {
+        std::vector<ElemType> acc((size_t)d.kH * d.kW * cb);
+#pragma omp for
+        for (int task = 0; task < numTasks; task++)
+        {
+            int c = task % d.inC;
+            int kb = task / d.inC;
+            std::fill(acc.begin(), acc.end(), (ElemType)0);
+
+            for (int n = 0; n < batchSize; n++)
+            {
+                const ElemType* plane = in + n * d.InSize() + (size_t)c * d.inW * d.inH;
+                const ElemType* srcGradBlock = packedSrcGrad + ((size_t)n * numKBlocks + kb) * outPlaneSize * cb;
+                for (int oy = 0; oy < d.outH; oy++)
+                {
+                    int iy0 = oy * d.strideH - d.padH;
+                    int kyBegin = std::max(0, -iy0);
+                    int kyEnd = std::min(d.kH, d.inH - iy0);
+                    for (int ox = 0; ox < d.outW; ox++)
+                    {
+                        const ElemType* s = srcGradBlock + ((size_t)oy * d.outW + ox) * cb;
+                        int ix0 = ox * d.strideW - d.padW;
+                        int kxBegin = std::max(0, -ix0);
+                        int kxEnd = std::min(d.kW, d.inW - ix0);
+                        for (int ky = kyBegin; ky < kyEnd; ky++)
+                        {
+                            const ElemType* row = plane + (size_t)(iy0 + ky) * d.inW + ix0;
+                            ElemType* a = acc.data() + (size_t)ky * d.kW * cb;
+                            for (int kx = kxBegin; kx < kxEnd; kx++)
+                            {
+                                ElemType v = row[kx];
+                                for (int j = 0; j < cb; j++)
+                                    a[kx * cb + j] += v * s[j];
+                            }
+                        }
+                    }
+                }
+            }
+
+            int numK = std::min(cb, d.outC - kb * cb);
+            for (int j = 0; j < numK; j++)
+            {
+                ElemType* dst = kernelGrad + (kb * cb + j) * kernelSize + (size_t)c * d.kW * d.kH;
+                for (int ky = 0; ky < d.kH; ky++)
+                    for (int kx = 0; kx < d.kW; kx++)
+                        dst[kx + d.kW * ky] += acc[((size_t)ky * d.kW + kx) * cb + j];
+            }
+        }
+    }
+}
+
+// -----------------------------------------------------------------------
+// Winograd convolution
+// -----------------------------------------------------------------------
+
+// Transforms of the minimal filtering algorithm F(M x M, 3 x 3) (Lavin and Gray, Fast Algorithms for Convolutional
+// Neural Networks): out = AT * [(G * g * GT) .* (BT * in * B)] * A for an input tile of (M + 2) x (M + 2)
+// and an output tile of M x M. The products of the transformed tiles over the input channels are GEMMs.
+template <int M>
+struct WinogradTransform;
+
+template <>
+struct WinogradTransform<2>
+{
+    static const int Alpha = 4;
+    static const double* BT()
+    {
+        static const double bt[4 * 4] = {
+            1,  0, -1,  0,
+            0,  1,  1,  0,
+            0, -1,  1,  0,
+            0,  1,  0, -1 };
+        return bt;
+    }
+    static const double* G()
+    {
+        static const double g[4 * 3] = {
+            1,    0,   0,
+            0.5, 0.5,  0.5,
+            0.5, -0.5, 0.5,
+            0,    0,   1 };
+        return g;
+    }
+    static const double* AT()
+    {
+        static const double at[2 * 4] = {
+            1, 1,  1,  0,
+            0, 1, -1, -1 };
+        return at;
+    }
+};
+
+template <>
+struct WinogradTransform<4>
+{
+    static const int Alpha = 6;
+    static const double* BT()
+    {
+        static const double bt[6 * 6] = {
+            4,  0, -5,  0, 1, 0,
+            0, -4, -4,  1, 1, 0,
+            0,  4, -4, -1, 1, 0,
+            0, -2, -1,  2, 1, 0,
+            0,  2, -1, -2, 1, 0,
+            0,  4,  0, -5, 0, 1 };
+        return bt;
+    }
+    static const double* G()
+    {
+        static const double g[6 * 3] = {
+            1.0 / 4,   0,          0,
+            -1.0 / 6,  -1.0 / 6,  -1.0 / 6,
+            -1.0 / 6,  1.0 / 6,   -1.0 / 6,
+            1.0 / 24,  1.0 / 12,  1.0 / 6,
+            1.0 / 24,  -1.0 / 12, 1.0 / 6,
+            0,          0,          1 };
+        return g;
+    }
+    static const double* AT()
+    {
+        static const double at[4 * 6] = {
+            1, 1,  1, 1,  1, 0,
+            0, 1, -1, 2, -2, 0,
+            0, 1,  1, 4,  4, 0,
+            0, 1, -1, 8, -8, 1 };
+        return at;
+    }
+};
+
+// Number of M x M output tiles of one sample.
+template <int M>
+int WinogradNumTiles(const ConvolutionDims2D& d)
+{
+    return ConvNumBlocks(d.outW, M) * ConvNumBlocks(d.outH, M);
+}
+
+// U[xi] = (G * g * GT)[xi] for all pairs of output map k and input channel c, stored as Alpha^2 column-major [outC x inC] matrices.
+// With flip, d describes the data gradient convolution of a 3 x 3 stride 1 convolution with the given kernel:
+// its input and output channels are swapped and the kernel is rotated by 180 degrees.
+template <int M, class ElemType>
+void WinogradKernelTransform(const ConvolutionDims2D& d, const ElemType* kernel, bool flip, ElemType* U)
+{
+    typedef WinogradTransform<M> T;
+    const int alpha = T::Alpha;
+    ElemType G[alpha * 3];
+    std::copy(T::G(), T::G() + alpha * 3, G);
+    size_t matrixSize = (size_t)d.outC * d.inC;
+    int numPairs = d.outC * d.inC;
+
+#pragma omp parallel for
+    for (int pair = 0; pair < numPairs; pair++)
+    {
+        int k = pair % d.outC;
+        int c = pair / d.outC;
+        // Weights of the original convolution are [3 x 3 x C] x K.
+        const ElemType* w = flip ? kernel + (size_t)c * 9 * d.outC + (size_t)k * 9 : kernel + (size_t)k * 9 * d.inC + (size_t)c * 9;
+        ElemType g[3][3];
+        for (int y = 0; y < 3; y++)
+            for (int x = 0; x < 3; x++)
+                g[y][x] = flip ? w[(2 - x) + 3 * (2 - y)] : w[x + 3 * y];
+
+        ElemType gGT[3][alpha];
+        for (int y = 0; y < 3; y++)
+            for (int j = 0; j < alpha; j++)
+                gGT[y][j] = g[y][0] * G[j * 3] + g[y][1] * G[j * 3 + 1] + g[y][2] * G[j * 3 + 2];
+
+        for (int i = 0; i < alpha; i++)
+            for (int j = 0; j < alpha; j++)
+                U[(i * alpha + j) * matrixSize + pair] = G[i * 3] * gGT[0][j] + G[i * 3 + 1] * gGT[1][j] + G[i * 3 + 2] * gGT[2][j];
+    }
+}
+
+// V[xi] = (BT * tile * B)[xi] for all input tiles of batchSize samples, stored as Alpha^2 column-major [inC x numTiles * batchSize] matrices.
+template <int M, class ElemType>
+void WinogradInputTransform(const ConvolutionDims2D& d, const ElemType* in, ElemType* V, int batchSize)
+{
+    typedef WinogradTransform<M> T;
+    const int alpha = T::Alpha;
+    ElemType BT[alpha * alpha];
+    std::copy(T::BT(), T::BT() + alpha * alpha, BT);
+    int tilesW = ConvNumBlocks(d.outW, M);
+    int numTiles = WinogradNumTiles<M>(d) * batchSize;
+    size_t matrixSize = (size_t)d.inC * numTiles;
+
+#pragma omp parallel for
+    for (int tile = 0; tile < numTiles; tile++)
+    {
+        int n = tile / WinogradNumTiles<M>(d);
+        int t = tile % WinogradNumTiles<M>(d);
+        int y0 = (t / tilesW) * M - d.padH;
+        int x0 = (t % tilesW) * M - d.padW;
+        for (int c = 0; c < d.inC; c++)
+        {
+            const ElemType* plane = in + n * d.InSize() + (size_t)c * d.inW * d.inH;
+            ElemType tileIn[alpha][alpha];
+            for (int i = 0; i < alpha; i++)
+            {
+                int y = y0 + i;
+                for (int j = 0; j < alpha; j++)
+                {
+                    int x = x0 + j;
+                    tileIn[i][j] = y >= 0 && y < d.inH && x >= 0 && x < d.inW ? plane[(size_t)y * d.inW + x] : 0;
+                }
+            }
+
+            ElemType BTd[alpha][alpha];
+            for (int i = 0; i < alpha; i++)
+                for (int j = 0; j < alpha; j++)
+                {
+                    ElemType sum = 0;
+                    for (int l = 0; l < alpha; l++)
+                        sum += BT[i * alpha + l] * tileIn[l][j];
+                    BTd[i][j] = sum;
+                }
+
+            for (int i = 0; i < alpha; i++)
+                for (int j = 0; j < alpha; j++)
+                {
+                    ElemType sum = 0;
+                    for (int l = 0; l < alpha; l++)
+                        sum += BTd[i][l] * BT[j * alpha + l];
+                    V[(i * alpha + j) * matrixSize + (size_t)tile * d.inC + c] = sum;
+                }
+        }
+    }
+}
+
+// out = (or +=, with accumulate) (AT * m * A) for the Alpha^2 column-major [outC x numTiles * batchSize] products m = U * V.
+template <int M, class ElemType>
+void WinogradOutputTransform(const ConvolutionDims2D& d, const ElemType* product, ElemType* out, int batchSize, bool accumulate)
+{
+    typedef WinogradTransform<M> T;
+    const int alpha = T::Alpha;
+    ElemType AT[M * alpha];
+    std::copy(T::AT(), T::AT() + M * alpha, AT);
+    int tilesW = ConvNumBlocks(d.outW, M);
+    int numTiles = WinogradNumTiles<M>(d) * batchSize;
+    size_t matrixSize = (size_t)d.outC * numTiles;
+
+#pragma omp parallel for
+    for (int tile = 0; tile < numTiles; tile++)
+    {
+        int n = tile / WinogradNumTiles<M>(d);
+        int t = tile % WinogradNumTiles<M>(d);
+        int y0 = (t / tilesW) * M;
+        int x0 = (t % tilesW) * M;
+        int numRows = std::min(M, d.outH - y0);
+        int numCols = std::min(M, d.outW - x0);
+        for (int k = 0; k < d.outC; k++)
+        {
+            ElemType m[alpha][alpha];
+            for (int i = 0; i < alpha; i++)
+                for (int j = 0; j < alpha; j++)
+                    m[i][j] = product[(i * alpha + j) * matrixSize + (size_t)tile * d.outC + k];
+
+            ElemType ATm[M][alpha];
+            for (int i = 0; i < M; i++)
+                for (int j = 0; j < alpha; j++)
+                {
+                    ElemType sum = 0;
+                    for (int l = 0; l < alpha; l++)
+                        sum += AT[i * alpha + l] * m[l][j];
+                    ATm[i][j] = sum;
+                }
+
+            ElemType* plane = out + n * d.OutSize() + (size_t)k * d.outW * d.outH;
+            for (int i = 0; i < numRows; i++)
+                for (int j = 0; j < numCols; j++)
+                {
+                    ElemType sum = 0;
+                    for (int l = 0; l < alpha; l++)
+                        sum += ATm[i][l] * AT[j * alpha + l];
+                    ElemType& dst = plane[(size_t)(y0 + i) * d.outW + x0 + j];
+                    dst = accumulate ? dst + sum : sum;
+                }
+        }
+    }
+}
+
+}}}
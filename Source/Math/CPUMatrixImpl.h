@@ -12,6 +12,10 @@
 
 #include "CPUMatrix.h"
 #include "TensorOps.h"
+#include "CPUTensorOpKernels.h"
+#include "CPURNN.h"
+#include "CPUThreadPool.h"
+#include "LowPrecision.h"
 #include <assert.h>
 #include <stdexcept>
 #include <omp.h>
@@ -117,7 +121,10 @@ static ElemType* NewArray(size_t n)
     // number gaussians on the GPU is not supported so we must always 
     // generate an even number. So since we wouldn't know how to update the tally
     // we are making this allocate one more element in the worst case.
-    ElemType* p = new ElemType[AsMultipleOf(n, 2)]();
+    // The buffer is zeroed by the thread pool, so that its pages are placed on the NUMA nodes that will compute on them.
+    size_t numElements = AsMultipleOf(n, 2);
+    ElemType* p = new ElemType[numElements];
+    CPUThreadPool::Instance().ZeroFill(p, numElements * sizeof(ElemType));
 #if 0 // _DEBUG
         ElemType nan = Matrix<ElemType>::MakeNan(__LINE__);
         for (size_t i = 0; i < n; i++)
@@ -875,12 +882,14 @@ void CPUMatrix<ElemType>::SetValue(const size_t numRows, const size_t numCols, E
     if (matrixFlags & matrixFlagDontOwnBuffer)
     {
         // free previous array allocation if any before overwriting
-        delete[] Buffer();
+        if (!HasExternalBuffer())
+            delete[] Buffer();
 
         m_numRows = numRows;
         m_numCols = numCols;
         SetBuffer(pArray, GetNumElements() * sizeof(ElemType), true);
         SetSizeAllocated(GetNumElements());
+        SetArenaBuffer((matrixFlags & matrixFlagArenaBuffer) != 0);
     }
     else
     {
@@ -1510,6 +1519,7 @@ void CPUMatrix<ElemType>::RequireSize(const size_t numRows, const size_t numCols
 // Current content is not preserved.
 // If growOnly is true, resize will not reallocate memory if the current memory is large enough (i.e., will not shrink).
 // If this object does not own its memory then new memory cannot be allocated (one can still shrink and/or reshape).
+// The exception is an arena slot (matrixFlagArenaBuffer): it never shrinks, and growing beyond it moves the matrix to its own buffer.
 template <class ElemType>
 void CPUMatrix<ElemType>::Resize(const size_t numRows, const size_t numCols, bool growOnly /*=true*/)
 {
@@ -1519,8 +1529,8 @@ void CPUMatrix<ElemType>::Resize(const size_t numRows, const size_t numCols, boo
     VerifyResizable(__func__);
 
     size_t numElements = numRows * numCols;
-    if (numElements > GetSizeAllocated() ||                 // grow allocation
-        (!growOnly && (numElements != GetSizeAllocated()))) // shrink allocation (not if 'growOnly')
+    if (numElements > GetSizeAllocated() ||                                       // grow allocation
+        (!growOnly && !HasArenaBuffer() && (numElements != GetSizeAllocated()))) // shrink allocation (not if 'growOnly')
     {
         // reallocate buffer
         ElemType* pArray = nullptr;
@@ -1529,7 +1539,8 @@ void CPUMatrix<ElemType>::Resize(const size_t numRows, const size_t numCols, boo
             pArray = NewArray<ElemType>(numElements);
         }
         // success: update the object
-        delete[] Buffer();
+        if (!HasExternalBuffer())
+            delete[] Buffer();
 
         SetBuffer(pArray, numElements * sizeof(ElemType));
         SetSizeAllocated(numElements);
@@ -4848,6 +4859,35 @@ void CPUMatrix<ElemType>::BatchNormalizationBackward(const CPUMatrix<ElemType>&
     RuntimeError("Batch normalization training on CPU is not yet implemented.");
 }
 
+#pragma region RNN Functions
+
+template <class ElemType>
+void CPUMatrix<ElemType>::RNNForward(const CPUMatrix<ElemType>& inputX, const CPUMatrix<ElemType>& paramW, size_t xDim, size_t yDim, const vector<size_t>& numSequencesForFrame, const RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace)
+{
+    // The matrix may be reused for another RNN (e.g. from a matrix pool), unlike the cuDNN executor this one is cheap to recreate.
+    if (!m_rnnExecutor || !m_rnnExecutor->IsCompatible(xDim, yDim, rnnAttributes))
+        m_rnnExecutor = std::make_shared<CPURNNExecutor<ElemType>>(xDim, yDim, rnnAttributes);
+    m_rnnExecutor->ForwardCore(paramW, inputX, *this, numSequencesForFrame, rnnAttributes, reserve, workspace);
+}
+
+template <class ElemType>
+void CPUMatrix<ElemType>::RNNBackwardData(const CPUMatrix<ElemType>& outputDY, const CPUMatrix<ElemType>& paramW, CPUMatrix<ElemType>& outputDX, const RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace)
+{
+    if (!m_rnnExecutor)
+        LogicError("RNNBackwardData called, but RNNWrapper object is not yet initialized");
+    m_rnnExecutor->BackwardDataCore(*this, outputDY, paramW, outputDX, rnnAttributes, reserve, workspace);
+}
+
+template <class ElemType>
+void CPUMatrix<ElemType>::RNNBackwardWeights(const CPUMatrix<ElemType>& inputX, const CPUMatrix<ElemType>& outputY, CPUMatrix<ElemType>& dw, const RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace)
+{
+    if (!m_rnnExecutor)
+        LogicError("RNNBackwardWeights called, but RNNWrapper object is not yet initialized");
+    m_rnnExecutor->BackwardWeightsCore(inputX, outputY, dw, rnnAttributes, reserve, workspace);
+}
+
+#pragma endregion RNN Functions
+
 
 #pragma region Static BLAS Functions
 
@@ -6659,6 +6699,7 @@ int CPUMatrix<ElemType>::SetNumThreads(int numThreads)
 #ifdef _OPENMP
     omp_set_num_threads(numThreads);
     numThreads = omp_get_max_threads();
+    CPUThreadPool::Instance().Configure(numThreads);
 
     #ifdef USE_MKL
         mkl_set_num_threads(numThreads);
@@ -6740,6 +6781,89 @@ struct TensorOpReduction<ElemType, OPFN, ReductionOp, N, -1>
     }
 };
 
+// reduction operations, applied to the double aggregate
+template <ElementWiseOperator reductionOp>
+struct TensorOpReductionFn;
+
+#define DefTensorOpReductionFn(oper)                                     \
+    template <>                                                          \
+    struct TensorOpReductionFn<ElementWiseOperator::op##oper>            \
+    {                                                                    \
+        double operator()(double a, double b) const                      \
+        {                                                                \
+            return Op##oper(a, b);                                       \
+        }                                                                \
+    }
+
+DefTensorOpReductionFn(Sum);
+DefTensorOpReductionFn(LogSum);
+DefTensorOpReductionFn(Min);
+DefTensorOpReductionFn(Max);
+DefTensorOpReductionFn(ElementwiseProduct);
+
+// ops with explicitly vectorized kernels in CPUTensorOpKernels.h
+// They compute the same values as the lambdas of the other ops; the innermost loops are specialized for them below.
+template <class ElemType, class Kernel>
+struct TensorOpUnaryKernelFn
+{
+    ElemType operator()(const array<ElemType*, 2>& pp) const
+    {
+        return Kernel::Scalar(*pp[0]);
+    }
+};
+
+template <class ElemType, class Kernel>
+struct TensorOpBinaryKernelFn
+{
+    ElemType operator()(const array<ElemType*, 3>& pp) const
+    {
+        return Kernel::Scalar(*pp[0], *pp[1]);
+    }
+};
+
+// reduction of n contiguous elements, with vectorized versions for sum and max
+template <class ElemType, typename ReductionOp>
+static inline double TensorOpReduceContiguous(const ReductionOp& reductionOp, const ElemType* pa, size_t n)
+{
+    double aggregate = pa[0];
+    for (size_t i = 1; i < n; i++)
+        aggregate = reductionOp(aggregate, pa[i]);
+    return aggregate;
+}
+
+template <class ElemType>
+static inline double TensorOpReduceContiguous(const TensorOpReductionFn<ElementWiseOperator::opSum>&, const ElemType* pa, size_t n)
+{
+    return SimdReduceSum(pa, n);
+}
+
+template <class ElemType>
+static inline double TensorOpReduceContiguous(const TensorOpReductionFn<ElementWiseOperator::opMax>&, const ElemType* pa, size_t n)
+{
+    return SimdReduceMax(pa, n);
+}
+
+// Special version for the innermost reduction of a plain copy, e.g. ReduceSum() or ReduceMax() over a contiguous axis.
+template <class ElemType, typename ReductionOp>
+struct TensorOpReduction<ElemType, TensorOpUnaryKernelFn<ElemType, SimdOpCopy>, ReductionOp, 2, 0>
+{
+    static inline ElemType Loop(array<ElemType*, 2> pointers, const TensorOpUnaryKernelFn<ElemType, SimdOpCopy>&, const ReductionOp& reductionOp,
+                                const SmallVector<size_t>& reducingOpDims, const array<SmallVector<ptrdiff_t>, 2>& reducingStrides)
+    {
+        ptrdiff_t stride = reducingStrides[0][0];
+        if (stride == 1)
+            return static_cast<ElemType>(TensorOpReduceContiguous(reductionOp, pointers[0], reducingOpDims[0]));
+
+        double aggregate = *pointers[0];
+        for (size_t dim = reducingOpDims[0] - 1; dim-- > 0;)
+        {
+            pointers[0] += stride;
+            aggregate = reductionOp(aggregate, *pointers[0]);
+        }
+        return static_cast<ElemType>(aggregate);
+    }
+};
+
 // perform loop over reduction index m, while keeping track of the number of elements and their corresponding indices.
 // This function is declared inside a wrapper struct to allow partial specialization (m = -1).
 template <class ElemType, size_t N, int m>
@@ -6854,6 +6978,7 @@ struct TensorOpIteration
 
 // Special version for innermost loop with strides all being 1 and no further reduction. Compiler can use SSE.
 // This is a very common case, e.g. adding vectors or computing the Sigmoid.
+// The loop runs on a single thread; large ops are partitioned across threads in TensorOpWithFnAndReduction().
 template <class ElemType, typename OPFN, typename ReductionOp>
 struct TensorOpIteration<ElemType, OPFN, ReductionOp, 3, true /*vectorizable*/, -1 /*no reduction*/, 0 /*innermost loop*/>
 {
@@ -6867,20 +6992,15 @@ struct TensorOpIteration<ElemType, OPFN, ReductionOp, 3, true /*vectorizable*/,
         size_t K = regularOpDims[0];
         // special-case beta and alpha to allow the compiler to short-circuit it
         if (beta != 0)
-#pragma omp parallel for
-            for (int k = 0; k < (int) K; k++)
+            for (size_t k = 0; k < K; k++)
                 TensorOpIteration<ElemType, OPFN, ReductionOp, 3, true /*vectorizable*/, -1 /*no reduction*/, -1 /*scalar*/>::Loop(beta, array<ElemType*, 3>{pa + k, pb + k, pc + k}, alpha, opfn, reductionOp, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
         else if (alpha != 1)
-#pragma omp parallel for
-            for (int k = 0; k < (int) K; k++)
+            for (size_t k = 0; k < K; k++)
                 TensorOpIteration<ElemType, OPFN, ReductionOp, 3, true /*vectorizable*/, -1 /*no reduction*/, -1 /*scalar*/>::Loop(0, array<ElemType*, 3>{pa + k, pb + k, pc + k}, alpha, opfn, reductionOp, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
         else
-#pragma omp parallel for
-            for (int k = 0; k < (int) K; k++)
+            for (size_t k = 0; k < K; k++)
                 TensorOpIteration<ElemType, OPFN, ReductionOp, 3, true /*vectorizable*/, -1 /*no reduction*/, -1 /*scalar*/>::Loop(0, array<ElemType*, 3>{pa + k, pb + k, pc + k}, 1, opfn, reductionOp, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
-        // TODO: According to Amit, the VS compiler is not able to vectorize into lambdas. Solution: change the lambda to take an N, or to implement the loop inside (with 1 element by default).
-        // TODO: The signedness of k (required for omp) causes an extra sign-extend.
-        // TODO: OMP adds LOTS of overhead. Do we need a guard, a min size when to use it?
+        // TODO: According to Amit, the VS compiler is not able to vectorize into lambdas. Ops with an explicit kernel use the specialization below.
     }
 };
 // and unary
@@ -6896,20 +7016,40 @@ struct TensorOpIteration<ElemType, OPFN, ReductionOp, 2, true /*vectorizable*/,
         size_t K = regularOpDims[0];
         // special-case beta and alpha to allow the compiler to short-circuit it
         if (beta != 0)
-#pragma omp parallel for
-            for (int k = 0; k < (int) K; k++)
+            for (size_t k = 0; k < K; k++)
                 TensorOpIteration<ElemType, OPFN, ReductionOp, 2, true /*vectorizable*/, -1 /*no reduction*/, -1 /*scalar*/>::Loop(beta, array<ElemType*, 2>{pa + k, pb + k}, alpha, opfn, reductionOp, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
         else if (alpha != 1)
-#pragma omp parallel for
-            for (int k = 0; k < (int) K; k++)
+            for (size_t k = 0; k < K; k++)
                 TensorOpIteration<ElemType, OPFN, ReductionOp, 2, true /*vectorizable*/, -1 /*no reduction*/, -1 /*scalar*/>::Loop(0, array<ElemType*, 2>{pa + k, pb + k}, alpha, opfn, reductionOp, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
         else
-#pragma omp parallel for
-            for (int k = 0; k < (int) K; k++)
+            for (size_t k = 0; k < K; k++)
                 TensorOpIteration<ElemType, OPFN, ReductionOp, 2, true /*vectorizable*/, -1 /*no reduction*/, -1 /*scalar*/>::Loop(0, array<ElemType*, 2>{pa + k, pb + k}, 1, opfn, reductionOp, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
     }
 };
 
+// Special versions of the innermost loop for the ops with an explicitly vectorized kernel.
+template <class ElemType, class Kernel, typename ReductionOp>
+struct TensorOpIteration<ElemType, TensorOpBinaryKernelFn<ElemType, Kernel>, ReductionOp, 3, true /*vectorizable*/, -1 /*no reduction*/, 0 /*innermost loop*/>
+{
+    static inline void Loop(ElemType beta, array<ElemType*, 3> pointers, ElemType alpha, const TensorOpBinaryKernelFn<ElemType, Kernel>&, const ReductionOp&,
+                            const SmallVector<size_t>& regularOpDims, const array<SmallVector<ptrdiff_t>, 3>&,
+                            const SmallVector<size_t>&, const array<SmallVector<ptrdiff_t>, 3>&)
+    {
+        SimdBinaryLoop<Kernel>(beta, pointers[0], pointers[1], alpha, pointers[2], regularOpDims[0]);
+    }
+};
+// and unary
+template <class ElemType, class Kernel, typename ReductionOp>
+struct TensorOpIteration<ElemType, TensorOpUnaryKernelFn<ElemType, Kernel>, ReductionOp, 2, true /*vectorizable*/, -1 /*no reduction*/, 0 /*innermost loop*/>
+{
+    static inline void Loop(ElemType beta, array<ElemType*, 2> pointers, ElemType alpha, const TensorOpUnaryKernelFn<ElemType, Kernel>&, const ReductionOp&,
+                            const SmallVector<size_t>& regularOpDims, const array<SmallVector<ptrdiff_t>, 2>&,
+                            const SmallVector<size_t>&, const array<SmallVector<ptrdiff_t>, 2>&)
+    {
+        SimdUnaryLoop<Kernel>(beta, pointers[0], alpha, pointers[1], regularOpDims[0]);
+    }
+};
+
 template <class ElemType, typename OPFN, typename ReductionOp, size_t N, bool vectorizable, int m>
 struct TensorOpIteration<ElemType, OPFN, ReductionOp, N, vectorizable, m, -1>
 {
@@ -7008,13 +7148,10 @@ static void TensorOpWithRegularLoop(ElemType beta, const array<ElemType*, N>& po
 // tensor operation, generalized in number of arguments, operation already provided as a lambda
 // This function now expands into different k.
 template <class ElemType, typename OPFN, typename ReductionOp, size_t N>
-static void TensorOpWithFnAndReduction(ElemType beta, array<ElemType*, N> pointers, ElemType alpha, const OPFN& opfn, const ReductionOp& reductionOp,
-    const array<size_t, N>& offsets,
+static void TensorOpWithRegularDims(ElemType beta, const array<ElemType*, N>& pointers, ElemType alpha, const OPFN& opfn, const ReductionOp& reductionOp,
     const SmallVector<size_t>& regularOpDims, const array<SmallVector<ptrdiff_t>, N>& regularStrides,
     const SmallVector<size_t>& reducingOpDims, const array<SmallVector<ptrdiff_t>, N>& reducingStrides)
 {
-    for (size_t i = 0; i < N; i++) // N = a small constant, this will be unrolled
-        pointers[i] += offsets[i];
     size_t dims = regularOpDims.size();
     switch (dims)
     {
@@ -7033,6 +7170,146 @@ static void TensorOpWithFnAndReduction(ElemType beta, array<ElemType*, N> pointe
     }
 }
 
+// -----------------------------------------------------------------------
+// partition tensor operations across threads
+// -----------------------------------------------------------------------
+
+// Minimum number of elementary operations per thread. Smaller tensor ops run on the calling thread,
+// since starting a parallel region costs more than the work itself.
+static const size_t TensorOpGrainSize = 16384;
+
+// Full reductions are computed as at most this many partial results, which are then combined in a fixed order.
+// The number does not depend on the number of threads, so that the result does not either.
+static const size_t TensorOpMaxReductionSlices = 64;
+
+static inline size_t TensorOpNumElements(const SmallVector<size_t>& opDims)
+{
+    size_t numElements = 1;
+    for (size_t i = 0; i < opDims.size(); i++)
+        numElements *= opDims[i];
+    return numElements;
+}
+
+// Partitions one of the regular (output) dimensions into slices of about equal size, which are processed
+// in parallel. The slices write disjoint parts of the output, so no synchronization is needed.
+template <class ElemType, typename OPFN, typename ReductionOp, size_t N>
+static void TensorOpWithRegularDimsParallel(size_t numSlices, ElemType beta, const array<ElemType*, N>& pointers, ElemType alpha, const OPFN& opfn, const ReductionOp& reductionOp,
+    const SmallVector<size_t>& regularOpDims, const array<SmallVector<ptrdiff_t>, N>& regularStrides,
+    const SmallVector<size_t>& reducingOpDims, const array<SmallVector<ptrdiff_t>, N>& reducingStrides)
+{
+    // split the outermost dimension that has enough elements for all slices, otherwise the largest one
+    size_t dims = regularOpDims.size();
+    size_t splitDim = dims;
+    for (size_t d = dims; d-- > 0 && splitDim == dims;)
+    {
+        if (regularOpDims[d] >= numSlices)
+            splitDim = d;
+    }
+    if (splitDim == dims)
+    {
+        splitDim = 0;
+        for (size_t d = 1; d < dims; d++)
+        {
+            if (regularOpDims[d] > regularOpDims[splitDim])
+                splitDim = d;
+        }
+    }
+    size_t dimSize = regularOpDims[splitDim];
+    numSlices = std::min(numSlices, dimSize);
+
+#pragma omp parallel for
+    for (int slice = 0; slice < (int) numSlices; slice++)
+    {
+        size_t begin = dimSize * slice / numSlices;
+        size_t end = dimSize * (slice + 1) / numSlices;
+        SmallVector<size_t> sliceOpDims = regularOpDims;
+        sliceOpDims[splitDim] = end - begin;
+        array<ElemType*, N> slicePointers = pointers;
+        for (size_t i = 0; i < N; i++)
+            slicePointers[i] += (ptrdiff_t) begin * regularStrides[i][splitDim];
+        TensorOpWithRegularDims(beta, slicePointers, alpha, opfn, reductionOp, sliceOpDims, regularStrides, reducingOpDims, reducingStrides);
+    }
+}
+
+// reduction of all input elements of a tensor op with a scalar result, without alpha and beta
+template <class ElemType, typename OPFN, typename ReductionOp, size_t N>
+static ElemType TensorOpReduceAll(const array<ElemType*, N>& pointers, const OPFN& opfn, const ReductionOp& reductionOp,
+    const SmallVector<size_t>& reducingOpDims, const array<SmallVector<ptrdiff_t>, N>& reducingStrides)
+{
+    size_t dims = reducingOpDims.size();
+    switch (dims)
+    {
+    case 2:
+        return TensorOpReduction<ElemType, OPFN, ReductionOp, N, 1>::Loop(pointers, opfn, reductionOp, reducingOpDims, reducingStrides);
+    case 1:
+        return TensorOpReduction<ElemType, OPFN, ReductionOp, N, 0>::Loop(pointers, opfn, reductionOp, reducingOpDims, reducingStrides);
+    default:
+        LogicError("TensorOp: %d non-flattened reduction dimensions are not supported.", (int) dims);
+    }
+}
+
+// Reduction into a scalar. The outermost reducing dimension is partitioned into slices, each of which is reduced
+// into a partial result in parallel. The partial results are combined in a fixed order.
+template <class ElemType, typename OPFN, typename ReductionOp, size_t N>
+static void TensorOpReduceAllParallel(size_t numSlices, ElemType beta, const array<ElemType*, N>& pointers, ElemType alpha, const OPFN& opfn, const ReductionOp& reductionOp,
+    const SmallVector<size_t>& reducingOpDims, const array<SmallVector<ptrdiff_t>, N>& reducingStrides)
+{
+    size_t splitDim = reducingOpDims.size() - 1;
+    size_t dimSize = reducingOpDims[splitDim];
+    numSlices = std::min(numSlices, dimSize);
+
+    std::vector<double> partials(numSlices);
+#pragma omp parallel for
+    for (int slice = 0; slice < (int) numSlices; slice++)
+    {
+        size_t begin = dimSize * slice / numSlices;
+        size_t end = dimSize * (slice + 1) / numSlices;
+        SmallVector<size_t> sliceOpDims = reducingOpDims;
+        sliceOpDims[splitDim] = end - begin;
+        array<ElemType*, N> slicePointers = pointers;
+        for (size_t i = 0; i < N - 1; i++) // last pointer (result) is unused in reduction
+            slicePointers[i] += (ptrdiff_t) begin * reducingStrides[i][splitDim];
+        partials[slice] = TensorOpReduceAll(slicePointers, opfn, reductionOp, sliceOpDims, reducingStrides);
+    }
+
+    double aggregate = partials[0];
+    for (size_t slice = 1; slice < numSlices; slice++)
+        aggregate = reductionOp(aggregate, partials[slice]);
+
+    // scale and combine with previous value in target, like the scalar TensorOpIteration
+    ElemType val = static_cast<ElemType>(aggregate);
+    val *= alpha;
+    auto* pout = pointers.back();
+    if (beta != 0)
+        val += beta * *pout;
+    *pout = val;
+}
+
+// tensor operation, generalized in number of arguments, operation already provided as a lambda
+// This function partitions large operations across threads.
+template <class ElemType, typename OPFN, typename ReductionOp, size_t N>
+static void TensorOpWithFnAndReduction(ElemType beta, array<ElemType*, N> pointers, ElemType alpha, const OPFN& opfn, const ReductionOp& reductionOp,
+    const array<size_t, N>& offsets,
+    const SmallVector<size_t>& regularOpDims, const array<SmallVector<ptrdiff_t>, N>& regularStrides,
+    const SmallVector<size_t>& reducingOpDims, const array<SmallVector<ptrdiff_t>, N>& reducingStrides)
+{
+    for (size_t i = 0; i < N; i++) // N = a small constant, this will be unrolled
+        pointers[i] += offsets[i];
+
+    // unsupported numbers of dimensions are reported by the serial version, outside of a parallel region
+    bool supported = regularOpDims.size() <= 4 && reducingOpDims.size() <= 2;
+    size_t numSlices = TensorOpNumElements(regularOpDims) * TensorOpNumElements(reducingOpDims) / TensorOpGrainSize;
+    if (supported && numSlices > 1)
+    {
+        size_t numThreads = omp_in_parallel() ? 1 : (size_t) omp_get_max_threads();
+        if (!regularOpDims.empty() && numThreads > 1)
+            return TensorOpWithRegularDimsParallel(std::min(numSlices, numThreads), beta, pointers, alpha, opfn, reductionOp, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
+        else if (regularOpDims.empty() && !reducingOpDims.empty())
+            return TensorOpReduceAllParallel(std::min(numSlices, TensorOpMaxReductionSlices), beta, pointers, alpha, opfn, reductionOp, reducingOpDims, reducingStrides);
+    }
+    TensorOpWithRegularDims(beta, pointers, alpha, opfn, reductionOp, regularOpDims, regularStrides, reducingOpDims, reducingStrides);
+}
+
 // tensor operation, generalized in number of arguments, operation already provided as a lambda
 // This function now expands into different reductionOps
 template <class ElemType, typename OPFN, size_t N>
@@ -7047,12 +7324,9 @@ static void TensorOpWithFn(ElemType beta, array<ElemType*, N> pointers, ElemType
 // * It is not consitent with what we do on GPU, there we aggregate on ElemType.
 // * It costs performance.
 // TODO: apdapt e2e tests to run with aggregator of type ElemType.
-#define CaseTensorOpWithFnAndReduction(oper)                                                  \
-    case ElementWiseOperator::op##oper:                                                       \
-    return TensorOpWithFnAndReduction(beta, pointers, alpha, opfn, [](double a, double b)     \
-                                    {                                                         \
-                                    return Op##oper(a, b);                                    \
-                                    },                                                        \
+#define CaseTensorOpWithFnAndReduction(oper)                                                                   \
+    case ElementWiseOperator::op##oper:                                                                        \
+    return TensorOpWithFnAndReduction(beta, pointers, alpha, opfn, TensorOpReductionFn<ElementWiseOperator::op##oper>(), \
                                     offsets, regularOpDims, regularStrides, reducingOpDims, reducingStrides)
 
     switch (reductionOp)
@@ -7095,8 +7369,22 @@ void CPUMatrix<ElemType>::TensorOp(ElemType beta, const CPUMatrix<ElemType>& a,
                               },                                                       \
                               reductionOp, offsets, regularOpDims, regularStrides, reducingOpDims, reducingStrides)
 
+// ops with an explicitly vectorized kernel
+#define CaseUnaryKernelTensorOp(oper)                                                                          \
+    case ElementWiseOperator::op##oper:                                                                        \
+        return TensorOpWithFn(beta, pointers, alpha, TensorOpUnaryKernelFn<ElemType, SimdOp##oper>(),           \
+                              reductionOp, offsets, regularOpDims, regularStrides, reducingOpDims, reducingStrides)
+
     array<ElemType*, 2> pointers = {a.Data(), Data()};
     switch (op)
+    {
+        CaseUnaryKernelTensorOp(Copy);
+        CaseUnaryKernelTensorOp(Negate);
+        CaseUnaryKernelTensorOp(LinearRectifier);
+    default:
+        break;
+    }
+    switch (op)
     {
         ForAllUnaryOps(CaseUnaryTensorOp);
     default:
@@ -7123,8 +7411,22 @@ void CPUMatrix<ElemType>::TensorOp(ElemType beta, const CPUMatrix<ElemType>& a,
                               },                                                       \
                               reductionOp, offsets, regularOpDims, regularStrides, reducingOpDims, reducingStrides)
 
+#define CaseBinaryKernelTensorOp(oper)                                                                         \
+    case ElementWiseOperator::op##oper:                                                                        \
+        return TensorOpWithFn(beta, pointers, alpha, TensorOpBinaryKernelFn<ElemType, SimdOp##oper>(),          \
+                              reductionOp, offsets, regularOpDims, regularStrides, reducingOpDims, reducingStrides)
+
     array<ElemType*, 3> pointers = {a.Data(), b.Data(), Data()};
     switch (op)
+    {
+        CaseBinaryKernelTensorOp(Sum);
+        CaseBinaryKernelTensorOp(Difference);
+        CaseBinaryKernelTensorOp(ElementwiseProduct);
+        CaseBinaryKernelTensorOp(ElementwiseProductWithLinearRectifierDerivativeFromOutput);
+    default:
+        break;
+    }
+    switch (op)
     {
         ForAllBinaryOps(CaseBinaryTensorOp);
     default:
@@ -7377,5 +7679,39 @@ template void CPUMatrix<short>::Reshape(const size_t, const size_t);
 
 template CPUMatrix<int>::CPUMatrix(const size_t, const size_t, int*, const size_t);
 
+// Support the 16-bit floating point storage types, see CPUMatrixLowPrecision.h
+template CPUMatrix<bfloat16>::CPUMatrix(const size_t numRows, const size_t numCols);
+template CPUMatrix<bfloat16>::CPUMatrix(const size_t numRows, const size_t numCols, bfloat16* pArray, const size_t matrixFlags);
+template CPUMatrix<bfloat16>::CPUMatrix();
+template CPUMatrix<bfloat16>::CPUMatrix(CPUMatrix<bfloat16> const&);
+template CPUMatrix<bfloat16>::CPUMatrix(CPUMatrix<bfloat16>&&);
+template size_t CPUMatrix<bfloat16>::LocateElement(size_t, size_t) const;
+template CPUMatrix<bfloat16> CPUMatrix<bfloat16>::ColumnSlice(size_t startColumn, size_t numCols) const;
+template CPUMatrix<bfloat16>& CPUMatrix<bfloat16>::operator=(CPUMatrix<bfloat16>&&);
+template void CPUMatrix<bfloat16>::SetValue(const bfloat16);
+template void CPUMatrix<bfloat16>::SetValue(const size_t numRows, const size_t numCols, bfloat16* pArray, size_t matrixFlags);
+template void CPUMatrix<bfloat16>::SetValue(CPUMatrix<bfloat16> const&);
+template void CPUMatrix<bfloat16>::RequireSize(const size_t numRows, const size_t numCols, bool growOnly);
+template void CPUMatrix<bfloat16>::Resize(const size_t numRows, const size_t numCols, bool growOnly);
+template bfloat16* CPUMatrix<bfloat16>::CopyToArray(void) const;
+template void CPUMatrix<bfloat16>::CopySection(size_t numRows, size_t numCols, bfloat16* dst, size_t colStride) const;
+template void CPUMatrix<bfloat16>::Reshape(const size_t, const size_t);
+template CPUMatrix<float16>::CPUMatrix(const size_t numRows, const size_t numCols);
+template CPUMatrix<float16>::CPUMatrix(const size_t numRows, const size_t numCols, float16* pArray, const size_t matrixFlags);
+template CPUMatrix<float16>::CPUMatrix();
+template CPUMatrix<float16>::CPUMatrix(CPUMatrix<float16> const&);
+template CPUMatrix<float16>::CPUMatrix(CPUMatrix<float16>&&);
+template size_t CPUMatrix<float16>::LocateElement(size_t, size_t) const;
+template CPUMatrix<float16> CPUMatrix<float16>::ColumnSlice(size_t startColumn, size_t numCols) const;
+template CPUMatrix<float16>& CPUMatrix<float16>::operator=(CPUMatrix<float16>&&);
+template void CPUMatrix<float16>::SetValue(const float16);
+template void CPUMatrix<float16>::SetValue(const size_t numRows, const size_t numCols, float16* pArray, size_t matrixFlags);
+template void CPUMatrix<float16>::SetValue(CPUMatrix<float16> const&);
+template void CPUMatrix<float16>::RequireSize(const size_t numRows, const size_t numCols, bool growOnly);
+template void CPUMatrix<float16>::Resize(const size_t numRows, const size_t numCols, bool growOnly);
+template float16* CPUMatrix<float16>::CopyToArray(void) const;
+template void CPUMatrix<float16>::CopySection(size_t numRows, size_t numCols, float16* dst, size_t colStride) const;
+template void CPUMatrix<float16>::Reshape(const size_t, const size_t);
+
 }}}
 
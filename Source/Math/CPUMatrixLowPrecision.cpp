@@ -0,0 +1,167 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUMatrixLowPrecision.cpp -- conversions and GEMM for CPU matrices stored in bfloat16 or float16
+//
+
+#include "stdafx.h"
+#include "CPUMatrixLowPrecision.h"
+#include <algorithm>
+#include <vector>
+
+#ifdef USE_MKL
+#include <mkl.h>
+#else
+#include <cblas.h>
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Elements converted per thread and step, and columns of c computed per panel of the software GEMM.
+static const size_t s_conversionChunk = 16384;
+static const size_t s_panelColumns = 256;
+
+template <class StorageType>
+static void ParallelConvertFromFloat(const float* from, StorageType* to, size_t n)
+{
+    long numChunks = (long) ((n + s_conversionChunk - 1) / s_conversionChunk);
+#pragma omp parallel for
+    for (long chunk = 0; chunk < numChunks; chunk++)
+    {
+        size_t begin = chunk * s_conversionChunk;
+        ConvertFromFloat(from + begin, to + begin, std::min(s_conversionChunk, n - begin));
+    }
+}
+
+template <class StorageType>
+static void ParallelConvertToFloat(const StorageType* from, float* to, size_t n)
+{
+    long numChunks = (long) ((n + s_conversionChunk - 1) / s_conversionChunk);
+#pragma omp parallel for
+    for (long chunk = 0; chunk < numChunks; chunk++)
+    {
+        size_t begin = chunk * s_conversionChunk;
+        ConvertToFloat(from + begin, to + begin, std::min(s_conversionChunk, n - begin));
+    }
+}
+
+template <class StorageType>
+void AssignToLowPrecision(const CPUMatrix<float>& from, CPUMatrix<StorageType>& to)
+{
+    to.RequireSize(from.GetNumRows(), from.GetNumCols());
+    ParallelConvertFromFloat(from.Data(), to.Data(), from.GetNumElements());
+}
+
+template <class StorageType>
+void AssignFromLowPrecision(const CPUMatrix<StorageType>& from, CPUMatrix<float>& to)
+{
+    to.RequireSize(from.GetNumRows(), from.GetNumCols());
+    ParallelConvertToFloat(from.Data(), to.Data(), from.GetNumElements());
+}
+
+// Native low-precision GEMM, if the BLAS library has one for the storage type.
+static bool NativeLowPrecisionGemm(float, const CPUMatrix<float16>&, bool, const CPUMatrix<float16>&, bool, float, CPUMatrix<float>&)
+{
+    return false;
+}
+
+static bool NativeLowPrecisionGemm(float alpha, const CPUMatrix<bfloat16>& a, bool transposeA, const CPUMatrix<bfloat16>& b, bool transposeB, float beta, CPUMatrix<float>& c)
+{
+#if defined(USE_MKL) && defined(INTEL_MKL_VERSION) && INTEL_MKL_VERSION >= 20200000
+    MKL_INT m = (MKL_INT) c.GetNumRows();
+    MKL_INT n = (MKL_INT) c.GetNumCols();
+    MKL_INT k = (MKL_INT) (transposeA ? a.GetNumRows() : a.GetNumCols());
+    cblas_gemm_bf16bf16f32(CblasColMajor, transposeA ? CblasTrans : CblasNoTrans, transposeB ? CblasTrans : CblasNoTrans, m, n, k,
+                           alpha, (const MKL_BF16*) a.Data(), (MKL_INT) a.GetNumRows(), (const MKL_BF16*) b.Data(), (MKL_INT) b.GetNumRows(),
+                           beta, c.Data(), m);
+    return true;
+#else
+    UNUSED(alpha); UNUSED(a); UNUSED(transposeA); UNUSED(b); UNUSED(transposeB); UNUSED(beta); UNUSED(c);
+    return false;
+#endif
+}
+
+// Determines the shape of the product and prepares c like CPUMatrix::MultiplyAndWeightedAdd does.
+template <class AType, class BType>
+static void PrepareProduct(const CPUMatrix<AType>& a, const bool transposeA, const CPUMatrix<BType>& b, const bool transposeB, float beta, CPUMatrix<float>& c)
+{
+    size_t m = transposeA ? a.GetNumCols() : a.GetNumRows();
+    size_t k = transposeA ? a.GetNumRows() : a.GetNumCols();
+    size_t l = transposeB ? b.GetNumCols() : b.GetNumRows();
+    size_t n = transposeB ? b.GetNumRows() : b.GetNumCols();
+    if (k != l)
+        InvalidArgument("LowPrecisionMultiplyAndWeightedAdd: The inner dimensions of a (= %lu) and b (= %lu) don't match.", (unsigned long) k, (unsigned long) l);
+
+    if (beta == 0)
+        c.RequireSize(m, n);
+    else
+        c.VerifySize(m, n); // Can't resize if beta != 0
+}
+
+template <class StorageType>
+void LowPrecisionMultiplyAndWeightedAdd(float alpha, const CPUMatrix<float>& a, const bool transposeA,
+                                        const CPUMatrix<StorageType>& b, const bool transposeB, float beta, CPUMatrix<float>& c)
+{
+    PrepareProduct(a, transposeA, b, transposeB, beta, c);
+    size_t m = c.GetNumRows();
+    size_t n = c.GetNumCols();
+    size_t k = transposeA ? a.GetNumRows() : a.GetNumCols();
+    if (m == 0 || n == 0)
+        return;
+    if (k == 0)
+    {
+        CPUMatrix<float>::Scale(beta, c);
+        return;
+    }
+
+    // Convert op(b) to float one panel of columns of c at a time, so that the float copy stays small
+    // (and in cache for the GEMM) while b is read only once.
+    std::vector<float> panel(k * std::min(n, s_panelColumns));
+    for (size_t j0 = 0; j0 < n; j0 += s_panelColumns)
+    {
+        size_t nb = std::min(s_panelColumns, n - j0);
+        if (!transposeB) // columns j0... of b
+            ParallelConvertToFloat(b.Data() + j0 * k, panel.data(), k * nb);
+        else // rows j0... of b, transposed
+        {
+            const StorageType* bData = b.Data();
+            float* panelData = panel.data();
+#pragma omp parallel for
+            for (long kk = 0; kk < (long) k; kk++)
+            {
+                for (size_t j = 0; j < nb; j++)
+                    panelData[kk + j * k] = bData[j0 + j + kk * n];
+            }
+        }
+        cblas_sgemm(CblasColMajor, transposeA ? CblasTrans : CblasNoTrans, CblasNoTrans, (int) m, (int) nb, (int) k,
+                    alpha, a.Data(), (int) a.GetNumRows(), panel.data(), (int) k, beta, c.Data() + j0 * m, (int) m);
+    }
+}
+
+template <class StorageType>
+void LowPrecisionMultiplyAndWeightedAdd(float alpha, const CPUMatrix<StorageType>& a, const bool transposeA,
+                                        const CPUMatrix<StorageType>& b, const bool transposeB, float beta, CPUMatrix<float>& c)
+{
+    PrepareProduct(a, transposeA, b, transposeB, beta, c);
+    if (c.IsEmpty())
+        return;
+    if (NativeLowPrecisionGemm(alpha, a, transposeA, b, transposeB, beta, c))
+        return;
+
+    // a is typically the smaller operand (weights or a minibatch of gradients), so it is converted as a whole
+    CPUMatrix<float> aFloat;
+    AssignFromLowPrecision(a, aFloat);
+    LowPrecisionMultiplyAndWeightedAdd(alpha, aFloat, transposeA, b, transposeB, beta, c);
+}
+
+template MATH_API void AssignToLowPrecision<bfloat16>(const CPUMatrix<float>& from, CPUMatrix<bfloat16>& to);
+template MATH_API void AssignToLowPrecision<float16>(const CPUMatrix<float>& from, CPUMatrix<float16>& to);
+template MATH_API void AssignFromLowPrecision<bfloat16>(const CPUMatrix<bfloat16>& from, CPUMatrix<float>& to);
+template MATH_API void AssignFromLowPrecision<float16>(const CPUMatrix<float16>& from, CPUMatrix<float>& to);
+template MATH_API void LowPrecisionMultiplyAndWeightedAdd<bfloat16>(float, const CPUMatrix<bfloat16>&, const bool, const CPUMatrix<bfloat16>&, const bool, float, CPUMatrix<float>&);
+template MATH_API void LowPrecisionMultiplyAndWeightedAdd<float16>(float, const CPUMatrix<float16>&, const bool, const CPUMatrix<float16>&, const bool, float, CPUMatrix<float>&);
+template MATH_API void LowPrecisionMultiplyAndWeightedAdd<bfloat16>(float, const CPUMatrix<float>&, const bool, const CPUMatrix<bfloat16>&, const bool, float, CPUMatrix<float>&);
+template MATH_API void LowPrecisionMultiplyAndWeightedAdd<float16>(float, const CPUMatrix<float>&, const bool, const CPUMatrix<float16>&, const bool, float, CPUMatrix<float>&);
+
+}}}
@@ -0,0 +1,45 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUMatrixLowPrecision.h -- CPU matrices stored in bfloat16 or float16
+//
+// CPUMatrix<bfloat16> and CPUMatrix<float16> are storage-only instantiations (like CPUMatrix<char> for
+// QuantizedMatrix): they support allocation, copying and slicing, while computation happens in float.
+// Keeping activations and other large tensors in 16 bits halves their footprint and the memory
+// traffic of the memory-bound operations that read them.
+//
+// Matrix<ElemType>, the computation nodes and MatrixPool are not wired to these types: node values,
+// gradients and pooled matrices stay in ElemType. Code that wants a tensor in 16 bits converts it
+// explicitly with AssignToLowPrecision and AssignFromLowPrecision, as activation checkpointing does
+// for the checkpoints it keeps in bfloat16 (see ComputationNetwork::SetActivationCheckpointing()).
+//
+
+#pragma once
+
+#include "CPUMatrix.h"
+#include "LowPrecision.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// to = from, rounded to the storage precision (to nearest, ties to even)
+template <class StorageType>
+MATH_API void AssignToLowPrecision(const CPUMatrix<float>& from, CPUMatrix<StorageType>& to);
+
+// to = from
+template <class StorageType>
+MATH_API void AssignFromLowPrecision(const CPUMatrix<StorageType>& from, CPUMatrix<float>& to);
+
+// c = alpha * op(a) * op(b) + beta * c, with products and sums in float.
+// Uses the MKL bfloat16 GEMM where available and otherwise converts the operands panel by panel
+// and calls the float GEMM.
+template <class StorageType>
+MATH_API void LowPrecisionMultiplyAndWeightedAdd(float alpha, const CPUMatrix<StorageType>& a, const bool transposeA,
+                                                 const CPUMatrix<StorageType>& b, const bool transposeB, float beta, CPUMatrix<float>& c);
+
+// Same with a float left operand, e.g. float weights times low-precision activations.
+template <class StorageType>
+MATH_API void LowPrecisionMultiplyAndWeightedAdd(float alpha, const CPUMatrix<float>& a, const bool transposeA,
+                                                 const CPUMatrix<StorageType>& b, const bool transposeB, float beta, CPUMatrix<float>& c);
+
+}}}
@@ -0,0 +1,501 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#include "CPURNN.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifdef USE_MKL
+#include <mkl.h>
+#else
+#include <cblas.h>
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Column-major GEMM on raw pointers, c = alpha * op(a) * op(b) + beta * c.
+static void RNNGemm(bool transA, bool transB, int m, int n, int k, float alpha, const float* a, int lda, const float* b, int ldb, float beta, float* c, int ldc)
+{
+    cblas_sgemm(CblasColMajor, transA ? CblasTrans : CblasNoTrans, transB ? CblasTrans : CblasNoTrans, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+}
+
+static void RNNGemm(bool transA, bool transB, int m, int n, int k, double alpha, const double* a, int lda, const double* b, int ldb, double beta, double* c, int ldc)
+{
+    cblas_dgemm(CblasColMajor, transA ? CblasTrans : CblasNoTrans, transB ? CblasTrans : CblasNoTrans, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc);
+}
+
+template <class ElemType>
+static inline ElemType RNNSigmoid(ElemType x)
+{
+    return 1 / (1 + exp(-x));
+}
+
+template <class ElemType>
+CPURNNExecutor<ElemType>::CPURNNExecutor(size_t xDim, size_t yDim, const RnnAttributes& rnnAttributes)
+    : m_xDim(xDim), m_yDim(yDim), m_hiddenSize(rnnAttributes.m_hiddenSize), m_rnnAttributes(rnnAttributes),
+      m_numColumns(0), m_maxSequences(0), m_BackwardDataCalledYet(false)
+{
+    if      (rnnAttributes.m_recurrentOp == wstring(L"lstm"))    { m_cellKind = CellKind::Lstm;    m_numGates = 4; }
+    else if (rnnAttributes.m_recurrentOp == wstring(L"gru"))     { m_cellKind = CellKind::Gru;     m_numGates = 3; }
+    else if (rnnAttributes.m_recurrentOp == wstring(L"rnnReLU")) { m_cellKind = CellKind::RnnReLU; m_numGates = 1; }
+    else if (rnnAttributes.m_recurrentOp == wstring(L"rnnTanh")) { m_cellKind = CellKind::RnnTanh; m_numGates = 1; }
+    else InvalidArgument("Unknown cell type '%ls'. Supported values are 'lstm', 'gru', 'rnnReLU', 'rnnTanh'.", rnnAttributes.m_recurrentOp.c_str());
+
+    if (m_yDim != NumDirections() * m_hiddenSize)
+        InvalidArgument("CPU RNN: Output leading dimension must be twice hidden size for bidirectional networks");
+}
+
+template <class ElemType>
+typename CPURNNExecutor<ElemType>::ParamOffsets CPURNNExecutor<ElemType>::GetParamOffsets(size_t layer, size_t dir) const
+{
+    // All weight matrices come first, then all biases, both ordered by layer and direction.
+    size_t gateRows = m_numGates * m_hiddenSize;
+    size_t weights = 0;
+    size_t biases = 0;
+    ParamOffsets offsets = {};
+    for (size_t l = 0; l < m_rnnAttributes.m_numLayers; l++)
+    {
+        for (size_t d = 0; d < NumDirections(); d++)
+        {
+            if (l == layer && d == dir)
+            {
+                offsets.inputDim = LayerInputDim(l);
+                offsets.w = weights;
+                offsets.r = weights + gateRows * LayerInputDim(l);
+                offsets.bw = biases;
+                offsets.br = biases + gateRows;
+            }
+            weights += gateRows * (LayerInputDim(l) + m_hiddenSize);
+            biases += 2 * gateRows;
+        }
+    }
+    offsets.bw += weights;
+    offsets.br += weights;
+    return offsets;
+}
+
+template <class ElemType>
+size_t CPURNNExecutor<ElemType>::GetNumParameters() const
+{
+    size_t total = 0;
+    for (size_t l = 0; l < m_rnnAttributes.m_numLayers; l++)
+        total += NumDirections() * m_numGates * m_hiddenSize * (LayerInputDim(l) + m_hiddenSize + 2);
+    return total;
+}
+
+// Per layer and direction, 'reserve' holds the gate activations and, for LSTM the cell states, for
+// GRU the recurrent projection of the candidate (R_h * h + b_Rh), which is needed for its gradient.
+// The output of each layer follows the states of its directions.
+template <class ElemType>
+size_t CPURNNExecutor<ElemType>::StateRows() const
+{
+    return (m_numGates + (m_numGates > 1 ? 1 : 0)) * m_hiddenSize;
+}
+
+template <class ElemType>
+ElemType* CPURNNExecutor<ElemType>::GateActivations(ElemType* reserve, size_t layer, size_t dir) const
+{
+    size_t layerSize = (NumDirections() * StateRows() + m_yDim) * m_numColumns;
+    return reserve + layer * layerSize + dir * StateRows() * m_numColumns;
+}
+
+template <class ElemType>
+ElemType* CPURNNExecutor<ElemType>::CellStates(ElemType* reserve, size_t layer, size_t dir) const
+{
+    return GateActivations(reserve, layer, dir) + m_numGates * m_hiddenSize * m_numColumns;
+}
+
+template <class ElemType>
+ElemType* CPURNNExecutor<ElemType>::LayerOutput(ElemType* reserve, size_t layer) const
+{
+    return GateActivations(reserve, layer, NumDirections());
+}
+
+template <class ElemType>
+size_t CPURNNExecutor<ElemType>::ReserveSize() const
+{
+    return m_rnnAttributes.m_numLayers * (NumDirections() * StateRows() + m_yDim) * m_numColumns;
+}
+
+template <class ElemType>
+size_t CPURNNExecutor<ElemType>::NumPreviousSequences(size_t t, size_t dir) const
+{
+    // Sequences are sorted by decreasing length, so the sequences of a frame that continue are the first ones.
+    if (dir == 0)
+        return t == 0 ? 0 : m_numSequencesForFrame[t];
+    else
+        return t + 1 == m_numSequencesForFrame.size() ? 0 : m_numSequencesForFrame[t + 1];
+}
+
+template <class ElemType>
+void CPURNNExecutor<ElemType>::ForwardLayer(const ElemType* w, size_t layer, size_t dir, const ElemType* x, ElemType* reserve, ElemType* workspace)
+{
+    const ParamOffsets p = GetParamOffsets(layer, dir);
+    const int H = (int)m_hiddenSize;
+    const int gateRows = (int)m_numGates * H;
+    const int outRows = (int)m_yDim;
+    const int N = (int)m_numColumns;
+    const CellKind cellKind = m_cellKind;
+
+    ElemType* gates = GateActivations(reserve, layer, dir);
+    ElemType* cells = CellStates(reserve, layer, dir);
+    ElemType* out = LayerOutput(reserve, layer) + dir * H;
+    ElemType* recurrent = workspace; // [gateRows x sequences of a frame]
+
+    // Input projections of all frames at once, plus biases. The recurrent bias of the GRU candidate is
+    // applied inside the reset gate, see below.
+    RNNGemm(true, false, gateRows, N, (int)p.inputDim, 1, w + p.w, (int)p.inputDim, x, (int)p.inputDim, 0, gates, gateRows);
+    const ElemType* bw = w + p.bw;
+    const ElemType* br = w + p.br;
+    int biasRowsR = cellKind == CellKind::Gru ? 2 * H : gateRows;
+#pragma omp parallel for
+    for (int j = 0; j < N; j++)
+    {
+        ElemType* g = gates + (size_t)j * gateRows;
+        for (int k = 0; k < biasRowsR; k++)
+            g[k] += bw[k] + br[k];
+        for (int k = biasRowsR; k < gateRows; k++)
+            g[k] += bw[k];
+    }
+
+    size_t numFrames = m_numSequencesForFrame.size();
+    for (size_t s = 0; s < numFrames; s++)
+    {
+        size_t t = dir == 0 ? s : numFrames - 1 - s;
+        int n = (int)m_numSequencesForFrame[t];
+        int numPrev = (int)NumPreviousSequences(t, dir);
+        size_t col = FrameOffset(t);
+        size_t prevCol = numPrev == 0 ? 0 : FrameOffset(dir == 0 ? t - 1 : t + 1);
+
+        if (numPrev > 0)
+            RNNGemm(true, false, gateRows, numPrev, H, 1, w + p.r, H, out + prevCol * outRows, outRows, 0, recurrent, gateRows);
+
+        // Fused gate nonlinearities and state update, one sequence per iteration.
+#pragma omp parallel for
+        for (int j = 0; j < n; j++)
+        {
+            bool hasPrev = j < numPrev;
+            const ElemType* rh = recurrent + (size_t)j * gateRows;
+            const ElemType* hPrev = out + (prevCol + j) * outRows;
+            ElemType* g = gates + (col + j) * gateRows;
+            ElemType* h = out + (col + j) * outRows;
+            switch (cellKind)
+            {
+            case CellKind::Lstm:
+            {
+                const ElemType* cPrev = cells + (prevCol + j) * H;
+                ElemType* c = cells + (col + j) * H;
+                for (int k = 0; k < H; k++)
+                {
+                    ElemType gi = RNNSigmoid(g[k]         + (hasPrev ? rh[k]         : 0));
+                    ElemType gf = RNNSigmoid(g[H + k]     + (hasPrev ? rh[H + k]     : 0));
+                    ElemType gc = tanh      (g[2 * H + k] + (hasPrev ? rh[2 * H + k] : 0));
+                    ElemType go = RNNSigmoid(g[3 * H + k] + (hasPrev ? rh[3 * H + k] : 0));
+                    c[k] = gi * gc + (hasPrev ? gf * cPrev[k] : 0);
+                    h[k] = go * tanh(c[k]);
+                    g[k] = gi;
+                    g[H + k] = gf;
+                    g[2 * H + k] = gc;
+                    g[3 * H + k] = go;
+                }
+                break;
+            }
+            case CellKind::Gru:
+            {
+                ElemType* hn = cells + (col + j) * H;
+                const ElemType* brh = br + 2 * H;
+                for (int k = 0; k < H; k++)
+                {
+                    ElemType gr = RNNSigmoid(g[k]     + (hasPrev ? rh[k]     : 0));
+                    ElemType gz = RNNSigmoid(g[H + k] + (hasPrev ? rh[H + k] : 0));
+                    hn[k] = brh[k] + (hasPrev ? rh[2 * H + k] : 0);
+                    ElemType gh = tanh(g[2 * H + k] + gr * hn[k]);
+                    h[k] = (1 - gz) * gh + (hasPrev ? gz * hPrev[k] : 0);
+                    g[k] = gr;
+                    g[H + k] = gz;
+                    g[2 * H + k] = gh;
+                }
+                break;
+            }
+            case CellKind::RnnReLU:
+                for (int k = 0; k < H; k++)
+                {
+                    g[k] = std::max(g[k] + (hasPrev ? rh[k] : 0), (ElemType)0);
+                    h[k] = g[k];
+                }
+                break;
+            case CellKind::RnnTanh:
+                for (int k = 0; k < H; k++)
+                {
+                    g[k] = tanh(g[k] + (hasPrev ? rh[k] : 0));
+                    h[k] = g[k];
+                }
+                break;
+            }
+        }
+    }
+}
+
+template <class ElemType>
+void CPURNNExecutor<ElemType>::ForwardCore(const CPUMatrix<ElemType>& weightsW, const CPUMatrix<ElemType>& inputX, CPUMatrix<ElemType>& outputY,
+                                           const vector<size_t>& numSequencesForFrame, const RnnAttributes& rnnAttributes,
+                                           CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace)
+{
+    if (!(m_rnnAttributes == rnnAttributes))
+        LogicError("RNN Layout has changed during processing");
+    if (weightsW.GetNumElements() != GetNumParameters())
+        InvalidArgument("RNN needs %ld parameters, but %ld were allocated", (long)GetNumParameters(), (long)weightsW.GetNumElements());
+
+    m_numSequencesForFrame = numSequencesForFrame;
+    m_frameOffsets.resize(numSequencesForFrame.size());
+    m_numColumns = 0;
+    m_maxSequences = 0;
+    for (size_t t = 0; t < numSequencesForFrame.size(); t++)
+    {
+        m_frameOffsets[t] = m_numColumns;
+        m_numColumns += numSequencesForFrame[t];
+        m_maxSequences = std::max(m_maxSequences, numSequencesForFrame[t]);
+    }
+    if (inputX.GetNumRows() != m_xDim || inputX.GetNumCols() != m_numColumns)
+        InvalidArgument("CPU RNN: Input is [%d x %d], but the layout requires [%d x %d].", (int)inputX.GetNumRows(), (int)inputX.GetNumCols(), (int)m_xDim, (int)m_numColumns);
+    if (outputY.GetNumRows() != m_yDim || outputY.GetNumCols() != m_numColumns)
+        InvalidArgument("CPU RNN: Output is [%d x %d], but the layout requires [%d x %d].", (int)outputY.GetNumRows(), (int)outputY.GetNumCols(), (int)m_yDim, (int)m_numColumns);
+
+    reserve.Resize(ReserveSize(), 1);
+    workspace.Resize(m_numGates * m_hiddenSize * m_maxSequences, 1);
+
+    const ElemType* w = weightsW.Data();
+    for (size_t layer = 0; layer < m_rnnAttributes.m_numLayers; layer++)
+    {
+        const ElemType* x = layer == 0 ? inputX.Data() : LayerOutput(reserve.Data(), layer - 1);
+        for (size_t dir = 0; dir < NumDirections(); dir++)
+            ForwardLayer(w, layer, dir, x, reserve.Data(), workspace.Data());
+    }
+    memcpy(outputY.Data(), LayerOutput(reserve.Data(), m_rnnAttributes.m_numLayers - 1), sizeof(ElemType) * m_yDim * m_numColumns);
+    m_BackwardDataCalledYet = false;
+}
+
+// Backpropagates dy (the gradient of the output rows of this direction, leading dimension yDim) through
+// the recurrence of a layer and direction. Produces the gradients of the gate pre-activations on the
+// input side (dGates) and on the recurrent side (dRecurrent, the same as dGates except for GRU).
+template <class ElemType>
+void CPURNNExecutor<ElemType>::BackwardLayerData(const ElemType* w, size_t layer, size_t dir, const ElemType* dy, ElemType* reserve,
+                                                 ElemType* dGates, ElemType* dRecurrent, ElemType* workspace)
+{
+    const ParamOffsets p = GetParamOffsets(layer, dir);
+    const int H = (int)m_hiddenSize;
+    const int gateRows = (int)m_numGates * H;
+    const int outRows = (int)m_yDim;
+    const int N = (int)m_numColumns;
+    const CellKind cellKind = m_cellKind;
+
+    const ElemType* gates = GateActivations(reserve, layer, dir);
+    const ElemType* cells = CellStates(reserve, layer, dir);
+    const ElemType* out = LayerOutput(reserve, layer) + dir * H;
+
+    // Gradients of the hidden (and cell) states, accumulated from the output and from the following frames.
+    ElemType* dh = workspace;
+    ElemType* dc = workspace + (size_t)H * N;
+#pragma omp parallel for
+    for (int j = 0; j < N; j++)
+    {
+        memcpy(dh + (size_t)j * H, dy + (size_t)j * outRows, sizeof(ElemType) * H);
+        if (cellKind == CellKind::Lstm)
+            memset(dc + (size_t)j * H, 0, sizeof(ElemType) * H);
+    }
+
+    size_t numFrames = m_numSequencesForFrame.size();
+    for (size_t s = numFrames; s-- > 0;)
+    {
+        size_t t = dir == 0 ? s : numFrames - 1 - s;
+        int n = (int)m_numSequencesForFrame[t];
+        int numPrev = (int)NumPreviousSequences(t, dir);
+        size_t col = FrameOffset(t);
+        size_t prevCol = numPrev == 0 ? 0 : FrameOffset(dir == 0 ? t - 1 : t + 1);
+
+#pragma omp parallel for
+        for (int j = 0; j < n; j++)
+        {
+            bool hasPrev = j < numPrev;
+            const ElemType* g = gates + (col + j) * gateRows;
+            const ElemType* dhj = dh + (col + j) * H;
+            ElemType* dg = dGates + (col + j) * gateRows;
+            switch (cellKind)
+            {
+            case CellKind::Lstm:
+            {
+                const ElemType* c = cells + (col + j) * H;
+                const ElemType* cPrev = cells + (prevCol + j) * H;
+                const ElemType* dcj = dc + (col + j) * H;
+                ElemType* dcPrev = dc + (prevCol + j) * H;
+                for (int k = 0; k < H; k++)
+                {
+                    ElemType gi = g[k], gf = g[H + k], gc = g[2 * H + k], go = g[3 * H + k];
+                    ElemType tc = tanh(c[k]);
+                    ElemType dck = dcj[k] + dhj[k] * go * (1 - tc * tc);
+                    dg[k]         = dck * gc * gi * (1 - gi);
+                    dg[H + k]     = hasPrev ? dck * cPrev[k] * gf * (1 - gf) : 0;
+                    dg[2 * H + k] = dck * gi * (1 - gc * gc);
+                    dg[3 * H + k] = dhj[k] * tc * go * (1 - go);
+                    if (hasPrev)
+                        dcPrev[k] += dck * gf;
+                }
+                break;
+            }
+            case CellKind::Gru:
+            {
+                const ElemType* hn = cells + (col + j) * H;
+                const ElemType* hPrev = out + (prevCol + j) * outRows;
+                ElemType* dhPrev = dh + (prevCol + j) * H;
+                ElemType* dgr = dRecurrent + (col + j) * gateRows;
+                for (int k = 0; k < H; k++)
+                {
+                    ElemType gr = g[k], gz = g[H + k], gh = g[2 * H + k];
+                    ElemType dPreH = dhj[k] * (1 - gz) * (1 - gh * gh);
+                    dg[k]         = dPreH * hn[k] * gr * (1 - gr);
+                    dg[H + k]     = dhj[k] * ((hasPrev ? hPrev[k] : 0) - gh) * gz * (1 - gz);
+                    dg[2 * H + k] = dPreH;
+                    dgr[k]         = dg[k];
+                    dgr[H + k]     = dg[H + k];
+                    dgr[2 * H + k] = dPreH * gr;
+                    if (hasPrev)
+                        dhPrev[k] += dhj[k] * gz;
+                }
+                break;
+            }
+            case CellKind::RnnReLU:
+                for (int k = 0; k < H; k++)
+                    dg[k] = g[k] > 0 ? dhj[k] : 0;
+                break;
+            case CellKind::RnnTanh:
+                for (int k = 0; k < H; k++)
+                    dg[k] = dhj[k] * (1 - g[k] * g[k]);
+                break;
+            }
+        }
+
+        // Recurrent part of the gradient of the previous hidden states.
+        if (numPrev > 0)
+            RNNGemm(false, false, H, numPrev, gateRows, 1, w + p.r, H, dRecurrent + col * gateRows, gateRows, 1, dh + prevCol * H, H);
+    }
+}
+
+template <class ElemType>
+void CPURNNExecutor<ElemType>::BackwardDataCore(const CPUMatrix<ElemType>& outputY, const CPUMatrix<ElemType>& outputDY, const CPUMatrix<ElemType>& weightsW, CPUMatrix<ElemType>& dx,
+                                                const RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace)
+{
+    UNUSED(outputY);
+    if (!(m_rnnAttributes == rnnAttributes))
+        LogicError("RNN Layout has changed during processing");
+    if (reserve.GetNumElements() != ReserveSize())
+        LogicError("RNNBackwardData: the reserve does not match the last forward pass.");
+    if (outputDY.GetNumRows() != m_yDim || outputDY.GetNumCols() != m_numColumns || dx.GetNumRows() != m_xDim || dx.GetNumCols() != m_numColumns)
+        InvalidArgument("RNNBackwardData: gradients do not match the layout of the last forward pass.");
+
+    if (m_BackwardDataCalledYet)
+        return;
+
+    // The gate gradients of all layers stay in the front of the workspace for BackwardWeightsCore.
+    size_t numLayerDirs = m_rnnAttributes.m_numLayers * NumDirections();
+    size_t gateSize = m_numGates * m_hiddenSize * m_numColumns;
+    size_t gradSize = gateSize * numLayerDirs * (m_cellKind == CellKind::Gru ? 2 : 1);
+    size_t dySize = m_yDim * m_numColumns;
+    workspace.Resize(gradSize + 2 * dySize + 2 * m_hiddenSize * m_numColumns, 1);
+    ElemType* dGatesAll = workspace.Data();
+    ElemType* dRecurrentAll = m_cellKind == CellKind::Gru ? dGatesAll + gateSize * numLayerDirs : dGatesAll;
+    ElemType* dyBuffers[2] = { dGatesAll + gradSize, dGatesAll + gradSize + dySize };
+    ElemType* temp = dyBuffers[1] + dySize;
+
+    const ElemType* w = weightsW.Data();
+    const ElemType* dy = outputDY.Data();
+    for (size_t layer = m_rnnAttributes.m_numLayers; layer-- > 0;)
+    {
+        ParamOffsets p0 = GetParamOffsets(layer, 0);
+        ElemType* dIn = layer == 0 ? dx.Data() : dyBuffers[layer % 2];
+        for (size_t dir = 0; dir < NumDirections(); dir++)
+        {
+            size_t index = layer * NumDirections() + dir;
+            ElemType* dGates = dGatesAll + index * gateSize;
+            ElemType* dRecurrent = dRecurrentAll + index * gateSize;
+            BackwardLayerData(w, layer, dir, dy + dir * m_hiddenSize, reserve.Data(), dGates, dRecurrent, temp);
+
+            // Gradient of the layer input, summed over the directions.
+            ParamOffsets p = GetParamOffsets(layer, dir);
+            RNNGemm(false, false, (int)p0.inputDim, (int)m_numColumns, (int)(m_numGates * m_hiddenSize), 1, w + p.w, (int)p.inputDim,
+                    dGates, (int)(m_numGates * m_hiddenSize), dir == 0 ? 0 : 1, dIn, (int)p0.inputDim);
+        }
+        dy = dIn;
+    }
+    m_BackwardDataCalledYet = true;
+}
+
+template <class ElemType>
+void CPURNNExecutor<ElemType>::BackwardWeightsCore(const CPUMatrix<ElemType>& inputX, const CPUMatrix<ElemType>& outputY, CPUMatrix<ElemType>& dw,
+                                                   const RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace)
+{
+    UNUSED(outputY);
+    if (!(m_rnnAttributes == rnnAttributes))
+        LogicError("RNN Layout has changed during processing");
+    if (!m_BackwardDataCalledYet)
+        LogicError("RNNBackwardWeights: RNNBackwardData must be called first.");
+    if (dw.GetNumElements() != GetNumParameters())
+        InvalidArgument("RNN needs %ld parameters, but the gradient has %ld", (long)GetNumParameters(), (long)dw.GetNumElements());
+
+    size_t numLayerDirs = m_rnnAttributes.m_numLayers * NumDirections();
+    const int H = (int)m_hiddenSize;
+    const int gateRows = (int)m_numGates * H;
+    const int outRows = (int)m_yDim;
+    const int N = (int)m_numColumns;
+    size_t gateSize = (size_t)gateRows * N;
+    const ElemType* dGatesAll = workspace.Data();
+    const ElemType* dRecurrentAll = m_cellKind == CellKind::Gru ? dGatesAll + gateSize * numLayerDirs : dGatesAll;
+
+    // The gradients are accumulated into dw, like cudnnRNNBackwardWeights does.
+    ElemType* dW = dw.Data();
+    for (size_t layer = 0; layer < m_rnnAttributes.m_numLayers; layer++)
+    {
+        const ElemType* x = layer == 0 ? inputX.Data() : LayerOutput(reserve.Data(), layer - 1);
+        const ElemType* out = LayerOutput(reserve.Data(), layer);
+        for (size_t dir = 0; dir < NumDirections(); dir++)
+        {
+            ParamOffsets p = GetParamOffsets(layer, dir);
+            size_t index = layer * NumDirections() + dir;
+            const ElemType* dGates = dGatesAll + index * gateSize;
+            const ElemType* dRecurrent = dRecurrentAll + index * gateSize;
+
+            RNNGemm(false, true, (int)p.inputDim, gateRows, N, 1, x, (int)p.inputDim, dGates, gateRows, 1, dW + p.w, (int)p.inputDim);
+
+            for (size_t t = 0; t < m_numSequencesForFrame.size(); t++)
+            {
+                int numPrev = (int)NumPreviousSequences(t, dir);
+                if (numPrev == 0)
+                    continue;
+                size_t prevCol = FrameOffset(dir == 0 ? t - 1 : t + 1);
+                RNNGemm(false, true, H, gateRows, numPrev, 1, out + prevCol * outRows + dir * H, outRows,
+                        dRecurrent + FrameOffset(t) * gateRows, gateRows, 1, dW + p.r, H);
+            }
+
+            ElemType* dbw = dW + p.bw;
+            ElemType* dbr = dW + p.br;
+            for (int j = 0; j < N; j++)
+            {
+                const ElemType* dg = dGates + (size_t)j * gateRows;
+                const ElemType* dgr = dRecurrent + (size_t)j * gateRows;
+                for (int k = 0; k < gateRows; k++)
+                {
+                    dbw[k] += dg[k];
+                    dbr[k] += dgr[k];
+                }
+            }
+        }
+    }
+}
+
+template class CPURNNExecutor<float>;
+template class CPURNNExecutor<double>;
+
+}}}
@@ -0,0 +1,95 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#pragma once
+
+#include "CPUMatrix.h"
+#include "RNNCommon.h"
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// CPURNNExecutor is the CPU counterpart of CuDnnRNNExecutor: it runs a stack of LSTM, GRU or plain
+// RNN layers (optionally bidirectional) on data in the dense cuDNN packing, i.e. frame-major with
+// numSequencesForFrame[t] sequences in frame t, sorted by decreasing length.
+//
+// The parameters use the cuDNN layout (CUDNN_LINEAR_INPUT), so models can move between GPU and CPU:
+// for every layer and direction the input weights W [numGates * hidden x input] and the recurrent
+// weights R [numGates * hidden x hidden] in row-major order, followed by two bias vectors (for W and
+// for R) per layer and direction. Gates are ordered i, f, c, o for LSTM and r, z, h for GRU, and the
+// cells follow the cuDNN equations.
+//
+// Forward computes the input projections of all frames with one GEMM per layer and direction and
+// then runs the recurrence frame by frame, with a GEMM for the recurrent projection and a fused,
+// threaded kernel for the gate nonlinearities and the state update. The gate activations, cell
+// states and layer outputs are kept in 'reserve' for backpropagation.
+template <class ElemType>
+class CPURNNExecutor
+{
+public:
+    CPURNNExecutor(size_t xDim, size_t yDim, const RnnAttributes& rnnAttributes);
+
+    bool IsCompatible(size_t xDim, size_t yDim, const RnnAttributes& rnnAttributes) const
+    {
+        return m_xDim == xDim && m_yDim == yDim && m_rnnAttributes == rnnAttributes;
+    }
+
+    void ForwardCore(const CPUMatrix<ElemType>& weightsW, const CPUMatrix<ElemType>& inputX, CPUMatrix<ElemType>& outputY, const vector<size_t>& numSequencesForFrame, const RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace);
+    void BackwardDataCore(const CPUMatrix<ElemType>& outputY, const CPUMatrix<ElemType>& outputDY, const CPUMatrix<ElemType>& weightsW, CPUMatrix<ElemType>& dx, const RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace);
+    void BackwardWeightsCore(const CPUMatrix<ElemType>& inputX, const CPUMatrix<ElemType>& outputY, CPUMatrix<ElemType>& dw, const RnnAttributes& rnnAttributes, CPUMatrix<ElemType>& reserve, CPUMatrix<ElemType>& workspace);
+
+    DISABLE_COPY_AND_MOVE(CPURNNExecutor);
+
+private:
+    enum class CellKind
+    {
+        Lstm,
+        Gru,
+        RnnReLU,
+        RnnTanh
+    };
+
+    // Offsets of the parameters of one layer and direction in the weight vector.
+    struct ParamOffsets
+    {
+        size_t w, r, bw, br;
+        size_t inputDim;
+    };
+
+    size_t NumDirections() const { return m_rnnAttributes.m_bidirectional ? 2 : 1; }
+    size_t LayerInputDim(size_t layer) const { return layer == 0 ? m_xDim : NumDirections() * m_hiddenSize; }
+    ParamOffsets GetParamOffsets(size_t layer, size_t dir) const;
+    size_t GetNumParameters() const;
+
+    // Sizes (in elements) and offsets in 'reserve' of the state of a layer and direction.
+    size_t StateRows() const;
+    ElemType* GateActivations(ElemType* reserve, size_t layer, size_t dir) const;
+    ElemType* CellStates(ElemType* reserve, size_t layer, size_t dir) const;
+    ElemType* LayerOutput(ElemType* reserve, size_t layer) const;
+    size_t ReserveSize() const;
+
+    // Columns of frame t and the number of sequences of frame t that continue a sequence of the
+    // previous frame in processing order (t - 1 forward, t + 1 backward).
+    size_t FrameOffset(size_t t) const { return m_frameOffsets[t]; }
+    size_t NumPreviousSequences(size_t t, size_t dir) const;
+
+    void ForwardLayer(const ElemType* w, size_t layer, size_t dir, const ElemType* x, ElemType* reserve, ElemType* workspace);
+    void BackwardLayerData(const ElemType* w, size_t layer, size_t dir, const ElemType* dy, ElemType* reserve, ElemType* dGates, ElemType* dRecurrent, ElemType* workspace);
+
+    size_t m_xDim, m_yDim;
+    size_t m_hiddenSize;
+    size_t m_numGates;
+    CellKind m_cellKind;
+    RnnAttributes m_rnnAttributes;
+
+    // layout of the current minibatch
+    std::vector<size_t> m_numSequencesForFrame;
+    std::vector<size_t> m_frameOffsets;
+    size_t m_numColumns;
+    size_t m_maxSequences;
+
+    bool m_BackwardDataCalledYet;
+};
+
+}}}
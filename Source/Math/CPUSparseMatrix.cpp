@@ -290,7 +290,8 @@ void CPUSparseMatrix<ElemType>::SetValue(const size_t row, const size_t col, con
     }
     // Note we don't have m_nz anymore. In order for the change from m_nz to
     // NzCount to make sense, we need to propogate nz+1 to all col slices.
-    for (size_t max = c + 1; max < m_numCols + 1; max++)
+    size_t numSecondary = (GetFormat() == matrixFormatSparseCSC) ? m_numCols : m_numRows;
+    for (size_t max = c + 1; max < numSecondary + 1; max++)
     {
         SecondaryIndexLocation()[max] = CPUSPARSE_INDEX_TYPE(nz + 1);
     }
@@ -870,7 +871,67 @@ void CPUSparseMatrix<ElemType>::Reset()
     SetBlockIdShift(0);
 }
 
+// Nonzero elements of a CSC or CSR matrix grouped along its compressed dimension, i.e. by column for CSC and
+// by row for CSR. The nonzeros of group g are the entries start[g] - start[0] ... start[g + 1] - start[0] of
+// 'index' (their position along the other dimension) and 'value'.
+template <class ElemType>
+struct SparseGroups
+{
+    size_t numGroups;
+    const CPUSPARSE_INDEX_TYPE* start;
+    const CPUSPARSE_INDEX_TYPE* index;
+    const ElemType* value;
+
+    // Groups as stored in the matrix.
+    explicit SparseGroups(const CPUSparseMatrix<ElemType>& a)
+        : numGroups(a.GetFormat() == matrixFormatSparseCSC ? a.GetNumCols() : a.GetNumRows()),
+          start(a.SecondaryIndexLocation()), index(a.MajorIndexLocation()), value(a.Data())
+    {
+    }
+
+    // Groups along the other dimension (of size numGroupsOther), i.e. CSC converted to CSR and vice versa.
+    // This is a counting sort in O(nnz + numGroupsOther) which keeps the nonzeros of each new group ordered.
+    SparseGroups(const SparseGroups& other, size_t numGroupsOther)
+        : numGroups(numGroupsOther), m_start(numGroupsOther + 1, 0)
+    {
+        size_t nz = other.start[other.numGroups] - other.start[0];
+        for (size_t p = 0; p < nz; p++)
+            m_start[other.index[p] + 1]++;
+        for (size_t g = 0; g < numGroups; g++)
+            m_start[g + 1] += m_start[g];
+
+        m_index.resize(nz);
+        m_value.resize(nz);
+        vector<CPUSPARSE_INDEX_TYPE> next(m_start.begin(), m_start.end() - 1);
+        for (size_t g = 0; g < other.numGroups; g++)
+        {
+            for (size_t p = other.start[g] - other.start[0]; p < other.start[g + 1] - other.start[0]; p++)
+            {
+                auto q = next[other.index[p]]++;
+                m_index[q] = (CPUSPARSE_INDEX_TYPE) g;
+                m_value[q] = other.value[p];
+            }
+        }
+        start = m_start.data();
+        index = m_index.data();
+        value = m_value.data();
+    }
+
+    SparseGroups(const SparseGroups&) = delete;
+    SparseGroups& operator=(const SparseGroups&) = delete;
+
+private:
+    vector<CPUSPARSE_INDEX_TYPE> m_start, m_index;
+    vector<ElemType> m_value;
+};
+
 // Implements product of one sparse and one dense matrix updating a third dense matrix. Input matrices are optionally transposed.
+// The sparse matrix may be CSC or CSR.
+//
+// The product is parallelized over the rows (sparse times dense) or columns (dense times sparse) of c that the
+// nonzeros of the sparse factor are scattered to, so every thread owns its part of c and no atomics are needed.
+// If the sparse matrix is not stored grouped along that dimension (e.g. CSC in sparse times dense) the nonzeros
+// are regrouped first, so the scatter runs in two phases: a serial O(nnz) counting sort and the parallel product.
 // NOTE: The only for using a class template instead of a function template was that I couldn't make the function template compile.
 template <class ElemType, bool denseTimesSparse /* false means SparseTimesDense */, bool transposeA, bool transposeB>
 class MultiplyDenseAndSparse{
@@ -891,13 +952,6 @@ public:
         if (k != l)
             InvalidArgument("CPUSparseMatrix::MultiplyAndWeightedAdd: The inner dimensions of a (= %lu) and b (= %lu) don't match.", k, l);
 
-        // Determine the dimension of the outer index of the dense matrix.
-        size_t outerDimensionDense;
-        if      ( denseTimesSparse && !transposeA) outerDimensionDense = dense.GetNumRows();
-        else if ( denseTimesSparse &&  transposeA) outerDimensionDense = dense.GetNumCols();
-        else if (!denseTimesSparse && !transposeB) outerDimensionDense = dense.GetNumCols();
-        else if (!denseTimesSparse &&  transposeB) outerDimensionDense = dense.GetNumRows();
-
         if (beta == 0)
             c.RequireSize(m, n);
         else
@@ -920,56 +974,74 @@ public:
         if (sparse.IsEmpty() || dense.IsEmpty())
             return;
 
-        // TODO: Implement CSR as a transposition of b, like we do for GPU.
-        if (sparse.GetFormat() != matrixFormatSparseCSC)
+        if (sparse.GetFormat() != matrixFormatSparseCSC && sparse.GetFormat() != matrixFormatSparseCSR)
             NOT_IMPLEMENTED;
 
         // Up to here we have:
         // * checked that the matrices are compatible in size
         // * Initialized the output matrix c
 
-        // Now do the actual multiplication.
-        ElemType* valueBuffer = sparse.Buffer() + *sparse.SecondaryIndexLocation(); // Points to the value buffer of the current view (i.e. buffer containing values of non-zero elements).
-        int* rowIndexBuffer = sparse.MajorIndexLocation();                          // Points to the index buffer of the current view (i.e. buffer containing indices of non-zero elements).
-        size_t iNonzero = 0;                                                           // Number of nonzero elements handled so far for curent slice view.
-        int numPreviosNonzero = sparse.SecondaryIndexLocation()[0];                 // Total number of nonzero values handled in previous slices.
-
-        // Loop over columns of the sparse matrix
-        for (size_t colSparse = 0; colSparse < sparse.GetNumCols(); colSparse++)
+        // The nonzeros of the sparse factor as it enters the product (i.e. after transposition) are needed
+        // grouped by its columns for dense times sparse, and by its rows for sparse times dense. Regroup if
+        // the storage is the other way round.
+        bool isCSC = sparse.GetFormat() == matrixFormatSparseCSC;
+        bool transposeSparse = denseTimesSparse ? transposeB : transposeA;
+        bool storedByColumnsOfFactor = isCSC != transposeSparse;
+        const SparseGroups<ElemType> stored(sparse);
+        unique_ptr<SparseGroups<ElemType>> regrouped;
+        if (storedByColumnsOfFactor != denseTimesSparse)
+            regrouped.reset(new SparseGroups<ElemType>(stored, isCSC ? sparse.GetNumRows() : sparse.GetNumCols()));
+        const SparseGroups<ElemType>& groups = regrouped ? *regrouped : stored;
+
+        const ElemType* denseData = dense.Data();
+        size_t ldDense = dense.GetNumRows();
+        ElemType* cData = c.Data();
+        size_t ldc = c.GetNumRows();
+
+        // Each group updates one column (dense times sparse) or row (sparse times dense) of c.
+#pragma omp parallel for
+        for (long g = 0; g < (long) groups.numGroups; g++)
         {
-            size_t numNonzeroInSparseCol = sparse.SecondaryIndexLocation()[colSparse + 1] - numPreviosNonzero;
-            // Loop over the nonzero rows of the current column of the sparse matrix
-            for (; iNonzero < numNonzeroInSparseCol; iNonzero++)
+            size_t begin = groups.start[g] - groups.start[0];
+            size_t end = groups.start[g + 1] - groups.start[0];
+            if (begin == end)
+                continue;
+
+            // Below if-statements are evaluated at compile time.
+            if (denseTimesSparse)
+            {
+                // c[:, g] += alpha * sum_p value[p] * op(dense)[:, index[p]]
+                ElemType* cCol = cData + g * ldc;
+                for (size_t p = begin; p < end; p++)
+                {
+                    size_t innerIndex = groups.index[p];
+                    ElemType sparseVal = alpha * groups.value[p];
+                    if (!transposeA)
+                    {
+                        const ElemType* denseCol = denseData + innerIndex * ldDense;
+                        for (size_t i = 0; i < m; i++)
+                            cCol[i] += sparseVal * denseCol[i];
+                    }
+                    else
+                    {
+                        for (size_t i = 0; i < m; i++)
+                            cCol[i] += sparseVal * denseData[innerIndex + i * ldDense];
+                    }
+                }
+            }
+            else
             {
-                size_t rowSparse = rowIndexBuffer[iNonzero]; // RowLocation
-                ElemType sparseVal = valueBuffer[iNonzero];
-
-                // Determine the index of the 'outer' dimension of the sparse matrix and the common inner index.
-                size_t outerIndexSparse;
-                size_t innerIndex;
-                // Below if-statements are evaluated at compile time.
-                if      ( denseTimesSparse && !transposeB) { outerIndexSparse = colSparse; innerIndex = rowSparse; }
-                else if ( denseTimesSparse &&  transposeB) { outerIndexSparse = rowSparse; innerIndex = colSparse; }
-                else if (!denseTimesSparse && !transposeA) { outerIndexSparse = rowSparse; innerIndex = colSparse; }
-                else if (!denseTimesSparse &&  transposeA) { outerIndexSparse = colSparse; innerIndex = rowSparse; }
-
-                // Loop over the outer index of the dense matrix
-                for (size_t outerIndexDense = 0; outerIndexDense < outerDimensionDense; outerIndexDense++)
+                // c[g, :] += alpha * sum_p value[p] * op(dense)[index[p], :]
+                for (size_t j = 0; j < n; j++)
                 {
-                    // Determine the row index of the dense input matrix.
-                    // Below if-statements are evaluated at compile time.
-                    ElemType denseVal;
-                    if      ( denseTimesSparse && !transposeA) denseVal = dense(outerIndexDense,      innerIndex);
-                    else if ( denseTimesSparse &&  transposeA) denseVal = dense(     innerIndex, outerIndexDense);
-                    else if (!denseTimesSparse && !transposeB) denseVal = dense(     innerIndex, outerIndexDense);
-                    else if (!denseTimesSparse &&  transposeB) denseVal = dense(outerIndexDense,      innerIndex);
-                    
-
-                    // Update matrix c.
-                    if (denseTimesSparse)
-                        c(outerIndexDense, outerIndexSparse) += alpha * denseVal * sparseVal;
-                    else /*Sparse times dense */
-                        c(outerIndexSparse, outerIndexDense) += alpha * denseVal * sparseVal;
+                    ElemType sum = 0;
+                    for (size_t p = begin; p < end; p++)
+                    {
+                        size_t innerIndex = groups.index[p];
+                        ElemType denseVal = transposeB ? denseData[j + innerIndex * ldDense] : denseData[innerIndex + j * ldDense];
+                        sum += groups.value[p] * denseVal;
+                    }
+                    cData[g + j * ldc] += alpha * sum;
                 }
             }
         }
@@ -1060,16 +1132,22 @@ void CPUSparseMatrix<ElemType>::MultiplyAndAdd(ElemType alpha, const CPUMatrix<E
             col2BlockId[c.GetBlockIds()[blockId]] = blockId;
         }
 
+        // Phase 1: assign a block to every column of c that is hit, and group the nonzeros of rhs by the
+        // block they update (counting sort).
+        size_t nz = rhs.NzCount();
+        vector<size_t> nzBlock(nz);
         size_t blockSizeCurr = blockSizePrev;
-        for (size_t rhsNz = 0; rhsNz < rhs.NzCount(); rhsNz++)
+        for (size_t rhsNz = 0; rhsNz < nz; rhsNz++)
         {
             size_t resultCol = rhs.MajorIndexLocation()[rhsNz];
-            if (col2BlockId.find(resultCol) == col2BlockId.end())
+            auto iter = col2BlockId.find(resultCol);
+            if (iter == col2BlockId.end())
             {
-                col2BlockId[resultCol] = blockSizeCurr;
+                iter = col2BlockId.insert(make_pair(resultCol, blockSizeCurr)).first;
                 c.GetBlockIds()[blockSizeCurr] = resultCol;
                 blockSizeCurr ++;
             }
+            nzBlock[rhsNz] = iter->second;
         }
 
         if (blockSizeCurr > blockSizePrev)
@@ -1079,22 +1157,39 @@ void CPUSparseMatrix<ElemType>::MultiplyAndAdd(ElemType alpha, const CPUMatrix<E
             memset(c.Data() + m * blockSizePrev, 0, sizeof(ElemType) * m * (blockSizeCurr - blockSizePrev));
         }
 
+        vector<size_t> blockStart(blockSizeCurr + 1, 0);
+        for (size_t rhsNz = 0; rhsNz < nz; rhsNz++)
+            blockStart[nzBlock[rhsNz] + 1]++;
+        for (size_t blockId = 0; blockId < blockSizeCurr; blockId++)
+            blockStart[blockId + 1] += blockStart[blockId];
+
+        vector<size_t> nzByBlock(nz), rhsColByBlock(nz);
+        vector<size_t> next(blockStart.begin(), blockStart.end() - 1);
+        size_t firstNz = rhs.SecondaryIndexLocation()[0];
         for (size_t rhsCol = 0; rhsCol < rhs.GetNumCols(); rhsCol++)
         {
-            size_t start = rhs.SecondaryIndexLocation()[rhsCol];
-            size_t end = rhs.SecondaryIndexLocation()[rhsCol + 1];
-
-            for (size_t p = start; p < end; p++)
+            for (size_t p = rhs.SecondaryIndexLocation()[rhsCol] - firstNz; p < rhs.SecondaryIndexLocation()[rhsCol + 1] - firstNz; p++)
             {
-                size_t rhsRow = rhs.MajorIndexLocation()[p];
-                ElemType val = rhs.Buffer()[p];
+                size_t q = next[nzBlock[p]]++;
+                nzByBlock[q] = p;
+                rhsColByBlock[q] = rhsCol;
+            }
+        }
 
-                ElemType* results = c.Buffer() + col2BlockId[rhsRow] * m;
-                #pragma omp parallel for
-                for (int lhsRow = 0; lhsRow < (int)m; lhsRow++)
-                {
-                    results[lhsRow] += alpha * lhs((size_t)lhsRow, rhsCol) * val;
-                }
+        // Phase 2: every thread accumulates into its own blocks, i.e. columns of c.
+        const ElemType* rhsValues = rhs.Data();
+        const ElemType* lhsData = lhs.Data();
+        size_t ldLhs = lhs.GetNumRows();
+#pragma omp parallel for
+        for (long blockId = 0; blockId < (long) blockSizeCurr; blockId++)
+        {
+            ElemType* results = c.Buffer() + blockId * m;
+            for (size_t q = blockStart[blockId]; q < blockStart[blockId + 1]; q++)
+            {
+                ElemType val = alpha * rhsValues[nzByBlock[q]];
+                const ElemType* lhsCol = lhsData + rhsColByBlock[q] * ldLhs;
+                for (size_t lhsRow = 0; lhsRow < m; lhsRow++)
+                    results[lhsRow] += lhsCol[lhsRow] * val;
             }
         }
     }
@@ -1163,8 +1258,10 @@ void CPUSparseMatrix<ElemType>::ScaleAndAdd(const ElemType alpha, const CPUSpars
 
     if (lhs.GetFormat() == MatrixFormat::matrixFormatSparseCSC || lhs.GetFormat() == MatrixFormat::matrixFormatSparseCSR)
     {
+        // every column (CSC) or row (CSR) of lhs updates its own column or row of rhs
         size_t col_num = (lhs.GetFormat() == MatrixFormat::matrixFormatSparseCSC) ? lhs.GetNumCols() : lhs.GetNumRows();
-        for (size_t j = 0; j < col_num; j++)
+#pragma omp parallel for
+        for (long j = 0; j < (long)col_num; j++)
         {
             size_t start = lhs.SecondaryIndexLocation()[j];
             size_t end = lhs.SecondaryIndexLocation()[j + 1];
@@ -1180,7 +1277,9 @@ void CPUSparseMatrix<ElemType>::ScaleAndAdd(const ElemType alpha, const CPUSpars
     }
     else if (lhs.GetFormat() == MatrixFormat::matrixFormatSparseBlockCol || lhs.GetFormat() == MatrixFormat::matrixFormatSparseBlockRow)
     {
-        for (size_t j = 0; j < lhs.GetBlockSize(); j++)
+        // block ids are unique, so the blocks can be added in parallel
+#pragma omp parallel for
+        for (long j = 0; j < (long)lhs.GetBlockSize(); j++)
         {
             size_t i = lhs.GetBlockIds()[j] - lhs.GetBlockIdShift();
             size_t len = (lhs.GetFormat() == MatrixFormat::matrixFormatSparseBlockCol) ? lhs.GetNumRows() : lhs.GetNumCols();
@@ -1304,7 +1403,8 @@ void CPUSparseMatrix<ElemType>::NormalGrad(CPUMatrix<ElemType>& c, const ElemTyp
     if (GetFormat() == MatrixFormat::matrixFormatSparseBlockCol || GetFormat() == MatrixFormat::matrixFormatSparseBlockRow)
     {
         const auto isSparseBlockCol = (GetFormat() == MatrixFormat::matrixFormatSparseBlockCol);
-        for (size_t j = 0; j < GetBlockSize(); j++)
+#pragma omp parallel for
+        for (long j = 0; j < (long)GetBlockSize(); j++)
         {
             size_t i = GetBlockIds()[j] - GetBlockIdShift();
             size_t len = (isSparseBlockCol) ? GetNumRows() : GetNumCols();
@@ -1342,7 +1442,8 @@ ElemType CPUSparseMatrix<ElemType>::Adagrad(CPUMatrix<ElemType>& c, const bool n
     if (GetFormat() == MatrixFormat::matrixFormatSparseCSC || GetFormat() == MatrixFormat::matrixFormatSparseCSR)
     {
         size_t col_num = (GetFormat() == MatrixFormat::matrixFormatSparseCSC) ? GetNumCols() : GetNumRows();
-        for (size_t j = 0; j < col_num; j++)
+#pragma omp parallel for reduction(+ : aveMultiplier)
+        for (long j = 0; j < (long)col_num; j++)
         {
             size_t start = SecondaryIndexLocation()[j];
             size_t end = SecondaryIndexLocation()[j + 1];
@@ -1367,11 +1468,12 @@ ElemType CPUSparseMatrix<ElemType>::Adagrad(CPUMatrix<ElemType>& c, const bool n
     else if (GetFormat() == MatrixFormat::matrixFormatSparseBlockCol || GetFormat() == MatrixFormat::matrixFormatSparseBlockRow)
     {
         size_t len = (GetFormat() == MatrixFormat::matrixFormatSparseBlockCol) ? GetNumRows() : GetNumCols();
-        size_t p = 0;
-        for (long j = 0; j < GetBlockSize(); j++)
+#pragma omp parallel for reduction(+ : aveMultiplier)
+        for (long j = 0; j < (long)GetBlockSize(); j++)
         {
             size_t colOrRow = GetBlockIds()[j] - GetBlockIdShift();
-            for (long i = 0; i < len; i++, p++)
+            size_t p = j * len;
+            for (long i = 0; i < (long)len; i++, p++)
             {
                 ElemType val = Buffer()[p];
 
@@ -0,0 +1,296 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUTensorOpKernels.h : explicitly vectorized innermost loops of the CPU tensor ops
+//
+// The generic tensor op engine in CPUMatrixImpl.h calls an op lambda per element, which compilers
+// do not reliably vectorize. The kernels below handle the most frequent ops on contiguous data
+// with AVX-512 or AVX2 registers, depending on the instruction set the file is compiled for,
+// and fall back to plain loops otherwise. They compute the same values as the Op* functions in
+// TensorOps.h, up to the summation order of reductions.
+//
+
+#pragma once
+
+#include "TensorOps.h"
+#include <cstddef>
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// SimdVector -- the widest vector register of the target instruction set
+// -----------------------------------------------------------------------
+
+// Only specialized if the file is compiled for AVX2 or AVX-512. Kernels check CNTK_TENSOROP_SIMD.
+template <class ElemType>
+struct SimdVector;
+
+#if defined(__AVX512F__)
+
+#define CNTK_TENSOROP_SIMD
+
+template <>
+struct SimdVector<float>
+{
+    typedef __m512 Type;
+    static const size_t Width = 16;
+    static Type Load(const float* p) { return _mm512_loadu_ps(p); }
+    static void Store(float* p, Type a) { _mm512_storeu_ps(p, a); }
+    static Type Set(float a) { return _mm512_set1_ps(a); }
+    static Type Zero() { return _mm512_setzero_ps(); }
+    static Type Add(Type a, Type b) { return _mm512_add_ps(a, b); }
+    static Type Sub(Type a, Type b) { return _mm512_sub_ps(a, b); }
+    static Type Mul(Type a, Type b) { return _mm512_mul_ps(a, b); }
+    static Type Max(Type a, Type b) { return _mm512_max_ps(a, b); } // a > b ? a : b, like OpMax()
+    static Type Negate(Type a) { return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a), _mm512_set1_epi32((int) 0x80000000))); }
+    static Type IfPositive(Type c, Type a) { return _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(c, Zero(), _CMP_GT_OQ), a); } // c > 0 ? a : 0
+};
+
+template <>
+struct SimdVector<double>
+{
+    typedef __m512d Type;
+    static const size_t Width = 8;
+    static Type Load(const double* p) { return _mm512_loadu_pd(p); }
+    static void Store(double* p, Type a) { _mm512_storeu_pd(p, a); }
+    static Type Set(double a) { return _mm512_set1_pd(a); }
+    static Type Zero() { return _mm512_setzero_pd(); }
+    static Type Add(Type a, Type b) { return _mm512_add_pd(a, b); }
+    static Type Sub(Type a, Type b) { return _mm512_sub_pd(a, b); }
+    static Type Mul(Type a, Type b) { return _mm512_mul_pd(a, b); }
+    static Type Max(Type a, Type b) { return _mm512_max_pd(a, b); }
+    static Type Negate(Type a) { return _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(a), _mm512_set1_epi64(0x8000000000000000ll))); }
+    static Type IfPositive(Type c, Type a) { return _mm512_maskz_mov_pd(_mm512_cmp_pd_mask(c, Zero(), _CMP_GT_OQ), a); }
+};
+
+// sums are accumulated in double, like in the generic reduction
+struct SimdSumAccumulator
+{
+    typedef __m512d Type;
+    static const size_t Width = 8;
+    static Type Load(const float* p) { return _mm512_cvtps_pd(_mm256_loadu_ps(p)); }
+    static Type Load(const double* p) { return _mm512_loadu_pd(p); }
+    static void Store(double* p, Type a) { _mm512_storeu_pd(p, a); }
+    static Type Zero() { return _mm512_setzero_pd(); }
+    static Type Add(Type a, Type b) { return _mm512_add_pd(a, b); }
+};
+
+#elif defined(__AVX2__)
+
+#define CNTK_TENSOROP_SIMD
+
+template <>
+struct SimdVector<float>
+{
+    typedef __m256 Type;
+    static const size_t Width = 8;
+    static Type Load(const float* p) { return _mm256_loadu_ps(p); }
+    static void Store(float* p, Type a) { _mm256_storeu_ps(p, a); }
+    static Type Set(float a) { return _mm256_set1_ps(a); }
+    static Type Zero() { return _mm256_setzero_ps(); }
+    static Type Add(Type a, Type b) { return _mm256_add_ps(a, b); }
+    static Type Sub(Type a, Type b) { return _mm256_sub_ps(a, b); }
+    static Type Mul(Type a, Type b) { return _mm256_mul_ps(a, b); }
+    static Type Max(Type a, Type b) { return _mm256_max_ps(a, b); } // a > b ? a : b, like OpMax()
+    static Type Negate(Type a) { return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f)); }
+    static Type IfPositive(Type c, Type a) { return _mm256_and_ps(_mm256_cmp_ps(c, Zero(), _CMP_GT_OQ), a); } // c > 0 ? a : 0
+};
+
+template <>
+struct SimdVector<double>
+{
+    typedef __m256d Type;
+    static const size_t Width = 4;
+    static Type Load(const double* p) { return _mm256_loadu_pd(p); }
+    static void Store(double* p, Type a) { _mm256_storeu_pd(p, a); }
+    static Type Set(double a) { return _mm256_set1_pd(a); }
+    static Type Zero() { return _mm256_setzero_pd(); }
+    static Type Add(Type a, Type b) { return _mm256_add_pd(a, b); }
+    static Type Sub(Type a, Type b) { return _mm256_sub_pd(a, b); }
+    static Type Mul(Type a, Type b) { return _mm256_mul_pd(a, b); }
+    static Type Max(Type a, Type b) { return _mm256_max_pd(a, b); }
+    static Type Negate(Type a) { return _mm256_xor_pd(a, _mm256_set1_pd(-0.0)); }
+    static Type IfPositive(Type c, Type a) { return _mm256_and_pd(_mm256_cmp_pd(c, Zero(), _CMP_GT_OQ), a); }
+};
+
+// sums are accumulated in double, like in the generic reduction
+struct SimdSumAccumulator
+{
+    typedef __m256d Type;
+    static const size_t Width = 4;
+    static Type Load(const float* p) { return _mm256_cvtps_pd(_mm_loadu_ps(p)); }
+    static Type Load(const double* p) { return _mm256_loadu_pd(p); }
+    static void Store(double* p, Type a) { _mm256_storeu_pd(p, a); }
+    static Type Zero() { return _mm256_setzero_pd(); }
+    static Type Add(Type a, Type b) { return _mm256_add_pd(a, b); }
+};
+
+#endif
+
+// -----------------------------------------------------------------------
+// elementwise kernels
+// Each kernel provides the scalar op (identical to the Op* function) and its vector version.
+// -----------------------------------------------------------------------
+
+struct SimdOpCopy
+{
+    template <class ElemType> static ElemType Scalar(ElemType a) { return OpCopy(a); }
+    template <class V> static typename V::Type Vector(typename V::Type a) { return a; }
+};
+
+struct SimdOpNegate
+{
+    template <class ElemType> static ElemType Scalar(ElemType a) { return OpNegate(a); }
+    template <class V> static typename V::Type Vector(typename V::Type a) { return V::Negate(a); }
+};
+
+struct SimdOpLinearRectifier
+{
+    template <class ElemType> static ElemType Scalar(ElemType a) { return OpLinearRectifier(a); }
+    template <class V> static typename V::Type Vector(typename V::Type a) { return V::IfPositive(a, a); }
+};
+
+struct SimdOpSum
+{
+    template <class ElemType> static ElemType Scalar(ElemType a, ElemType b) { return OpSum(a, b); }
+    template <class V> static typename V::Type Vector(typename V::Type a, typename V::Type b) { return V::Add(a, b); }
+};
+
+struct SimdOpDifference
+{
+    template <class ElemType> static ElemType Scalar(ElemType a, ElemType b) { return OpDifference(a, b); }
+    template <class V> static typename V::Type Vector(typename V::Type a, typename V::Type b) { return V::Sub(a, b); }
+};
+
+struct SimdOpElementwiseProduct
+{
+    template <class ElemType> static ElemType Scalar(ElemType a, ElemType b) { return OpElementwiseProduct(a, b); }
+    template <class V> static typename V::Type Vector(typename V::Type a, typename V::Type b) { return V::Mul(a, b); }
+};
+
+// gradient of ReLU
+struct SimdOpElementwiseProductWithLinearRectifierDerivativeFromOutput
+{
+    template <class ElemType> static ElemType Scalar(ElemType a, ElemType b) { return OpElementwiseProductWithLinearRectifierDerivativeFromOutput(a, b); }
+    template <class V> static typename V::Type Vector(typename V::Type a, typename V::Type b) { return V::IfPositive(b, a); }
+};
+
+// -----------------------------------------------------------------------
+// contiguous loops c = beta * c + alpha * op(a [, b]) over n elements
+// As in the generic loop, c is not read if beta == 0.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+static inline ElemType SimdScaleAndAdd(ElemType beta, ElemType val, ElemType alpha, const ElemType* pc)
+{
+    val *= alpha;
+    if (beta != 0)
+        val += beta * *pc;
+    return val;
+}
+
+template <class Kernel, class ElemType>
+static void SimdUnaryLoop(ElemType beta, const ElemType* pa, ElemType alpha, ElemType* pc, size_t n)
+{
+    size_t i = 0;
+#ifdef CNTK_TENSOROP_SIMD
+    typedef SimdVector<ElemType> V;
+    const typename V::Type vbeta = V::Set(beta);
+    const typename V::Type valpha = V::Set(alpha);
+    if (beta != 0)
+        for (; i + V::Width <= n; i += V::Width)
+            V::Store(pc + i, V::Add(V::Mul(valpha, Kernel::template Vector<V>(V::Load(pa + i))), V::Mul(vbeta, V::Load(pc + i))));
+    else if (alpha != 1)
+        for (; i + V::Width <= n; i += V::Width)
+            V::Store(pc + i, V::Mul(valpha, Kernel::template Vector<V>(V::Load(pa + i))));
+    else
+        for (; i + V::Width <= n; i += V::Width)
+            V::Store(pc + i, Kernel::template Vector<V>(V::Load(pa + i)));
+#endif
+    for (; i < n; i++)
+        pc[i] = SimdScaleAndAdd(beta, Kernel::Scalar(pa[i]), alpha, pc + i);
+}
+
+template <class Kernel, class ElemType>
+static void SimdBinaryLoop(ElemType beta, const ElemType* pa, const ElemType* pb, ElemType alpha, ElemType* pc, size_t n)
+{
+    size_t i = 0;
+#ifdef CNTK_TENSOROP_SIMD
+    typedef SimdVector<ElemType> V;
+    const typename V::Type vbeta = V::Set(beta);
+    const typename V::Type valpha = V::Set(alpha);
+    if (beta != 0)
+        for (; i + V::Width <= n; i += V::Width)
+            V::Store(pc + i, V::Add(V::Mul(valpha, Kernel::template Vector<V>(V::Load(pa + i), V::Load(pb + i))), V::Mul(vbeta, V::Load(pc + i))));
+    else if (alpha != 1)
+        for (; i + V::Width <= n; i += V::Width)
+            V::Store(pc + i, V::Mul(valpha, Kernel::template Vector<V>(V::Load(pa + i), V::Load(pb + i))));
+    else
+        for (; i + V::Width <= n; i += V::Width)
+            V::Store(pc + i, Kernel::template Vector<V>(V::Load(pa + i), V::Load(pb + i)));
+#endif
+    for (; i < n; i++)
+        pc[i] = SimdScaleAndAdd(beta, Kernel::Scalar(pa[i], pb[i]), alpha, pc + i);
+}
+
+// -----------------------------------------------------------------------
+// contiguous reductions over n > 0 elements
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+static double SimdReduceSum(const ElemType* pa, size_t n)
+{
+    size_t i = 0;
+    double sum = 0;
+#ifdef CNTK_TENSOROP_SIMD
+    typedef SimdSumAccumulator A;
+    if (n >= 2 * A::Width)
+    {
+        // two accumulators to hide the latency of the additions
+        typename A::Type sum0 = A::Zero();
+        typename A::Type sum1 = A::Zero();
+        for (; i + 2 * A::Width <= n; i += 2 * A::Width)
+        {
+            sum0 = A::Add(sum0, A::Load(pa + i));
+            sum1 = A::Add(sum1, A::Load(pa + i + A::Width));
+        }
+        double lanes[A::Width];
+        A::Store(lanes, A::Add(sum0, sum1));
+        for (size_t j = 0; j < A::Width; j++)
+            sum += lanes[j];
+    }
+#endif
+    for (; i < n; i++)
+        sum += pa[i];
+    return sum;
+}
+
+template <class ElemType>
+static ElemType SimdReduceMax(const ElemType* pa, size_t n)
+{
+    size_t i = 1;
+    ElemType result = pa[0];
+#ifdef CNTK_TENSOROP_SIMD
+    typedef SimdVector<ElemType> V;
+    if (n >= V::Width)
+    {
+        typename V::Type max = V::Load(pa);
+        for (i = V::Width; i + V::Width <= n; i += V::Width)
+            max = V::Max(max, V::Load(pa + i));
+        ElemType lanes[V::Width];
+        V::Store(lanes, max);
+        result = lanes[0];
+        for (size_t j = 1; j < V::Width; j++)
+            result = OpMax(result, lanes[j]);
+    }
+#endif
+    for (; i < n; i++)
+        result = OpMax(result, pa[i]);
+    return result;
+}
+
+}}}
@@ -0,0 +1,273 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUThreadPool.cpp -- engine-wide layout of the CPU worker threads over NUMA nodes
+//
+
+#include "stdafx.h"
+#include "CPUThreadPool.h"
+#include <algorithm>
+#include <string.h>
+#include <thread>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef USE_MKL
+#include <mkl.h>
+#endif
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Buffers smaller than this are zeroed by the calling thread; they do not span enough pages to be
+// worth distributing.
+static const size_t s_minParallelZeroFillBytes = 1 << 20;
+static const size_t s_pageSize = 4096;
+
+#ifdef _WIN32
+
+static std::vector<std::vector<int>> GetNumaNodeProcessors()
+{
+    std::vector<std::vector<int>> nodes;
+    DWORD_PTR processMask, systemMask;
+    ULONG highestNode;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask) || !GetNumaHighestNodeNumber(&highestNode))
+        return nodes;
+
+    // Note: only processor group 0 is considered, as for the affinity mask of the process.
+    for (ULONG node = 0; node <= highestNode; node++)
+    {
+        ULONGLONG nodeMask;
+        if (!GetNumaNodeProcessorMask((UCHAR) node, &nodeMask))
+            continue;
+        std::vector<int> processors;
+        for (int cpu = 0; cpu < (int) (8 * sizeof(DWORD_PTR)); cpu++)
+        {
+            if ((nodeMask & processMask & ((DWORD_PTR) 1 << cpu)) != 0)
+                processors.push_back(cpu);
+        }
+        if (!processors.empty())
+            nodes.push_back(processors);
+    }
+    return nodes;
+}
+
+static void PinCurrentThread(const std::vector<int>& processors)
+{
+    DWORD_PTR mask = 0;
+    for (int cpu : processors)
+        mask |= (DWORD_PTR) 1 << cpu;
+    SetThreadAffinityMask(GetCurrentThread(), mask);
+}
+
+#else
+
+// Parses a Linux cpu list such as "0-11,24-35".
+static std::vector<int> ParseCpuList(const char* list)
+{
+    std::vector<int> cpus;
+    const char* p = list;
+    while (*p)
+    {
+        char* end;
+        long first = strtol(p, &end, 10);
+        if (end == p)
+            break;
+        long last = first;
+        p = end;
+        if (*p == '-')
+        {
+            last = strtol(p + 1, &end, 10);
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; cpu++)
+            cpus.push_back((int) cpu);
+        if (*p == ',')
+            p++;
+        else
+            break;
+    }
+    return cpus;
+}
+
+static std::vector<std::vector<int>> GetNumaNodeProcessors()
+{
+    std::vector<std::vector<int>> nodes;
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return nodes;
+
+    // Node ids may have gaps (e.g. offline or memory-only nodes), so probe a generous range.
+    for (int node = 0; node < 1024; node++)
+    {
+        char path[128];
+        sprintf(path, "/sys/devices/system/node/node%d/cpulist", node);
+        FILE* f = fopen(path, "r");
+        if (!f)
+            continue;
+        char list[4096] = {};
+        bool ok = fgets(list, sizeof(list), f) != nullptr;
+        fclose(f);
+        if (!ok)
+            continue;
+
+        std::vector<int> processors;
+        for (int cpu : ParseCpuList(list))
+        {
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))
+                processors.push_back(cpu);
+        }
+        if (!processors.empty())
+            nodes.push_back(processors);
+    }
+    return nodes;
+}
+
+static void PinCurrentThread(const std::vector<int>& processors)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : processors)
+        CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+#endif
+
+/*static*/ CPUThreadPool& CPUThreadPool::Instance()
+{
+    static CPUThreadPool pool;
+    return pool;
+}
+
+CPUThreadPool::CPUThreadPool()
+{
+    DiscoverTopology();
+#ifdef _OPENMP
+    m_numThreads = omp_get_max_threads();
+#else
+    m_numThreads = 1;
+#endif
+    AssignThreadsToNodes();
+}
+
+void CPUThreadPool::DiscoverTopology()
+{
+    m_nodes = GetNumaNodeProcessors();
+    if (m_nodes.empty()) // no NUMA information: a single node with all processors
+    {
+        m_nodes.resize(1);
+        for (int cpu = 0; cpu < (int) std::max(1u, std::thread::hardware_concurrency()); cpu++)
+            m_nodes[0].push_back(cpu);
+    }
+}
+
+// Splits the workers into contiguous groups, one per node, in proportion to the processors of the nodes.
+// Once there are at least as many workers as nodes, every node gets one worker and only the rest is split,
+// so that a small node next to a big one is not left without workers.
+void CPUThreadPool::AssignThreadsToNodes()
+{
+    size_t numProcessors = 0;
+    for (const auto& node : m_nodes)
+        numProcessors += node.size();
+
+    size_t numThreads = m_numThreads;
+    size_t numThreadsPerNode = numThreads >= m_nodes.size() ? 1 : 0;
+    size_t numProportionalThreads = numThreads - numThreadsPerNode * m_nodes.size();
+
+    m_threadNode.clear();
+    m_threadNode.reserve(numThreads);
+    size_t processorsSoFar = 0, proportionalThreadsSoFar = 0;
+    for (size_t node = 0; node < m_nodes.size(); node++)
+    {
+        processorsSoFar += m_nodes[node].size();
+        size_t proportionalThreadsEnd = processorsSoFar * numProportionalThreads / numProcessors;
+        m_threadNode.insert(m_threadNode.end(), numThreadsPerNode + proportionalThreadsEnd - proportionalThreadsSoFar, node);
+        proportionalThreadsSoFar = proportionalThreadsEnd;
+    }
+}
+
+void CPUThreadPool::PinWorkers()
+{
+#ifdef _OPENMP
+    // The OpenMP runtime keeps its threads between parallel regions, with the same thread taking the
+    // same position in the team, so pinning them once is enough.
+#pragma omp parallel num_threads(m_numThreads)
+    {
+        int thread = omp_get_thread_num();
+        if (thread != 0)
+            PinCurrentThread(m_nodes[m_threadNode[thread]]);
+    }
+#endif
+}
+
+int CPUThreadPool::Configure(int numThreads)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_numThreads = std::max(1, numThreads);
+    AssignThreadsToNodes();
+
+    // Pinning only pays off if there is memory traffic between nodes to avoid.
+    if (m_nodes.size() > 1)
+        PinWorkers();
+
+    if (GetMathLibTraceLevel() > 0)
+    {
+        fprintf(stderr, "CPUThreadPool: %d worker threads on %d NUMA node(s):", m_numThreads, (int) m_nodes.size());
+        for (size_t node = 0; node < m_nodes.size(); node++)
+        {
+            auto threads = ThreadsOfNode(node);
+            fprintf(stderr, " node %d: %d", (int) node, threads.second - threads.first);
+        }
+        fprintf(stderr, "\n");
+    }
+    return m_numThreads;
+}
+
+/*static*/ void CPUThreadPool::LimitCallingThread(int numThreads)
+{
+#ifdef _OPENMP
+    omp_set_num_threads(numThreads > 0 ? numThreads : Instance().NumThreads());
+#endif
+#ifdef USE_MKL
+    mkl_set_num_threads_local(std::max(0, numThreads)); // (0: the process-wide setting)
+#endif
+}
+
+std::pair<int, int> CPUThreadPool::ThreadsOfNode(size_t node) const
+{
+    auto first = std::lower_bound(m_threadNode.begin(), m_threadNode.end(), node);
+    auto last = std::upper_bound(m_threadNode.begin(), m_threadNode.end(), node);
+    return std::make_pair((int) (first - m_threadNode.begin()), (int) (last - m_threadNode.begin()));
+}
+
+void CPUThreadPool::ZeroFill(void* p, size_t bytes) const
+{
+    if (bytes < s_minParallelZeroFillBytes || m_numThreads == 1)
+    {
+        memset(p, 0, bytes);
+        return;
+    }
+
+    // Static scheduling gives worker t the same share of the pages as it gets of the elements in the
+    // kernels, so each page is first touched by the node that will work on it.
+    char* bytePtr = (char*) p;
+    long numPages = (long) ((bytes + s_pageSize - 1) / s_pageSize);
+#pragma omp parallel for schedule(static)
+    for (long page = 0; page < numPages; page++)
+    {
+        size_t offset = page * s_pageSize;
+        memset(bytePtr + offset, 0, std::min(s_pageSize, bytes - offset));
+    }
+}
+
+}}}
@@ -0,0 +1,76 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUThreadPool.h -- engine-wide layout of the CPU worker threads over NUMA nodes
+//
+
+#pragma once
+
+#include "CommonMatrix.h" // for MATH_API
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// CPUThreadPool owns the layout of the worker threads that run the CPU Math kernels. The kernels
+// (CPUMatrix, CPUSparseMatrix, the BlockMultiplier, ...) parallelize with OpenMP, so the workers are
+// the threads of the OpenMP team; the pool decides how they are spread over the machine.
+//
+// The workers are split into one contiguous group per NUMA node (socket), sized in proportion to the
+// processors of the node, and every worker except the calling thread (worker 0) is pinned to the
+// processors of its node. The calling thread is left alone, since threads it creates later (readers,
+// prefetchers) would inherit its affinity.
+//
+// Loops with static scheduling hand worker t the t-th contiguous chunk of their range, so each part
+// of a buffer is always processed on the same node. ZeroFill() initializes buffers with the same
+// partitioning, so that under the first-touch policy of the OS their pages end up on the node that
+// computes on them instead of on the node of the allocating thread.
+#pragma warning(push)
+#pragma warning(disable : 4251)
+
+class MATH_API CPUThreadPool
+{
+public:
+    static CPUThreadPool& Instance();
+
+    // Sets the number of workers and lays them out over the NUMA nodes. Returns the number of workers.
+    int Configure(int numThreads);
+
+    int NumThreads() const { return m_numThreads; }
+    size_t NumNodes() const { return m_nodes.size(); }
+    size_t NodeOfThread(int thread) const { return m_threadNode[thread]; }
+
+    // Workers [first, second) belong to the given node.
+    std::pair<int, int> ThreadsOfNode(size_t node) const;
+
+    // Processors of the given node that this process may run on.
+    const std::vector<int>& ProcessorsOfNode(size_t node) const { return m_nodes[node]; }
+
+    // Sets 'bytes' bytes at p to zero, in parallel with the partitioning of the kernels (see above).
+    void ZeroFill(void* p, size_t bytes) const;
+
+    // Limits the kernels that the calling thread starts to numThreads workers, or lifts the limit if numThreads <= 0.
+    // This is for threads that start kernels next to each other, which would otherwise oversubscribe the processors.
+    // OpenBLAS only has a process-wide thread count, so its products are not limited.
+    static void LimitCallingThread(int numThreads);
+
+    DISABLE_COPY_AND_MOVE(CPUThreadPool);
+
+private:
+    CPUThreadPool();
+
+    void DiscoverTopology();
+    void AssignThreadsToNodes();
+    void PinWorkers();
+
+    std::vector<std::vector<int>> m_nodes; // processors of each NUMA node
+    std::vector<size_t> m_threadNode;      // node of each worker
+    int m_numThreads;
+    std::mutex m_mutex;
+};
+
+#pragma warning(pop)
+
+}}}
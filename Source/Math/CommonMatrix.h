@@ -99,6 +99,7 @@ enum ElementWiseOperator
     opElementwiseProductWithAbsDerivative, opElementwiseProductWithSqrtDerivative,
     opElementwiseProductWithReciprocalDerivative, opSqrOfDifference,
     opElementwiseProductWithExponentialLinearUnitDerivativeFromOutput,
+    opLinearRectifierOfSum, opSigmoidOfSum, opTanhOfSum, // activation of a sum, for fused nodes
     // binary ops for indexing
     // opIndex,
     // ternary
@@ -167,7 +168,10 @@ enum ElementWiseOperator
     Macro(ElementwiseProductWithReciprocalDerivative);                       \
     Macro(ElementwiseProductWithSqrtDerivative);                             \
     Macro(SqrOfDifference);                                                  \
-    Macro(ElementwiseProductWithExponentialLinearUnitDerivativeFromOutput);
+    Macro(ElementwiseProductWithExponentialLinearUnitDerivativeFromOutput);  \
+    Macro(LinearRectifierOfSum);                                             \
+    Macro(SigmoidOfSum);                                                     \
+    Macro(TanhOfSum);
     //Macro(Index);
 
 #define ForAllTernaryOps(Macro)                         \
@@ -192,6 +196,7 @@ enum MatrixFlagBitPosition
     bitPosCompressed = 2,       // a compressed sparse format (CSC/CSR)
     bitPosDontOwnBuffer = 3,    // buffer is not owned by this matrix
     bitPosSetValueOnDevice = 4, // in a setValue situation, the copy from buffer is already on the device
+    bitPosArenaBuffer = 5,      // buffer is a slot of a memory arena (only together with bitPosDontOwnBuffer)
 };
 
 enum MatrixFormat
@@ -219,6 +224,9 @@ enum MatrixFlags
     matrixFlagNormal = 0,
     matrixFlagDontOwnBuffer = 1 << bitPosDontOwnBuffer,       // the matrix memory pointers are externally managed, don't allocate/free or attempt to copy to another location
     matrixFlagSetValueOnDevice = 1 << bitPosSetValueOnDevice, // SetValue() call has a buffer that is already on the device
+    // with matrixFlagDontOwnBuffer: the buffer is a slot of a memory arena (see MatrixPool). The matrix may be resized within
+    // the size of the slot; if it needs more, it moves to a buffer of its own instead of failing.
+    matrixFlagArenaBuffer = 1 << bitPosArenaBuffer,
 };
 
 // -----------------------------------------------------------------------
@@ -314,7 +322,10 @@ protected:
     bool IsEmpty() const { return m_numRows == 0 || m_numCols == 0; }
 
     ElemType* Buffer() const { return m_pArray; }
-    void SetBuffer(ElemType* pArray, size_t alloc, bool external = false) { m_pArray = pArray; m_totalBufferSizeAllocated = alloc; m_externalBuffer = external; }
+    void SetBuffer(ElemType* pArray, size_t alloc, bool external = false) { m_pArray = pArray; m_totalBufferSizeAllocated = alloc; m_externalBuffer = external; m_arenaBuffer = false; }
+
+    bool HasArenaBuffer() const { return m_arenaBuffer; }
+    void SetArenaBuffer(bool arena) { m_arenaBuffer = arena && m_externalBuffer; }
 
     size_t BufferSizeAllocated() const { return m_totalBufferSizeAllocated; }
     
@@ -363,6 +374,7 @@ protected:
     void ZeroInit(const MatrixFormat matrixFormat = matrixFormatDense, const DEVICEID_TYPE computeDevice = -1)
     {
         m_externalBuffer           = false;
+        m_arenaBuffer              = false;
         m_format                   = matrixFormat;
         m_computeDevice            = computeDevice;
         m_numRows                  = 0;
@@ -391,6 +403,7 @@ protected:
     MatrixFormat m_format;
     mutable DEVICEID_TYPE m_computeDevice; // current GPU device Id or CPUDEVICE
     bool m_externalBuffer; // is the buffer used by this matrix,
+    bool m_arenaBuffer;    // the external buffer is a slot of a memory arena, see matrixFlagArenaBuffer
 
     // m_numRows and m_numCols should be removed
     size_t m_numRows;
@@ -453,7 +466,7 @@ public:
     { 
         if (!m_sob.unique())
             LogicError("%s: Cannot resize the matrix because it is a view.", function);
-        else if (m_sob->HasExternalBuffer())
+        else if (m_sob->HasExternalBuffer() && !m_sob->HasArenaBuffer())
             LogicError("%s: Cannot resize the matrix because it is externally owned.", function);
     }
 
@@ -502,6 +515,8 @@ protected:
     void SetFormat(MatrixFormat format) { m_sob->SetFormat(format); }
 
     bool HasExternalBuffer() const { return m_sob->HasExternalBuffer(); }
+    bool HasArenaBuffer() const { return m_sob->HasArenaBuffer(); }
+    void SetArenaBuffer(bool arena) { m_sob->SetArenaBuffer(arena); }
 
     DEVICEID_TYPE GetComputeDeviceId() const { return m_sob->GetComputeDeviceId(); }
     void SetComputeDeviceId(const DEVICEID_TYPE computeId) const { m_sob->SetComputeDeviceId(computeId); }
@@ -6,6 +6,17 @@
 #include "stdafx.h"
 #include "ConvolutionEngine.h"
 #include "CuDnnFactories.h"
+#include "CPUConvolutionKernels.h"
+#include "TimerUtility.h"
+#include <atomic>
+#include <limits>
+#include <mutex>
+#include <omp.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -851,6 +862,554 @@ public:
     }
 };
 
+//------------------------------------------------------------------
+// Direct convolution engine implementation.
+// Computes 2D convolutions with full sharing on CPU without unrolling the input (see CPUConvolutionKernels.h).
+// The weights are repacked into a channel-blocked layout for every call which is cheap compared to
+// the convolution itself. Uses reference engine for pooling operations.
+//------------------------------------------------------------------
+template <class ElemType>
+class DirectConvolutionEngine : public ReferenceConvolutionEngine<ElemType>
+{
+public:
+    using Base = ReferenceConvolutionEngine<ElemType>;
+    using typename Base::Mat;
+
+public:
+    DirectConvolutionEngine(ConvolveGeometryPtr geometry, DEVICEID_TYPE deviceId, ImageLayoutKind imageLayout, size_t maxTempMemSizeInSamples, PoolKind poolKind, bool poolIncludePad)
+        : Base(geometry, deviceId, imageLayout, maxTempMemSizeInSamples, poolKind, poolIncludePad)
+    {
+        const auto& inT = geometry->InputShape();
+        const auto& outT = geometry->OutputShape();
+        const auto& kernT = geometry->KernelShape();
+        // 1D convolutions of rank 2 have a height of 1.
+        bool is2D = inT.GetRank() == 3;
+        m_dims.inW = (int)inT[0];
+        m_dims.inH = is2D ? (int)inT[1] : 1;
+        m_dims.inC = (int)inT[inT.GetRank() - 1];
+        m_dims.outW = (int)outT[0];
+        m_dims.outH = is2D ? (int)outT[1] : 1;
+        m_dims.outC = (int)outT[outT.GetRank() - 1];
+        m_dims.kW = (int)kernT[0];
+        m_dims.kH = is2D ? (int)kernT[1] : 1;
+        m_dims.strideW = (int)geometry->GetStride(0);
+        m_dims.strideH = is2D ? (int)geometry->GetStride(1) : 1;
+        m_dims.padW = geometry->GetLowerPad(0);
+        m_dims.padH = is2D ? geometry->GetLowerPad(1) : 0;
+    }
+
+protected:
+    using Base::IsGpu;
+
+    using Base::m_geometry;
+    using Base::m_deviceId;
+    using Base::m_imageLayout;
+    using Base::m_maxTempMemSizeInSamples;
+
+    void EnsureCompatible() override
+    {
+        if (m_imageLayout != ImageLayoutKind::CHW)
+            LogicError("Direct convolution engine supports only CHW/cudnn layout.");
+        if (IsGpu(m_deviceId))
+            LogicError("Direct convolution engine supports only CPU device.");
+    }
+
+    void EnsureConvolutionInitialized() override
+    {
+        // The kernels compute the indices, the lookup tables of the reference engine are not needed.
+    }
+
+    size_t GetSubBatchSize(size_t batchSize) const
+    {
+        return m_maxTempMemSizeInSamples == 0 ? batchSize : min(batchSize, m_maxTempMemSizeInSamples);
+    }
+
+    // The workspace only holds the packed kernel: [ceil(K / block) x C x kH x kW x block].
+    void ForwardCore(const Mat& in, const Mat& kernel, Mat& out, Mat& workspace) override
+    {
+        const int block = ConvChannelBlock<ElemType>::Size;
+        workspace.Resize(1, (size_t)ConvNumBlocks(m_dims.outC, block) * block * m_dims.KernelSize());
+        PackConvolutionKernel(m_dims, kernel.Data(), false, workspace.Data());
+        DirectConvolutionForward(m_dims, workspace.Data(), in.Data(), out.Data(), (int)in.GetNumCols());
+    }
+
+    // The workspace only holds the packed kernel: [ceil(C / block) x K x kH x kW x block].
+    void BackwardDataCore(const Mat& srcGrad, const Mat& kernel, Mat& grad, bool /*accumulateGradient*/, Mat& workspace) override
+    {
+        const int block = ConvChannelBlock<ElemType>::Size;
+        workspace.Resize(1, (size_t)ConvNumBlocks(m_dims.inC, block) * block * m_dims.outC * m_dims.kW * m_dims.kH);
+        PackConvolutionKernel(m_dims, kernel.Data(), true, workspace.Data());
+        DirectConvolutionBackwardData(m_dims, workspace.Data(), srcGrad.Data(), grad.Data(), (int)srcGrad.GetNumCols());
+    }
+
+    // The workspace holds the source gradients of a sub-batch packed into [N x ceil(K / block) x H' x W' x block].
+    void BackwardKernelCore(const Mat& srcGrad, const Mat& in, Mat& kernelGrad, bool /*accumulateGradient*/, bool /*allowReuse*/, Mat& workspace) override
+    {
+        const int block = ConvChannelBlock<ElemType>::Size;
+        size_t batchSize = srcGrad.GetNumCols();
+        size_t subBatchSize = GetSubBatchSize(batchSize);
+        size_t packedSize = (size_t)ConvNumBlocks(m_dims.outC, block) * block * m_dims.outW * m_dims.outH;
+        workspace.Resize(1, packedSize * subBatchSize);
+
+        for (size_t start = 0; start < batchSize; start += subBatchSize)
+        {
+            size_t curBatchSize = min(subBatchSize, batchSize - start);
+            PackConvolutionOutput(m_dims, srcGrad.Data() + start * m_dims.OutSize(), workspace.Data(), (int)curBatchSize);
+            DirectConvolutionBackwardKernel(m_dims, workspace.Data(), in.Data() + start * m_dims.InSize(), kernelGrad.Data(), (int)curBatchSize);
+        }
+    }
+
+    ConvolutionDims2D m_dims;
+
+public:
+    static bool IsSupported(DEVICEID_TYPE deviceId, ConvolveGeometryPtr geometry)
+    {
+        if (deviceId >= 0 ||
+            find(begin(geometry->Sharing()), end(geometry->Sharing()), false) != end(geometry->Sharing()))
+            return false;
+
+        // 1D or 2D convolutions where the kernel covers all input channels and
+        // the feature maps are in the last dimension, i.e. what cuDNN calls a 2D convolution.
+        const auto& inT = geometry->InputShape();
+        size_t dimCount = inT.GetRank();
+        if (dimCount != 2 && dimCount != 3)
+            return false;
+        size_t last = dimCount - 1;
+        for (size_t i = 0; i < last; i++)
+        {
+            if (geometry->GetMapCount(i) != 1)
+                return false;
+        }
+        return geometry->KernelShape()[last] == inT[last] &&
+               geometry->OutputShape()[last] == geometry->GetMapCount(last) &&
+               geometry->GetLowerPad(last) == 0;
+    }
+};
+
+//------------------------------------------------------------------
+// Winograd convolution engine implementation.
+// Computes 3x3 convolutions with stride 1 using the minimal filtering algorithms F(2x2, 3x3) and F(4x4, 3x3):
+// the input tiles and the weights are transformed, multiplied by Alpha^2 GEMMs over the channels and
+// transformed back. F(4x4, 3x3) needs fewer multiplications but is less accurate, it is used for outputs of
+// at least 8x8 where it pays off. The data gradient is the Winograd convolution of the source gradients with
+// the rotated weights, the kernel gradient is computed by the direct engine.
+//------------------------------------------------------------------
+template <class ElemType>
+class WinogradConvolutionEngine : public DirectConvolutionEngine<ElemType>
+{
+public:
+    using Base = DirectConvolutionEngine<ElemType>;
+    using typename Base::Mat;
+
+public:
+    WinogradConvolutionEngine(ConvolveGeometryPtr geometry, DEVICEID_TYPE deviceId, ImageLayoutKind imageLayout, size_t maxTempMemSizeInSamples, PoolKind poolKind, bool poolIncludePad)
+        : Base(geometry, deviceId, imageLayout, maxTempMemSizeInSamples, poolKind, poolIncludePad)
+    {
+    }
+
+protected:
+    using Base::m_dims;
+    using Base::GetSubBatchSize;
+
+    void ForwardCore(const Mat& in, const Mat& kernel, Mat& out, Mat& workspace) override
+    {
+        if (m_dims.outW >= 8 && m_dims.outH >= 8)
+            Convolve<4>(m_dims, in, kernel, false, out, false, workspace);
+        else
+            Convolve<2>(m_dims, in, kernel, false, out, false, workspace);
+    }
+
+    void BackwardDataCore(const Mat& srcGrad, const Mat& kernel, Mat& grad, bool /*accumulateGradient*/, Mat& workspace) override
+    {
+        // Full convolution of the source gradients with the rotated weights, input and output channels swapped.
+        ConvolutionDims2D dims = m_dims;
+        std::swap(dims.inW, dims.outW);
+        std::swap(dims.inH, dims.outH);
+        std::swap(dims.inC, dims.outC);
+        dims.padW = 2 - m_dims.padW;
+        dims.padH = 2 - m_dims.padH;
+        if (dims.outW >= 8 && dims.outH >= 8)
+            Convolve<4>(dims, srcGrad, kernel, true, grad, true, workspace);
+        else
+            Convolve<2>(dims, srcGrad, kernel, true, grad, true, workspace);
+    }
+
+    // The workspace holds the transformed weights U, inputs V and products M = U * V for a sub-batch,
+    // each of them Alpha^2 matrices of [K x C], [C x tiles] and [K x tiles].
+    template <int M>
+    void Convolve(const ConvolutionDims2D& dims, const Mat& in, const Mat& kernel, bool flipKernel, Mat& out, bool accumulate, Mat& workspace)
+    {
+        const size_t alpha2 = WinogradTransform<M>::Alpha * WinogradTransform<M>::Alpha;
+        size_t batchSize = in.GetNumCols();
+        size_t subBatchSize = GetSubBatchSize(batchSize);
+        size_t tilesPerSample = WinogradNumTiles<M>(dims);
+        size_t sizeU = (size_t)dims.outC * dims.inC;
+        size_t sizeV = (size_t)dims.inC * tilesPerSample * subBatchSize;
+        size_t sizeM = (size_t)dims.outC * tilesPerSample * subBatchSize;
+        workspace.Resize(1, alpha2 * (sizeU + sizeV + sizeM));
+
+        WinogradKernelTransform<M>(dims, kernel.Data(), flipKernel, workspace.Data());
+        for (size_t start = 0; start < batchSize; start += subBatchSize)
+        {
+            size_t curBatchSize = min(subBatchSize, batchSize - start);
+            size_t tiles = tilesPerSample * curBatchSize;
+            size_t offsetV = alpha2 * sizeU;
+            size_t offsetM = offsetV + alpha2 * dims.inC * tiles;
+            WinogradInputTransform<M>(dims, in.Data() + start * dims.InSize(), workspace.Data() + offsetV, (int)curBatchSize);
+            for (size_t xi = 0; xi < alpha2; xi++)
+            {
+                auto u = workspace.ColumnSlice(xi * sizeU, sizeU);
+                u.Reshape(dims.outC, dims.inC);
+                auto v = workspace.ColumnSlice(offsetV + xi * dims.inC * tiles, dims.inC * tiles);
+                v.Reshape(dims.inC, tiles);
+                auto m = workspace.ColumnSlice(offsetM + xi * dims.outC * tiles, dims.outC * tiles);
+                m.Reshape(dims.outC, tiles);
+                Mat::Multiply(u, false, v, false, m);
+            }
+            WinogradOutputTransform<M>(dims, workspace.Data() + offsetM, out.Data() + start * dims.OutSize(), (int)curBatchSize, accumulate);
+        }
+    }
+
+public:
+    static bool IsSupported(DEVICEID_TYPE deviceId, ConvolveGeometryPtr geometry)
+    {
+        const auto& kernT = geometry->KernelShape();
+        return Base::IsSupported(deviceId, geometry) && kernT.GetRank() == 3 &&
+               kernT[0] == 3 && kernT[1] == 3 && geometry->GetStride(0) == 1 && geometry->GetStride(1) == 1;
+    }
+};
+
+//------------------------------------------------------------------
+// Autotuning of CPU convolution engines.
+//------------------------------------------------------------------
+static std::atomic<bool> s_cpuConvolutionAutotuning(false);
+
+static const char* CpuConvolutionEngineName(ConvolutionEngineKind kind)
+{
+    switch (kind)
+    {
+    case ConvolutionEngineKind::Reference: return "reference";
+    case ConvolutionEngineKind::Gemm:      return "GEMM";
+    case ConvolutionEngineKind::Direct:    return "direct";
+    case ConvolutionEngineKind::Winograd:  return "Winograd";
+    default:                               return "unknown";
+    }
+}
+
+// Fastest CPU convolution engines found by autotuning, shared by all engines of the process.
+// If a file is set, the results are appended to it, one line per result with tab-separated
+// CPU model, key (operation, element type, threads, temp memory, minibatch size and geometry),
+// engine name and workspace size in elements. Results of other CPU models are ignored.
+class CpuConvolutionTuningCache
+{
+public:
+    struct Entry
+    {
+        ConvolutionEngineKind m_engineKind;
+        size_t m_workspaceSize;
+    };
+
+    static CpuConvolutionTuningCache& Instance()
+    {
+        static CpuConvolutionTuningCache cache;
+        return cache;
+    }
+
+    void SetFile(const std::wstring& file)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (file == m_file)
+            return;
+        m_file = file;
+        m_loaded = false;
+        m_entries.clear();
+    }
+
+    bool Find(const std::string& key, Entry& entry)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        EnsureLoaded();
+        auto it = m_entries.find(key);
+        if (it == m_entries.end())
+            return false;
+        entry = it->second;
+        return true;
+    }
+
+    void Add(const std::string& key, const Entry& entry)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries[key] = entry;
+        if (m_file.empty())
+            return;
+
+        FILE* f = _wfopen(m_file.c_str(), L"a");
+        if (f == nullptr)
+        {
+            fprintf(stderr, "WARNING: cannot write convolution tuning cache file '%ls'.\n", m_file.c_str());
+            return;
+        }
+        fprintf(f, "%s\t%s\t%s\t%zu\n", m_cpuModel.c_str(), key.c_str(), CpuConvolutionEngineName(entry.m_engineKind), entry.m_workspaceSize);
+        fclose(f);
+    }
+
+private:
+    CpuConvolutionTuningCache()
+        : m_cpuModel(GetCpuModel()), m_loaded(false)
+    {
+    }
+
+    void EnsureLoaded()
+    {
+        if (m_loaded || m_file.empty())
+            return;
+        m_loaded = true;
+
+        // The file does not exist before the first result is stored.
+        FILE* f = _wfopen(m_file.c_str(), L"r");
+        if (f == nullptr)
+            return;
+
+        std::string line;
+        char buf[1024];
+        while (fgets(buf, sizeof(buf), f) != nullptr)
+        {
+            line += buf;
+            if (line.back() != '\n' && !feof(f))
+                continue;
+
+            std::vector<std::string> fields;
+            std::istringstream fieldStream(line);
+            for (std::string field; std::getline(fieldStream, field, '\t');)
+                fields.push_back(field);
+            line.clear();
+
+            // Skip malformed lines, e.g. written concurrently by several processes.
+            if (fields.size() != 4 || fields[0] != m_cpuModel)
+                continue;
+            for (auto kind : {ConvolutionEngineKind::Reference, ConvolutionEngineKind::Gemm, ConvolutionEngineKind::Direct, ConvolutionEngineKind::Winograd})
+            {
+                if (fields[2] == CpuConvolutionEngineName(kind))
+                    m_entries[fields[1]] = Entry{kind, (size_t)strtoull(fields[3].c_str(), nullptr, 10)};
+            }
+        }
+        fclose(f);
+    }
+
+    static std::string GetCpuModel()
+    {
+        std::string model;
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+        // Processor brand string, e.g. "Intel(R) Xeon(R) CPU E5-2690 v4 @ 2.60GHz".
+        unsigned int regs[12] = {};
+        for (unsigned int i = 0; i < 3; i++)
+        {
+#ifdef _MSC_VER
+            __cpuid((int*)regs + 4 * i, 0x80000002 + i);
+#else
+            __get_cpuid(0x80000002 + i, regs + 4 * i, regs + 4 * i + 1, regs + 4 * i + 2, regs + 4 * i + 3);
+#endif
+        }
+        model.assign((const char*)regs, strnlen((const char*)regs, sizeof(regs)));
+#endif
+        // Keys must not contain separators of the cache file.
+        std::replace(model.begin(), model.end(), '\t', ' ');
+        model.erase(0, model.find_first_not_of(' '));
+        model.erase(model.find_last_not_of(' ') + 1);
+        return model.empty() ? "unknown" : model;
+    }
+
+    std::mutex m_mutex;
+    std::string m_cpuModel;
+    std::wstring m_file;
+    bool m_loaded;
+    std::map<std::string, Entry> m_entries;
+};
+
+void SetCpuConvolutionAutotuning(bool enable, const std::wstring& tuningCacheFile)
+{
+    s_cpuConvolutionAutotuning = enable;
+    CpuConvolutionTuningCache::Instance().SetFile(tuningCacheFile);
+}
+
+//------------------------------------------------------------------
+// Autotuning convolution engine implementation.
+// Wraps all CPU engines that support a convolution geometry. The first time a minibatch size is seen,
+// every operation (forward, backward data and backward kernel) is measured with all engines and
+// the fastest one is used from then on, similar to what the cuDNN engine does on GPU.
+// Each engine is timed over a few runs after a warm-up run, and its fastest run counts, to be robust to noise.
+// The measurements write into temporary matrices, so they do not affect the results.
+//------------------------------------------------------------------
+template <class ElemType>
+class AutotuningConvolutionEngine : public ConvolutionEngine<ElemType>
+{
+public:
+    using Base = ConvolutionEngine<ElemType>;
+    using typename Base::Mat;
+    using Candidates = std::vector<std::pair<ConvolutionEngineKind, std::unique_ptr<Base>>>;
+
+public:
+    AutotuningConvolutionEngine(ConvolveGeometryPtr geometry, DEVICEID_TYPE deviceId, ImageLayoutKind imageLayout, size_t maxTempMemSizeInSamples,
+                                Candidates&& candidates, const std::wstring& logPrefix)
+        : Base(geometry, deviceId, imageLayout, maxTempMemSizeInSamples, PoolKind::None), m_candidates(std::move(candidates)), m_logPrefix(logPrefix)
+    {
+        assert(!m_candidates.empty());
+    }
+
+    void SetmMaxTempMemSizeInSamples(const size_t maxTempMemSizeInSamples) override
+    {
+        Base::SetmMaxTempMemSizeInSamples(maxTempMemSizeInSamples);
+        for (auto& candidate : m_candidates)
+            candidate.second->SetmMaxTempMemSizeInSamples(maxTempMemSizeInSamples);
+        // The amount of temp memory changes the speed of the engines.
+        for (auto& selected : m_selected)
+            selected.clear();
+    }
+
+protected:
+    using Base::m_geometry;
+    using Base::m_deviceId;
+    using Base::m_maxTempMemSizeInSamples;
+
+    enum Operation
+    {
+        ForwardOperation,
+        BackwardDataOperation,
+        BackwardKernelOperation,
+        OperationCount
+    };
+
+    // The candidates check the compatibility in their own calls.
+    void EnsureCompatible() override
+    {
+    }
+
+    void EnsureConvolutionInitialized() override
+    {
+    }
+
+    void ForwardCore(const Mat& in, const Mat& kernel, Mat& out, Mat& workspace) override
+    {
+        auto& engine = Select(ForwardOperation, in.GetNumCols(), out, workspace,
+                              [&](Base& candidate, Mat& target) { candidate.Forward(in, kernel, target, workspace); });
+        engine.Forward(in, kernel, out, workspace);
+    }
+
+    void BackwardDataCore(const Mat& srcGrad, const Mat& kernel, Mat& grad, bool accumulateGradient, Mat& workspace) override
+    {
+        auto& engine = Select(BackwardDataOperation, srcGrad.GetNumCols(), grad, workspace,
+                              [&](Base& candidate, Mat& target) { candidate.BackwardData(srcGrad, kernel, target, accumulateGradient, workspace); });
+        engine.BackwardData(srcGrad, kernel, grad, accumulateGradient, workspace);
+    }
+
+    void BackwardKernelCore(const Mat& srcGrad, const Mat& in, Mat& kernelGrad, bool accumulateGradient, bool allowReuse, Mat& workspace) override
+    {
+        auto& engine = Select(BackwardKernelOperation, in.GetNumCols(), kernelGrad, workspace,
+                              [&](Base& candidate, Mat& target) { candidate.BackwardKernel(srcGrad, in, target, accumulateGradient, allowReuse, workspace); });
+        engine.BackwardKernel(srcGrad, in, kernelGrad, accumulateGradient, allowReuse, workspace);
+    }
+
+    void EnsurePoolingInitialized() override
+    {
+        LogicError("Autotuning convolution engine does not support pooling.");
+    }
+
+    void ForwardPoolingCore(const Mat& /*in*/, Mat& /*out*/) override
+    {
+        LogicError("Autotuning convolution engine does not support pooling.");
+    }
+
+    void BackwardPoolingCore(const Mat& /*out*/, const Mat& /*srcGrad*/, const Mat& /*in*/, Mat& /*grad*/) override
+    {
+        LogicError("Autotuning convolution engine does not support pooling.");
+    }
+
+    void MaxUnpoolingCore(const Mat& /*out*/, const Mat& /*poolIn*/, Mat& /*in*/) override
+    {
+        LogicError("Autotuning convolution engine does not support pooling.");
+    }
+
+private:
+    // Returns the fastest engine of the operation for the minibatch size, measures the candidates if it is not known yet.
+    // run(candidate, target) executes the operation writing into target which has the shape of result.
+    template <class Run>
+    Base& Select(Operation operation, size_t batchSize, const Mat& result, Mat& workspace, const Run& run)
+    {
+        auto& selected = m_selected[operation];
+        auto it = selected.find(batchSize);
+        if (it != selected.end())
+            return *m_candidates[it->second].second;
+
+        static const char* operationNames[OperationCount] = { "forward", "backward data", "backward kernel" };
+        std::ostringstream key;
+        key << operationNames[operation] << ";" << (sizeof(ElemType) == sizeof(float) ? "float" : "double") << ";threads " << omp_get_max_threads()
+            << ";temp memory " << m_maxTempMemSizeInSamples << ";minibatch " << batchSize << ";" << (std::string)*m_geometry;
+
+        auto& cache = CpuConvolutionTuningCache::Instance();
+        CpuConvolutionTuningCache::Entry entry;
+        size_t best = m_candidates.size();
+        if (cache.Find(key.str(), entry))
+        {
+            for (size_t i = 0; i < m_candidates.size(); i++)
+            {
+                if (m_candidates[i].first == entry.m_engineKind)
+                    best = i;
+            }
+        }
+
+        // Not in the cache or the cached engine is disabled.
+        if (best == m_candidates.size())
+        {
+            Mat target(result.GetNumRows(), result.GetNumCols(), m_deviceId);
+            double bestTime = std::numeric_limits<double>::max();
+            for (size_t i = 0; i < m_candidates.size(); i++)
+            {
+                // The first run allocates the workspace and warms up the caches.
+                target.SetValue(0);
+                workspace.Resize(0, 0);
+                run(*m_candidates[i].second, target);
+                size_t workspaceSize = workspace.GetNumElements();
+
+                // An engine that is already much slower than the best one is not measured any further.
+                double time = std::numeric_limits<double>::max();
+                for (size_t sample = 0; sample < NumTimingRuns && time < 2 * bestTime; sample++)
+                {
+                    Timer timer;
+                    timer.Start();
+                    run(*m_candidates[i].second, target);
+                    timer.Stop();
+                    time = std::min(time, timer.ElapsedSeconds());
+                }
+                if (GetMathLibTraceLevel() > 1)
+                    fprintf(stderr, "%ls%s convolution engine: %s %.3f ms, workspace %zu elements.\n",
+                            m_logPrefix.c_str(), CpuConvolutionEngineName(m_candidates[i].first), operationNames[operation], time * 1000, workspaceSize);
+
+                if (time < bestTime)
+                {
+                    bestTime = time;
+                    best = i;
+                    entry = CpuConvolutionTuningCache::Entry{m_candidates[i].first, workspaceSize};
+                }
+            }
+            cache.Add(key.str(), entry);
+        }
+
+        if (GetMathLibTraceLevel() > 0)
+            fprintf(stderr, "%lsusing %s convolution engine for %s with minibatch size %zu, workspace %zu elements.\n",
+                    m_logPrefix.c_str(), CpuConvolutionEngineName(m_candidates[best].first), operationNames[operation], batchSize, entry.m_workspaceSize);
+
+        selected[batchSize] = best;
+        return *m_candidates[best].second;
+    }
+
+    static const size_t NumTimingRuns = 3;
+
+    Candidates m_candidates;
+    // Index of the fastest candidate per operation and minibatch size.
+    std::map<size_t, size_t> m_selected[OperationCount];
+    std::wstring m_logPrefix;
+};
+
 template <class ElemType>
 std::unique_ptr<ConvolutionEngine<ElemType>> ConvolutionEngine<ElemType>::Create(ConvolveGeometryPtr geometry, DEVICEID_TYPE deviceId,
                                                                                  ImageLayoutKind imageLayout, size_t maxTempMemSizeInSamples, PoolKind poolKind,
@@ -886,6 +1445,45 @@ std::unique_ptr<ConvolutionEngine<ElemType>> ConvolutionEngine<ElemType>::Create
         return CuDnnConvolutionEngineFactory<ElemType>::Create(geometry, deviceId, imageLayout, maxTempMemSizeInSamples, poolKind, forceDeterministicAlgorithms, poolIncludePad);
     }
 
+    // Measure all CPU engines that support the geometry if autotuning is enabled. The choice depends on timing,
+    // so deterministic algorithms get the fixed engine below, which computes the same results in every run.
+    if (s_cpuConvolutionAutotuning && !forceDeterministicAlgorithms && deviceId < 0 && poolKind == PoolKind::None)
+    {
+        typename AutotuningConvolutionEngine<ElemType>::Candidates candidates;
+        if (isEnabled(ConvolutionEngineKind::Winograd) && WinogradConvolutionEngine<ElemType>::IsSupported(deviceId, geometry))
+            candidates.emplace_back(ConvolutionEngineKind::Winograd, std::make_unique<WinogradConvolutionEngine<ElemType>>(geometry, deviceId, imageLayout, maxTempMemSizeInSamples, poolKind, poolIncludePad));
+        if (isEnabled(ConvolutionEngineKind::Direct) && DirectConvolutionEngine<ElemType>::IsSupported(deviceId, geometry))
+            candidates.emplace_back(ConvolutionEngineKind::Direct, std::make_unique<DirectConvolutionEngine<ElemType>>(geometry, deviceId, imageLayout, maxTempMemSizeInSamples, poolKind, poolIncludePad));
+        if (isEnabled(ConvolutionEngineKind::Gemm) && GemmConvolutionEngine<ElemType>::IsSupported(deviceId, geometry))
+            candidates.emplace_back(ConvolutionEngineKind::Gemm, std::make_unique<GemmConvolutionEngine<ElemType>>(geometry, deviceId, imageLayout, maxTempMemSizeInSamples, poolKind, poolIncludePad));
+        if (isEnabled(ConvolutionEngineKind::Reference))
+            candidates.emplace_back(ConvolutionEngineKind::Reference, std::make_unique<ReferenceConvolutionEngine<ElemType>>(geometry, deviceId, imageLayout, maxTempMemSizeInSamples, poolKind, poolIncludePad));
+
+        if (candidates.size() > 1)
+        {
+            if (GetMathLibTraceLevel() > 0)
+                fprintf(stderr, "%lsusing autotuned CPU convolution engine for geometry: %s.\n", logPrefix.c_str(), engStr.c_str());
+
+            return std::make_unique<AutotuningConvolutionEngine<ElemType>>(geometry, deviceId, imageLayout, maxTempMemSizeInSamples, std::move(candidates), logPrefix);
+        }
+    }
+
+    if (isEnabled(ConvolutionEngineKind::Winograd) && WinogradConvolutionEngine<ElemType>::IsSupported(deviceId, geometry))
+    {
+        if (GetMathLibTraceLevel() > 0)
+            fprintf(stderr, "%lsusing Winograd convolution engine for geometry: %s.\n", logPrefix.c_str(), engStr.c_str());
+
+        return std::make_unique<WinogradConvolutionEngine<ElemType>>(geometry, deviceId, imageLayout, maxTempMemSizeInSamples, poolKind, poolIncludePad);
+    }
+
+    if (isEnabled(ConvolutionEngineKind::Direct) && DirectConvolutionEngine<ElemType>::IsSupported(deviceId, geometry))
+    {
+        if (GetMathLibTraceLevel() > 0)
+            fprintf(stderr, "%lsusing direct convolution engine for geometry: %s.\n", logPrefix.c_str(), engStr.c_str());
+
+        return std::make_unique<DirectConvolutionEngine<ElemType>>(geometry, deviceId, imageLayout, maxTempMemSizeInSamples, poolKind, poolIncludePad);
+    }
+
     if (isEnabled(ConvolutionEngineKind::Gemm) && GemmConvolutionEngine<ElemType>::IsSupported(deviceId, geometry))
     {
         if (GetMathLibTraceLevel() > 0)
@@ -22,8 +22,10 @@ enum class ConvolutionEngineKind
     CuDnn     = 1 << 1, // cuDNN, works only for 2D/3D convos with full sharing.
     Legacy    = 1 << 2, // Legacy, for backwards compatibility. REVIEW alexeyk: implement sparse version and remove Legacy altogether.
     Gemm      = 1 << 3, // Uses convolution unrolling+GEMM technique. Works only for convos with full sharing.
+    Direct    = 1 << 4, // Direct CPU convolution without unrolling. Works only for 1D/2D convos with full sharing.
+    Winograd  = 1 << 5, // Winograd CPU convolution. Works only for 2D 3x3 convos with stride 1 and full sharing.
 
-    All       = Reference | CuDnn | Legacy | Gemm
+    All       = Reference | CuDnn | Legacy | Gemm | Direct | Winograd
 };
 
 enum class PoolKind
@@ -67,7 +69,7 @@ public:
     DISABLE_COPY_AND_MOVE(ConvolutionEngine);
 
     // REVIEW alexeyk: This is not enough as there should be invalidation of auto-tuner state in cuDNN engine. Fine for now if it works.
-    void SetmMaxTempMemSizeInSamples(const size_t maxTempMemSizeInSamples)
+    virtual void SetmMaxTempMemSizeInSamples(const size_t maxTempMemSizeInSamples)
     {
         m_maxTempMemSizeInSamples = maxTempMemSizeInSamples;
     }
@@ -110,6 +112,12 @@ protected:
 
 #pragma warning(pop)
 
+// Enables autotuning of CPU convolutions: ConvolutionEngine::Create returns an engine that measures all enabled CPU engines
+// supporting the geometry the first time a minibatch size is seen and then uses the fastest one.
+// If tuningCacheFile is not empty, the results are stored in it per CPU model, so that later runs skip the measurements.
+// Engines created with forceDeterministicAlgorithms are not autotuned, since the choice depends on the timing.
+MATH_API void SetCpuConvolutionAutotuning(bool enable, const std::wstring& tuningCacheFile = L"");
+
 static inline PoolKind PoolKindFrom(const wstring& s)
 {
     if (s.empty() || AreEqualIgnoreCase(s, L"none"))
@@ -1268,7 +1268,7 @@ void GPUMatrix<ElemType>::SetValue(const size_t numRows, const size_t numCols, i
     if (matrixFlags & matrixFlagDontOwnBuffer)
     {
         // free the existing array if it used to be an owned array
-        if ( Buffer() != NULL)
+        if (Buffer() != NULL && !HasExternalBuffer())
         {
             TracingGPUMemoryAllocator::Free<ElemType>(GetComputeDeviceId(), Buffer());
         }
@@ -1276,6 +1276,7 @@ void GPUMatrix<ElemType>::SetValue(const size_t numRows, const size_t numCols, i
         m_numCols = numCols;
         SetBuffer(pArray, GetNumElements() * sizeof(ElemType), true);
         SetSizeAllocated(GetNumElements());
+        SetArenaBuffer((matrixFlags & matrixFlagArenaBuffer) != 0);
         SetFormat(matrixFormatDense);
         SetComputeDeviceId(deviceId);
     }
@@ -1748,11 +1749,11 @@ void GPUMatrix<ElemType>::Resize(const size_t numRows, const size_t numCols, boo
     VerifyResizable(__FUNCTION__);
 
     size_t numElements = numRows * numCols;
-    if (numElements > GetSizeAllocated() ||                     // grow allocation
-        (!growOnly && numElements != GetSizeAllocated()))   // shrink allocation if not growOnly
+    if (numElements > GetSizeAllocated() ||                                   // grow allocation
+        (!growOnly && !HasArenaBuffer() && numElements != GetSizeAllocated())) // shrink allocation if not growOnly (an arena slot never shrinks)
     {
-        // If the buffer exists, free it before allocate
-        if (Buffer())
+        // If the buffer exists, free it before allocate (an arena slot is not ours to free; growing beyond it moves the matrix to its own buffer)
+        if (Buffer() && !HasExternalBuffer())
         {
             TracingGPUMemoryAllocator::Free<ElemType>(GetComputeDeviceId(), Buffer());
         }
@@ -134,6 +134,8 @@ class MATH_API GPUMatrix : public BaseMatrix<ElemType>
     using Base::m_numCols;
     using Base::m_sliceViewOffset;
     using Base::HasExternalBuffer;
+    using Base::HasArenaBuffer;
+    using Base::SetArenaBuffer;
     using Base::SetBuffer;
     using Base::SetComputeDeviceId;
     using Base::ZeroInit;
@@ -0,0 +1,155 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// LowPrecision.h -- 16-bit floating point storage types (bfloat16 and IEEE half precision float16)
+//
+// These are storage formats only: there is no arithmetic on them. Values are converted to float for
+// computation, and results are rounded back (to nearest, ties to even). bfloat16 keeps the range of
+// float with 8 bits of precision; float16 has 11 bits of precision but overflows above 65504.
+// float16 is not called half so that it does not clash with the CUDA half type.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+static inline uint32_t FloatBits(float f)
+{
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+static inline float FloatFromBits(uint32_t bits)
+{
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+static inline uint16_t FloatToBFloat16Bits(float f)
+{
+    uint32_t bits = FloatBits(f);
+    if ((bits & 0x7fffffff) > 0x7f800000) // NaN: keep it a (quiet) NaN
+        return (uint16_t) ((bits >> 16) | 0x40);
+    bits += 0x7fff + ((bits >> 16) & 1);
+    return (uint16_t) (bits >> 16);
+}
+
+static inline float BFloat16BitsToFloat(uint16_t h)
+{
+    return FloatFromBits((uint32_t) h << 16);
+}
+
+static inline uint16_t FloatToHalfBits(float f)
+{
+    uint32_t bits = FloatBits(f);
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t absBits = bits & 0x7fffffff;
+
+    if (absBits > 0x7f800000) // NaN
+        return (uint16_t) (sign | 0x7e00);
+    if (absBits >= 0x477ff000) // rounds to infinity (65520 and above)
+        return (uint16_t) (sign | 0x7c00);
+    if (absBits >= 0x38800000) // normal half
+    {
+        uint32_t h = (absBits - 0x38000000) >> 13;
+        uint32_t rest = absBits & 0x1fff;
+        if (rest > 0x1000 || (rest == 0x1000 && (h & 1)))
+            h++; // a carry into the exponent is the correct result
+        return (uint16_t) (sign | h);
+    }
+    if (absBits <= 0x33000000) // below half of the smallest subnormal: zero
+        return (uint16_t) sign;
+
+    // subnormal half: the value in units of 2^-24
+    uint32_t exponent = absBits >> 23;
+    uint32_t mantissa = (absBits & 0x7fffff) | 0x800000;
+    uint32_t shift = 126 - exponent;
+    uint32_t h = mantissa >> shift;
+    uint32_t rest = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (h & 1)))
+        h++;
+    return (uint16_t) (sign | h);
+}
+
+static inline float HalfBitsToFloat(uint16_t h)
+{
+    uint32_t sign = (uint32_t) (h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1f;
+    uint32_t mantissa = h & 0x3ff;
+    if (exponent == 0x1f) // infinity or NaN
+        return FloatFromBits(sign | 0x7f800000 | (mantissa << 13));
+    if (exponent == 0) // zero or subnormal
+    {
+        float f = mantissa * 5.9604644775390625e-8f; // 2^-24, exact
+        return sign ? -f : f;
+    }
+    return FloatFromBits(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+// bfloat16: the upper 16 bits of a float.
+struct bfloat16
+{
+    uint16_t m_bits;
+
+    bfloat16() = default;
+    bfloat16(float f) : m_bits(FloatToBFloat16Bits(f)) {}
+    operator float() const { return BFloat16BitsToFloat(m_bits); }
+};
+
+// IEEE 754 binary16 (half precision).
+struct float16
+{
+    uint16_t m_bits;
+
+    float16() = default;
+    float16(float f) : m_bits(FloatToHalfBits(f)) {}
+    operator float() const { return HalfBitsToFloat(m_bits); }
+};
+
+// Bulk conversions. These are the hot loops of low-precision storage; the bfloat16 ones are plain
+// bit manipulation that the compiler vectorizes, the float16 ones use F16C where the build enables it.
+static inline void ConvertFromFloat(const float* from, bfloat16* to, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        to[i].m_bits = FloatToBFloat16Bits(from[i]);
+}
+
+static inline void ConvertToFloat(const bfloat16* from, float* to, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        to[i] = BFloat16BitsToFloat(from[i].m_bits);
+}
+
+static inline void ConvertFromFloat(const float* from, float16* to, size_t n)
+{
+    size_t i = 0;
+#ifdef __F16C__
+    for (; i + 8 <= n; i += 8)
+        _mm_storeu_si128((__m128i*) (to + i), _mm256_cvtps_ph(_mm256_loadu_ps(from + i), _MM_FROUND_TO_NEAREST_INT));
+#endif
+    for (; i < n; i++)
+        to[i].m_bits = FloatToHalfBits(from[i]);
+}
+
+static inline void ConvertToFloat(const float16* from, float* to, size_t n)
+{
+    size_t i = 0;
+#ifdef __F16C__
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(to + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*) (from + i))));
+#endif
+    for (; i < n; i++)
+        to[i] = HalfBitsToFloat(from[i].m_bits);
+}
+
+}}}
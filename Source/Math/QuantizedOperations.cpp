@@ -0,0 +1,119 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include "QuantizedOperations.h"
+#include <algorithm>
+#include <vector>
+#include <omp.h>
+
+// The block handlers are implemented with SSE/AVX2 intrinsics which are not available on ARM64,
+// where the product falls back to a plain loop (see also BlockHandlerSSE.cpp).
+#if !defined(__aarch64__)
+#include "BlockMultiplier.h"
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+#if !defined(__aarch64__)
+
+#ifdef SUPPORT_AVX2
+typedef BlockMultiplier<BlockHandlerAVX> QuantizedBlockMultiplierT;
+#else
+typedef BlockMultiplier<BlockHandlerSSE> QuantizedBlockMultiplierT;
+#endif
+
+struct QuantizedBlockMultiplier::Impl
+{
+    QuantizedBlockMultiplierT m_multiplier;
+    short* m_preparedB = nullptr;
+    int m_k = 0;
+    int m_n = 0;
+
+    ~Impl()
+    {
+        FreePreparedB();
+    }
+
+    void FreePreparedB()
+    {
+        if (m_preparedB)
+            QuantizedBlockMultiplierT::FreeMatrix(m_preparedB);
+        m_preparedB = nullptr;
+    }
+
+    void PrepareB(const short* B, int k, int n)
+    {
+        FreePreparedB();
+        m_preparedB = m_multiplier.PrepareB(const_cast<short*>(B), k, n);
+        m_k = k;
+        m_n = n;
+    }
+
+    void Multiply(const short* A, int m, int32_t* C)
+    {
+        // Follow the number of threads of the CPU matrices, it can be changed between the calls.
+        int numThreads = omp_get_max_threads();
+        if (numThreads != m_multiplier.m_numThreads)
+            m_multiplier.SetNumThreads(numThreads);
+
+        // The multiplier accumulates into C.
+        std::fill(C, C + (size_t)m * m_n, 0);
+        m_multiplier.MultiplyMatrices(const_cast<short*>(A), m, m_k, m_preparedB, m_n, C);
+    }
+};
+
+#else
+
+struct QuantizedBlockMultiplier::Impl
+{
+    std::vector<short> m_B;
+    int m_k = 0;
+    int m_n = 0;
+
+    void PrepareB(const short* B, int k, int n)
+    {
+        m_B.assign(B, B + (size_t)k * n);
+        m_k = k;
+        m_n = n;
+    }
+
+    void Multiply(const short* A, int m, int32_t* C)
+    {
+        for (int i = 0; i < m; i++)
+            for (int j = 0; j < m_n; j++)
+            {
+                int32_t dotProduct = 0;
+                for (int l = 0; l < m_k; l++)
+                    dotProduct += (int32_t)A[i * m_k + l] * m_B[l * m_n + j];
+                C[i * m_n + j] = dotProduct;
+            }
+    }
+};
+
+#endif
+
+QuantizedBlockMultiplier::QuantizedBlockMultiplier()
+    : m_impl(new Impl())
+{
+}
+
+QuantizedBlockMultiplier::~QuantizedBlockMultiplier()
+{
+}
+
+void QuantizedBlockMultiplier::PrepareB(const short* B, int k, int n)
+{
+    m_impl->PrepareB(B, k, n);
+}
+
+void QuantizedBlockMultiplier::Multiply(const short* A, int m, int32_t* C)
+{
+    if (m_impl->m_k == 0)
+        LogicError("QuantizedBlockMultiplier: PrepareB must be called before Multiply.");
+
+    m_impl->Multiply(A, m, C);
+}
+
+}}}
@@ -3,10 +3,35 @@
 // Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
 //
 #pragma once
+#include "CommonMatrix.h"
 #include "Quantizers.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+// Product C[m,n] = A[m,k] * B[k,n] of 16-bit integer matrices in row-major order computed by the BlockMultiplier
+// (see BlockMultiplier.h) with the widest block handler of the build, i.e. AVX2 if SUPPORT_AVX2 is defined and SSE otherwise.
+// The right operand has to be rewritten into the block order of the multiplier by PrepareB before the product,
+// so that a constant operand is rewritten once and then multiplied by any number of left operands.
+// The implementation lives in QuantizedOperations.cpp to keep the intrinsics out of the headers that are compiled by nvcc.
+class MATH_API QuantizedBlockMultiplier
+{
+public:
+    QuantizedBlockMultiplier();
+    ~QuantizedBlockMultiplier();
+
+    void PrepareB(const short* B, int k, int n);
+
+    // C is overwritten; the number of columns of A and B are taken from the last call to PrepareB
+    void Multiply(const short* A, int m, int32_t* C);
+
+private:
+    QuantizedBlockMultiplier(const QuantizedBlockMultiplier&) = delete;
+    QuantizedBlockMultiplier& operator=(const QuantizedBlockMultiplier&) = delete;
+
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+};
+
 
 // Quantized product of two dense matrices A and B, where each matrix has its own quantizer.
 // This class handles quantization of both matrices, product and de-quantization of the result.
@@ -21,6 +46,12 @@ class QuantizedMultiplier
     // Placeholders for quantized matrices A and B
     vector<short> m_pMatA, m_pMatB;
 
+    // Integer product before de-quantization
+    vector<int32_t> m_pMatC;
+
+    // Quantized A rewritten into the block order of the multiplier
+    QuantizedBlockMultiplier m_blockMultiplier;
+
     // Whether matrices A and B are constant (i.e. weights)
     // If the matrix is constant, the size of the underlying container for quatized values will be preserved for
     // the lifespan of the object
@@ -50,8 +81,12 @@ public:
             m_pMatA.resize(m*k);
             ArrayRef<short> refMatA(m_pMatA.data(), m_pMatA.size());
             m_pQuantizerA->Quantize(ArrayRef<ElemType>(A, m_pMatA.size()), refMatA);
+
+            // CNTK is using column-major storage, so A[m,k], B[k,n] and C[m,n] are the row-major A'[k,m], B'[n,k] and C'[n,m],
+            // and the product is computed as C' = B' * A', which makes A (typically the weights) the right operand of the multiplier.
+            m_blockMultiplier.PrepareB(m_pMatA.data(), k, m);
         }
-        
+
         if (!m_isBConstant || m_firstPass)
         {
             m_pMatB.resize(n*k);
@@ -62,22 +97,13 @@ public:
         m_firstPass = false;
 
         // Do multiply
-        // Naive inefficient product, just for demonstation
-        // TODO: replace with an efficient version, e.g. IPG, block multiplier, Eigen, gemmlowp, etc.
-        for (size_t i = 0; i < m; i++)
-            for (size_t j = 0; j < n; j++)
-            {
-                int dotProduct=0;
-                for (size_t l = 0; l < k; l++)
-                {
-                    // CNTK is using column-major storage
-                    dotProduct += m_pMatA[i + l*m] * m_pMatB[l + k*j];
-                }
-                C[i + j*m] = (ElemType)dotProduct;
-            }
+        int mn = m*n;
+        m_pMatC.resize(mn);
+        m_blockMultiplier.Multiply(m_pMatB.data(), n, m_pMatC.data());
+        for (int i = 0; i < mn; i++)
+            C[i] = (ElemType)m_pMatC[i];
 
         // De-quantize
-        int mn = m*n;
         m_pQuantizerB->Dequantize(C, C, mn);
         m_pQuantizerA->Dequantize(C, C, mn);
     }
@@ -13,14 +13,6 @@
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
-enum class MatrixEncodingType : unsigned char
-{
-    dense = 0,
-    sparse_csc = 1,
-    // TODO: compressed_sparse_csc = 2, // indices are encoded as var-ints
-};
-
-
 void BinaryChunkDeserializer::ReadChunkTable(FILE* infile)
 {
     ReadChunkTable(infile, 0, m_numChunks);
@@ -47,11 +39,11 @@ void BinaryChunkDeserializer::ReadChunkTable(FILE* infile, uint32_t firstChunkId
     CNTKBinaryFileHelper::ReadOrDie(chunks, sizeof(ChunkInfo), numChunks, infile);
 
     // Now read the final entry. It is either the next offset entry (if we're reading a subset and the
-    // entry exists), or we just fill it with the correct information based on file size if it doesn't
+    // entry exists), or we just fill it with the correct information based on the header offset if it doesn't
+    // (the header directly follows the last chunk).
     if (firstChunkIdx + numChunks == m_numChunks)
     {
-        auto position = CNTKBinaryFileHelper::TellOrDie(infile);
-        chunks[numChunks].offset = position;
+        chunks[numChunks].offset = m_headerOffset;
         chunks[numChunks].numSamples = 0;
         chunks[numChunks].numSequences = 0;
     }
@@ -62,12 +54,22 @@ void BinaryChunkDeserializer::ReadChunkTable(FILE* infile, uint32_t firstChunkId
 
 }
 
+void BinaryChunkDeserializer::ReadStreamOffsets(FILE* infile)
+{
+    // The table of stream offsets directly follows the chunk table.
+    CNTKBinaryFileHelper::SeekOrDie(infile, m_chunkTableOffset + m_numChunks * sizeof(ChunkInfo), SEEK_SET);
+
+    m_streamOffsets.resize(size_t(m_numChunks) * m_numInputs);
+    if (!m_streamOffsets.empty())
+        CNTKBinaryFileHelper::ReadOrDie(m_streamOffsets.data(), sizeof(uint64_t), m_streamOffsets.size(), infile);
+}
+
 BinaryChunkDeserializer::BinaryChunkDeserializer(const BinaryConfigHelper& helper) :
     BinaryChunkDeserializer(helper.GetFilePath())
 {
     SetTraceLevel(helper.GetTraceLevel());
 
-    Initialize(helper.GetRename(), helper.GetElementType());
+    Initialize(helper.GetRename(), helper.GetElementType(), helper.ReadListedInputsOnly());
 }
 
 
@@ -77,7 +79,8 @@ BinaryChunkDeserializer::BinaryChunkDeserializer(const std::wstring& filename) :
     m_file(nullptr),
     m_headerOffset(0),
     m_chunkTableOffset(0),
-    m_traceLevel(0)
+    m_traceLevel(0),
+    m_version(0)
 {
 }
 
@@ -88,7 +91,7 @@ BinaryChunkDeserializer::~BinaryChunkDeserializer()
 }
 
 
-void BinaryChunkDeserializer::Initialize(const std::map<std::wstring, std::wstring>& rename, ElementType precision)
+void BinaryChunkDeserializer::Initialize(const std::map<std::wstring, std::wstring>& rename, ElementType precision, bool readListedInputsOnly)
 {
     if (m_file)
         CNTKBinaryFileHelper::CloseOrDie(m_file);
@@ -98,11 +101,12 @@ void BinaryChunkDeserializer::Initialize(const std::map<std::wstring, std::wstri
     // First, verify the magic number.
     CNTKBinaryFileHelper::FindMagicOrDie(m_file, m_filename);
     
-    // Second, read the version number of the data file, and (for now) make sure the reader version is the same.
-    uint32_t versionNumber = CNTKBinaryFileHelper::GetVersionNumber(m_file);
-    if (versionNumber != s_currentVersion)
+    // Second, read the version number of the data file, and make sure the reader supports it
+    // (all versions up to the current one can be read).
+    m_version = CNTKBinaryFileHelper::GetVersionNumber(m_file);
+    if (m_version == 0 || m_version > s_currentVersion)
         LogicError("The reader version is %" PRIu32 ", but the data file was created for version %" PRIu32 ".",
-            s_currentVersion, versionNumber);
+            s_currentVersion, m_version);
 
     // Now, find where the header is.
     m_headerOffset = CNTKBinaryFileHelper::GetHeaderOffset(m_file);
@@ -117,7 +121,8 @@ void BinaryChunkDeserializer::Initialize(const std::map<std::wstring, std::wstri
     CNTKBinaryFileHelper::ReadOrDie(&m_numInputs, sizeof(m_numInputs), 1, m_file);
 
     // Reserve space for all of the inputs, and then read them in.
-    m_streams.resize(m_numInputs);
+    m_streams.clear();
+    m_selectedInputs.clear();
     m_deserializers.resize(m_numInputs);
 
     for (decltype(m_numInputs) i = 0; i < m_numInputs; i++)
@@ -132,17 +137,26 @@ void BinaryChunkDeserializer::Initialize(const std::map<std::wstring, std::wstri
             RuntimeError("Unknown encoding type %u requested.", (unsigned int)type);
 
         auto description = m_deserializers[i]->GetStreamDescription();
-        description->m_id = i;
         // Check if we should rename this input based on the config
         auto it = rename.find(description->m_name);
         if (it != rename.end()) 
         {
             description->m_name = it->second;
         }
+        else if (readListedInputsOnly)
+        {
+            // The deserializer is still needed to skip the input in the chunk.
+            continue;
+        }
 
-        m_streams[i] = description;
+        description->m_id = m_streams.size();
+        m_streams.push_back(description);
+        m_selectedInputs.push_back(i);
     }
 
+    if (m_streams.empty())
+        RuntimeError("None of the inputs listed in the configuration are present in the input file (%ls).", m_filename.c_str());
+
     // We just finished the header. So we're now at the chunk table.
     m_chunkTableOffset = CNTKBinaryFileHelper::TellOrDie(m_file);
 
@@ -150,6 +164,9 @@ void BinaryChunkDeserializer::Initialize(const std::map<std::wstring, std::wstri
     // Note it's possible in distributed reading mode to only want to read
     // a subset of the offsets table.
     ReadChunkTable(m_file);
+
+    if (m_version >= 2)
+        ReadStreamOffsets(m_file);
 }
 
 ChunkDescriptions BinaryChunkDeserializer::GetChunkDescriptions()
@@ -214,13 +231,60 @@ unique_ptr<byte[]> BinaryChunkDeserializer::ReadChunk(ChunkIdType chunkId)
     return buffer;
 }
 
+unique_ptr<byte[]> BinaryChunkDeserializer::ReadSelectedStreams(ChunkIdType chunkId)
+{
+    assert(m_version >= 2);
+
+    const uint64_t* offsets = m_streamOffsets.data() + size_t(chunkId) * m_numInputs;
+    auto chunkOffset = m_chunkTable->GetOffset(chunkId);
+    auto chunkEnd = m_chunkTable->GetDataStartOffset(chunkId) + m_chunkTable->GetChunkSize(chunkId);
+
+    // A block ends where the block of the next input starts (or at the end of the chunk).
+    auto blockEnd = [&](size_t input)
+    {
+        return input + 1 < m_numInputs ? chunkOffset + int64_t(offsets[input + 1]) : chunkEnd;
+    };
+
+    size_t size = 0;
+    for (auto input : m_selectedInputs)
+        size += blockEnd(input) - (chunkOffset + offsets[input]);
+
+    unique_ptr<byte[]> buffer(new byte[size]);
+    size_t position = 0;
+    for (auto input : m_selectedInputs)
+    {
+        int64_t blockStart = chunkOffset + offsets[input];
+        size_t blockSize = blockEnd(input) - blockStart;
+
+        CNTKBinaryFileHelper::SeekOrDie(m_file, blockStart, SEEK_SET);
+        CNTKBinaryFileHelper::ReadOrDie(buffer.get() + position, sizeof(byte), blockSize, m_file);
+        position += blockSize;
+    }
+
+    return buffer;
+}
 
 ChunkPtr BinaryChunkDeserializer::GetChunk(ChunkIdType chunkId)
 {
+    auto numSequences = m_chunkTable->GetNumSequences(chunkId);
+    if (m_version >= 2 && m_selectedInputs.size() < m_numInputs)
+    {
+        // Only the blocks of the selected streams are read from disk.
+        std::vector<BinaryDataDeserializerPtr> deserializers;
+        std::vector<size_t> outputs;
+        for (auto input : m_selectedInputs)
+        {
+            outputs.push_back(deserializers.size());
+            deserializers.push_back(m_deserializers[input]);
+        }
+
+        return make_shared<BinaryDataChunk>(chunkId, numSequences, ReadSelectedStreams(chunkId), deserializers, outputs);
+    }
+
     // Read the chunk into memory
     unique_ptr<byte[]> buffer = ReadChunk(chunkId);
 
-    return make_shared<BinaryDataChunk>(chunkId, m_chunkTable->GetNumSequences(chunkId), std::move(buffer), m_deserializers);
+    return make_shared<BinaryDataChunk>(chunkId, numSequences, std::move(buffer), m_deserializers, m_selectedInputs);
 }
 
 void BinaryChunkDeserializer::SetTraceLevel(unsigned int traceLevel)
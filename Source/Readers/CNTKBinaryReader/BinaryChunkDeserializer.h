@@ -99,15 +99,21 @@ public:
 
 private:
     // Builds an index of the input data.
-    void Initialize(const std::map<std::wstring, std::wstring>& rename, ElementType precision);
+    void Initialize(const std::map<std::wstring, std::wstring>& rename, ElementType precision, bool readListedInputsOnly = false);
 
     // Reads the chunk table from disk into memory
     void ReadChunkTable(FILE* infile, uint32_t firstChunkIdx, uint32_t numChunks);
     void ReadChunkTable(FILE* infile);
 
+    // Reads the per-stream block offsets of all chunks (version 2 and above).
+    void ReadStreamOffsets(FILE* infile);
+
     // Reads a chunk from disk into buffer
     unique_ptr<byte[]> ReadChunk(ChunkIdType chunkId);
 
+    // Reads only the blocks of the selected streams of a chunk into a buffer, one after another.
+    unique_ptr<byte[]> ReadSelectedStreams(ChunkIdType chunkId);
+
     BinaryChunkDeserializer(const wstring& filename);
 
     void SetTraceLevel(unsigned int traceLevel);
@@ -120,6 +126,13 @@ private:
 
     std::vector<BinaryDataDeserializerPtr> m_deserializers;
     ChunkTablePtr m_chunkTable;
+
+    // Indices of the inputs in the file that are exposed as streams.
+    std::vector<size_t> m_selectedInputs;
+
+    // Offset of each stream block relative to the beginning of its chunk,
+    // m_numInputs values per chunk (only present in version 2 files).
+    std::vector<uint64_t> m_streamOffsets;
     void* m_chunkBuffer;
 
     
@@ -128,9 +141,14 @@ private:
     
     unsigned int m_traceLevel;
 
-    static const uint32_t s_currentVersion = 1;
+    uint32_t m_version;
+
+    // Version 2 adds the table of stream block offsets, which allows
+    // reading a subset of the streams of a chunk.
+    static const uint32_t s_currentVersion = 2;
 
     friend class CNTKBinaryReaderTestRunner;
+    friend class BinaryChunkSerializer;
 
 
     DISABLE_COPY_AND_MOVE(BinaryChunkDeserializer);
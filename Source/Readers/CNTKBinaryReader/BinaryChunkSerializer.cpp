@@ -0,0 +1,307 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <thread>
+#include "BinaryChunkSerializer.h"
+#include "ExceptionCapture.h"
+#include "FileHelper.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Appends the raw bytes of a value to the block.
+template <class T>
+static void AppendValue(std::vector<char>& block, const T& value)
+{
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    block.insert(block.end(), bytes, bytes + sizeof(T));
+}
+
+// Appends count values of the given source type to the block, converting them to TargetType.
+template <class TargetType>
+static void AppendValues(std::vector<char>& block, const void* values, ElementType sourceType, size_t count)
+{
+    size_t position = block.size();
+    block.resize(position + count * sizeof(TargetType));
+    TargetType* target = reinterpret_cast<TargetType*>(block.data() + position);
+
+    switch (sourceType)
+    {
+    case ElementType::tfloat:
+        std::copy(static_cast<const float*>(values), static_cast<const float*>(values) + count, target);
+        break;
+    case ElementType::tdouble:
+        std::copy(static_cast<const double*>(values), static_cast<const double*>(values) + count, target);
+        break;
+    case ElementType::tuchar:
+        std::copy(static_cast<const unsigned char*>(values), static_cast<const unsigned char*>(values) + count, target);
+        break;
+    default:
+        RuntimeError("Unsupported element type %d of the input sequence.", (int)sourceType);
+    }
+}
+
+static size_t SizeOfElementType(ElementType type)
+{
+    switch (type)
+    {
+    case ElementType::tfloat:
+        return sizeof(float);
+    case ElementType::tdouble:
+        return sizeof(double);
+    case ElementType::tuchar:
+        return sizeof(unsigned char);
+    default:
+        RuntimeError("Unsupported element type %d of the input sequence.", (int)type);
+    }
+}
+
+// Not all deserializers set the element type of the sequences they return (e.g. the text format one doesn't),
+// the values of those have the element type of their stream.
+static ElementType GetElementType(const SequenceDataPtr& sequence, const StreamDescription& stream)
+{
+    return sequence->m_elementType != ElementType::tvariant ? sequence->m_elementType : stream.m_elementType;
+}
+
+BinaryChunkSerializer::BinaryChunkSerializer(IDataDeserializerPtr source, ElementType precision, size_t numThreads) :
+    m_source(source),
+    m_streams(source->GetStreamDescriptions()),
+    m_precision(precision),
+    m_numThreads(numThreads)
+{
+    if (m_precision != ElementType::tfloat && m_precision != ElementType::tdouble)
+        InvalidArgument("Binary format can only store float or double values.");
+
+    for (const auto& stream : m_streams)
+    {
+        if (stream->m_storageType != StorageType::dense && stream->m_storageType != StorageType::sparse_csc)
+            RuntimeError("Stream '%ls' has an unsupported storage type.", stream->m_name.c_str());
+
+        if (!stream->m_sampleLayout)
+            RuntimeError("Stream '%ls' does not have a fixed sample layout and cannot be converted.", stream->m_name.c_str());
+    }
+
+    if (m_numThreads == 0)
+        m_numThreads = std::max(1u, std::thread::hardware_concurrency());
+}
+
+void BinaryChunkSerializer::AppendDense(const SequenceDataPtr& sequence, const StreamDescription& stream, std::vector<char>& block) const
+{
+    size_t sampleDimension = stream.m_sampleLayout->GetNumElements();
+    if (sequence->m_sampleLayout && sequence->m_sampleLayout->GetNumElements() != sampleDimension)
+        RuntimeError("Sequence sample dimension %" PRIu64 " does not match the stream sample dimension %" PRIu64 ".",
+            (uint64_t)sequence->m_sampleLayout->GetNumElements(), (uint64_t)sampleDimension);
+
+    AppendValue(block, sequence->m_numberOfSamples);
+
+    size_t count = sampleDimension * sequence->m_numberOfSamples;
+    if (m_precision == ElementType::tfloat)
+        AppendValues<float>(block, sequence->GetDataBuffer(), GetElementType(sequence, stream), count);
+    else
+        AppendValues<double>(block, sequence->GetDataBuffer(), GetElementType(sequence, stream), count);
+}
+
+void BinaryChunkSerializer::AppendSparse(const SequenceDataPtr& sequence, const StreamDescription& stream, std::vector<char>& block) const
+{
+    auto sparse = static_cast<SparseSequenceData*>(sequence.get());
+    if (sparse->m_nnzCounts.size() != sparse->m_numberOfSamples)
+        RuntimeError("Number of nnz counts does not match the number of samples in a sparse sequence.");
+
+    const char* values = static_cast<const char*>(sparse->GetDataBuffer());
+    ElementType elementType = GetElementType(sequence, stream);
+    size_t valueSize = SizeOfElementType(elementType);
+
+    // The reader expects the indices of each sample to be in increasing order,
+    // so values are reordered per sample together with their indices.
+    std::vector<size_t> order(sparse->m_totalNnzCount);
+    size_t sampleStart = 0;
+    for (auto nnz : sparse->m_nnzCounts)
+    {
+        auto begin = order.begin() + sampleStart, end = begin + nnz;
+        std::iota(begin, end, sampleStart);
+        std::sort(begin, end, [sparse](size_t a, size_t b) { return sparse->m_indices[a] < sparse->m_indices[b]; });
+        sampleStart += nnz;
+    }
+
+    if (sampleStart != order.size())
+        RuntimeError("Sum of nnz counts does not match the total nnz count in a sparse sequence.");
+
+    AppendValue(block, sparse->m_numberOfSamples);
+    AppendValue(block, (uint32_t)sparse->m_totalNnzCount);
+
+    for (auto i : order)
+    {
+        if (m_precision == ElementType::tfloat)
+            AppendValues<float>(block, values + i * valueSize, elementType, 1);
+        else
+            AppendValues<double>(block, values + i * valueSize, elementType, 1);
+    }
+
+    for (auto i : order)
+        AppendValue(block, (int32_t)sparse->m_indices[i]);
+
+    for (auto nnz : sparse->m_nnzCounts)
+        AppendValue(block, (int32_t)nnz);
+}
+
+void BinaryChunkSerializer::SerializeChunk(ChunkIdType chunkId, SerializedChunk& result)
+{
+    std::vector<SequenceDescription> sequences;
+    ChunkPtr chunk;
+    {
+        std::lock_guard<std::mutex> lock(m_sourceLock);
+        m_source->GetSequencesForChunk(chunkId, sequences);
+        chunk = m_source->GetChunk(chunkId);
+    }
+
+    result.m_numSamples.clear();
+    result.m_numSamples.reserve(sequences.size());
+    result.m_blocks.assign(m_streams.size(), std::vector<char>());
+
+    std::vector<SequenceDataPtr> data;
+    size_t numInvalid = 0;
+    for (const auto& sequence : sequences)
+    {
+        data.clear();
+        chunk->GetSequence(sequence.m_indexInChunk, data);
+        if (data.size() != m_streams.size())
+            LogicError("Number of sequences returned by the chunk does not match the number of streams.");
+
+        // Sequences that are invalid in any of the streams are skipped as a whole.
+        if (std::any_of(data.begin(), data.end(), [](const SequenceDataPtr& s) { return !s->m_isValid; }))
+        {
+            numInvalid++;
+            continue;
+        }
+
+        uint32_t numSamples = 0;
+        for (size_t i = 0; i < data.size(); ++i)
+        {
+            if (m_streams[i]->m_storageType == StorageType::dense)
+                AppendDense(data[i], *m_streams[i], result.m_blocks[i]);
+            else
+                AppendSparse(data[i], *m_streams[i], result.m_blocks[i]);
+
+            numSamples = std::max(numSamples, data[i]->m_numberOfSamples);
+        }
+
+        result.m_numSamples.push_back(numSamples);
+    }
+
+    if (numInvalid > 0)
+        fprintf(stderr, "WARNING: Skipped %" PRIu64 " invalid sequence(s) in chunk %" PRIu64 ".\n",
+            (uint64_t)numInvalid, (uint64_t)chunkId);
+}
+
+void BinaryChunkSerializer::Write(const std::wstring& filename)
+{
+    auto chunks = m_source->GetChunkDescriptions();
+
+    FILE* file = CNTKBinaryFileHelper::OpenOrDie(filename, L"wb");
+    std::unique_ptr<FILE, int(*)(FILE*)> guard(file, fclose);
+
+    uint64_t magic = CNTKBinaryFileHelper::MAGIC_NUMBER;
+    uint32_t version = BinaryChunkDeserializer::s_currentVersion;
+    CNTKBinaryFileHelper::WriteOrDie(&magic, sizeof(magic), 1, file);
+    CNTKBinaryFileHelper::WriteOrDie(&version, sizeof(version), 1, file);
+
+    std::vector<ChunkInfo> chunkTable;
+    std::vector<uint64_t> streamOffsets;
+
+    // Chunks are converted in batches, one chunk per thread, and written in their original order.
+    for (size_t first = 0; first < chunks.size(); first += m_numThreads)
+    {
+        int count = (int)std::min(m_numThreads, chunks.size() - first);
+        std::vector<SerializedChunk> batch(count);
+
+        ExceptionCapture capture;
+#pragma omp parallel for schedule(dynamic) num_threads(count)
+        for (int j = 0; j < count; ++j)
+        {
+            capture.SafeRun([this, &chunks, &batch, first](int i)
+            {
+                SerializeChunk(chunks[first + i]->m_id, batch[i]);
+            }, j);
+        }
+        capture.RethrowIfHappened();
+
+        for (auto& chunk : batch)
+        {
+            if (chunk.m_numSamples.empty())
+                continue;
+
+            uint64_t numSamples = std::accumulate(chunk.m_numSamples.begin(), chunk.m_numSamples.end(), (uint64_t)0);
+            if (numSamples > std::numeric_limits<uint32_t>::max())
+                RuntimeError("Chunk %" PRIu64 " has too many samples to be stored in the binary format.", (uint64_t)chunkTable.size());
+
+            ChunkInfo info;
+            info.offset = CNTKBinaryFileHelper::TellOrDie(file);
+            info.numSequences = (uint32_t)chunk.m_numSamples.size();
+            info.numSamples = (uint32_t)numSamples;
+            chunkTable.push_back(info);
+
+            // Each chunk starts with the number of samples of its sequences, followed by the stream blocks.
+            CNTKBinaryFileHelper::WriteOrDie(chunk.m_numSamples.data(), sizeof(uint32_t), chunk.m_numSamples.size(), file);
+            uint64_t blockOffset = sizeof(uint32_t) * chunk.m_numSamples.size();
+            for (const auto& block : chunk.m_blocks)
+            {
+                streamOffsets.push_back(blockOffset);
+                if (!block.empty())
+                    CNTKBinaryFileHelper::WriteOrDie(block.data(), sizeof(char), block.size(), file);
+                blockOffset += block.size();
+            }
+        }
+    }
+
+    WriteHeader(file, chunkTable, streamOffsets);
+
+    guard.release();
+    CNTKBinaryFileHelper::CloseOrDie(file);
+}
+
+void BinaryChunkSerializer::WriteHeader(FILE* file, const std::vector<ChunkInfo>& chunkTable, const std::vector<uint64_t>& streamOffsets)
+{
+    int64_t headerOffset = CNTKBinaryFileHelper::TellOrDie(file);
+
+    uint64_t magic = CNTKBinaryFileHelper::MAGIC_NUMBER;
+    uint32_t numChunks = (uint32_t)chunkTable.size();
+    uint32_t numInputs = (uint32_t)m_streams.size();
+    CNTKBinaryFileHelper::WriteOrDie(&magic, sizeof(magic), 1, file);
+    CNTKBinaryFileHelper::WriteOrDie(&numChunks, sizeof(numChunks), 1, file);
+    CNTKBinaryFileHelper::WriteOrDie(&numInputs, sizeof(numInputs), 1, file);
+
+    // Description of each input: encoding, name, data type and sample dimension.
+    for (const auto& stream : m_streams)
+    {
+        auto encoding = stream->m_storageType == StorageType::dense ? MatrixEncodingType::dense : MatrixEncodingType::sparse_csc;
+        CNTKBinaryFileHelper::WriteOrDie(&encoding, sizeof(encoding), 1, file);
+
+        std::string name = msra::strfun::utf8(stream->m_name);
+        uint32_t nameLength = (uint32_t)name.size();
+        CNTKBinaryFileHelper::WriteOrDie(&nameLength, sizeof(nameLength), 1, file);
+        CNTKBinaryFileHelper::WriteOrDie(name.data(), sizeof(char), name.size(), file);
+
+        auto dataType = m_precision == ElementType::tfloat ? BinaryDataDeserialzer::DataType::tfloat : BinaryDataDeserialzer::DataType::tdouble;
+        CNTKBinaryFileHelper::WriteOrDie(&dataType, sizeof(dataType), 1, file);
+
+        uint32_t sampleDimension = (uint32_t)stream->m_sampleLayout->GetNumElements();
+        CNTKBinaryFileHelper::WriteOrDie(&sampleDimension, sizeof(sampleDimension), 1, file);
+    }
+
+    if (!chunkTable.empty())
+    {
+        CNTKBinaryFileHelper::WriteOrDie(chunkTable.data(), sizeof(ChunkInfo), chunkTable.size(), file);
+        CNTKBinaryFileHelper::WriteOrDie(streamOffsets.data(), sizeof(uint64_t), streamOffsets.size(), file);
+    }
+
+    CNTKBinaryFileHelper::WriteOrDie(&headerOffset, sizeof(headerOffset), 1, file);
+}
+
+}}}
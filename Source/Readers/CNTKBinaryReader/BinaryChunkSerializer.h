@@ -0,0 +1,56 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include "DataDeserializer.h"
+#include <mutex>
+#include "BinaryChunkDeserializer.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// Converts the data exposed by an arbitrary deserializer (CNTK text format, HTK, images, ...)
+// into the CNTK binary format read by the BinaryChunkDeserializer.
+// Every chunk of the source becomes a chunk of the output file, consisting of the number of samples
+// of each sequence followed by one block per stream. The header at the end of the file additionally stores
+// the offsets of the stream blocks, so that the reader can load only the streams it needs.
+class BinaryChunkSerializer
+{
+public:
+    // numThreads == 0 uses all available cores.
+    BinaryChunkSerializer(IDataDeserializerPtr source, ElementType precision, size_t numThreads = 0);
+
+    // Writes all chunks of the source into the given file.
+    void Write(const std::wstring& filename);
+
+private:
+    // A chunk converted into the on-disk representation.
+    struct SerializedChunk
+    {
+        std::vector<uint32_t> m_numSamples;      // number of samples of each sequence
+        std::vector<std::vector<char>> m_blocks; // one block per stream
+    };
+
+    // Loads a chunk from the source and converts its sequences.
+    void SerializeChunk(ChunkIdType chunkId, SerializedChunk& result);
+
+    void AppendDense(const SequenceDataPtr& sequence, const StreamDescription& stream, std::vector<char>& block) const;
+    void AppendSparse(const SequenceDataPtr& sequence, const StreamDescription& stream, std::vector<char>& block) const;
+
+    void WriteHeader(FILE* file, const std::vector<ChunkInfo>& chunkTable, const std::vector<uint64_t>& streamOffsets);
+
+    IDataDeserializerPtr m_source;
+    std::vector<StreamDescriptionPtr> m_streams;
+    ElementType m_precision;
+    size_t m_numThreads;
+
+    // Deserializers are not required to be thread safe, chunks and sequence
+    // descriptions are retrieved from the source under this lock.
+    std::mutex m_sourceLock;
+
+    DISABLE_COPY_AND_MOVE(BinaryChunkSerializer);
+};
+
+}}}
@@ -64,6 +64,9 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 
         m_filepath = msra::strfun::utf16(config(L"file"));
         m_keepDataInMemory = config(L"keepDataInMemory", false);
+        m_readListedInputsOnly = config(L"readListedInputsOnly", false);
+        if (m_readListedInputsOnly && m_streams.empty())
+            InvalidArgument("'readListedInputsOnly' requires an input section listing the streams to read.");
 
         m_randomizationWindow = GetRandomizationWindowFromConfig(config);
         m_sampleBasedRandomizationWindow = config(L"sampleBasedRandomizationWindow", false);
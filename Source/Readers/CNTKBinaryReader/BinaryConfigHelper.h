@@ -34,6 +34,9 @@ public:
 
     bool ShouldKeepDataInMemory() const { return m_keepDataInMemory; }
 
+    // True, if only the streams listed in the input section should be exposed (and read from disk).
+    bool ReadListedInputsOnly() const { return m_readListedInputsOnly; }
+
     ElementType GetElementType() const { return m_elementType; }
 
     DISABLE_COPY_AND_MOVE(BinaryConfigHelper);
@@ -48,6 +51,7 @@ private:
     bool m_sampleBasedRandomizationWindow;
     unsigned int m_traceLevel;
     bool m_keepDataInMemory; // if true the whole dataset is kept in memory
+    bool m_readListedInputsOnly; // if true streams not listed in the input section are skipped
 };
 
 } } }
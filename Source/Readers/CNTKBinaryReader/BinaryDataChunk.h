@@ -18,11 +18,13 @@ public:
     explicit BinaryDataChunk(ChunkIdType chunkId,
         size_t numSequences, 
         unique_ptr<byte[]> buffer, 
-        std::vector<BinaryDataDeserializerPtr> deserializer)
+        std::vector<BinaryDataDeserializerPtr> deserializer,
+        std::vector<size_t> outputs)
         : m_chunkId(chunkId),
         m_numSequences(numSequences), 
         m_buffer(std::move(buffer)), 
-        m_deserializers(deserializer)
+        m_deserializers(deserializer),
+        m_outputs(outputs)
     { }
 
     // Gets a sequence using its index inside the chunk.
@@ -35,16 +37,16 @@ public:
         assert(m_data.size() != 0);
 
         // resize the output to have the same dimensionality
-        result.resize(m_data.size());
+        result.resize(m_outputs.size());
         // now copy the decoded sequences
-        for (size_t i = 0; i < m_data.size(); i++)
-            result[i] = m_data[i].at(sequenceIdx);
+        for (size_t i = 0; i < m_outputs.size(); i++)
+            result[i] = m_data[m_outputs[i]].at(sequenceIdx);
     }
 
     uint32_t GetNumSamples(size_t sequenceIdx)
     {
         uint32_t numSamples = 0;
-        for (size_t i = 0; i < m_data.size(); i++)
+        for (auto i : m_outputs)
             numSamples = max(numSamples, m_data[i].at(sequenceIdx)->m_numberOfSamples);
         return numSamples;
     }
@@ -73,6 +75,9 @@ protected:
 
     // This is the deserializer who knows how to interpret the m_data chunk that we read in
     std::vector<BinaryDataDeserializerPtr> m_deserializers;
+
+    // Indices of the deserialized inputs that are exposed as streams.
+    std::vector<size_t> m_outputs;
     
     // The parsed data. We will parse each chunk once, and store the data here. 
     // If we want to delay parsing, we will add that later as/if needed.
@@ -13,10 +13,24 @@
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+enum class MatrixEncodingType : unsigned char
+{
+    dense = 0,
+    sparse_csc = 1,
+    // TODO: compressed_sparse_csc = 2, // indices are encoded as var-ints
+};
 
 class BinaryDataDeserialzer 
 {
 public:
+    enum class DataType : unsigned char
+    {
+        tfloat = 0,
+        tdouble = 1,
+        // TODO: 
+        // tbool = 2, 1 bit per value (one-hot data)
+        // tbyte = 3, 1 byte per value
+    };
 
     BinaryDataDeserialzer(FILE* file, ElementType precision = ElementType::tfloat)
     {
@@ -65,16 +79,6 @@ public:
     }
 
 protected:
-
-    enum class DataType : unsigned char
-    {
-        tfloat = 0,
-        tdouble = 1,
-        // TODO: 
-        // tbool = 2, 1 bit per value (one-hot data)
-        // tbyte = 3, 1 byte per value
-    };
-
     virtual ~BinaryDataDeserialzer() = default;
 
     void ReadName(FILE* file)
@@ -6,12 +6,16 @@
 //
 
 #include "stdafx.h"
+#include <list>
 #define DATAREADER_EXPORTS
 #include "DataReader.h"
 #include "ReaderShim.h"
 #include "CNTKBinaryReader.h"
 #include "HeapMemoryProvider.h"
 #include "CudaMemoryProvider.h"
+#include "BinaryChunkSerializer.h"
+#include "Bundler.h"
+#include "CorpusDescriptor.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -31,4 +35,59 @@ extern "C" DATAREADER_API void GetReaderD(IDataReader** preader)
 {
     *preader = new ReaderShim<double>(factory);
 }
+
+// Converts the data described by the 'deserializers' section of the config (same as for the composite reader,
+// i.e. CNTK text format, HTK or image deserializers) into a CNTK binary format file given by 'outputFile'.
+extern "C" DATAREADER_API void ConvertToCNTKBinaryFormat(const ConfigParameters* parameters)
+{
+    typedef bool(*CreateDeserializerFactory) (IDataDeserializer** d, const std::wstring& type, const ConfigParameters& cfg, CorpusDescriptorPtr corpus, bool primary);
+
+    const ConfigParameters& config = *parameters;
+    std::wstring outputFile = config(L"outputFile");
+    std::string precision = config("precision", "float");
+    size_t numThreads = config(L"numThreads", (size_t)0);
+
+    argvector<ConfigValue> deserializerConfigs =
+        config(L"deserializers", ConfigParameters::Array(argvector<ConfigValue>(vector<ConfigValue> {})));
+    if (deserializerConfigs.size() == 0)
+        InvalidArgument("Could not find deserializers in the conversion config.");
+
+    // Same defaults as in the composite reader.
+    bool useNumericSequenceKeys = true;
+    for (size_t i = 0; i < deserializerConfigs.size(); ++i)
+    {
+        ConfigParameters p = deserializerConfigs[i];
+        std::wstring type = p("type");
+        if (type != L"CNTKTextFormatDeserializer" && type != L"ImageDeserializer" && type != L"Base64ImageDeserializer")
+            useNumericSequenceKeys = false;
+    }
+    useNumericSequenceKeys = config(L"useNumericSequenceKeys", useNumericSequenceKeys);
+    auto corpus = std::make_shared<CorpusDescriptor>(useNumericSequenceKeys, config(L"hashSequenceKeys", false));
+
+    // Loaded modules must outlive the deserializers created by them.
+    std::list<Plugin> plugins;
+    std::vector<IDataDeserializerPtr> deserializers;
+    for (size_t i = 0; i < deserializerConfigs.size(); ++i)
+    {
+        ConfigParameters p = deserializerConfigs[i];
+        p.Insert("frameMode", "false");
+        p.Insert("precision", precision);
+
+        std::string module = p("module");
+        std::wstring type = p("type");
+        CreateDeserializerFactory f = (CreateDeserializerFactory)plugins.emplace(plugins.end())->Load(module, "CreateDeserializer");
+
+        IDataDeserializer* d;
+        if (!f(&d, type, p, corpus, i == 0))
+            RuntimeError("Cannot create deserializer. Please check module and type in the configuration.");
+        deserializers.push_back(IDataDeserializerPtr(d));
+    }
+
+    IDataDeserializerPtr source = deserializers.front();
+    if (deserializers.size() > 1)
+        source = std::make_shared<Bundler>(config, source, deserializers, config(L"checkData", true));
+
+    BinaryChunkSerializer serializer(source, precision == "double" ? ElementType::tdouble : ElementType::tfloat, numThreads);
+    serializer.Write(outputFile);
+}
 } } }
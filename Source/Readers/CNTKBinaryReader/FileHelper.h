@@ -115,6 +115,14 @@ public:
             RuntimeError("Error reading: %s.", strerror(errno));
     }
 
+    static void WriteOrDie(const void* ptr, size_t size, size_t count, FILE* f)
+    {
+        size_t rc;
+        rc = fwrite(ptr, size, count, f);
+        if (rc != count)
+            RuntimeError("Error writing: %s.", strerror(errno));
+    }
+
 private:
     CNTKBinaryFileHelper();
 };
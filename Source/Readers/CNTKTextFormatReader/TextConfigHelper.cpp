@@ -124,6 +124,8 @@ TextConfigHelper::TextConfigHelper(const ConfigParameters& config)
     m_traceLevel = config(L"traceLevel", 1);
     m_chunkSizeBytes = config(L"chunkSizeInBytes", g_32MB); // 32 MB by default
     m_keepDataInMemory = config(L"keepDataInMemory", false);
+    m_cacheIndex = config(L"cacheIndex", false);
+    m_numIndexingThreads = config(L"numIndexingThreads", 1);
     m_frameMode = config(L"frameMode", false);
 
     m_randomizationWindow = GetRandomizationWindowFromConfig(config);
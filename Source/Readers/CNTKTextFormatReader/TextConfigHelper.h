@@ -39,6 +39,10 @@ public:
 
     bool ShouldKeepDataInMemory() const { return m_keepDataInMemory; }
 
+    bool ShouldCacheIndex() const { return m_cacheIndex; }
+
+    size_t GetNumIndexingThreads() const { return m_numIndexingThreads; }
+
     bool IsInFrameMode() const { return m_frameMode; }
 
     ElementType GetElementType() const { return m_elementType; }
@@ -58,6 +62,8 @@ private:
     unsigned int m_traceLevel;
     size_t m_chunkSizeBytes; // chunks size in bytes
     bool m_keepDataInMemory; // if true the whole dataset is kept in memory
+    bool m_cacheIndex; // if true the index is persisted next to the input file and reused by later runs
+    size_t m_numIndexingThreads; // number of threads building the index (default 1), 0 = choose based on the input size
     bool m_frameMode; // if true, the maximum expected sequence length in the dataset is one sample.
 };
 
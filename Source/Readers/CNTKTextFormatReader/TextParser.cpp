@@ -65,6 +65,7 @@ TextParser(corpus, helper.GetFilePath(), helper.GetStreams(), primary)
     SetMaxAllowedErrors(helper.GetMaxAllowedErrors());
     SetChunkSize(helper.GetChunkSize());
     SetSkipSequenceIds(helper.ShouldSkipSequenceIds());
+    SetIndexCaching(helper.ShouldCacheIndex(), helper.GetNumIndexingThreads());
 
     Initialize();
 }
@@ -89,6 +90,8 @@ TextParser<ElemType>::TextParser(CorpusDescriptorPtr corpus, const std::wstring&
     m_hadWarnings(false),
     m_numAllowedErrors(0),
     m_skipSequenceIds(false),
+    m_cacheIndex(false),
+    m_numIndexingThreads(1),
     m_numRetries(5),
     m_corpus(corpus)
 {
@@ -181,6 +184,7 @@ void TextParser<ElemType>::Initialize()
         }
 
         m_indexer = make_unique<Indexer>(m_file, m_primary, m_skipSequenceIds, NAME_PREFIX, m_chunkSizeBytes, mainStreamAlias);
+        m_indexer->SetInputFile(m_filename, m_cacheIndex, m_numIndexingThreads);
         m_indexer->Build(m_corpus);
     });
 
@@ -1285,6 +1289,13 @@ void TextParser<ElemType>::SetChunkSize(size_t size)
     m_chunkSizeBytes = size;
 }
 
+template <class ElemType>
+void TextParser<ElemType>::SetIndexCaching(bool cacheIndex, size_t numIndexingThreads)
+{
+    m_cacheIndex = cacheIndex;
+    m_numIndexingThreads = numIndexingThreads;
+}
+
 template <class ElemType>
 void TextParser<ElemType>::SetNumRetries(unsigned int numRetries)
 {
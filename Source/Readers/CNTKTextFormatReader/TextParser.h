@@ -121,6 +121,8 @@ private:
     bool m_hadWarnings;
     unsigned int m_numAllowedErrors;
     bool m_skipSequenceIds;
+    bool m_cacheIndex;
+    size_t m_numIndexingThreads;
     unsigned int m_numRetries; // specifies the number of times an unsuccessful
                                // file operation should be repeated (default value is 5).
 
@@ -192,6 +194,8 @@ private:
 
     void SetChunkSize(size_t size);
 
+    void SetIndexCaching(bool cacheIndex, size_t numIndexingThreads);
+
     void SetNumRetries(unsigned int numRetries);
 
     friend class CNTKTextFormatReaderTestRunner<ElemType>;
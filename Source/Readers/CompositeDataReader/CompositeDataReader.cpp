@@ -17,6 +17,7 @@
 #include "NoRandomizer.h"
 #include "FramePacker.h"
 #include "SequencePacker.h"
+#include "BucketingSequencePacker.h"
 #include "TruncatedBpttPacker.h"
 #include "CorpusDescriptor.h"
 #include "ConfigUtil.h"
@@ -183,13 +184,31 @@ CompositeDataReader::CompositeDataReader(const ConfigParameters& config) :
             m_corpus);
         break;
     case PackingMode::sequence:
-        m_packer = std::make_shared<SequencePacker>(
-            m_sequenceEnumerator,
-            m_streams,
-            numAlternatingBuffers,
-            localTimeline,
-            m_corpus);
+    {
+        // Optionally group sequences of similar length from a window of minibatches to reduce padding.
+        size_t bucketingWindow = isActionWrite ? 0 : config(L"bucketingWindow", 0);
+        if (bucketingWindow > 0)
+        {
+            m_packer = std::make_shared<BucketingSequencePacker>(
+                m_sequenceEnumerator,
+                m_streams,
+                bucketingWindow,
+                numAlternatingBuffers,
+                localTimeline,
+                m_corpus,
+                GetRandomSeed(config));
+        }
+        else
+        {
+            m_packer = std::make_shared<SequencePacker>(
+                m_sequenceEnumerator,
+                m_streams,
+                numAlternatingBuffers,
+                localTimeline,
+                m_corpus);
+        }
         break;
+    }
     case PackingMode::truncated:
     {
         m_packer = std::make_shared<TruncatedBPTTPacker>(
@@ -111,7 +111,8 @@ namespace Microsoft { namespace MSR { namespace CNTK {
             }
             else
             {
-                image = cv::imdecode(decodedImage, m_deserializer.m_grayscale ? cv::IMREAD_GRAYSCALE : cv::IMREAD_COLOR);
+                image = DecodeImage(reinterpret_cast<const unsigned char*>(decodedImage.data()), decodedImage.size(),
+                    m_deserializer.m_grayscale, m_deserializer.m_minimumDecodeSize);
             }
 
             m_deserializer.PopulateSequenceData(image, classId, copyId, { sequence.m_key, 0 }, result);
@@ -6,11 +6,10 @@
 #pragma once
 #include <opencv2/core/mat.hpp>
 #include "Config.h"
+#include "ConcStack.h"
 #ifdef USE_ZIP
-#include <zip.h>
 #include <unordered_map>
 #include <memory>
-#include "ConcStack.h"
 #endif
 
 namespace Microsoft { namespace MSR { namespace CNTK {
@@ -26,7 +25,13 @@ public:
     virtual void Register(const MultiMap& sequences) = 0;
     virtual cv::Mat Read(size_t seqId, const std::string& path, bool grayscale) = 0;
 
+    // Sets the size the shorter side of JPEG images may be reduced to while decoding, 0 decodes at the full resolution.
+    void SetMinimumDecodeSize(int size) { m_minimumDecodeSize = size; }
+
     DISABLE_COPY_AND_MOVE(ByteReader);
+
+protected:
+    int m_minimumDecodeSize = 0;
 };
 
 class FileByteReader : public ByteReader
@@ -39,24 +44,50 @@ public:
     cv::Mat Read(size_t seqId, const std::string& path, bool grayscale) override;
 
     std::string m_expandDirectory;
+
+private:
+    // Buffers for the encoded file contents, reused between reads.
+    conc_stack<std::vector<unsigned char>> m_workspace;
 };
 
 #ifdef USE_ZIP
+// Reads images from a zip container. The container is memory mapped and its central directory
+// is parsed once, so reads do not require any locking: stored (uncompressed) entries are decoded
+// directly from the mapped memory, deflated entries are inflated into per thread buffers.
 class ZipByteReader : public ByteReader
 {
 public:
     ZipByteReader(const std::string& zipPath);
+    ~ZipByteReader();
 
     void Register(const std::map<std::string, std::vector<size_t>>& sequences) override;
     cv::Mat Read(size_t seqId, const std::string& path, bool grayscale) override;
 
 private:
-    using ZipPtr = std::unique_ptr<zip_t, void(*)(zip_t*)>;
-    ZipPtr OpenZip();
+    // Location of an entry inside the mapped container.
+    struct ZipEntry
+    {
+        uint64_t m_localHeaderOffset;
+        uint64_t m_dataOffset;
+        uint64_t m_compressedSize;
+        uint64_t m_uncompressedSize;
+        uint16_t m_compressionMethod;
+    };
+
+    // Maps the container into memory.
+    void Map();
+
+    // Parses the central directory of the container into entries by name.
+    std::unordered_map<std::string, ZipEntry> ReadCentralDirectory() const;
+
+    // Returns a pointer to the given range of the container, checking the bounds.
+    const unsigned char* At(uint64_t offset, uint64_t size) const;
 
     std::string m_zipPath;
-    conc_stack<ZipPtr> m_zips;
-    std::unordered_map<size_t, std::pair<zip_uint64_t, zip_uint64_t>> m_seqIdToIndex;
+    const unsigned char* m_data;
+    uint64_t m_size;
+
+    std::unordered_map<size_t, ZipEntry> m_seqIdToEntry;
     conc_stack<std::vector<unsigned char>> m_workspace;
 };
 #endif
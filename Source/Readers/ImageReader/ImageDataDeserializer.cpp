@@ -142,6 +142,7 @@ void ImageDataDeserializer::CreateSequenceDescriptions(CorpusDescriptorPtr corpu
     // Creating the default reader with expanded directory to the map file.
     auto mapFileDirectory = ExtractDirectory(mapPath);
     m_defaultReader = make_unique<FileByteReader>(mapFileDirectory);
+    m_defaultReader->SetMinimumDecodeSize(m_minimumDecodeSize);
 
     size_t numberOfCopies = isMultiCrop ? ImageDeserializerBase::NumMultiViewCopies : 1;
     static_assert(ImageDeserializerBase::NumMultiViewCopies < std::numeric_limits<uint8_t>::max(), "Do not support more than 256 copies.");
@@ -224,6 +225,7 @@ void ImageDataDeserializer::CreateSequenceDescriptions(CorpusDescriptorPtr corpu
 
     for (auto& reader : knownReaders)
     {
+        reader.second->SetMinimumDecodeSize(m_minimumDecodeSize);
         reader.second->Register(readerSequences[reader.first]);
     }
 
@@ -297,7 +299,26 @@ cv::Mat FileByteReader::Read(size_t, const std::string& seqPath, bool grayscale)
     assert(!seqPath.empty());
     auto path = Expand3Dots(seqPath, m_expandDirectory);
 
-    return cv::imread(path, grayscale ? cv::IMREAD_GRAYSCALE : cv::IMREAD_COLOR);
+    if (m_minimumDecodeSize == 0)
+        return cv::imread(path, grayscale ? cv::IMREAD_GRAYSCALE : cv::IMREAD_COLOR);
+
+    // The file is read into a reusable buffer, so that the decoder can pick the resolution
+    // based on the image header.
+    std::unique_ptr<FILE, int(*)(FILE*)> file(fopen(path.c_str(), "rb"), fclose);
+    if (!file || fseek(file.get(), 0, SEEK_END) != 0)
+        return cv::Mat();
+
+    long size = ftell(file.get());
+    if (size <= 0 || fseek(file.get(), 0, SEEK_SET) != 0)
+        return cv::Mat();
+
+    auto contents = m_workspace.pop_or_create([]() { return std::vector<unsigned char>(); });
+    contents.resize(size);
+    cv::Mat image;
+    if (fread(contents.data(), 1, size, file.get()) == (size_t)size)
+        image = DecodeImage(contents.data(), contents.size(), grayscale, m_minimumDecodeSize);
+    m_workspace.push(std::move(contents));
+    return image;
 }
 
 bool ImageDataDeserializer::GetSequenceDescriptionByKey(const KeyType& key, SequenceDescription& result)
@@ -18,7 +18,7 @@ namespace Microsoft { namespace MSR { namespace CNTK {
     ImageDeserializerBase::ImageDeserializerBase() 
         : DataDeserializerBase(true),
           m_precision(ElementType::tfloat),
-          m_grayscale(false), m_verbosity(0), m_multiViewCrop(false)
+          m_grayscale(false), m_verbosity(0), m_multiViewCrop(false), m_minimumDecodeSize(0)
     {}
 
     ImageDeserializerBase::ImageDeserializerBase(CorpusDescriptorPtr corpus, const ConfigParameters& config, bool primary)
@@ -71,6 +71,49 @@ namespace Microsoft { namespace MSR { namespace CNTK {
         // TODO: multiview should be done on the level of randomizer/transformers - it is responsiblity of the
         // TODO: randomizer to collect how many copies each transform needs and request same sequence several times.
         m_multiViewCrop = config(L"multiViewCrop", false);
+
+        // JPEG images can be decoded at 1/2, 1/4 or 1/8 of their resolution, if the crop
+        // that is scaled to the network input is still large enough.
+        m_minimumDecodeSize = config(L"reducedResolutionDecode", false) ? GetMinimumDecodeSize(featureSection) : 0;
+        if (m_verbosity > 0 && m_minimumDecodeSize > 0)
+            fprintf(stderr, "ImageDeserializer: JPEG images are decoded with the shorter side reduced down to %d pixels.\n", m_minimumDecodeSize);
+    }
+
+    int ImageDeserializerBase::GetMinimumDecodeSize(const ConfigParameters& featureSection)
+    {
+        if (!featureSection.ExistsCurrent(L"transforms"))
+            return 0;
+
+        // Smallest part of the shorter image side that can be cropped before scaling.
+        double cropRatio = 1.0;
+        argvector<ConfigParameters> transforms = featureSection("transforms");
+        for (size_t i = 0; i < transforms.size(); ++i)
+        {
+            ConfigParameters transform = transforms[i];
+            std::wstring type = transform(L"type");
+            if (type == L"Crop")
+            {
+                // Crops of a fixed size in pixels depend on the original resolution.
+                intargvector cropSize = transform(L"cropSize", "0");
+                if (cropSize[0] != 0 || cropSize[1] != 0)
+                    return 0;
+
+                floatargvector sideRatio = transform(L"sideRatio", "0.0");
+                floatargvector areaRatio = transform(L"areaRatio", "0.0");
+                floatargvector aspectRatio = transform(L"aspectRatio", "1.0");
+                double ratio = sideRatio[0] > 0 ? sideRatio[0] : (areaRatio[0] > 0 ? std::sqrt(areaRatio[0]) : 1.0);
+                cropRatio *= ratio * std::sqrt(aspectRatio[0]);
+            }
+            else if (type == L"Scale")
+            {
+                size_t width = transform(L"width");
+                size_t height = transform(L"height");
+                return (int)std::ceil(std::max(width, height) / cropRatio);
+            }
+        }
+
+        // Without scaling the network input depends on the original resolution.
+        return 0;
     }
 
     void ImageDeserializerBase::PopulateSequenceData(
@@ -51,5 +51,13 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 
         // Corpus descriptor.
         CorpusDescriptorPtr m_corpus;
+
+        // Size the shorter side of JPEG images can be reduced to while decoding
+        // without losing resolution in the transforms, 0 if images are decoded at the full resolution.
+        int m_minimumDecodeSize;
+
+    private:
+        // Derives the minimum decode size from the crop and scale transforms of the feature stream.
+        static int GetMinimumDecodeSize(const ConfigParameters& featureSection);
     };
 }}}
@@ -410,30 +410,35 @@ void ScaleTransformer::Apply(uint8_t, cv::Mat &mat)
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+// Loads the mean image stored by OpenCV FileStorage in the given file.
+static cv::Mat LoadMeanImage(const std::wstring& meanFile)
+{
+    cv::Mat meanImg;
+    cv::FileStorage fs;
+    fs.open(msra::strfun::utf8(meanFile).c_str(), cv::FileStorage::READ);
+    if (!fs.isOpened())
+        RuntimeError("Could not open file: %ls", meanFile.c_str());
+    fs["MeanImg"] >> meanImg;
+    int cchan;
+    fs["Channel"] >> cchan;
+    int crow;
+    fs["Row"] >> crow;
+    int ccol;
+    fs["Col"] >> ccol;
+    if (cchan * crow * ccol !=
+        meanImg.channels() * meanImg.rows * meanImg.cols)
+        RuntimeError("Invalid data in file: %ls", meanFile.c_str());
+    fs.release();
+    return meanImg.reshape(cchan, crow);
+}
+
 MeanTransformer::MeanTransformer(const ConfigParameters& config) : ImageTransformerBase(config)
 {
     std::wstring meanFile = config(L"meanFile", L"");
     if (meanFile.empty())
         m_meanImg.release();
     else
-    {
-        cv::FileStorage fs;
-        fs.open(msra::strfun::utf8(meanFile).c_str(), cv::FileStorage::READ);
-        if (!fs.isOpened())
-            RuntimeError("Could not open file: %ls", meanFile.c_str());
-        fs["MeanImg"] >> m_meanImg;
-        int cchan;
-        fs["Channel"] >> cchan;
-        int crow;
-        fs["Row"] >> crow;
-        int ccol;
-        fs["Col"] >> ccol;
-        if (cchan * crow * ccol !=
-            m_meanImg.channels() * m_meanImg.rows * m_meanImg.cols)
-            RuntimeError("Invalid data in file: %ls", meanFile.c_str());
-        fs.release();
-        m_meanImg = m_meanImg.reshape(cchan, crow);
-    }
+        m_meanImg = LoadMeanImage(meanFile);
 }
 
 void MeanTransformer::Apply(uint8_t, cv::Mat &mat)
@@ -458,9 +463,15 @@ void MeanTransformer::Apply(uint8_t, cv::Mat &mat)
     }
 }
 
+// Transpose can subtract the mean image (meanFile) in the same pass over the image,
+// which saves a full pass and a floating point copy of the image compared to a separate Mean transform.
 TransposeTransformer::TransposeTransformer(const ConfigParameters& config) : TransformBase(config),
     m_floatTransform(this), m_doubleTransform(this)
-{}
+{
+    std::wstring meanFile = config(L"meanFile", L"");
+    if (!meanFile.empty())
+        LoadMeanImage(meanFile).convertTo(m_meanImg, CV_64F);
+}
 
 // The method describes how input stream is transformed to the output stream. Called once per applied stream.
 // Transpose transformer expects the dense input stream with samples as HWC and outputs CHW.
@@ -536,6 +547,15 @@ SequenceDataPtr TransposeTransformer::TypedTranspose<TElementTo>::Apply(ImageSeq
 
     auto dst = result->GetBuffer();
 
+    const cv::Mat& mean = m_parent->m_meanImg;
+    bool subtractMean = !mean.empty();
+    if (subtractMean && (mean.rows != inputSequence->m_image.rows || mean.cols != inputSequence->m_image.cols || (size_t)mean.channels() != channelCount))
+    {
+        fprintf(stderr, "WARNING: Mean file does not match the size of the input image, will be ignored.\n"
+            "Please remove meanFile from the transpose config.\n");
+        subtractMean = false;
+    }
+
     if (channelCount == 3) // Unrolling for BGR, the most common case.
     {
         size_t nRows = inputSequence->m_image.rows;
@@ -548,23 +568,39 @@ SequenceDataPtr TransposeTransformer::TypedTranspose<TElementTo>::Apply(ImageSeq
         for (size_t i = 0; i < nRows; ++i)
         {
             auto* x = inputSequence->m_image.ptr<TElementFrom>((int)i);
-            for (size_t j = 0; j < nCols; ++j)
+            if (subtractMean)
+            {
+                auto* m = mean.ptr<double>((int)i);
+                for (size_t j = 0; j < nCols; ++j)
+                {
+                    auto row = j * 3;
+                    *b++ = static_cast<TElementTo>(x[row] - m[row]);
+                    *g++ = static_cast<TElementTo>(x[row + 1] - m[row + 1]);
+                    *r++ = static_cast<TElementTo>(x[row + 2] - m[row + 2]);
+                }
+            }
+            else
             {
-                auto row = j * 3;
-                *b++ = static_cast<TElementTo>(x[row]);
-                *g++ = static_cast<TElementTo>(x[row + 1]);
-                *r++ = static_cast<TElementTo>(x[row + 2]);
+                for (size_t j = 0; j < nCols; ++j)
+                {
+                    auto row = j * 3;
+                    *b++ = static_cast<TElementTo>(x[row]);
+                    *g++ = static_cast<TElementTo>(x[row + 1]);
+                    *r++ = static_cast<TElementTo>(x[row + 2]);
+                }
             }
         }
     }
     else
     {
         auto src = reinterpret_cast<const TElementFrom*>(inputSequence->GetDataBuffer());
+        const double* m = subtractMean ? mean.ptr<double>() : nullptr;
         for (size_t irow = 0; irow < rowCount; irow++)
         {
             for (size_t icol = 0; icol < channelCount; icol++)
             {
-                dst[icol * rowCount + irow] = static_cast<TElementTo>(src[irow * channelCount + icol]);
+                size_t index = irow * channelCount + icol;
+                dst[icol * rowCount + irow] = static_cast<TElementTo>(m ? src[index] - m[index] : src[index]);
             }
         }
     }
@@ -196,6 +196,9 @@ private:
 
     // Auxiliary buffer to handle images of double type.
     TypedTranspose<double> m_doubleTransform;
+
+    // Optional mean image (HWC, double) subtracted while transposing.
+    cv::Mat m_meanImg;
 };
 
 // Intensity jittering based on PCA transform as described in original AlexNet paper
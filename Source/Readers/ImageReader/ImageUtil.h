@@ -8,6 +8,7 @@
 #include <opencv2/opencv.hpp>
 #include "SequenceData.h"
 #include <numeric>
+#include <algorithm>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -52,6 +53,77 @@ namespace Microsoft { namespace MSR { namespace CNTK {
         return resultType;
     }
 
+    // Reads the dimensions of a JPEG image from its frame header without decoding the image.
+    // Returns false if the buffer does not contain a JPEG image.
+    inline bool GetJpegDimensions(const unsigned char* data, size_t size, int& width, int& height)
+    {
+        if (size < 4 || data[0] != 0xFF || data[1] != 0xD8)
+            return false;
+
+        size_t position = 2;
+        while (position + 4 <= size)
+        {
+            if (data[position] != 0xFF)
+                return false;
+
+            unsigned char marker = data[position + 1];
+            if (marker == 0xFF) // Fill byte.
+            {
+                position++;
+                continue;
+            }
+
+            if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) // Markers without a payload.
+            {
+                position += 2;
+                continue;
+            }
+
+            // Start of frame markers, except for DHT (0xC4), JPG (0xC8) and DAC (0xCC).
+            if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+            {
+                if (position + 9 > size)
+                    return false;
+                height = (data[position + 5] << 8) | data[position + 6];
+                width = (data[position + 7] << 8) | data[position + 8];
+                return width > 0 && height > 0;
+            }
+
+            if (marker == 0xDA) // Start of scan without a frame header.
+                return false;
+
+            position += 2 + ((data[position + 2] << 8) | data[position + 3]);
+        }
+        return false;
+    }
+
+    // Decodes an encoded image. If minimumSize is not 0, JPEG images with the shorter side
+    // at least 2, 4 or 8 times larger than minimumSize are decoded at the reduced resolution
+    // directly by the JPEG decoder (DCT scaling), which is considerably faster than decoding
+    // at the full resolution and scaling down afterwards.
+    inline cv::Mat DecodeImage(const unsigned char* data, size_t size, bool grayscale, int minimumSize)
+    {
+        if (size == 0)
+            return cv::Mat();
+
+        int flags = grayscale ? cv::IMREAD_GRAYSCALE : cv::IMREAD_COLOR;
+        int width, height;
+        if (minimumSize > 0 && GetJpegDimensions(data, size, width, height))
+        {
+            int side = std::min(width, height);
+            if (side >= 8 * minimumSize)
+                flags = grayscale ? cv::IMREAD_REDUCED_GRAYSCALE_8 : cv::IMREAD_REDUCED_COLOR_8;
+            else if (side >= 4 * minimumSize)
+                flags = grayscale ? cv::IMREAD_REDUCED_GRAYSCALE_4 : cv::IMREAD_REDUCED_COLOR_4;
+            else if (side >= 2 * minimumSize)
+                flags = grayscale ? cv::IMREAD_REDUCED_GRAYSCALE_2 : cv::IMREAD_REDUCED_COLOR_2;
+        }
+
+        // Wrapping the buffer without copying it.
+        cv::Mat encoded(1, (int)size, CV_8UC1, const_cast<unsigned char*>(data));
+        return cv::imdecode(encoded, flags);
+    }
+
     // A helper interface to generate a typed label in a sparse format for categories.
     // It is represented as an array indexed by the category, containing zero values for all categories the sequence does not belong to,
     // and a single one for a category it belongs to: [ 0 .. 0.. 1 .. 0 ]
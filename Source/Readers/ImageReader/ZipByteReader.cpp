@@ -4,71 +4,243 @@
 //
 
 #include "stdafx.h"
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
 #include <opencv2/opencv.hpp>
 #include "ByteReader.h"
+#include "ImageUtil.h"
 
 #ifdef USE_ZIP
-#include <File.h>
+#include <zlib.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
-std::string GetZipError(int err)
+// Signatures and sizes of the zip records, as described in the PKWARE .ZIP file format specification.
+static const uint32_t EndOfCentralDirectorySignature = 0x06054b50;
+static const uint32_t Zip64EndOfCentralDirectorySignature = 0x06064b50;
+static const uint32_t Zip64EndOfCentralDirectoryLocatorSignature = 0x07064b50;
+static const uint32_t CentralDirectoryEntrySignature = 0x02014b50;
+static const uint32_t LocalHeaderSignature = 0x04034b50;
+
+static const size_t EndOfCentralDirectorySize = 22;
+static const size_t Zip64EndOfCentralDirectorySize = 56;
+static const size_t Zip64EndOfCentralDirectoryLocatorSize = 20;
+static const size_t CentralDirectoryEntrySize = 46;
+static const size_t LocalHeaderSize = 30;
+static const size_t MaxCommentSize = 0xFFFF;
+
+static const uint16_t Zip64ExtraFieldId = 0x0001;
+static const uint16_t StoredMethod = 0;
+static const uint16_t DeflatedMethod = 8;
+
+// Zip records are little endian.
+template <class T>
+static T ReadValue(const unsigned char* data)
 {
-    zip_error_t error;
-    zip_error_init_with_code(&error, err);
-    std::string errS(zip_error_strerror(&error));
-    zip_error_fini(&error);
-    return errS;
+    T value;
+    memcpy(&value, data, sizeof(T));
+    return value;
 }
 
 ZipByteReader::ZipByteReader(const std::string& zipPath)
-    : m_zipPath(zipPath)
+    : m_zipPath(zipPath), m_data(nullptr), m_size(0)
 {
     assert(!m_zipPath.empty());
+    Map();
+}
+
+ZipByteReader::~ZipByteReader()
+{
+    if (m_data == nullptr)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(m_data);
+#else
+    munmap(const_cast<unsigned char*>(m_data), m_size);
+#endif
 }
 
-ZipByteReader::ZipPtr ZipByteReader::OpenZip()
+void ZipByteReader::Map()
 {
-    int err = ZIP_ER_OK;
-    auto zip = zip_open(m_zipPath.c_str(), ZIP_RDONLY, &err);
-    if (ZIP_ER_OK != err)
-        RuntimeError("Failed to open %s, zip library error: %s", m_zipPath.c_str(), GetZipError(err).c_str());
+#ifdef _WIN32
+    HANDLE file = CreateFileA(m_zipPath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        RuntimeError("Failed to open %s, error code: %d", m_zipPath.c_str(), (int)GetLastError());
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        RuntimeError("Failed to get the size of %s or the file is empty.", m_zipPath.c_str());
+    }
+
+    // The view keeps the mapping and the file open.
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (mapping == nullptr)
+        RuntimeError("Failed to map %s, error code: %d", m_zipPath.c_str(), (int)GetLastError());
 
-    return ZipPtr(zip, [](zip_t* z)
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (data == nullptr)
+        RuntimeError("Failed to map %s, error code: %d", m_zipPath.c_str(), (int)GetLastError());
+    m_size = size.QuadPart;
+#else
+    int file = open(m_zipPath.c_str(), O_RDONLY);
+    if (file < 0)
+        RuntimeError("Failed to open %s: %s", m_zipPath.c_str(), strerror(errno));
+
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size == 0)
     {
-        assert(z != nullptr);
-        int err = zip_close(z);
-        assert(ZIP_ER_OK == err);
-#ifdef NDEBUG
-        UNUSED(err);
+        close(file);
+        RuntimeError("Failed to get the size of %s or the file is empty.", m_zipPath.c_str());
+    }
+
+    // The mapping keeps the file open.
+    void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, file, 0);
+    close(file);
+    if (data == MAP_FAILED)
+        RuntimeError("Failed to map %s: %s", m_zipPath.c_str(), strerror(errno));
+
+    // Images are read in the randomized order.
+    madvise(data, info.st_size, MADV_RANDOM);
+    m_size = info.st_size;
 #endif
-    });
+    m_data = static_cast<const unsigned char*>(data);
+}
+
+const unsigned char* ZipByteReader::At(uint64_t offset, uint64_t size) const
+{
+    if (offset > m_size || size > m_size - offset)
+        RuntimeError("Unexpected end of the zip file %s, the file is corrupted.", m_zipPath.c_str());
+    return m_data + offset;
+}
+
+std::unordered_map<std::string, ZipByteReader::ZipEntry> ZipByteReader::ReadCentralDirectory() const
+{
+    // The end of central directory record is at the very end of the file, followed only by an optional comment.
+    if (m_size < EndOfCentralDirectorySize)
+        RuntimeError("%s is not a valid zip file.", m_zipPath.c_str());
+
+    uint64_t lowest = m_size > EndOfCentralDirectorySize + MaxCommentSize ? m_size - EndOfCentralDirectorySize - MaxCommentSize : 0;
+    uint64_t endRecord = m_size - EndOfCentralDirectorySize;
+    while (ReadValue<uint32_t>(m_data + endRecord) != EndOfCentralDirectorySignature)
+    {
+        if (endRecord == lowest)
+            RuntimeError("%s is not a valid zip file, the end of central directory record is not found.", m_zipPath.c_str());
+        endRecord--;
+    }
+
+    const unsigned char* record = m_data + endRecord;
+    uint64_t numEntries = ReadValue<uint16_t>(record + 10);
+    uint64_t directoryOffset = ReadValue<uint32_t>(record + 16);
+    if (numEntries == 0xFFFF || directoryOffset == 0xFFFFFFFF)
+    {
+        // Zip64 archive, the locator of the zip64 end of central directory record directly precedes the end of central directory record.
+        if (endRecord < Zip64EndOfCentralDirectoryLocatorSize)
+            RuntimeError("%s is not a valid zip64 file.", m_zipPath.c_str());
+
+        const unsigned char* locator = At(endRecord - Zip64EndOfCentralDirectoryLocatorSize, Zip64EndOfCentralDirectoryLocatorSize);
+        if (ReadValue<uint32_t>(locator) != Zip64EndOfCentralDirectoryLocatorSignature)
+            RuntimeError("%s is not a valid zip64 file, the zip64 end of central directory locator is not found.", m_zipPath.c_str());
+
+        record = At(ReadValue<uint64_t>(locator + 8), Zip64EndOfCentralDirectorySize);
+        if (ReadValue<uint32_t>(record) != Zip64EndOfCentralDirectorySignature)
+            RuntimeError("%s is not a valid zip64 file, the zip64 end of central directory record is not found.", m_zipPath.c_str());
+
+        numEntries = ReadValue<uint64_t>(record + 32);
+        directoryOffset = ReadValue<uint64_t>(record + 48);
+    }
+
+    std::unordered_map<std::string, ZipEntry> entries;
+    entries.reserve(numEntries);
+
+    uint64_t position = directoryOffset;
+    for (uint64_t i = 0; i < numEntries; ++i)
+    {
+        const unsigned char* header = At(position, CentralDirectoryEntrySize);
+        if (ReadValue<uint32_t>(header) != CentralDirectoryEntrySignature)
+            RuntimeError("Invalid central directory entry %" PRIu64 " in %s.", i, m_zipPath.c_str());
+
+        ZipEntry entry;
+        entry.m_compressionMethod = ReadValue<uint16_t>(header + 10);
+        entry.m_compressedSize = ReadValue<uint32_t>(header + 20);
+        entry.m_uncompressedSize = ReadValue<uint32_t>(header + 24);
+        entry.m_localHeaderOffset = ReadValue<uint32_t>(header + 42);
+        entry.m_dataOffset = 0; // Resolved from the local header on registration.
+
+        uint16_t nameLength = ReadValue<uint16_t>(header + 28);
+        uint16_t extraLength = ReadValue<uint16_t>(header + 30);
+        uint16_t commentLength = ReadValue<uint16_t>(header + 32);
+        const unsigned char* name = At(position + CentralDirectoryEntrySize, nameLength);
+        const unsigned char* extra = At(position + CentralDirectoryEntrySize + nameLength, extraLength);
+
+        // The zip64 extended information contains 64 bit values of the fields saturated in the header, in a fixed order.
+        for (size_t offset = 0; offset + 4 <= extraLength;)
+        {
+            uint16_t id = ReadValue<uint16_t>(extra + offset);
+            uint16_t size = ReadValue<uint16_t>(extra + offset + 2);
+            if (id == Zip64ExtraFieldId)
+            {
+                const unsigned char* value = extra + offset + 4;
+                const unsigned char* end = extra + std::min<size_t>(extraLength, offset + 4 + size);
+                for (uint64_t* field : { &entry.m_uncompressedSize, &entry.m_compressedSize, &entry.m_localHeaderOffset })
+                {
+                    if (*field == 0xFFFFFFFF && value + sizeof(uint64_t) <= end)
+                    {
+                        *field = ReadValue<uint64_t>(value);
+                        value += sizeof(uint64_t);
+                    }
+                }
+            }
+            offset += 4 + size;
+        }
+
+        entries.emplace(std::string(reinterpret_cast<const char*>(name), nameLength), entry);
+        position += CentralDirectoryEntrySize + nameLength + extraLength + commentLength;
+    }
+
+    return entries;
 }
 
 void ZipByteReader::Register(const MultiMap& sequences)
 {
-    auto zipFile = m_zips.pop_or_create([this]() { return OpenZip(); });
-    zip_stat_t stat;
-    zip_stat_init(&stat);
+    auto entries = ReadCentralDirectory();
 
     size_t numberOfEntries = 0;
-    size_t numEntries = zip_get_num_entries(zipFile.get(), 0);
-    for (size_t i = 0; i < numEntries; ++i) {
-        int err = zip_stat_index(zipFile.get(), i, 0, &stat);
-        if (ZIP_ER_OK != err)
-            RuntimeError("Failed to get file info for index %d, zip library error: %s", (int)i, GetZipError(err).c_str());
-
-        auto sequenceInfo = sequences.find(std::string(stat.name));
-        if (sequenceInfo == sequences.end())
+    for (const auto& sequence : sequences)
+    {
+        auto found = entries.find(sequence.first);
+        if (found == entries.end())
         {
             continue;
         }
 
-        for (auto sid : sequenceInfo->second)
-            m_seqIdToIndex[sid] = std::make_pair(stat.index, stat.size);
+        ZipEntry& entry = found->second;
+        if (entry.m_compressionMethod != StoredMethod && entry.m_compressionMethod != DeflatedMethod)
+            RuntimeError("Entry %s in %s uses unsupported compression method %d, only stored and deflated entries are supported.",
+                sequence.first.c_str(), m_zipPath.c_str(), (int)entry.m_compressionMethod);
+
+        // The data follows the local header, whose extra field can differ from the one in the central directory.
+        const unsigned char* local = At(entry.m_localHeaderOffset, LocalHeaderSize);
+        if (ReadValue<uint32_t>(local) != LocalHeaderSignature)
+            RuntimeError("Invalid local header of entry %s in %s.", sequence.first.c_str(), m_zipPath.c_str());
+
+        entry.m_dataOffset = entry.m_localHeaderOffset + LocalHeaderSize + ReadValue<uint16_t>(local + 26) + ReadValue<uint16_t>(local + 28);
+        At(entry.m_dataOffset, entry.m_compressedSize);
+
+        for (auto sid : sequence.second)
+            m_seqIdToEntry[sid] = entry;
         numberOfEntries++;
     }
-    m_zips.push(std::move(zipFile));
 
     if (numberOfEntries == sequences.size())
         return;
@@ -78,7 +250,7 @@ void ZipByteReader::Register(const MultiMap& sequences)
     {
         for (const auto& id : s.second)
         {
-            if (m_seqIdToIndex.find(id) == m_seqIdToIndex.end())
+            if (m_seqIdToEntry.find(id) == m_seqIdToEntry.end())
             {
                 fprintf(stderr, "Sequence %s is not found in container %s.\n", s.first.c_str(), m_zipPath.c_str());
                 break;
@@ -91,50 +263,40 @@ void ZipByteReader::Register(const MultiMap& sequences)
 
 cv::Mat ZipByteReader::Read(size_t seqId, const std::string& path, bool grayscale)
 {
-    // Find index of the file in .zip file.
-    auto r = m_seqIdToIndex.find(seqId);
-    if (r == m_seqIdToIndex.end())
+    // Find the entry of the file in .zip file.
+    auto r = m_seqIdToEntry.find(seqId);
+    if (r == m_seqIdToEntry.end())
         RuntimeError("Could not find file %s in the zip file, sequence id = %lu", path.c_str(), (long)seqId);
 
-    zip_uint64_t index = std::get<0>((*r).second);
-    zip_uint64_t size = std::get<1>((*r).second);
+    const ZipEntry& entry = r->second;
+    const unsigned char* data = m_data + entry.m_dataOffset;
+
+    // Stored entries are decoded directly from the mapped memory.
+    if (entry.m_compressionMethod == StoredMethod)
+        return DecodeImage(data, entry.m_compressedSize, grayscale, m_minimumDecodeSize);
+
+    auto contents = m_workspace.pop_or_create([]() { return std::vector<unsigned char>(); });
+    contents.resize(entry.m_uncompressedSize);
+
+    z_stream stream = {};
+    if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) // Raw deflate data without a zlib header.
+        RuntimeError("Failed to initialize zlib while reading file %s", path.c_str());
+
+    stream.next_in = const_cast<unsigned char*>(data);
+    stream.avail_in = (uInt)entry.m_compressedSize;
+    stream.next_out = contents.data();
+    stream.avail_out = (uInt)contents.size();
+    int result = inflate(&stream, Z_FINISH);
+    uint64_t bytesRead = stream.total_out;
+    inflateEnd(&stream);
 
-    auto contents = m_workspace.pop_or_create([size]() { return vector<unsigned char>(size); });
-    if (contents.size() < size)
-        contents.resize(size);
-    auto zipFile = m_zips.pop_or_create([this]() { return OpenZip(); });
-    attempt(5, [&zipFile, &contents, &path, index, seqId, size]()
+    if (result != Z_STREAM_END || bytesRead != entry.m_uncompressedSize)
     {
-        std::unique_ptr<zip_file_t, void(*)(zip_file_t*)> file(
-            zip_fopen_index(zipFile.get(), index, 0),
-            [](zip_file_t* f)
-            {
-                assert(f != nullptr);
-                int err = zip_fclose(f);
-                assert(ZIP_ER_OK == err);
-#ifdef NDEBUG
-                UNUSED(err);
-#endif
-            });
-        assert(nullptr != file);
-        if (nullptr == file)
-        {
-            RuntimeError("Could not open file %s in the zip file, sequence id = %lu, zip library error: %s",
-                         path.c_str(), (long)seqId, GetZipError(zip_error_code_zip(zip_get_error(zipFile.get()))).c_str());
-        }
-        assert(contents.size() >= size);
-        zip_uint64_t bytesRead = zip_fread(file.get(), contents.data(), size);
-        assert(bytesRead == size);
-        if (bytesRead != size)
-        {
-            RuntimeError("Bytes read %lu != expected %lu while reading file %s",
-                         (long)bytesRead, (long)size, path.c_str());
-        }
-    });
-    m_zips.push(std::move(zipFile));
+        RuntimeError("Failed to decompress file %s in the zip file, sequence id = %lu, zlib error: %d",
+                     path.c_str(), (long)seqId, result);
+    }
 
-    cv::Mat img = cv::imdecode(contents, grayscale ? cv::IMREAD_GRAYSCALE : cv::IMREAD_COLOR);
-    assert(nullptr != img.data);
+    cv::Mat img = DecodeImage(contents.data(), contents.size(), grayscale, m_minimumDecodeSize);
     m_workspace.push(std::move(contents));
     return img;
 }
@@ -10,6 +10,7 @@
 #include "BlockRandomizer.h"
 #include <algorithm>
 #include <utility>
+#include <set>
 
 #include "DataReader.h"
 #include "ExceptionCapture.h"
@@ -231,6 +232,14 @@ std::pair<size_t, size_t> BlockRandomizer::LoadSequenceData(size_t globalSampleC
             process(i);
     }
 
+    // Remember the chunks the sequences belong to.
+    std::set<ChunkIdType> chunkIds;
+    for (const auto& description : m_sequenceBuffer)
+    {
+        if (chunkIds.insert(description.m_chunk->m_original->m_id).second)
+            sequences.m_chunks.push_back(m_chunks[description.m_chunk->m_original->m_id]);
+    }
+
     // Now it is safe to start the new chunk prefetch.
     ChunkIdType chunkToPrefetchNext = GetChunkToPrefetch(windowRange);
     Prefetch(chunkToPrefetchNext);
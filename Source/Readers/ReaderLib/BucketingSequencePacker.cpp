@@ -0,0 +1,181 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#define _CRT_SECURE_NO_WARNINGS
+#define _SCL_SECURE_NO_WARNINGS
+
+#include <algorithm>
+#include "BucketingSequencePacker.h"
+#include "RandomOrdering.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+BucketingSequencePacker::BucketingSequencePacker(
+    SequenceEnumeratorPtr sequenceEnumerator,
+    const std::vector<StreamDescriptionPtr>& streams,
+    size_t windowSizeInMinibatches,
+    size_t numberOfBuffers,
+    bool useLocalTimeline,
+    CorpusDescriptorPtr corpus,
+    size_t seed) :
+    SequencePacker(sequenceEnumerator, streams, numberOfBuffers, useLocalTimeline, corpus),
+    m_windowSizeInMinibatches(windowSizeInMinibatches),
+    m_seed(seed),
+    m_windowStartPosition(0),
+    m_windowEndPosition(0),
+    m_maxBucketSizeInSamples(0),
+    m_windowMinibatchSizeInSamples(0),
+    m_endOfSweep(false),
+    m_endOfEpoch(false)
+{
+    if (m_windowSizeInMinibatches == 0)
+        InvalidArgument("Bucketing window size cannot be zero.");
+}
+
+size_t BucketingSequencePacker::GetCurrentSamplePosition()
+{
+    return m_buckets.empty() ? SequencePacker::GetCurrentSamplePosition() : m_windowStartPosition;
+}
+
+void BucketingSequencePacker::Reset()
+{
+    if (m_buckets.empty() || m_sequenceEnumerator->GetCurrentSamplePosition() != m_windowStartPosition)
+    {
+        m_buckets.clear();
+        m_windowChunks.clear();
+        m_endOfSweep = m_endOfEpoch = false;
+        return;
+    }
+
+    // The reported position of the current window is restored: the buffered sequences are kept
+    // and the sequence enumerator continues after the window.
+    m_sequenceEnumerator->SetCurrentSamplePosition(m_windowEndPosition);
+    if (m_windowMinibatchSizeInSamples == m_localMinibatchSizeInSamples)
+        return;
+
+    // The minibatch size has changed, the rest of the window is split into buckets of the new size.
+    std::vector<WindowSequence> window;
+    size_t numberOfStreams = m_buckets.front().m_data.size();
+    for (auto& bucket : m_buckets)
+    {
+        for (size_t j = 0; j < bucket.m_data.front().size(); ++j)
+        {
+            WindowSequence sequence{ 0, {} };
+            for (auto& stream : bucket.m_data)
+            {
+                sequence.m_numberOfSamples = std::max<size_t>(sequence.m_numberOfSamples, stream[j]->m_numberOfSamples);
+                sequence.m_streams.push_back(std::move(stream[j]));
+            }
+            window.push_back(std::move(sequence));
+        }
+    }
+
+    m_maxBucketSizeInSamples = std::max<size_t>(1, m_maxBucketSizeInSamples * m_localMinibatchSizeInSamples / std::max<size_t>(1, m_windowMinibatchSizeInSamples));
+    SplitIntoBuckets(window, numberOfStreams, m_maxBucketSizeInSamples);
+}
+
+Minibatch BucketingSequencePacker::ReadMinibatch()
+{
+    if (m_buckets.empty())
+        FillWindow();
+
+    if (m_buckets.empty())
+        return Minibatch(m_endOfSweep, m_endOfEpoch);
+
+    Sequences sequences = std::move(m_buckets.front());
+    m_buckets.pop_front();
+
+    // Only the last minibatch of the window can be at the end of sweep or epoch.
+    if (m_buckets.empty())
+    {
+        sequences.m_endOfSweep = m_endOfSweep;
+        sequences.m_endOfEpoch = m_endOfEpoch;
+    }
+
+    return PackMinibatch(sequences);
+}
+
+void BucketingSequencePacker::FillWindow()
+{
+    m_windowStartPosition = m_sequenceEnumerator->GetCurrentSamplePosition();
+
+    std::vector<WindowSequence> window;
+    size_t numberOfStreams = 0;
+
+    // Buckets are at most as big as the biggest minibatch returned by the sequence enumerator,
+    // this preserves the number of local samples per minibatch for both local and global timelines.
+    size_t maxBucketSizeInSamples = 0;
+
+    m_windowChunks.clear();
+    m_endOfSweep = m_endOfEpoch = false;
+    for (size_t i = 0; i < m_windowSizeInMinibatches && !m_endOfSweep && !m_endOfEpoch; ++i)
+    {
+        auto sequences = m_sequenceEnumerator->GetNextSequences(m_globalMinibatchSizeInSamples, m_localMinibatchSizeInSamples);
+        m_endOfSweep = sequences.m_endOfSweep;
+        m_endOfEpoch = sequences.m_endOfEpoch;
+        m_windowChunks.insert(m_windowChunks.end(), sequences.m_chunks.begin(), sequences.m_chunks.end());
+        if (sequences.m_data.empty())
+            continue;
+
+        numberOfStreams = sequences.m_data.size();
+        size_t minibatchSizeInSamples = 0;
+        for (size_t j = 0; j < sequences.m_data.front().size(); ++j)
+        {
+            WindowSequence sequence{ 0, {} };
+            sequence.m_streams.reserve(numberOfStreams);
+            for (const auto& stream : sequences.m_data)
+            {
+                sequence.m_numberOfSamples = std::max<size_t>(sequence.m_numberOfSamples, stream[j]->m_numberOfSamples);
+                sequence.m_streams.push_back(stream[j]);
+            }
+
+            minibatchSizeInSamples += sequence.m_numberOfSamples;
+            window.push_back(std::move(sequence));
+        }
+
+        maxBucketSizeInSamples = std::max(maxBucketSizeInSamples, minibatchSizeInSamples);
+    }
+
+    m_windowEndPosition = m_sequenceEnumerator->GetCurrentSamplePosition();
+
+    // The sequence enumerator returns more samples than requested if the first sequence does not fit.
+    m_maxBucketSizeInSamples = std::min(maxBucketSizeInSamples, m_localMinibatchSizeInSamples);
+    SplitIntoBuckets(window, numberOfStreams, m_maxBucketSizeInSamples);
+}
+
+void BucketingSequencePacker::SplitIntoBuckets(std::vector<WindowSequence>& window, size_t numberOfStreams, size_t maxBucketSizeInSamples)
+{
+    // The order of minibatches depends only on the position of the window,
+    // so that the same minibatches are produced after restarting from a checkpoint.
+    std::mt19937_64 rng(m_seed + m_windowStartPosition);
+    m_windowMinibatchSizeInSamples = m_localMinibatchSizeInSamples;
+
+    // Stable sort keeps the randomized order among the sequences of the same length.
+    // The longest sequences go first, so that the layout places the shorter ones into the remaining gaps.
+    std::stable_sort(window.begin(), window.end(),
+        [](const WindowSequence& a, const WindowSequence& b) { return a.m_numberOfSamples > b.m_numberOfSamples; });
+
+    std::vector<Sequences> buckets;
+    size_t currentBucketSizeInSamples = 0;
+    for (auto& sequence : window)
+    {
+        // Sequences longer than the bucket size form a bucket of their own.
+        if (buckets.empty() || currentBucketSizeInSamples + sequence.m_numberOfSamples > maxBucketSizeInSamples)
+        {
+            buckets.push_back(Sequences());
+            buckets.back().m_data.resize(numberOfStreams);
+            currentBucketSizeInSamples = 0;
+        }
+
+        for (size_t streamIndex = 0; streamIndex < numberOfStreams; ++streamIndex)
+            buckets.back().m_data[streamIndex].push_back(std::move(sequence.m_streams[streamIndex]));
+        currentBucketSizeInSamples += sequence.m_numberOfSamples;
+    }
+
+    RandomShuffleMT(buckets, rng);
+    m_buckets.assign(std::make_move_iterator(buckets.begin()), std::make_move_iterator(buckets.end()));
+}
+
+}}}
@@ -0,0 +1,80 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <deque>
+#include "SequencePacker.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// This packer reduces the padding in minibatches of sequences with widely varying lengths.
+// It buffers a window of several minibatches worth of randomized sequences, sorts them by length and
+// splits the window into minibatches of sequences with similar lengths that are returned in random order.
+// The window never crosses a sweep or an epoch boundary, so the sweep randomization is preserved
+// up to the order of sequences inside a single window.
+class BucketingSequencePacker : public SequencePacker
+{
+public:
+    BucketingSequencePacker(
+        SequenceEnumeratorPtr sequenceEnumerator,
+        const std::vector<StreamDescriptionPtr>& streams,
+        size_t windowSizeInMinibatches,
+        size_t numberOfBuffers = 2,
+        bool useLocalTimeline = false,
+        CorpusDescriptorPtr corpus = nullptr,
+        size_t seed = 0);
+
+    Minibatch ReadMinibatch() override;
+
+    // The start of the current window while it has minibatches that have not been returned yet.
+    size_t GetCurrentSamplePosition() override;
+
+    // Drops the buffered sequences when the position of the sequence enumerator changes.
+    // Restoring the position of the current window instead keeps the sequences that have not been returned yet,
+    // i.e. when the minibatch size changes or a checkpoint of this reader is restored, so that every sequence is
+    // returned exactly once. When a new reader is restored to the start of a window, the whole window is read again.
+    void Reset() override;
+
+private:
+    // A single sequence with the data of all streams.
+    struct WindowSequence
+    {
+        size_t m_numberOfSamples;
+        std::vector<SequenceDataPtr> m_streams;
+    };
+
+    // Reads the next window from the sequence enumerator and splits it into buckets.
+    void FillWindow();
+
+    // Sorts the sequences of the window by length and splits them into buckets in random order.
+    void SplitIntoBuckets(std::vector<WindowSequence>& window, size_t numberOfStreams, size_t maxBucketSizeInSamples);
+
+    // Number of minibatches read from the sequence enumerator into a single window.
+    size_t m_windowSizeInMinibatches;
+
+    size_t m_seed;
+
+    // Positions of the sequence enumerator before and after reading the current window.
+    size_t m_windowStartPosition;
+    size_t m_windowEndPosition;
+
+    // Bucket size and local minibatch size the buckets of the current window were made for.
+    size_t m_maxBucketSizeInSamples;
+    size_t m_windowMinibatchSizeInSamples;
+
+    // Minibatches of the current window that have not been returned yet,
+    // each is stored as sequence enumerator output.
+    std::deque<Sequences> m_buckets;
+
+    // Chunks of the current window, the randomizer can release them before the window is packed.
+    std::vector<ChunkPtr> m_windowChunks;
+
+    // Sweep and epoch end flags of the current window, reported with its last minibatch.
+    bool m_endOfSweep;
+    bool m_endOfEpoch;
+};
+
+}}}
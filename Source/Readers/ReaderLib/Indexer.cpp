@@ -6,7 +6,11 @@
 #define __STDC_FORMAT_MACROS
 #define _CRT_SECURE_NO_WARNINGS
 #include <inttypes.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <thread>
 #include "Indexer.h"
+#include "ExceptionCapture.h"
 #include <boost/utility/string_ref.hpp>
 #include <boost/algorithm/string.hpp>
 
@@ -17,10 +21,14 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 Indexer::Indexer(FILE* file, bool primary, bool skipSequenceIds, char streamPrefix, size_t chunkSize, const std::string& mainStream, size_t bufferSize) :
     m_streamPrefix(streamPrefix),
     m_buffer(bufferSize, !mainStream.empty()),
+    m_bufferSize(bufferSize),
     m_file(file),
     m_hasSequenceIds(!skipSequenceIds),
+    m_skipSequenceIds(skipSequenceIds),
     m_index(chunkSize, primary),
-    m_mainStream(mainStream)
+    m_mainStream(mainStream),
+    m_useCache(false),
+    m_numThreads(1)
 {
     if (m_file == nullptr)
         RuntimeError("Input file not open for reading");
@@ -52,6 +60,13 @@ void Indexer::BuildFromLines()
     }
 }
 
+void Indexer::SetInputFile(const std::wstring& path, bool useCache, size_t numThreads)
+{
+    m_inputPath = path;
+    m_useCache = useCache;
+    m_numThreads = numThreads;
+}
+
 void Indexer::Build(CorpusDescriptorPtr corpus)
 {
     if (!m_index.IsEmpty())
@@ -59,6 +74,21 @@ void Indexer::Build(CorpusDescriptorPtr corpus)
         return;
     }
 
+    // Byte ranges of the input can only be indexed independently (and the index can only be
+    // reused across runs) when sequence ids do not depend on the order in which keys are read.
+    bool canUseInputFile = !m_inputPath.empty() && corpus->IsNumericSequenceKeys();
+    if (canUseInputFile && m_useCache)
+    {
+        if (TryLoadCache())
+        {
+            m_index.MapSequenceKeyToLocation();
+            return;
+        }
+
+        // Validating the cache samples the input, start over from its beginning.
+        m_buffer.SeekTo(m_file, 0);
+    }
+
     // Create a lambda to read symbolic or numeric sequence ids,
     // depending on what the corpus expects.
     std::function<bool(size_t&)> tryGetSequenceId;
@@ -75,6 +105,8 @@ void Indexer::Build(CorpusDescriptorPtr corpus)
 
     m_buffer.SkipBOMIfPresent();
 
+    size_t numThreads = canUseInputFile ? GetNumberOfThreads() : 1;
+
     // check the first byte and decide what to do next
     if (!m_hasSequenceIds || *m_buffer.m_current == m_streamPrefix)
     {
@@ -85,11 +117,28 @@ void Indexer::Build(CorpusDescriptorPtr corpus)
             RuntimeError("Corpus expects non-numeric sequence keys present but the input file does not have them."
                 "Please use the configuration to enable numeric keys instead.");
 
-        BuildFromLines();
-        m_index.MapSequenceKeyToLocation();
-        return;
+        if (numThreads > 1)
+            BuildInParallel(m_buffer.GetFileOffset(), /*fromLines =*/ true, numThreads);
+        else
+            BuildFromLines();
+    }
+    else if (numThreads > 1)
+    {
+        BuildInParallel(m_buffer.GetFileOffset(), /*fromLines =*/ false, numThreads);
+    }
+    else
+    {
+        BuildFromSequenceIds(tryGetSequenceId);
     }
 
+    m_index.MapSequenceKeyToLocation();
+
+    if (canUseInputFile && m_useCache)
+        SaveCache();
+}
+
+void Indexer::BuildFromSequenceIds(std::function<bool(size_t&)> tryGetSequenceId)
+{
     size_t id = 0;
     int64_t offset = m_buffer.GetFileOffset();
     // read the very first sequence id
@@ -128,7 +177,360 @@ void Indexer::Build(CorpusDescriptorPtr corpus)
     }
 
     m_index.AddSequence(SequenceDescriptor{ previousId, numberOfSamples }, sequenceOffset, m_fileSize);
-    m_index.MapSequenceKeyToLocation();
+}
+
+size_t Indexer::GetNumberOfThreads() const
+{
+    if (m_numThreads != 0)
+        return m_numThreads;
+
+    // Small inputs are read faster by a single thread, only split
+    // the input into ranges of at least 256MB.
+    const int64_t minRangeSize = 256 * 1024 * 1024;
+    size_t numRanges = static_cast<size_t>(m_fileSize / minRangeSize);
+    return std::max<size_t>(1, std::min<size_t>(numRanges, std::thread::hardware_concurrency()));
+}
+
+int64_t Indexer::FindLineStart(int64_t offset)
+{
+    assert(offset > 0);
+    if (offset >= m_fileSize)
+        return m_fileSize;
+
+    // Start at the preceding byte, so that an offset that already
+    // points at the beginning of a line is returned as is.
+    int64_t position = offset - 1;
+    if (_fseeki64(m_file, position, SEEK_SET) != 0)
+        RuntimeError("Could not seek to the offset %" PRIi64 " in the input file.", position);
+
+    std::vector<char> buffer(64 * 1024);
+    for (;;)
+    {
+        size_t bytesRead = fread(buffer.data(), 1, buffer.size(), m_file);
+        if (bytesRead == 0)
+            return m_fileSize;
+
+        auto newLine = static_cast<const char*>(memchr(buffer.data(), g_rowDelimiter, bytesRead));
+        if (newLine)
+            return position + (newLine - buffer.data()) + 1;
+
+        position += bytesRead;
+    }
+}
+
+void Indexer::BuildInParallel(int64_t dataStart, bool fromLines, size_t numThreads)
+{
+    if (fromLines)
+        m_hasSequenceIds = false;
+
+    // Split the input into line aligned ranges of roughly equal size.
+    std::vector<int64_t> boundaries { dataStart };
+    for (size_t i = 1; i < numThreads; ++i)
+    {
+        int64_t offset = FindLineStart(dataStart + (m_fileSize - dataStart) * i / numThreads);
+        if (offset > boundaries.back() && offset < m_fileSize)
+            boundaries.push_back(offset);
+    }
+    boundaries.push_back(m_fileSize);
+
+    std::vector<RangeScanResult> results(boundaries.size() - 1);
+    auto scan = [&](int rangeIndex)
+    {
+        // Each range is scanned by a separate indexer with its own file handle.
+        auto file = std::unique_ptr<FILE, int(*)(FILE*)>(fopenOrDie(m_inputPath, L"rbS"), fclose);
+        Indexer worker(file.get(), m_index.m_primary, m_skipSequenceIds, m_streamPrefix, m_index.m_maxChunkSize, m_mainStream, m_bufferSize);
+        worker.ScanRange(boundaries[rangeIndex], boundaries[rangeIndex + 1], fromLines, results[rangeIndex]);
+    };
+
+    ExceptionCapture capture;
+#pragma omp parallel for schedule(dynamic) num_threads((int)results.size())
+    for (int i = 0; i < (int)results.size(); ++i)
+        capture.SafeRun(scan, i);
+    capture.RethrowIfHappened();
+
+    if (results.front().m_continuesPreviousRange)
+        RuntimeError("Expected a sequence id at the offset %" PRIi64 ", none was found.", dataStart);
+
+    // Merge the ranges in file order: line numbers (which are the keys of sequences
+    // without ids) are made global and sequences spanning range boundaries are stitched together.
+    size_t numberOfLines = 0;
+    bool hasPrevious = false;
+    SequenceRecord previous;
+    for (const auto& range : results)
+    {
+        for (size_t i = 0; i < range.m_sequences.size(); ++i)
+        {
+            auto sequence = range.m_sequences[i];
+            if (fromLines)
+            {
+                sequence.m_key += numberOfLines;
+            }
+            else if ((i == 0 && range.m_continuesPreviousRange) || (hasPrevious && sequence.m_key == previous.m_key))
+            {
+                // Within a range a new record always has a different key, so a matching key
+                // can only be the continuation of the last sequence of the preceding range.
+                previous.m_numberOfSamples += sequence.m_numberOfSamples;
+                previous.m_endOffset = sequence.m_endOffset;
+                continue;
+            }
+
+            if (hasPrevious)
+                m_index.AddSequence(SequenceDescriptor{ previous.m_key, previous.m_numberOfSamples }, previous.m_startOffset, previous.m_endOffset);
+
+            previous = sequence;
+            hasPrevious = true;
+        }
+
+        numberOfLines += range.m_sequences.size();
+    }
+
+    if (hasPrevious)
+        m_index.AddSequence(SequenceDescriptor{ previous.m_key, previous.m_numberOfSamples }, previous.m_startOffset, previous.m_endOffset);
+}
+
+void Indexer::ScanRange(int64_t begin, int64_t end, bool fromLines, RangeScanResult& result)
+{
+    auto& sequences = result.m_sequences;
+    m_buffer.SeekTo(m_file, begin);
+    m_buffer.RefillFrom(m_file);
+
+    int64_t offset = begin;
+    if (fromLines)
+    {
+        // Same as BuildFromLines, keys are line numbers relative to the beginning of the range.
+        while (!m_buffer.Eof() && offset < end)
+        {
+            auto pos = m_buffer.MoveToNextLine();
+            if (pos)
+            {
+                auto sequenceOffset = offset;
+                offset = m_buffer.GetFileOffset();
+                sequences.push_back({ m_buffer.CurrentLine() - 1, sequenceOffset, offset, 1 });
+            }
+            else
+                m_buffer.RefillFrom(m_file);
+        }
+
+        if (offset < end)
+        {
+            // The last line is not terminated by a newline.
+            sequences.push_back({ m_buffer.CurrentLine(), offset, end, 1 });
+        }
+        return;
+    }
+
+    size_t id = 0;
+    bool hasId = TryGetNumericSequenceId(id);
+    result.m_continuesPreviousRange = !hasId;
+
+    auto sequenceOffset = offset;
+    size_t previousId = id;
+    uint32_t numberOfSamples = 0;
+    while (!m_buffer.Eof())
+    {
+        if (!m_mainStream.empty())
+        {
+            if (SkipLineWithCheck())
+                numberOfSamples++;
+        }
+        else
+        {
+            SkipLine();
+            numberOfSamples++;
+        }
+
+        offset = m_buffer.GetFileOffset();
+        if (offset >= end)
+            break;
+
+        if (!m_buffer.Eof() && TryGetNumericSequenceId(id) && (id != previousId || !hasId))
+        {
+            sequences.push_back({ previousId, sequenceOffset, offset, numberOfSamples });
+
+            sequenceOffset = offset;
+            previousId = id;
+            hasId = true;
+            numberOfSamples = 0;
+        }
+    }
+
+    sequences.push_back({ previousId, sequenceOffset, end, numberOfSamples });
+}
+
+// Index cache file layout (all values are stored in the native byte order):
+//   tag, version, input file size, modification time and sampled content hash,
+//   indexer settings the index depends on, followed by the sequence records in file order,
+//   each as a 64-bit key, start and end offset and a 32-bit number of samples.
+// The chunks are rebuilt by replaying the sequences through Index::AddSequence.
+static const char* s_indexCacheTag = "CIDX";
+static const uint32_t s_indexCacheVersion = 2;
+
+static uint64_t GetModificationTime(const std::wstring& path)
+{
+#ifdef _WIN32
+    struct _stat64 buffer;
+    if (_wstat64(path.c_str(), &buffer) != 0)
+#else
+    struct stat buffer;
+    if (stat(wtocharpath(path).c_str(), &buffer) != 0)
+#endif
+        RuntimeError("Could not retrieve the modification time of '%ls'.", path.c_str());
+    return static_cast<uint64_t>(buffer.st_mtime);
+}
+
+// FNV-1a hash of the beginning, the end and a number of evenly spaced blocks of the file.
+// Hashing the whole input would make validating the cache as expensive as rebuilding the index.
+static uint64_t ComputeSampledHash(FILE* file, int64_t fileSize)
+{
+    const int64_t blockSize = 64 * 1024;
+    const int64_t numBlocks = 16;
+
+    std::vector<int64_t> offsets;
+    if (fileSize <= blockSize * numBlocks)
+        offsets.push_back(0);
+    else
+        for (int64_t i = 0; i < numBlocks; ++i)
+            offsets.push_back((fileSize - blockSize) * i / (numBlocks - 1));
+
+    uint64_t hash = 14695981039346656037ull;
+    std::vector<unsigned char> buffer(fileSize <= blockSize * numBlocks ? fileSize : blockSize);
+    for (auto offset : offsets)
+    {
+        if (_fseeki64(file, offset, SEEK_SET) != 0)
+            RuntimeError("Could not seek to the offset %" PRIi64 " in the input file.", offset);
+        freadOrDie(buffer.data(), 1, buffer.size(), file);
+        for (auto c : buffer)
+            hash = (hash ^ c) * 1099511628211ull;
+    }
+    return hash;
+}
+
+bool Indexer::TryLoadCache()
+{
+    auto cachePath = GetCachePath();
+    if (!fexists(cachePath))
+        return false;
+
+    try
+    {
+        auto file = std::unique_ptr<FILE, int(*)(FILE*)>(fopenOrDie(cachePath, L"rbS"), fclose);
+
+        char tag[4];
+        uint32_t version;
+        freadOrDie(tag, 1, sizeof(tag), file.get());
+        fget(file.get(), version);
+        if (memcmp(tag, s_indexCacheTag, sizeof(tag)) != 0 || version != s_indexCacheVersion)
+            return false;
+
+        uint64_t fileSize, modificationTime, contentHash, chunkSize;
+        uint8_t primary, trackFirstSamples, skipSequenceIds, hasSequenceIds;
+        char streamPrefix;
+        uint32_t mainStreamLength;
+        fget(file.get(), fileSize);
+        fget(file.get(), modificationTime);
+        fget(file.get(), contentHash);
+        fget(file.get(), chunkSize);
+        fget(file.get(), primary);
+        fget(file.get(), trackFirstSamples);
+        fget(file.get(), skipSequenceIds);
+        fget(file.get(), hasSequenceIds);
+        fget(file.get(), streamPrefix);
+        fget(file.get(), mainStreamLength);
+        std::string mainStream(mainStreamLength, '\0');
+        if (mainStreamLength > 0)
+            freadOrDie(&mainStream[0], 1, mainStreamLength, file.get());
+
+        // Cheap checks first, the content hash requires reading parts of the input.
+        if (fileSize != static_cast<uint64_t>(m_fileSize) ||
+            modificationTime != GetModificationTime(m_inputPath) ||
+            chunkSize != m_index.m_maxChunkSize ||
+            !!primary != m_index.m_primary ||
+            !!trackFirstSamples != m_index.m_trackFirstSamples ||
+            !!skipSequenceIds != m_skipSequenceIds ||
+            streamPrefix != m_streamPrefix ||
+            mainStream != m_mainStream ||
+            contentHash != ComputeSampledHash(m_file, m_fileSize))
+        {
+            return false;
+        }
+
+        uint64_t numSequences;
+        fget(file.get(), numSequences);
+
+        for (uint64_t i = 0; i < numSequences; ++i)
+        {
+            uint64_t key;
+            int64_t startOffset, endOffset;
+            uint32_t numberOfSamples;
+            fget(file.get(), key);
+            fget(file.get(), startOffset);
+            fget(file.get(), endOffset);
+            fget(file.get(), numberOfSamples);
+            m_index.AddSequence(SequenceDescriptor{ key, numberOfSamples }, startOffset, endOffset);
+        }
+
+        m_hasSequenceIds = !!hasSequenceIds;
+        return true;
+    }
+    catch (const std::exception& e)
+    {
+        fprintf(stderr, "WARNING: Ignoring the index cache file '%ls', it could not be read: %s\n", cachePath.c_str(), e.what());
+        m_index.Clear();
+        return false;
+    }
+}
+
+void Indexer::SaveCache() const
+{
+    auto cachePath = GetCachePath();
+
+    // Write to a uniquely named temporary file first, so that concurrent
+    // jobs over the same input never observe a partially written cache.
+    auto temporaryPath = cachePath + L"." + std::to_wstring(std::chrono::steady_clock::now().time_since_epoch().count()) + L".tmp";
+    try
+    {
+        {
+            auto file = std::unique_ptr<FILE, int(*)(FILE*)>(fopenOrDie(temporaryPath, L"wbS"), fclose);
+            fwriteOrDie(s_indexCacheTag, 1, 4, file.get());
+            fput(file.get(), s_indexCacheVersion);
+            fput(file.get(), static_cast<uint64_t>(m_fileSize));
+            fput(file.get(), GetModificationTime(m_inputPath));
+            fput(file.get(), ComputeSampledHash(m_file, m_fileSize));
+            fput(file.get(), static_cast<uint64_t>(m_index.m_maxChunkSize));
+            fput(file.get(), static_cast<uint8_t>(m_index.m_primary));
+            fput(file.get(), static_cast<uint8_t>(m_index.m_trackFirstSamples));
+            fput(file.get(), static_cast<uint8_t>(m_skipSequenceIds));
+            fput(file.get(), static_cast<uint8_t>(m_hasSequenceIds));
+            fput(file.get(), m_streamPrefix);
+            fput(file.get(), static_cast<uint32_t>(m_mainStream.size()));
+            if (!m_mainStream.empty())
+                fwriteOrDie(m_mainStream.data(), 1, m_mainStream.size(), file.get());
+
+            uint64_t numSequences = 0;
+            for (const auto& chunk : m_index.Chunks())
+                numSequences += chunk.Sequences().size();
+            fput(file.get(), numSequences);
+
+            for (const auto& chunk : m_index.Chunks())
+            {
+                for (const auto& s : chunk.Sequences())
+                {
+                    int64_t start = chunk.m_offset + s.OffsetInChunk();
+                    fput(file.get(), static_cast<uint64_t>(s.m_key));
+                    fput(file.get(), start);
+                    fput(file.get(), static_cast<int64_t>(start + s.SizeInBytes()));
+                    fput(file.get(), s.m_numberOfSamples);
+                }
+            }
+        }
+        renameOrDie(temporaryPath, cachePath);
+    }
+    catch (const std::exception& e)
+    {
+        fprintf(stderr, "WARNING: Could not write the index cache file '%ls': %s\n", cachePath.c_str(), e.what());
+        if (fexists(temporaryPath))
+            _wunlink(temporaryPath.c_str());
+    }
 }
 
 void Indexer::SkipLine()
@@ -171,6 +171,13 @@ public:
         return m_chunks.empty();
     }
 
+    // Removes all chunks and sequences from the index.
+    void Clear()
+    {
+        m_chunks.clear();
+        m_keyToSequenceInChunk.clear();
+    }
+
     // Returns true or false with chunk and sequence index depending if the key has been found.
     std::tuple<bool, uint32_t, uint32_t> GetSequenceByKey(size_t key) const;
 
@@ -193,6 +200,14 @@ public:
     // sequences.
     void Build(CorpusDescriptorPtr corpus);
 
+    // Associates the indexer with the path of the input file, which allows it to
+    //  - reuse an index persisted by a previous run in a sidecar cache file (when useCache is set),
+    //    the cache is validated against the size, modification time and sampled content hash of the input;
+    //  - scan non-overlapping byte ranges of the input in parallel when no valid cache exists
+    //    (numThreads == 0 picks the number of threads based on the input size).
+    // Both only apply to numeric sequence keys, symbolic keys are mapped to ids in the order they are read.
+    void SetInputFile(const std::wstring& path, bool useCache, size_t numThreads = 1);
+
     // Returns input data index (chunk and sequence metadata)
     const Index& GetIndex() const { return m_index; }
 
@@ -210,8 +225,10 @@ private:
     FILE* m_file;
     int64_t m_fileSize;
     MemoryBuffer m_buffer;
+    const size_t m_bufferSize;
     bool m_hasSequenceIds; // true, when input contains one sequence per line 
                            // or when sequence id column was ignored during indexing.
+    const bool m_skipSequenceIds;
 
     // Stream that defines the size of the sequence.
     std::string m_mainStream;
@@ -221,6 +238,29 @@ private:
 
     const char m_streamPrefix;
 
+    // Path of the input file, empty if not known (see SetInputFile).
+    std::wstring m_inputPath;
+    bool m_useCache;
+    size_t m_numThreads;
+
+    // A sequence found while scanning a byte range of the input file.
+    struct SequenceRecord
+    {
+        size_t m_key;
+        int64_t m_startOffset;
+        int64_t m_endOffset;
+        uint32_t m_numberOfSamples;
+    };
+
+    // Sequences found in a single byte range of the input file.
+    struct RangeScanResult
+    {
+        std::vector<SequenceRecord> m_sequences;
+        // True if the range starts in the middle of a sequence
+        // (i.e., the first line of the range does not have a sequence id).
+        bool m_continuesPreviousRange = false;
+    };
+
     // Moves the buffer position to the beginning of the next line.
     void SkipLine();
 
@@ -244,6 +284,34 @@ private:
     // the corresponding sequence id.
     void BuildFromLines();
 
+    // Build a chunk/sequence index for the input with sequence ids, reading
+    // the ids with the provided function.
+    void BuildFromSequenceIds(std::function<bool(size_t&)> tryGetSequenceId);
+
+    // Splits [dataStart, m_fileSize) into line aligned byte ranges, indexes them
+    // in parallel and merges the results into the index.
+    void BuildInParallel(int64_t dataStart, bool fromLines, size_t numThreads);
+
+    // Indexes sequences (or lines, if fromLines is set) starting in [begin, end).
+    // Both offsets must point to the beginning of a line.
+    void ScanRange(int64_t begin, int64_t end, bool fromLines, RangeScanResult& result);
+
+    // Returns the offset of the first line that starts at or after the given offset.
+    int64_t FindLineStart(int64_t offset);
+
+    // Returns the number of threads to use for building the index.
+    size_t GetNumberOfThreads() const;
+
+    // Path of the sidecar file the index is cached in.
+    std::wstring GetCachePath() const { return m_inputPath + L".idx"; }
+
+    // Tries to restore the index from the cache file, returns false if the cache
+    // does not exist or does not match the input file and indexer settings.
+    bool TryLoadCache();
+
+    // Persists the index to the cache file, failures are reported as warnings.
+    void SaveCache() const;
+
     DISABLE_COPY_AND_MOVE(Indexer);
 };
 
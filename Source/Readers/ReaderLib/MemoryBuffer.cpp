@@ -3,7 +3,9 @@
 // Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
 //
 
+#define __STDC_FORMAT_MACROS
 #define _CRT_SECURE_NO_WARNINGS
+#include <inttypes.h>
 #include "MemoryBuffer.h"
 #include <boost/utility/string_ref.hpp>
 #include <boost/algorithm/string.hpp>
@@ -90,6 +92,19 @@ namespace Microsoft { namespace MSR { namespace CNTK {
         }
     }
 
+    void MemoryBuffer::SeekTo(FILE* file, int64_t offset)
+    {
+        if (_fseeki64(file, offset, SEEK_SET) != 0)
+            RuntimeError("Could not seek to the offset %" PRIi64 " in the input file.", offset);
+
+        m_data.clear();
+        m_lastPartialLineInBuffer.clear();
+        m_current = m_data.data();
+        m_fileOffsetStart = offset;
+        m_done = false;
+        m_line = 0;
+    }
+
     void MemoryBuffer::SkipBOMIfPresent()
     {
         assert(m_current == m_data.data());
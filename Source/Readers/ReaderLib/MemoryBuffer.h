@@ -38,6 +38,9 @@ public:
     // Refills the buffer from the file.
     void RefillFrom(FILE* file);
 
+    // Drops the buffered data and positions the buffer (and the file) at the given file offset.
+    void SeekTo(FILE* file, int64_t offset);
+
     // Moves the current position to the next line.
     // If no new lines is present, returns null, otherwise returns a new position.
     const char* MoveToNextLine()
@@ -211,6 +211,10 @@ Sequences NoRandomizer::GetNextSequences(size_t globalSampleCount, size_t localS
     // swap current chunks with new ones:
     m_chunks.swap(chunks);
 
+    result.m_chunks.reserve(m_chunks.size());
+    for (const auto& chunk : m_chunks)
+        result.m_chunks.push_back(chunk.second);
+
     auto process = [&](int i) -> void {
         std::vector<SequenceDataPtr> sequence;
         const auto& sequenceDescription = m_sequenceBuffer[i];
@@ -17,7 +17,11 @@ public:
     // Sets current epoch configuration.
     virtual void SetConfiguration(const ReaderConfiguration& config, const std::vector<MemoryProviderPtr>& memoryProviders) = 0;
 
-    // Flushes the internal state of the packer.
+    // Returns the sample position to checkpoint. A packer that reads ahead of the minibatches it has returned
+    // reports a position before the sequences it buffers.
+    virtual size_t GetCurrentSamplePosition() = 0;
+
+    // Flushes the internal state of the packer, called after the position of the sequence enumerator has been set.
     virtual void Reset() {};
 
     virtual Minibatch ReadMinibatch() = 0;
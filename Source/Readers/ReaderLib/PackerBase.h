@@ -97,6 +97,11 @@ protected:
 public:
     // Sets current epoch configuration.
     virtual void SetConfiguration(const ReaderConfiguration& config, const std::vector<MemoryProviderPtr>& memoryProviders) override;
+
+    virtual size_t GetCurrentSamplePosition() override
+    {
+        return m_sequenceEnumerator->GetCurrentSamplePosition();
+    }
 };
 
 inline void PackerBase::PackSparseSampleAsDense(char* destination, SparseSequenceDataPtr sequence,
@@ -65,7 +65,7 @@ Minibatch ReaderBase::ReadMinibatch()
 
 size_t ReaderBase::GetCurrentSamplePosition()
 {
-    return m_sequenceEnumerator->GetCurrentSamplePosition();
+    return m_packer->GetCurrentSamplePosition();
 }
 
 void ReaderBase::SetCurrentSamplePosition(size_t currentSamplePosition)
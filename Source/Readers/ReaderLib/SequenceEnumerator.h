@@ -27,6 +27,10 @@ struct Sequences
 
     // Indicates whether the epoch ends with the data returned.
     bool m_endOfEpoch{ false };
+
+    // Chunks the returned sequences belong to. The sequence data can point into the chunk memory,
+    // so the chunks have to be kept if the sequences are used after the next call to the enumerator.
+    std::vector<ChunkPtr> m_chunks;
 };
 
 class SequenceEnumerator;
@@ -39,6 +39,11 @@ MBLayoutPtr SequencePacker::CreateMBLayout(const StreamBatch& batch)
 Minibatch SequencePacker::ReadMinibatch()
 {
     auto sequences = m_sequenceEnumerator->GetNextSequences(m_globalMinibatchSizeInSamples, m_localMinibatchSizeInSamples);
+    return PackMinibatch(sequences);
+}
+
+Minibatch SequencePacker::PackMinibatch(const Sequences& sequences)
+{
     const auto& batch = sequences.m_data;
 
     Minibatch minibatch(sequences.m_endOfSweep, sequences.m_endOfEpoch);
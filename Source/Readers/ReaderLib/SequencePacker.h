@@ -31,6 +31,9 @@ public:
     void SetConfiguration(const ReaderConfiguration& config, const std::vector<MemoryProviderPtr>& memoryProviders) override;
 
 protected:
+    // Packs the given sequences into the current buffer.
+    Minibatch PackMinibatch(const Sequences& sequences);
+
     virtual MBLayoutPtr PackDenseStream(const StreamBatch& batch, size_t streamIndex);
 
     virtual MBLayoutPtr PackSparseStream(const StreamBatch& batch, size_t streamIndex);
@@ -289,7 +289,10 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
     additionalNodesToEvaluate.insert(additionalNodesToEvaluate.end(), preComputeNodesList.cbegin(), preComputeNodesList.cend());
 
     // allocate memory for forward and backward computation
+    net->SetActivationCheckpointing(m_activationCheckpointing, m_checkpointNodeNames, m_bfloat16Checkpoints);
     net->AllocateAllMatrices(evaluationNodes, additionalNodesToEvaluate, criterionNodes[0]); // TODO: use criterionNodes.front() throughout
+    if (m_nodeProfilerMinibatches > 0)
+        net->EnableNodeProfiler(m_nodeProfilerPath, m_nodeProfilerMinibatches);
 
     // get feature and label nodes into an array of matrices that will be passed to GetMinibatch()
     // TODO: instead, remember the nodes directly, to be able to handle both float and double nodes; current version will crash for mixed networks
@@ -3561,7 +3564,12 @@ void SGD<ElemType>::LoadCheckPointInfo(const size_t epochNumber,
         Matrix<ElemType>& smoothedGradientValues = *smoothedGradientIter;
         fstream >> smoothedGradientValues;
     }
-    fstream.GetMarker(FileMarker::fileMarkerEndSection, L"EGradient");
+    // Checkpoints used to have one smoothed gradient per consumer of a learnable parameter, now each parameter has one.
+    // Those of networks that share parameters cannot be matched up anymore.
+    if (!fstream.TryGetMarker(FileMarker::fileMarkerEndSection, L"EGradient"))
+        RuntimeError("LoadCheckPointInfo: The checkpoint '%ls' has more smoothed gradients than the model has learnable parameters. "
+                     "It was probably written by an earlier version for a model with shared parameters; restart from the model without the checkpoint.",
+                     checkPointFileName.c_str());
 
     if (fstream.TryGetMarker(FileMarker::fileMarkerBeginSection, L"BCount"))
     {
@@ -3915,6 +3923,16 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
 
     m_maxTempMemSizeInSamplesForCNN = configSGD(L"maxTempMemSizeInSamplesForCNN", (size_t) 0);
 
+    m_activationCheckpointing = configSGD(L"activationCheckpointing", false);
+    m_checkpointNodeNames = configSGD(L"checkpointNodes", ConfigRecordType::Array(stringargvector()));
+    wstring checkpointPrecision = configSGD(L"checkpointPrecision", L"float");
+    if (checkpointPrecision != L"float" && checkpointPrecision != L"bfloat16")
+        InvalidArgument("checkpointPrecision: Invalid value '%ls'. Valid values are (float | bfloat16)", checkpointPrecision.c_str());
+    m_bfloat16Checkpoints = checkpointPrecision == L"bfloat16";
+
+    m_nodeProfilerMinibatches = configSGD(L"nodeProfilerMinibatches", (size_t) 0);
+    m_nodeProfilerPath = msra::strfun::utf16(configSGD(L"nodeProfilerPath", L"nodeProfile"));
+
     m_traceLevel = configSGD(L"traceLevel", 0);
     m_numMBsToShowResult = configSGD(L"numMBsToShowResult", (size_t)10);
     m_firstMBsToShowResult = configSGD(L"firstMBsToShowResult", (size_t)0);
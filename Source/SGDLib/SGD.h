@@ -246,6 +246,15 @@ protected:
     doubleargvector m_batchNormalizationBlendTimeConstant;
     size_t m_maxTempMemSizeInSamplesForCNN;
 
+    // activation checkpointing: recompute node values during backprop instead of keeping them, see ComputationNetwork::SetActivationCheckpointing()
+    bool m_activationCheckpointing;
+    std::vector<std::wstring> m_checkpointNodeNames;
+    bool m_bfloat16Checkpoints;
+
+    // per-node time and memory profile of the first minibatches, see ComputationNetwork::EnableNodeProfiler()
+    size_t m_nodeProfilerMinibatches;
+    std::wstring m_nodeProfilerPath;
+
     int m_traceLevel;
 
     size_t m_numPrevLearnRates;
@@ -4,9 +4,11 @@
 //
 #include "stdafx.h"
 #include "EvalTestHelper.h"
+#include "EvalBatching.h"
 #include "ComputationNode.h"
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
+#include <thread>
 
 using namespace Microsoft::MSR::CNTK;
 
@@ -415,5 +417,219 @@ BOOST_AUTO_TEST_CASE(EvalRNNTest)
     eval->Destroy();
 }
 
+BOOST_AUTO_TEST_CASE(EvalSessionsTest)
+{
+    std::string modelDefinition =
+        "deviceId = -1 \n"
+        "precision = \"float\" \n"
+        "traceLevel = 1 \n"
+        "run=NDLNetworkBuilder \n"
+        "NDLNetworkBuilder=[ \n"
+        "i1 = Input(4) \n"
+        "o1 = Times(Constant(2, rows=1, cols=4), i1, tag=\"output\") \n"
+        "FeatureNodes = (i1) \n"
+        "] \n";
+
+    VariableSchema inputLayouts;
+    VariableSchema outputLayouts;
+    IEvaluateModelExtended<float> *eval;
+    eval = SetupNetworkAndGetLayouts(modelDefinition, inputLayouts, outputLayouts);
+
+    // sessions evaluate concurrently, each on its own inputs
+    const size_t numSessions = 4;
+    std::vector<IEvaluateModelExtended<float>*> sessions;
+    for (size_t i = 0; i < numSessions; i++)
+    {
+        sessions.push_back(eval->CreateSession());
+        sessions.back()->StartForwardEvaluation({ outputLayouts[0].m_name });
+    }
+    BOOST_CHECK_EQUAL(sessions[0]->GetInputSchema()[0].m_numElements, 4);
+
+    std::vector<std::vector<float>> results(numSessions);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < numSessions; i++)
+    {
+        threads.emplace_back([&, i]()
+        {
+            Values<float> inputBuffer(1);
+            Values<float> outputBuffer = outputLayouts.CreateBuffers<float>({ 1 });
+            for (int pass = 0; pass < 100; pass++)
+            {
+                inputBuffer[0].m_buffer = { (float) i, 1, 1, (float) pass };
+                sessions[i]->ForwardPass(inputBuffer, outputBuffer);
+                results[i].push_back(outputBuffer[0].m_buffer[0]);
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    for (size_t i = 0; i < numSessions; i++)
+    {
+        BOOST_REQUIRE_EQUAL(results[i].size(), 100);
+        for (int pass = 0; pass < 100; pass++)
+            BOOST_CHECK_EQUAL(results[i][pass], (float) (2 * (i + 2 + pass)));
+    }
+
+    // sessions do not depend on the object they were created from
+    eval->Destroy();
+    Values<float> inputBuffer(1);
+    inputBuffer[0].m_buffer = { 1, 2, 3, 4 };
+    Values<float> outputBuffer = outputLayouts.CreateBuffers<float>({ 1 });
+    sessions[0]->ForwardPass(inputBuffer, outputBuffer);
+    BOOST_CHECK_EQUAL(outputBuffer[0].m_buffer[0], 20);
+
+    for (auto session : sessions)
+        session->Destroy();
+}
+
+BOOST_AUTO_TEST_CASE(EvalBatchTest)
+{
+    std::string modelDefinition =
+        "deviceId = -1 \n"
+        "precision = \"float\" \n"
+        "traceLevel = 1 \n"
+        "run=NDLNetworkBuilder \n"
+        "NDLNetworkBuilder=[ \n"
+        "i1 = Input(2) \n"
+        "o1 = Times(Constant(2, rows=1, cols=2), i1, tag=\"output\") \n"
+        "FeatureNodes = (i1) \n"
+        "] \n";
+
+    VariableSchema inputLayouts;
+    VariableSchema outputLayouts;
+    IEvaluateModelExtended<float> *eval;
+    eval = SetupNetworkAndGetLayouts(modelDefinition, inputLayouts, outputLayouts);
+
+    // sequences of different lengths in one minibatch
+    std::vector<Values<float>> inputs(3, Values<float>(1));
+    inputs[0][0].m_buffer = { 1, 2 };
+    inputs[1][0].m_buffer = { 1, 1, 2, 2, 3, 3 };
+    inputs[2][0].m_buffer = { 5, 5, 6, 6 };
+    std::vector<Values<float>> outputs;
+    for (size_t r = 0; r < inputs.size(); r++)
+        outputs.push_back(outputLayouts.CreateBuffers<float>({ 3 }));
+    eval->ForwardPassBatch(inputs, outputs);
+
+    std::vector<std::vector<float>> expected{ { 6 }, { 4, 8, 12 }, { 20, 24 } };
+    for (size_t r = 0; r < inputs.size(); r++)
+    {
+        auto buf = outputs[r][0].m_buffer;
+        BOOST_CHECK_EQUAL_COLLECTIONS(buf.begin(), buf.end(), expected[r].begin(), expected[r].end());
+    }
+
+    // the same through the batching front-end, from concurrent callers
+    {
+        BatchingEvaluator<float> batching(eval, /*maxBatchSize=*/4, std::chrono::milliseconds(5));
+        std::vector<std::thread> threads;
+        std::vector<std::vector<float>> results(8);
+        for (size_t k = 0; k < results.size(); k++)
+        {
+            threads.emplace_back([&, k]()
+            {
+                Values<float> output = outputLayouts.CreateBuffers<float>({ 3 });
+                batching.ForwardPass(inputs[k % 3], output);
+                results[k] = output[0].m_buffer;
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+        for (size_t k = 0; k < results.size(); k++)
+            BOOST_CHECK_EQUAL_COLLECTIONS(results[k].begin(), results[k].end(), expected[k % 3].begin(), expected[k % 3].end());
+
+        // a bad request fails alone
+        Values<float> badInput(1);
+        badInput[0].m_buffer = { 1, 2, 3 };
+        Values<float> output = outputLayouts.CreateBuffers<float>({ 1 });
+        BOOST_REQUIRE_THROW(batching.ForwardPass(badInput, output), std::exception);
+    }
+
+    // a bad request in a batch with good ones fails, and the others are evaluated one by one
+    {
+        // the batch is full with the 4 requests, long before the wait is over
+        BatchingEvaluator<float> batching(eval, /*maxBatchSize=*/4, std::chrono::seconds(60));
+        Values<float> badInput(1);
+        badInput[0].m_buffer = { 1, 2, 3 };
+        std::vector<std::thread> threads;
+        std::vector<std::vector<float>> results(4);
+        std::vector<int> failed(4, 0); // (not vector<bool>, whose elements share bytes)
+        for (size_t k = 0; k < results.size(); k++)
+        {
+            threads.emplace_back([&, k]()
+            {
+                Values<float> output = outputLayouts.CreateBuffers<float>({ 3 });
+                try
+                {
+                    batching.ForwardPass(k == 2 ? badInput : inputs[k % 3], output);
+                    results[k] = output[0].m_buffer;
+                }
+                catch (const std::exception&)
+                {
+                    failed[k] = 1;
+                }
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+        for (size_t k = 0; k < results.size(); k++)
+        {
+            BOOST_CHECK_EQUAL(failed[k], k == 2 ? 1 : 0);
+            if (k != 2)
+                BOOST_CHECK_EQUAL_COLLECTIONS(results[k].begin(), results[k].end(), expected[k % 3].begin(), expected[k % 3].end());
+        }
+    }
+
+    eval->Destroy();
+}
+
+BOOST_AUTO_TEST_CASE(EvalSparseBatchTest)
+{
+    std::string modelDefinition =
+        "deviceId = -1 \n"
+        "precision = \"float\" \n"
+        "traceLevel = 1 \n"
+        "run=NDLNetworkBuilder \n"
+        "NDLNetworkBuilder=[ \n"
+        "i1 = SparseInput(3) \n"
+        "o1 = Times(Constant(2, rows=1, cols=3), i1, tag=\"output\") \n"
+        "FeatureNodes = (i1) \n"
+        "] \n";
+
+    VariableSchema inputLayouts;
+    VariableSchema outputLayouts;
+    IEvaluateModelExtended<float> *eval;
+    eval = SetupNetworkAndGetLayouts(modelDefinition, inputLayouts, outputLayouts);
+
+    // sparse sequences of different lengths, with empty samples, in one minibatch
+    std::vector<Values<float>> inputs(3, Values<float>(1));
+    inputs[0][0].m_buffer = { 1, 2, 3, 5, 6 };
+    inputs[0][0].m_indices = { 0, 2, 2, 1, 2 };
+    inputs[0][0].m_colIndices = { 0, 2, 2, 5 };
+    inputs[1][0].m_buffer = { 4 };
+    inputs[1][0].m_indices = { 1 };
+    inputs[1][0].m_colIndices = { 0, 1 };
+    inputs[2][0].m_buffer = { 1, 7 };
+    inputs[2][0].m_indices = { 0, 1 };
+    inputs[2][0].m_colIndices = { 0, 0, 2 };
+    std::vector<Values<float>> outputs;
+    for (size_t r = 0; r < inputs.size(); r++)
+        outputs.push_back(outputLayouts.CreateBuffers<float>({ 3 }));
+    eval->ForwardPassBatch(inputs, outputs);
+
+    // the same as evaluating each sequence on its own
+    std::vector<std::vector<float>> expected{ { 6, 0, 28 }, { 8 }, { 0, 16 } };
+    for (size_t r = 0; r < inputs.size(); r++)
+    {
+        auto buf = outputs[r][0].m_buffer;
+        BOOST_CHECK_EQUAL_COLLECTIONS(buf.begin(), buf.end(), expected[r].begin(), expected[r].end());
+
+        Values<float> output = outputLayouts.CreateBuffers<float>({ 3 });
+        eval->ForwardPass(inputs[r], output);
+        BOOST_CHECK_EQUAL_COLLECTIONS(output[0].m_buffer.begin(), output[0].m_buffer.end(), expected[r].begin(), expected[r].end());
+    }
+
+    eval->Destroy();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }}}}
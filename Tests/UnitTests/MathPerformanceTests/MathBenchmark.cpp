@@ -0,0 +1,225 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// MathBenchmark.cpp -- runner, statistics and reporting of the Math kernel benchmarks
+//
+
+#include "stdafx.h"
+#include "MathBenchmark.h"
+#include "CPUMatrix.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdlib.h>
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Benchmarks {
+
+double BenchmarkResult::Min() const
+{
+    return *std::min_element(samples.begin(), samples.end());
+}
+
+double BenchmarkResult::Median() const
+{
+    std::vector<double> sorted(samples);
+    std::sort(sorted.begin(), sorted.end());
+    size_t n = sorted.size();
+    return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+}
+
+double BenchmarkResult::Mean() const
+{
+    double sum = 0;
+    for (double s : samples)
+        sum += s;
+    return sum / samples.size();
+}
+
+double BenchmarkResult::StdDev() const
+{
+    if (samples.size() < 2)
+        return 0;
+    double mean = Mean(), sum = 0;
+    for (double s : samples)
+        sum += (s - mean) * (s - mean);
+    return sqrt(sum / (samples.size() - 1));
+}
+
+static double SecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+BenchmarkResult RunBenchmark(const Benchmark& benchmark, const BenchmarkOptions& options)
+{
+    BenchmarkCase benchmarkCase = benchmark.setup();
+
+    // The first call warms up caches, lazily allocated workspaces and the thread pool, and tells how
+    // many calls make a sample long enough for the clock resolution and the timing noise.
+    auto start = std::chrono::steady_clock::now();
+    benchmarkCase.run();
+    double firstCall = std::max(SecondsSince(start), 1e-9);
+
+    BenchmarkResult result;
+    result.name = benchmark.name;
+    result.work = benchmarkCase.work;
+    result.callsPerSample = std::max((size_t) 1, (size_t) ceil(options.minSampleSeconds / firstCall));
+    for (size_t r = 0; r < options.repetitions; r++)
+    {
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < result.callsPerSample; i++)
+            benchmarkCase.run();
+        result.samples.push_back(SecondsSince(start) / result.callsPerSample);
+    }
+    return result;
+}
+
+static void PrintUsage()
+{
+    fprintf(stderr,
+            "Usage: MathPerformanceTests [options]\n"
+            "  --filter <text>        run only the benchmarks whose name contains <text>\n"
+            "  --repetitions <n>      samples per benchmark (default 10)\n"
+            "  --minSampleTime <ms>   minimum duration of a sample (default 50)\n"
+            "  --threads <n>          number of threads of the Math library (default: all cores)\n"
+            "  --json <file>          also write the results as JSON to <file> ('-' for stdout)\n"
+            "  --list                 list the benchmarks without running them\n");
+}
+
+bool ParseBenchmarkOptions(const std::vector<std::string>& args, BenchmarkOptions& options)
+{
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        const std::string& arg = args[i];
+        if (arg == "--list")
+        {
+            options.listOnly = true;
+            continue;
+        }
+        if (i + 1 >= args.size())
+        {
+            PrintUsage();
+            return false;
+        }
+        const std::string& value = args[++i];
+        if (arg == "--filter")
+            options.filter = value;
+        else if (arg == "--repetitions")
+            options.repetitions = std::max(1, atoi(value.c_str()));
+        else if (arg == "--minSampleTime")
+            options.minSampleSeconds = atof(value.c_str()) / 1000;
+        else if (arg == "--threads")
+            options.numThreads = atoi(value.c_str());
+        else if (arg == "--json")
+            options.jsonPath = value;
+        else
+        {
+            PrintUsage();
+            return false;
+        }
+    }
+    return true;
+}
+
+void PrintBenchmarkTable(FILE* f, const std::vector<BenchmarkResult>& results)
+{
+    fprintf(f, "%-52s %11s %11s %8s %9s %9s %9s\n", "benchmark", "median us", "min us", "stddev%", "GFLOP/s", "GB/s", "ns/elem");
+    for (const auto& result : results)
+    {
+        double median = result.Median();
+        fprintf(f, "%-52s %11.2f %11.2f %8.2f", result.name.c_str(), median * 1e6, result.Min() * 1e6, 100 * result.StdDev() / median);
+        if (result.work.flops > 0)
+            fprintf(f, " %9.2f", result.work.flops / median * 1e-9);
+        else
+            fprintf(f, " %9s", "-");
+        if (result.work.bytes > 0)
+            fprintf(f, " %9.2f", result.work.bytes / median * 1e-9);
+        else
+            fprintf(f, " %9s", "-");
+        if (result.work.elements > 0)
+            fprintf(f, " %9.3f", median * 1e9 / result.work.elements);
+        else
+            fprintf(f, " %9s", "-");
+        fprintf(f, "\n");
+    }
+}
+
+static std::string JsonString(const std::string& s)
+{
+    std::string quoted = "\"";
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\')
+            quoted += '\\';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+void WriteBenchmarkJson(FILE* f, const std::vector<BenchmarkResult>& results, const BenchmarkOptions& options)
+{
+    // Times are in nanoseconds; rates that do not apply to a benchmark are omitted.
+    fprintf(f, "{\n  \"context\": {\"numThreads\": %d, \"repetitions\": %d, \"minSampleTimeMs\": %.3f},\n  \"benchmarks\": [",
+            CPUMatrix<float>::GetMaxNumThreads(), (int) options.repetitions, options.minSampleSeconds * 1000);
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const auto& result = results[i];
+        double median = result.Median();
+        fprintf(f, "%s\n    {\"name\": %s, \"callsPerSample\": %d, \"minNs\": %.1f, \"medianNs\": %.1f, \"meanNs\": %.1f, \"stdDevNs\": %.1f",
+                i == 0 ? "" : ",", JsonString(result.name).c_str(), (int) result.callsPerSample,
+                result.Min() * 1e9, median * 1e9, result.Mean() * 1e9, result.StdDev() * 1e9);
+        if (result.work.flops > 0)
+            fprintf(f, ", \"gflops\": %.4f", result.work.flops / median * 1e-9);
+        if (result.work.bytes > 0)
+            fprintf(f, ", \"gbPerSecond\": %.4f", result.work.bytes / median * 1e-9);
+        if (result.work.elements > 0)
+            fprintf(f, ", \"nsPerElement\": %.5f", median * 1e9 / result.work.elements);
+        fprintf(f, ", \"samplesNs\": [");
+        for (size_t r = 0; r < result.samples.size(); r++)
+            fprintf(f, "%s%.1f", r == 0 ? "" : ", ", result.samples[r] * 1e9);
+        fprintf(f, "]}");
+    }
+    fprintf(f, "\n  ]\n}\n");
+}
+
+int RunBenchmarks(const std::vector<Benchmark>& benchmarks, const BenchmarkOptions& options)
+{
+    if (options.numThreads > 0)
+        CPUMatrix<float>::SetNumThreads(options.numThreads);
+
+    std::vector<BenchmarkResult> results;
+    for (const auto& benchmark : benchmarks)
+    {
+        if (benchmark.name.find(options.filter) == std::string::npos)
+            continue;
+        if (options.listOnly)
+        {
+            printf("%s\n", benchmark.name.c_str());
+            continue;
+        }
+        results.push_back(RunBenchmark(benchmark, options));
+        // progress goes to stderr so that the JSON can go to stdout
+        fprintf(stderr, "%s done\n", benchmark.name.c_str());
+    }
+    if (options.listOnly)
+        return EXIT_SUCCESS;
+
+    bool jsonToStdout = options.jsonPath == "-";
+    PrintBenchmarkTable(jsonToStdout ? stderr : stdout, results);
+    if (!options.jsonPath.empty())
+    {
+        FILE* f = jsonToStdout ? stdout : fopen(options.jsonPath.c_str(), "w");
+        if (!f)
+        {
+            fprintf(stderr, "Cannot open '%s' for writing.\n", options.jsonPath.c_str());
+            return EXIT_FAILURE;
+        }
+        WriteBenchmarkJson(f, results, options);
+        if (!jsonToStdout)
+            fclose(f);
+    }
+    return EXIT_SUCCESS;
+}
+
+}}}}
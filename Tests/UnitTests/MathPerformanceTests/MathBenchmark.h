@@ -0,0 +1,80 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// MathBenchmark.h -- micro-benchmark harness for the Math kernels
+//
+// A benchmark has a name such as "gemm/dnn_hidden_2048x2048x256" and a setup function, which allocates
+// and initializes the operands and returns the kernel call to time together with the work that one call
+// does. The runner calibrates the number of calls per sample, takes repeated samples and reports
+// min/median/mean/stddev of the time per call, plus GFLOP/s, GB/s and ns per element from the median.
+//
+
+#pragma once
+
+#include <functional>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Benchmarks {
+
+// Work done by one kernel call. Quantities that do not apply are 0 and are not reported.
+struct BenchmarkWork
+{
+    double flops;    // floating-point (or integer multiply-add) operations
+    double bytes;    // bytes of operands read plus bytes of results written, each counted once
+    double elements; // elements of the result
+};
+
+// What a benchmark's setup returns. 'run' owns (captures) the operands.
+struct BenchmarkCase
+{
+    std::function<void()> run;
+    BenchmarkWork work;
+};
+
+struct Benchmark
+{
+    std::string name;
+    std::function<BenchmarkCase()> setup;
+};
+
+struct BenchmarkOptions
+{
+    std::string filter;             // run only benchmarks whose name contains this
+    size_t repetitions = 10;        // samples per benchmark
+    double minSampleSeconds = 0.05; // calls per sample are chosen so that a sample takes at least this long
+    int numThreads = 0;             // 0: keep the default of the Math library
+    std::string jsonPath;           // if set, also write the results as JSON to this file ("-" for stdout)
+    bool listOnly = false;
+};
+
+struct BenchmarkResult
+{
+    std::string name;
+    BenchmarkWork work;
+    size_t callsPerSample;
+    std::vector<double> samples; // seconds per call, one entry per repetition
+
+    double Min() const;
+    double Median() const;
+    double Mean() const;
+    double StdDev() const;
+};
+
+// the benchmarks of the Math kernels, see MathKernelBenchmarks.cpp
+std::vector<Benchmark> MathKernelBenchmarks();
+
+BenchmarkResult RunBenchmark(const Benchmark& benchmark, const BenchmarkOptions& options);
+
+// Parses the command-line arguments (without the program name). Prints the usage and returns false on an error.
+bool ParseBenchmarkOptions(const std::vector<std::string>& args, BenchmarkOptions& options);
+
+void PrintBenchmarkTable(FILE* f, const std::vector<BenchmarkResult>& results);
+void WriteBenchmarkJson(FILE* f, const std::vector<BenchmarkResult>& results, const BenchmarkOptions& options);
+
+// Runs all benchmarks selected by the options; returns the process exit code.
+int RunBenchmarks(const std::vector<Benchmark>& benchmarks, const BenchmarkOptions& options);
+
+}}}}
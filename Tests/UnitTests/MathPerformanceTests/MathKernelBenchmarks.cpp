@@ -0,0 +1,485 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// MathKernelBenchmarks.cpp -- benchmarks of the CPU hot paths of the Math library
+//
+// The shapes are taken from common networks (a fully connected acoustic model, an LSTM language model,
+// ResNet-50 on 224x224 images) so that the numbers reflect what training and evaluation actually run.
+// Work counts follow the usual conventions: 2 flops per multiply-add, and bytes counting every
+// operand read and every result written once, i.e. the minimum traffic of the kernel.
+//
+
+#include "stdafx.h"
+#include "MathBenchmark.h"
+#include "Matrix.h"
+#include "CPUMatrix.h"
+#include "CPUSparseMatrix.h"
+#include "TensorView.h"
+#include "ConvolutionEngine.h"
+#include "BatchNormalizationEngine.h"
+#include "MatrixQuantizerImpl.h"
+#include "BlockMultiplier.h"
+#include <memory>
+#include <random>
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Benchmarks {
+
+using namespace std;
+
+// minibatch sizes: frames for fully connected and recurrent layers, images for convolutional ones
+static const size_t s_frameBatch = 256;
+static const size_t s_sequenceBatch = 32;
+static const size_t s_imageBatch = 8;
+
+static shared_ptr<CPUMatrix<float>> RandomCPUMatrix(size_t rows, size_t cols, unsigned long seed)
+{
+    auto m = make_shared<CPUMatrix<float>>(rows, cols);
+    m->SetUniformRandomValue(-1, 1, seed);
+    return m;
+}
+
+static shared_ptr<Matrix<float>> RandomMatrix(size_t rows, size_t cols, unsigned long seed)
+{
+    return make_shared<Matrix<float>>(Matrix<float>::RandomUniform(rows, cols, CPUDEVICE, -1, 1, seed));
+}
+
+static string Shape(size_t a, size_t b)
+{
+    return to_string(a) + "x" + to_string(b);
+}
+
+static string Shape(size_t a, size_t b, size_t c)
+{
+    return Shape(a, b) + "x" + to_string(c);
+}
+
+// ---------------------------------------------------------------------------
+// dense GEMM: c = alpha * op(a) * op(b) + beta * c, with c of size m x n
+// ---------------------------------------------------------------------------
+
+static void AddGemmBenchmark(vector<Benchmark>& benchmarks, const string& what, size_t m, size_t k, size_t n, bool transposeA, bool transposeB)
+{
+    benchmarks.push_back({ "gemm/" + what + "_" + Shape(m, k, n), [=]
+    {
+        auto a = transposeA ? RandomCPUMatrix(k, m, 1) : RandomCPUMatrix(m, k, 1);
+        auto b = transposeB ? RandomCPUMatrix(n, k, 2) : RandomCPUMatrix(k, n, 2);
+        auto c = RandomCPUMatrix(m, n, 3);
+        BenchmarkWork work = { 2.0 * m * k * n, sizeof(float) * (m * k + k * n + 2.0 * m * n), (double) m * n };
+        return BenchmarkCase{ [=] { CPUMatrix<float>::MultiplyAndWeightedAdd(1, *a, transposeA, *b, transposeB, 1, *c); }, work };
+    } });
+}
+
+static void AddGemmBenchmarks(vector<Benchmark>& benchmarks)
+{
+    // fully connected hidden layer of an acoustic model: forward, gradient w.r.t. input and weights
+    AddGemmBenchmark(benchmarks, "dnn_hidden_fwd", 2048, 2048, s_frameBatch, false, false);
+    AddGemmBenchmark(benchmarks, "dnn_hidden_bwd_data", 2048, 2048, s_frameBatch, true, false);
+    AddGemmBenchmark(benchmarks, "dnn_hidden_bwd_weights", 2048, s_frameBatch, 2048, false, true);
+    // LSTM with 512 cells: the four gates for one time step of a minibatch of sequences
+    AddGemmBenchmark(benchmarks, "lstm_gates", 4 * 512, 512, s_sequenceBatch, false, false);
+    // output layer of a language model with a 10k vocabulary
+    AddGemmBenchmark(benchmarks, "lm_output", 10000, 512, s_sequenceBatch, false, false);
+    // ResNet 1x1 convolution at 56x56 as a GEMM (channels x pixels)
+    AddGemmBenchmark(benchmarks, "resnet_1x1", 256, 64, 56 * 56, false, false);
+}
+
+// ---------------------------------------------------------------------------
+// TensorView operations (unary, binary with broadcasting, reductions)
+// ---------------------------------------------------------------------------
+
+static TensorView<float> RandomTensor(const TensorShape& shape, unsigned long seed)
+{
+    return TensorView<float>(RandomMatrix(shape.GetNumElements(), 1, seed), shape);
+}
+
+static void AddTensorBenchmarks(vector<Benchmark>& benchmarks)
+{
+    struct UnaryCase { const char* name; ElementWiseOperator op; double flopsPerElement; };
+    for (const auto& unary : { UnaryCase{ "sigmoid", ElementWiseOperator::opSigmoid, 4 },
+                               UnaryCase{ "tanh", ElementWiseOperator::opTanh, 4 },
+                               UnaryCase{ "relu", ElementWiseOperator::opLinearRectifier, 1 } })
+    {
+        size_t rows = 2048, cols = s_frameBatch;
+        benchmarks.push_back({ string("tensor/unary_") + unary.name + "_" + Shape(rows, cols), [=]
+        {
+            auto a = RandomTensor(TensorShape(rows, cols), 1);
+            auto c = make_shared<TensorView<float>>(RandomTensor(TensorShape(rows, cols), 2));
+            double n = (double) rows * cols;
+            return BenchmarkCase{ [=] { c->DoUnaryOpOf(0, a, 1, unary.op, ElementWiseOperator::opSum); }, { unary.flopsPerElement * n, 2 * sizeof(float) * n, n } };
+        } });
+    }
+
+    // elementwise product of two layer outputs (e.g. the gates of an LSTM)
+    benchmarks.push_back({ "tensor/binary_product_" + Shape(2048, s_frameBatch), []
+    {
+        TensorShape shape(2048, s_frameBatch);
+        auto a = RandomTensor(shape, 1), b = RandomTensor(shape, 2);
+        auto c = make_shared<TensorView<float>>(RandomTensor(shape, 3));
+        double n = (double) shape.GetNumElements();
+        return BenchmarkCase{ [=] { c->AssignElementwiseProductOf(a, b); }, { n, 3 * sizeof(float) * n, n } };
+    } });
+
+    // bias addition of a convolutional layer, broadcasting over pixels and images
+    benchmarks.push_back({ "tensor/binary_bias_broadcast_28x28x128x" + to_string(s_imageBatch), []
+    {
+        TensorShape shape(28, 28, 128, s_imageBatch), biasShape(1, 1, 128);
+        auto a = RandomTensor(shape, 1), bias = RandomTensor(biasShape, 2);
+        auto c = make_shared<TensorView<float>>(RandomTensor(shape, 3));
+        double n = (double) shape.GetNumElements();
+        return BenchmarkCase{ [=] { c->AssignSumOf(a, bias); }, { n, 2 * sizeof(float) * n, n } };
+    } });
+
+    // bias gradient of a fully connected layer (reduction over the minibatch)
+    benchmarks.push_back({ "tensor/reduce_bias_grad_" + Shape(2048, 1024), []
+    {
+        auto gradient = RandomTensor(TensorShape(2048, 1024), 1);
+        auto bias = make_shared<TensorView<float>>(RandomTensor(TensorShape(2048), 2));
+        double n = 2048.0 * 1024;
+        return BenchmarkCase{ [=] { bias->DoCopyOf(0, gradient, 1); }, { n, sizeof(float) * (n + 2048), 2048 } };
+    } });
+
+    // bias gradient of a convolutional layer (reduction over pixels and images)
+    benchmarks.push_back({ "tensor/reduce_conv_bias_grad_28x28x128x" + to_string(s_imageBatch), []
+    {
+        TensorShape shape(28, 28, 128, s_imageBatch);
+        auto gradient = RandomTensor(shape, 1);
+        auto bias = make_shared<TensorView<float>>(RandomTensor(TensorShape(1, 1, 128), 2));
+        double n = (double) shape.GetNumElements();
+        return BenchmarkCase{ [=] { bias->DoCopyOf(0, gradient, 1); }, { n, sizeof(float) * (n + 128), 128 } };
+    } });
+}
+
+// ---------------------------------------------------------------------------
+// convolution engines and pooling
+// ---------------------------------------------------------------------------
+
+struct ConvolutionCase
+{
+    const char* name;
+    size_t width, channels, kernel, maps, stride;
+};
+
+static ConvolveGeometryPtr ConvolutionGeometry(const ConvolutionCase& conv)
+{
+    return make_shared<ConvolveGeometry>(TensorShape(conv.width, conv.width, conv.channels),
+                                         TensorShape(conv.kernel, conv.kernel, conv.channels), TensorShape(conv.maps),
+                                         TensorShape(conv.stride, conv.stride, conv.channels),
+                                         ConvolveGeometry::BoolVec{ true }, ConvolveGeometry::BoolVec{ true, true, false },
+                                         TensorShape(0), TensorShape(0));
+}
+
+enum class ConvolutionPass { Forward, BackwardData, BackwardKernel };
+
+static void AddConvolutionBenchmark(vector<Benchmark>& benchmarks, const ConvolutionCase& conv, ConvolutionEngineKind kind, const char* kindName, ConvolutionPass pass)
+{
+    const char* passName = pass == ConvolutionPass::Forward ? "fwd" : pass == ConvolutionPass::BackwardData ? "bwd_data" : "bwd_kernel";
+    string name = string("conv/") + conv.name + "_" + passName + "_" + kindName;
+    benchmarks.push_back({ name, [=]
+    {
+        auto geometry = ConvolutionGeometry(conv);
+        shared_ptr<ConvolutionEngine<float>> engine = ConvolutionEngine<float>::Create(geometry, CPUDEVICE, ImageLayoutKind::CHW, 0, PoolKind::None, kind);
+        size_t inputSize = geometry->InputShape().GetNumElements(), outputSize = geometry->OutputShape().GetNumElements();
+        size_t kernelSize = geometry->KernelShape().GetNumElements();
+        auto in = RandomMatrix(inputSize, s_imageBatch, 1);
+        auto kernel = RandomMatrix(conv.maps, kernelSize, 2);
+        auto out = RandomMatrix(outputSize, s_imageBatch, 3);
+        auto workspace = make_shared<Matrix<float>>(CPUDEVICE);
+
+        BenchmarkWork work = { 2.0 * outputSize * kernelSize * s_imageBatch,
+                               sizeof(float) * ((double) (inputSize + outputSize) * s_imageBatch + conv.maps * kernelSize), 0 };
+        function<void()> run;
+        if (pass == ConvolutionPass::Forward)
+        {
+            work.elements = (double) outputSize * s_imageBatch;
+            run = [=] { engine->Forward(*in, *kernel, *out, *workspace); };
+        }
+        else if (pass == ConvolutionPass::BackwardData)
+        {
+            work.elements = (double) inputSize * s_imageBatch;
+            run = [=] { engine->BackwardData(*out, *kernel, *in, false, *workspace); };
+        }
+        else
+        {
+            work.elements = (double) conv.maps * kernelSize;
+            run = [=] { engine->BackwardKernel(*out, *in, *kernel, false, false, *workspace); };
+        }
+        return BenchmarkCase{ run, work };
+    } });
+}
+
+static void AddConvolutionBenchmarks(vector<Benchmark>& benchmarks)
+{
+    // ResNet-50: the 7x7 stem, and 3x3 and 1x1 convolutions of the 56x56 and 28x28 stages
+    const ConvolutionCase stem = { "resnet_stem_224x224x3_7x7x64_s2", 224, 3, 7, 64, 2 };
+    const ConvolutionCase conv3x3 = { "resnet_56x56x64_3x3x64", 56, 64, 3, 64, 1 };
+    const ConvolutionCase conv3x3Small = { "resnet_28x28x128_3x3x128", 28, 128, 3, 128, 1 };
+    const ConvolutionCase conv1x1 = { "resnet_28x28x128_1x1x512", 28, 128, 1, 512, 1 };
+
+    for (auto pass : { ConvolutionPass::Forward, ConvolutionPass::BackwardData, ConvolutionPass::BackwardKernel })
+    {
+        for (const auto& conv : { stem, conv3x3, conv3x3Small, conv1x1 })
+            AddConvolutionBenchmark(benchmarks, conv, ConvolutionEngineKind::Gemm, "gemm", pass);
+    }
+    // the specialized engines (forward only), on the shapes they support
+    for (const auto& conv : { conv3x3, conv3x3Small })
+    {
+        AddConvolutionBenchmark(benchmarks, conv, ConvolutionEngineKind::Direct, "direct", ConvolutionPass::Forward);
+        AddConvolutionBenchmark(benchmarks, conv, ConvolutionEngineKind::Winograd, "winograd", ConvolutionPass::Forward);
+    }
+    AddConvolutionBenchmark(benchmarks, conv1x1, ConvolutionEngineKind::Direct, "direct", ConvolutionPass::Forward);
+
+    // pooling after the ResNet stem: 3x3 window with stride 2 on 112x112x64
+    for (auto poolKind : { PoolKind::Max, PoolKind::Average })
+    {
+        for (bool backward : { false, true })
+        {
+            string name = string("pool/resnet_") + (poolKind == PoolKind::Max ? "max" : "average") + "_112x112x64_3x3_s2_" + (backward ? "bwd" : "fwd");
+            benchmarks.push_back({ name, [=]
+            {
+                auto geometry = make_shared<ConvolveGeometry>(TensorShape(112, 112, 64), TensorShape(3, 3, 1), TensorShape(1), TensorShape(2, 2, 1),
+                                                              ConvolveGeometry::BoolVec{ true }, ConvolveGeometry::BoolVec{ true, true, false },
+                                                              TensorShape(0), TensorShape(0));
+                shared_ptr<ConvolutionEngine<float>> engine = ConvolutionEngine<float>::Create(geometry, CPUDEVICE, ImageLayoutKind::CHW, 0, poolKind);
+                size_t inputSize = geometry->InputShape().GetNumElements(), outputSize = geometry->OutputShape().GetNumElements();
+                auto in = RandomMatrix(inputSize, s_imageBatch, 1);
+                auto out = RandomMatrix(outputSize, s_imageBatch, 2);
+                auto outGrad = RandomMatrix(outputSize, s_imageBatch, 3);
+                auto inGrad = RandomMatrix(inputSize, s_imageBatch, 4);
+                engine->ForwardPooling(*in, *out);
+
+                double windowOps = 9.0 * outputSize * s_imageBatch;
+                if (!backward)
+                    return BenchmarkCase{ [=] { engine->ForwardPooling(*in, *out); },
+                                          { windowOps, sizeof(float) * (double) (inputSize + outputSize) * s_imageBatch, (double) outputSize * s_imageBatch } };
+                return BenchmarkCase{ [=] { engine->BackwardPooling(*out, *outGrad, *in, *inGrad); },
+                                      { windowOps, sizeof(float) * (2.0 * inputSize + 2.0 * outputSize) * s_imageBatch, (double) inputSize * s_imageBatch } };
+            } });
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// batch normalization
+// ---------------------------------------------------------------------------
+
+static void AddBatchNormalizationBenchmarks(vector<Benchmark>& benchmarks)
+{
+    struct BatchNormCase { const char* name; bool inferenceOnly; bool backward; };
+    for (const auto& bn : { BatchNormCase{ "fwd_train", false, false }, BatchNormCase{ "fwd_eval", true, false }, BatchNormCase{ "bwd", false, true } })
+    {
+        // spatial batch normalization after a ResNet 3x3 convolution at 56x56
+        string name = string("batchnorm/resnet_56x56x64_") + bn.name;
+        benchmarks.push_back({ name, [=]
+        {
+            const size_t channels = 64;
+            TensorShape shape(56, 56, channels);
+            size_t size = shape.GetNumElements();
+            shared_ptr<BatchNormEngine<float>> engine = BatchNormEngine<float>::Create(CPUDEVICE, shape, true /*spatial*/, ImageLayoutKind::CHW);
+            auto in = RandomMatrix(size, s_imageBatch, 1);
+            auto out = RandomMatrix(size, s_imageBatch, 2);
+            auto scale = RandomMatrix(channels, 1, 3);
+            auto bias = RandomMatrix(channels, 1, 4);
+            auto runMean = make_shared<Matrix<float>>(Matrix<float>::Zeros(channels, 1, CPUDEVICE));
+            auto runVariance = make_shared<Matrix<float>>(Matrix<float>::Ones(channels, 1, CPUDEVICE));
+            auto saveMean = make_shared<Matrix<float>>(channels, 1, CPUDEVICE);
+            auto saveInvStdDev = make_shared<Matrix<float>>(channels, 1, CPUDEVICE);
+            auto grad = RandomMatrix(size, s_imageBatch, 5);
+            auto scaleGrad = make_shared<Matrix<float>>(channels, 1, CPUDEVICE);
+            auto biasGrad = make_shared<Matrix<float>>(channels, 1, CPUDEVICE);
+
+            auto forward = [=]
+            {
+                engine->Forward(*in, *scale, *bias, bn.inferenceOnly, 0.1 /*expAvgFactor*/, 0 /*blendFactor*/, *runMean, *runVariance, *out, 1e-5, *saveMean, *saveInvStdDev);
+            };
+            double n = (double) size * s_imageBatch;
+            if (!bn.backward) // training reads the input twice (statistics, then normalization)
+                return BenchmarkCase{ forward, { (bn.inferenceOnly ? 2 : 5) * n, sizeof(float) * (bn.inferenceOnly ? 2 : 3) * n, n } };
+
+            forward(); // the backward pass needs the saved statistics
+            return BenchmarkCase{ [=] { engine->Backward(*in, *out, *grad, *scale, 0, *saveMean, *saveInvStdDev, *scaleGrad, *biasGrad); },
+                                  { 8 * n, sizeof(float) * 4 * n, n } };
+        } });
+    }
+}
+
+// ---------------------------------------------------------------------------
+// sparse products: one-hot input of a language model times the embedding, and its gradient
+// ---------------------------------------------------------------------------
+
+static shared_ptr<CPUSparseMatrix<float>> RandomOneHotCSC(size_t vocabulary, size_t cols, unsigned long seed)
+{
+    mt19937 rng(seed);
+    uniform_int_distribution<int> word(0, (int) vocabulary - 1);
+    vector<CPUSPARSE_INDEX_TYPE> colStarts(cols + 1), rows(cols);
+    vector<float> values(cols, 1.0f);
+    for (size_t j = 0; j < cols; j++)
+    {
+        colStarts[j] = (CPUSPARSE_INDEX_TYPE) j;
+        rows[j] = word(rng);
+    }
+    colStarts[cols] = (CPUSPARSE_INDEX_TYPE) cols;
+    auto m = make_shared<CPUSparseMatrix<float>>(MatrixFormat::matrixFormatSparseCSC);
+    m->SetMatrixFromCSCFormat(colStarts.data(), rows.data(), values.data(), cols, vocabulary, cols);
+    return m;
+}
+
+static void AddSparseBenchmarks(vector<Benchmark>& benchmarks)
+{
+    const size_t vocabulary = 50000, embedding = 512, words = s_frameBatch;
+
+    // embedding lookup: E (512 x 50000) * onehot (50000 x 256)
+    benchmarks.push_back({ "sparse/embedding_fwd_" + Shape(embedding, vocabulary, words), [=]
+    {
+        auto e = RandomCPUMatrix(embedding, vocabulary, 1);
+        auto x = RandomOneHotCSC(vocabulary, words, 2);
+        auto c = RandomCPUMatrix(embedding, words, 3);
+        double n = (double) embedding * words;
+        return BenchmarkCase{ [=] { CPUSparseMatrix<float>::MultiplyAndWeightedAdd(1, *e, false, *x, false, 0, *c); }, { 2 * n, sizeof(float) * 2 * n, n } };
+    } });
+
+    // embedding gradient: outputGradient (512 x 256) * onehot' accumulated into a block-sparse gradient
+    benchmarks.push_back({ "sparse/embedding_grad_" + Shape(embedding, words, vocabulary), [=]
+    {
+        auto g = RandomCPUMatrix(embedding, words, 1);
+        auto x = RandomOneHotCSC(vocabulary, words, 2);
+        auto c = make_shared<CPUSparseMatrix<float>>(MatrixFormat::matrixFormatSparseBlockCol, embedding, vocabulary, 0);
+        double n = (double) embedding * words;
+        return BenchmarkCase{ [=] { CPUSparseMatrix<float>::MultiplyAndAdd(1, *g, false, *x, true, *c); }, { 2 * n, sizeof(float) * 2 * n, n } };
+    } });
+
+    // sparse update of the embedding: E += alpha * gradient
+    benchmarks.push_back({ "sparse/embedding_update_" + Shape(embedding, vocabulary), [=]
+    {
+        auto g = RandomCPUMatrix(embedding, words, 1);
+        auto x = RandomOneHotCSC(vocabulary, words, 2);
+        auto gradient = make_shared<CPUSparseMatrix<float>>(MatrixFormat::matrixFormatSparseBlockCol, embedding, vocabulary, 0);
+        CPUSparseMatrix<float>::MultiplyAndAdd(1, *g, false, *x, true, *gradient);
+        auto e = RandomCPUMatrix(embedding, vocabulary, 3);
+        double n = (double) embedding * words;
+        return BenchmarkCase{ [=] { CPUSparseMatrix<float>::ScaleAndAdd(-1e-6f, *gradient, *e); }, { 2 * n, sizeof(float) * 3 * n, n } };
+    } });
+}
+
+// ---------------------------------------------------------------------------
+// quantization: 1-bit SGD gradient quantizer and the 16-bit integer block multiplier
+// ---------------------------------------------------------------------------
+
+static void AddQuantizerBenchmarks(vector<Benchmark>& benchmarks)
+{
+    const size_t rows = 2048, cols = 2048;
+    for (size_t bits : { 1, 8 })
+    {
+        for (bool unquantize : { false, true })
+        {
+            string name = "quantizer/" + string(unquantize ? "unquantize" : "quantize") + "_" + to_string(bits) + "bit_" + Shape(rows, cols);
+            benchmarks.push_back({ name, [=]
+            {
+                shared_ptr<MatrixQuantizerImpl<float>> quantizer(MatrixQuantizerImpl<float>::Create(CPUDEVICE, false /*useAsync*/));
+                auto in = RandomMatrix(rows, cols, 1);
+                auto residual = make_shared<Matrix<float>>(Matrix<float>::Zeros(rows, cols, CPUDEVICE));
+                auto out = make_shared<Matrix<float>>(Matrix<float>::Zeros(rows, cols, CPUDEVICE));
+                auto quantized = make_shared<QuantizedMatrix<float>>(rows, cols, bits, CPUDEVICE);
+                auto quantize = [=]
+                {
+                    quantizer->QuantizeAsync(*in, *residual, *quantized, *residual, false /*zeroThresholdFor1Bit*/);
+                    quantizer->WaitQuantizeAsyncDone();
+                };
+                double n = (double) rows * cols;
+                if (!unquantize) // reads the input and the residual, writes the residual and the bits
+                    return BenchmarkCase{ quantize, { 0, sizeof(float) * 3 * n + n * bits / 8, n } };
+
+                quantize();
+                return BenchmarkCase{ [=]
+                {
+                    quantizer->UnquantizeAsync(*quantized, *out, false /*add*/);
+                    quantizer->WaitUnquantizeAsyncDone();
+                }, { 0, sizeof(float) * n + n * bits / 8, n } };
+            } });
+        }
+    }
+
+    // int16 GEMM used by quantized evaluation: a 512 x 512 layer applied to 64 frames
+    const int m = 64, k = 512, n = 512;
+    benchmarks.push_back({ "quantizer/block_multiplier_int16_" + Shape(m, k, n), [=]
+    {
+        typedef BlockMultiplier<BlockHandlerSSE> Multiplier;
+        auto multiplier = make_shared<Multiplier>();
+        int16_t* a = Multiplier::CreateMatrixA(m, k);
+        int16_t* b = Multiplier::CreateMatrixB(k, n);
+        int32_t* c = Multiplier::CreateMatrixC(m, n);
+        mt19937 rng(1);
+        uniform_int_distribution<int> value(-63, 63);
+        for (int i = 0; i < m * k; i++)
+            a[i] = (int16_t) value(rng);
+        for (int i = 0; i < k * n; i++)
+            b[i] = (int16_t) value(rng);
+        int16_t* preparedB = multiplier->PrepareB(b, k, n);
+        // the matrices live as long as the benchmark case
+        shared_ptr<void> buffers(nullptr, [=](void*)
+        {
+            multiplier->FreeMatrix(a);
+            multiplier->FreeMatrix(c);
+            if (preparedB != b)
+                multiplier->FreeMatrix(preparedB);
+            multiplier->FreeMatrix(b);
+        });
+        return BenchmarkCase{ [=] { (void) buffers; multiplier->MultiplyMatrices(a, m, k, preparedB, n, c); },
+                              { 2.0 * m * k * n, sizeof(int16_t) * (double) (m * k + k * n) + sizeof(int32_t) * (double) m * n, (double) m * n } };
+    } });
+}
+
+// ---------------------------------------------------------------------------
+// softmax and cross entropy, as in CrossEntropyWithSoftmaxNode
+// ---------------------------------------------------------------------------
+
+static void AddSoftmaxBenchmarks(vector<Benchmark>& benchmarks)
+{
+    struct SoftmaxCase { const char* name; size_t classes, cols; };
+    for (const auto& s : { SoftmaxCase{ "imagenet", 1000, s_frameBatch }, SoftmaxCase{ "lm_10k", 10000, s_sequenceBatch } })
+    {
+        benchmarks.push_back({ string("softmax/log_softmax_") + s.name + "_" + Shape(s.classes, s.cols), [=]
+        {
+            auto z = RandomCPUMatrix(s.classes, s.cols, 1);
+            auto logSoftmax = RandomCPUMatrix(s.classes, s.cols, 2);
+            double n = (double) s.classes * s.cols;
+            return BenchmarkCase{ [=] { logSoftmax->AssignLogSoftmaxOf(*z, true); }, { 4 * n, sizeof(float) * 2 * n, n } };
+        } });
+
+        // forward: log softmax and the inner product with the labels; backward: softmax - labels
+        benchmarks.push_back({ string("softmax/cross_entropy_fwd_bwd_") + s.name + "_" + Shape(s.classes, s.cols), [=]
+        {
+            auto z = RandomCPUMatrix(s.classes, s.cols, 1);
+            auto labels = make_shared<CPUMatrix<float>>(s.classes, s.cols);
+            labels->SetValue(0);
+            for (size_t j = 0; j < s.cols; j++)
+                (*labels)(j * 7919 % s.classes, j) = 1;
+            auto logSoftmax = RandomCPUMatrix(s.classes, s.cols, 2);
+            auto gradient = RandomCPUMatrix(s.classes, s.cols, 3);
+            double n = (double) s.classes * s.cols;
+            return BenchmarkCase{ [=]
+            {
+                logSoftmax->AssignLogSoftmaxOf(*z, true);
+                volatile float crossEntropy = -CPUMatrix<float>::InnerProductOfMatrices(*labels, *logSoftmax);
+                (void) crossEntropy;
+                gradient->AssignExpOf(*logSoftmax);
+                *gradient -= *labels;
+            }, { 8 * n, sizeof(float) * 7 * n, n } };
+        } });
+    }
+}
+
+vector<Benchmark> MathKernelBenchmarks()
+{
+    vector<Benchmark> benchmarks;
+    AddGemmBenchmarks(benchmarks);
+    AddTensorBenchmarks(benchmarks);
+    AddConvolutionBenchmarks(benchmarks);
+    AddBatchNormalizationBenchmarks(benchmarks);
+    AddSparseBenchmarks(benchmarks);
+    AddQuantizerBenchmarks(benchmarks);
+    AddSoftmaxBenchmarks(benchmarks);
+    return benchmarks;
+}
+
+}}}}
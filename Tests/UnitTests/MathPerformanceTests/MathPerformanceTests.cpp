@@ -11,6 +11,7 @@
 #include "CPUMatrix.h"
 #include "TensorView.h"
 #include "Sequences.h"
+#include "MathBenchmark.h"
 #include <chrono>
 #include <iostream>
 #include <vector>
@@ -336,7 +337,8 @@ void MandSTest(int count, int devId)
     delete[] data3;
 }
 
-int wmain()
+// Runs the Math kernel benchmarks, see MathBenchmark.h and MathKernelBenchmarks.cpp.
+int wmain(int argc, wchar_t* argv[])
 {
     // MandSTest<float>(100, 2);
 
@@ -355,5 +357,25 @@ int wmain()
     MultiplyAndWeightedAddTest<float>(1100,1000,1200);    
     MultiplyAndWeightedAddTest<float>(11000,10000,12000);*/
 
-    return 0;
+    Benchmarks::BenchmarkOptions options;
+    vector<string> args;
+    for (int i = 1; i < argc; i++)
+        args.push_back(msra::strfun::utf8(argv[i]));
+    if (!Benchmarks::ParseBenchmarkOptions(args, options))
+        return EXIT_FAILURE;
+    return Benchmarks::RunBenchmarks(Benchmarks::MathKernelBenchmarks(), options);
 }
+
+#ifdef __UNIX__
+// UNIX main function converts arguments in UTF-8 encoding and passes to Visual-Studio style wmain() which takes wchar_t strings.
+int main(int argc, char* argv[])
+{
+    vector<wstring> args;
+    for (int i = 0; i < argc; i++)
+        args.push_back(msra::strfun::utf16(argv[i]));
+    vector<wchar_t*> wargs;
+    for (auto& arg : args)
+        wargs.push_back(&arg[0]);
+    return wmain(argc, wargs.data());
+}
+#endif
@@ -323,6 +323,144 @@ BOOST_AUTO_TEST_CASE(BatchNormalizationBackward)
     }
 }
 
+// Checks the fused CPU engine against a straightforward implementation of the definitions, forward and backward.
+BOOST_AUTO_TEST_CASE(BatchNormalizationCpuFused)
+{
+    std::mt19937 rng(0);
+    boost::random::normal_distribution<float> nd;
+
+    int deviceId = -1;
+    double eps = 1e-5;
+    // (shape, batch size, spatial)
+    std::vector<std::tuple<TensorShape, size_t, bool>> configs = {
+        std::make_tuple(TensorShape(17), 13, false),
+        std::make_tuple(TensorShape(130, 1, 1), 7, false),
+        std::make_tuple(TensorShape(2, 2, 2), 1, true),
+        std::make_tuple(TensorShape(11, 11, 13), 5, true),
+        std::make_tuple(TensorShape(3, 2, 70), 9, true)
+    };
+    for (const auto& cfg : configs)
+    {
+        for (double blendFactor : {0.0, 0.5, 1.0})
+        {
+            const auto& inOutT = std::get<0>(cfg);
+            size_t batchSize = std::get<1>(cfg);
+            bool spatial = std::get<2>(cfg);
+            double expAvg = 0.1;
+
+            size_t crow = inOutT.GetNumElements();
+            size_t ccol = batchSize;
+            size_t cfeat = spatial ? inOutT[inOutT.GetRank() - 1] : crow;
+            size_t cspatial = crow / cfeat;
+            size_t m = cspatial * ccol;
+
+            auto gen = [&](size_t n, float offset) { vec v(n); std::generate(begin(v), end(v), [&] { return nd(rng) + offset; }); return v; };
+            vec x = gen(crow * ccol, 3), dy = gen(crow * ccol, 0), dx0 = gen(crow * ccol, 0);
+            vec scaleV = gen(cfeat, 0), biasV = gen(cfeat, 0), runMeanV = gen(cfeat, 0), runVarV(cfeat);
+            std::generate(begin(runVarV), end(runVarV), [&] { return std::abs(nd(rng)) + 0.5f; });
+
+            // Reference forward.
+            std::vector<double> refMean(cfeat), refInvStdDev(cfeat), refRunMean(cfeat), refRunVar(cfeat);
+            vec refOut(crow * ccol);
+            for (size_t f = 0; f < cfeat; f++)
+            {
+                double sum = 0, sum2 = 0;
+                for (size_t j = 0; j < ccol; j++)
+                    for (size_t s = 0; s < cspatial; s++)
+                        sum += x[j * crow + f * cspatial + s];
+                double mean = sum / m;
+                for (size_t j = 0; j < ccol; j++)
+                    for (size_t s = 0; s < cspatial; s++)
+                        sum2 += (x[j * crow + f * cspatial + s] - mean) * (x[j * crow + f * cspatial + s] - mean);
+                refRunMean[f] = expAvg * mean + (1 - expAvg) * runMeanV[f];
+                refRunVar[f] = expAvg * (m == 1 ? 0 : sum2 / (m - 1)) + (1 - expAvg) * runVarV[f];
+                refMean[f] = blendFactor * refRunMean[f] + (1 - blendFactor) * mean;
+                refInvStdDev[f] = blendFactor / std::sqrt(refRunVar[f] + eps) + (1 - blendFactor) / std::sqrt(sum2 / m + eps);
+                for (size_t j = 0; j < ccol; j++)
+                    for (size_t s = 0; s < cspatial; s++)
+                    {
+                        size_t i = j * crow + f * cspatial + s;
+                        refOut[i] = (float)((x[i] - refMean[f]) * refInvStdDev[f] * scaleV[f] + biasV[f]);
+                    }
+            }
+
+            auto eng = BNEng::Create(deviceId, inOutT, spatial, ImageLayoutKind::CHW, BatchNormEngineKind::Cntk);
+            SingleMatrix in(crow, ccol, x.data(), deviceId, matrixFlagNormal);
+            SingleMatrix scale(cfeat, 1, scaleV.data(), deviceId, matrixFlagNormal);
+            SingleMatrix bias(cfeat, 1, biasV.data(), deviceId, matrixFlagNormal);
+            SingleMatrix runMean(cfeat, 1, runMeanV.data(), deviceId, matrixFlagNormal);
+            SingleMatrix runVar(cfeat, 1, runVarV.data(), deviceId, matrixFlagNormal);
+            SingleMatrix out(crow, ccol, deviceId);
+            SingleMatrix saveMean(deviceId);
+            SingleMatrix saveInvStdDev(deviceId);
+            eng->Forward(in, scale, bias, false, expAvg, blendFactor, runMean, runVar, out, eps, saveMean, saveInvStdDev);
+
+            std::stringstream tmsg;
+            tmsg << "inOut tensor: " << (std::string)inOutT << ", spatial = " << spatial << ", blendFactor = " << blendFactor;
+            auto check = [&](const SingleMatrix& actual, const vec& expected, const char* name)
+            {
+                BOOST_REQUIRE_EQUAL(actual.GetNumElements(), expected.size());
+                for (size_t i = 0; i < expected.size(); i++)
+                {
+                    float a = actual.Data()[i];
+                    BOOST_REQUIRE_MESSAGE(std::abs(a - expected[i]) <= 1e-4f * std::max(1.0f, std::abs(expected[i])),
+                                          name << "[" << i << "] = " << a << " instead of " << expected[i] << ", " << tmsg.str());
+                }
+            };
+            auto toVec = [](const std::vector<double>& v) { return vec(v.begin(), v.end()); };
+            check(out, refOut, "out");
+            check(runMean, toVec(refRunMean), "runMean");
+            check(runVar, toVec(refRunVar), "runVariance");
+            check(saveMean, toVec(refMean), "saveMean");
+            check(saveInvStdDev, toVec(refInvStdDev), "saveInvStdDev");
+
+            // Reference backward, the data gradient is added to dx0.
+            std::vector<double> refScaleGrad(cfeat), refBiasGrad(cfeat);
+            vec refDx = dx0;
+            for (size_t f = 0; f < cfeat; f++)
+            {
+                for (size_t j = 0; j < ccol; j++)
+                    for (size_t s = 0; s < cspatial; s++)
+                    {
+                        size_t i = j * crow + f * cspatial + s;
+                        refScaleGrad[f] += dy[i] * (x[i] - refMean[f]) * refInvStdDev[f];
+                        refBiasGrad[f] += dy[i];
+                    }
+                for (size_t j = 0; j < ccol; j++)
+                    for (size_t s = 0; s < cspatial; s++)
+                    {
+                        size_t i = j * crow + f * cspatial + s;
+                        double xHat = (x[i] - refMean[f]) * refInvStdDev[f];
+                        refDx[i] += (float)(scaleV[f] * refInvStdDev[f] * (dy[i] - (1 - blendFactor) * (xHat * refScaleGrad[f] + refBiasGrad[f]) / m));
+                    }
+            }
+
+            SingleMatrix srcGrad(crow, ccol, dy.data(), deviceId, matrixFlagNormal);
+            SingleMatrix grad(crow, ccol, dx0.data(), deviceId, matrixFlagNormal);
+            SingleMatrix scaleGrad(cfeat, 1, deviceId);
+            SingleMatrix biasGrad(cfeat, 1, deviceId);
+            eng->Backward(in, srcGrad, grad, scale, blendFactor, saveMean, saveInvStdDev, scaleGrad, biasGrad);
+            check(scaleGrad, toVec(refScaleGrad), "scaleGrad");
+            check(biasGrad, toVec(refBiasGrad), "biasGrad");
+            check(grad, refDx, "grad");
+
+            // Inference with fused ReLU normalizes with the running statistics.
+            auto engRelu = BNEng::Create(deviceId, inOutT, spatial, ImageLayoutKind::CHW, BatchNormEngineKind::Cntk, /*fuseRelu=*/true);
+            engRelu->Forward(in, scale, bias, true, 0, 1, runMean, runVar, out, eps, saveMean, saveInvStdDev);
+            BOOST_REQUIRE(saveMean.IsEmpty() && saveInvStdDev.IsEmpty());
+            for (size_t f = 0; f < cfeat; f++)
+                for (size_t j = 0; j < ccol; j++)
+                    for (size_t s = 0; s < cspatial; s++)
+                    {
+                        size_t i = j * crow + f * cspatial + s;
+                        double y = (x[i] - refRunMean[f]) / std::sqrt(refRunVar[f] + eps) * scaleV[f] + biasV[f];
+                        refOut[i] = (float)std::max(y, 0.0);
+                    }
+            check(out, refOut, "out (inference, ReLU)");
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 } } } }
@@ -4,6 +4,8 @@
 //
 #include "stdafx.h"
 #include "../../../Source/Math/CPUMatrix.h"
+#include "../../../Source/Math/CPUThreadPool.h"
+#include <omp.h>
 
 using namespace Microsoft::MSR::CNTK;
 
@@ -1087,6 +1089,187 @@ BOOST_FIXTURE_TEST_CASE(CPUMatrixGatherFromTarget, RandomSeedFixture)
     BOOST_CHECK(m2.IsEqualTo(expect, 1e-6));
 }
 
+// The tensor ops below are large enough to be partitioned across threads and use the vectorized kernels;
+// they are compared with plain loops over the elements.
+BOOST_FIXTURE_TEST_CASE(CPUMatrixTensorOpElementwise, RandomSeedFixture)
+{
+    const size_t rows = 1003;
+    const size_t cols = 129;
+    SMatrix a = SMatrix::RandomUniform(rows, cols, -1, 1, IncrementCounter());
+    SMatrix b = SMatrix::RandomUniform(rows, cols, -1, 1, IncrementCounter());
+    SMatrix c0 = SMatrix::RandomUniform(rows, cols, -1, 1, IncrementCounter());
+
+    const std::array<size_t, 3> offsets = { 0, 0, 0 };
+    const SmallVector<size_t> regularOpDims = { rows, cols };
+    const SmallVector<ptrdiff_t> strides = { 1, (ptrdiff_t) rows };
+    const std::array<SmallVector<ptrdiff_t>, 3> regularStrides = { strides, strides, strides };
+    const std::array<SmallVector<ptrdiff_t>, 3> reducingStrides;
+    const std::array<size_t, 2> unaryOffsets = { 0, 0 };
+    const std::array<SmallVector<ptrdiff_t>, 2> unaryRegularStrides = { strides, strides };
+    const std::array<SmallVector<ptrdiff_t>, 2> unaryReducingStrides;
+
+    int numThreads = SMatrix::GetMaxNumThreads();
+    for (int threads : { 1, 4 })
+    {
+        omp_set_num_threads(threads);
+        for (float beta : { 0.0f, 0.5f })
+        {
+            SMatrix c(c0);
+            c.TensorOp(beta, a, b, 2.0f, ElementWiseOperator::opSum, ElementWiseOperator::opSum, offsets, regularOpDims, regularStrides, SmallVector<size_t>(), reducingStrides);
+            SMatrix expected(c0);
+            foreach_coord (i, j, expected)
+                expected(i, j) = beta * c0(i, j) + 2.0f * (a(i, j) + b(i, j));
+            BOOST_CHECK(c.IsEqualTo(expected, c_epsilonFloatE5));
+
+            c.SetValue(c0);
+            c.TensorOp(beta, a, b, 1.0f, ElementWiseOperator::opElementwiseProductWithLinearRectifierDerivativeFromOutput, ElementWiseOperator::opSum, offsets, regularOpDims, regularStrides, SmallVector<size_t>(), reducingStrides);
+            foreach_coord (i, j, expected)
+                expected(i, j) = beta * c0(i, j) + (b(i, j) > 0 ? a(i, j) : 0);
+            BOOST_CHECK(c.IsEqualTo(expected, c_epsilonFloatE5));
+
+            c.SetValue(c0);
+            c.TensorOp(beta, a, 1.0f, ElementWiseOperator::opLinearRectifier, ElementWiseOperator::opSum, unaryOffsets, regularOpDims, unaryRegularStrides, SmallVector<size_t>(), unaryReducingStrides);
+            foreach_coord (i, j, expected)
+                expected(i, j) = beta * c0(i, j) + (a(i, j) > 0 ? a(i, j) : 0);
+            BOOST_CHECK(c.IsEqualTo(expected, c_epsilonFloatE5));
+
+            // an op without a vectorized kernel
+            c.SetValue(c0);
+            c.TensorOp(beta, a, 1.0f, ElementWiseOperator::opSigmoid, ElementWiseOperator::opSum, unaryOffsets, regularOpDims, unaryRegularStrides, SmallVector<size_t>(), unaryReducingStrides);
+            foreach_coord (i, j, expected)
+                expected(i, j) = beta * c0(i, j) + 1 / (1 + exp(-a(i, j)));
+            BOOST_CHECK(c.IsEqualTo(expected, c_epsilonFloatE5));
+        }
+    }
+    omp_set_num_threads(numThreads);
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixTensorOpReduction, RandomSeedFixture)
+{
+    const size_t rows = 1003;
+    const size_t cols = 129;
+    SMatrix a = SMatrix::RandomUniform(rows, cols, -1, 1, IncrementCounter());
+
+    const std::array<size_t, 2> offsets = { 0, 0 };
+    const std::array<SmallVector<ptrdiff_t>, 2> noStrides;
+
+    double sum = 0;
+    float max = a(0, 0);
+    std::vector<double> rowSums(rows, 0);
+    foreach_coord (i, j, a)
+    {
+        sum += a(i, j);
+        max = std::max(max, a(i, j));
+        rowSums[i] += a(i, j);
+    }
+
+    int numThreads = SMatrix::GetMaxNumThreads();
+    for (int threads : { 1, 4 })
+    {
+        omp_set_num_threads(threads);
+
+        // reduction of contiguous elements into a scalar
+        SMatrix c(1, 1);
+        const SmallVector<size_t> allOpDims = { rows * cols };
+        const std::array<SmallVector<ptrdiff_t>, 2> allStrides = { SmallVector<ptrdiff_t>{ 1 }, SmallVector<ptrdiff_t>{ 0 } };
+        c.TensorOp(0, a, 1.0f, ElementWiseOperator::opCopy, ElementWiseOperator::opSum, offsets, SmallVector<size_t>(), noStrides, allOpDims, allStrides);
+        BOOST_CHECK_CLOSE(c(0, 0), sum, 1e-3);
+        c.TensorOp(0, a, 1.0f, ElementWiseOperator::opCopy, ElementWiseOperator::opMax, offsets, SmallVector<size_t>(), noStrides, allOpDims, allStrides);
+        BOOST_CHECK_EQUAL(c(0, 0), max);
+
+        // reduction over two dimensions into a scalar, with alpha and beta
+        c(0, 0) = 1;
+        const SmallVector<size_t> matrixOpDims = { rows, cols };
+        const std::array<SmallVector<ptrdiff_t>, 2> matrixStrides = { SmallVector<ptrdiff_t>{ 1, (ptrdiff_t) rows }, SmallVector<ptrdiff_t>{ 0, 0 } };
+        c.TensorOp(2.0f, a, 0.5f, ElementWiseOperator::opCopy, ElementWiseOperator::opSum, offsets, SmallVector<size_t>(), noStrides, matrixOpDims, matrixStrides);
+        BOOST_CHECK_CLOSE(c(0, 0), 2.0 + 0.5 * sum, 1e-3);
+
+        // reduction over the columns, e.g. a bias gradient
+        SMatrix rowSum(rows, 1);
+        const SmallVector<size_t> rowOpDims = { rows };
+        const std::array<SmallVector<ptrdiff_t>, 2> rowStrides = { SmallVector<ptrdiff_t>{ 1 }, SmallVector<ptrdiff_t>{ 1 } };
+        const SmallVector<size_t> colOpDims = { cols };
+        const std::array<SmallVector<ptrdiff_t>, 2> colStrides = { SmallVector<ptrdiff_t>{ (ptrdiff_t) rows }, SmallVector<ptrdiff_t>{ 0 } };
+        rowSum.TensorOp(0, a, 1.0f, ElementWiseOperator::opCopy, ElementWiseOperator::opSum, offsets, rowOpDims, rowStrides, colOpDims, colStrides);
+        for (size_t i = 0; i < rows; i++)
+            BOOST_CHECK_CLOSE(rowSum(i, 0), rowSums[i], 1e-3);
+    }
+    omp_set_num_threads(numThreads);
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUThreadPoolLayout, RandomSeedFixture)
+{
+    auto& pool = CPUThreadPool::Instance();
+    int numThreads = omp_get_max_threads();
+    BOOST_REQUIRE(pool.NumNodes() >= 1);
+
+    for (int n : { 1, 3, 7 })
+    {
+        BOOST_CHECK_EQUAL(pool.Configure(n), n);
+        // the workers form one contiguous group per node, and every node with processors gets workers once there are enough
+        int next = 0;
+        for (size_t node = 0; node < pool.NumNodes(); node++)
+        {
+            auto threads = pool.ThreadsOfNode(node);
+            BOOST_CHECK_EQUAL(threads.first, next);
+            BOOST_CHECK(!pool.ProcessorsOfNode(node).empty());
+            if (n >= (int) pool.NumNodes())
+                BOOST_CHECK(threads.second > threads.first);
+            for (int t = threads.first; t < threads.second; t++)
+                BOOST_CHECK_EQUAL(pool.NodeOfThread(t), node);
+            next = threads.second;
+        }
+        BOOST_CHECK_EQUAL(next, n);
+    }
+    omp_set_num_threads(numThreads);
+    pool.Configure(numThreads);
+
+    // buffers are zeroed, including large ones that are first touched in parallel
+    std::vector<char> buffer(3 * 1024 * 1024 + 5, 1);
+    pool.ZeroFill(buffer.data(), buffer.size());
+    BOOST_CHECK(std::all_of(buffer.begin(), buffer.end(), [](char c) { return c == 0; }));
+
+    SMatrix m(1024, 1025);
+    BOOST_CHECK(std::all_of(m.Data(), m.Data() + m.GetNumElements(), [](float v) { return v == 0; }));
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixArenaBuffer, RandomSeedFixture)
+{
+    std::vector<float> arena(64, 7);
+
+    // an external buffer cannot be resized
+    SMatrix external(4, 4, arena.data(), matrixFlagDontOwnBuffer);
+    BOOST_CHECK_THROW(external.Resize(5, 4), std::logic_error);
+
+    // an arena slot can be resized within its size, in place and never shrinking
+    SMatrix m;
+    m.SetValue(16, 1, arena.data() + 16, matrixFlagDontOwnBuffer | matrixFlagArenaBuffer);
+    BOOST_CHECK(!m.OwnBuffer());
+    m.Resize(3, 5);
+    BOOST_CHECK_EQUAL(m.Data(), arena.data() + 16);
+    m.Resize(2, 2, /*growOnly=*/false);
+    BOOST_CHECK_EQUAL(m.Data(), arena.data() + 16);
+    m.Resize(4, 4);
+    BOOST_CHECK_EQUAL(m.Data(), arena.data() + 16);
+    m.SetValue(1);
+    BOOST_CHECK_EQUAL(arena[15], 7);
+    BOOST_CHECK_EQUAL(arena[16], 1);
+    BOOST_CHECK_EQUAL(arena[31], 1);
+    BOOST_CHECK_EQUAL(arena[32], 7);
+
+    // growing beyond the slot moves the matrix to a buffer of its own and leaves the arena alone
+    m.Resize(5, 4);
+    BOOST_CHECK(m.OwnBuffer());
+    BOOST_CHECK(m.Data() < arena.data() || m.Data() >= arena.data() + arena.size());
+    m.SetValue(2);
+    BOOST_CHECK(std::all_of(arena.begin() + 16, arena.begin() + 32, [](float v) { return v == 1; }));
+
+    // binding it to a slot again frees that buffer, not the arena
+    m.SetValue(32, 1, arena.data() + 32, matrixFlagDontOwnBuffer | matrixFlagArenaBuffer);
+    m.SetValue(16, 1, arena.data(), matrixFlagDontOwnBuffer | matrixFlagArenaBuffer);
+    BOOST_CHECK_EQUAL(m.Data(), arena.data());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }
 } } }
@@ -116,6 +116,79 @@ BOOST_FIXTURE_TEST_CASE(CPUSparseMatrixMultiplyAndAdd, RandomSeedFixture)
     }
 }
 
+BOOST_FIXTURE_TEST_CASE(CPUSparseMatrixMultiplyAndWeightedAdd, RandomSeedFixture)
+{
+    const size_t rows = 30;
+    const size_t cols = 20;
+    const size_t m = 7;
+
+    DenseMatrix dmSparse(rows, cols);
+    dmSparse.SetUniformRandomValue(-3, 1, IncrementCounter());
+    dmSparse.InplaceTruncateBottom(0);
+
+    SparseMatrix smCSC(MatrixFormat::matrixFormatSparseCSC, rows, cols, 0);
+    foreach_coord (row, col, dmSparse)
+    {
+        if (dmSparse(row, col) != 0)
+            smCSC.SetValue(row, col, dmSparse(row, col));
+    }
+    SparseMatrix smCSR(MatrixFormat::matrixFormatSparseCSR, rows, cols, 0);
+    for (size_t row = 0; row < rows; row++)
+    {
+        for (size_t col = 0; col < cols; col++)
+        {
+            if (dmSparse(row, col) != 0)
+                smCSR.SetValue(row, col, dmSparse(row, col));
+        }
+    }
+
+    for (const SparseMatrix* sm : { &smCSC, &smCSR })
+    {
+        for (bool transposeA : { false, true })
+        {
+            for (bool transposeB : { false, true })
+            {
+                // dense * sparse
+                size_t k = transposeB ? cols : rows;
+                size_t n = transposeB ? rows : cols;
+                DenseMatrix dmA = transposeA ? DenseMatrix(k, m) : DenseMatrix(m, k);
+                dmA.SetUniformRandomValue(-1, 1, IncrementCounter());
+                DenseMatrix dmC(m, n), dmExpected(m, n);
+                dmC.SetUniformRandomValue(-1, 1, IncrementCounter());
+                dmExpected.SetValue(dmC);
+
+                SparseMatrix::MultiplyAndWeightedAdd(0.5, dmA, transposeA, *sm, transposeB, 2, dmC);
+                DenseMatrix::MultiplyAndWeightedAdd(0.5, dmA, transposeA, dmSparse, transposeB, 2, dmExpected);
+                BOOST_CHECK(dmC.IsEqualTo(dmExpected, c_epsilonFloatE4));
+
+                // sparse * dense
+                k = transposeA ? rows : cols;
+                size_t mSparse = transposeA ? cols : rows;
+                DenseMatrix dmB = transposeB ? DenseMatrix(m, k) : DenseMatrix(k, m);
+                dmB.SetUniformRandomValue(-1, 1, IncrementCounter());
+                DenseMatrix dmD(mSparse, m), dmExpectedD(mSparse, m);
+                dmD.SetUniformRandomValue(-1, 1, IncrementCounter());
+                dmExpectedD.SetValue(dmD);
+
+                SparseMatrix::MultiplyAndWeightedAdd(0.5, *sm, transposeA, dmB, transposeB, 1, dmD);
+                DenseMatrix::MultiplyAndWeightedAdd(0.5, dmSparse, transposeA, dmB, transposeB, 1, dmExpectedD);
+                BOOST_CHECK(dmD.IsEqualTo(dmExpectedD, c_epsilonFloatE4));
+            }
+        }
+    }
+
+    // column slice of a CSC matrix, as used for minibatch slices
+    const size_t start = 5;
+    const size_t numCols = 10;
+    DenseMatrix dmA(m, rows);
+    dmA.SetUniformRandomValue(-1, 1, IncrementCounter());
+    DenseMatrix dmC(m, numCols);
+    SparseMatrix::MultiplyAndWeightedAdd(1, dmA, false, smCSC.ColumnSlice(start, numCols), false, 0, dmC);
+    DenseMatrix dmExpected(m, numCols);
+    DenseMatrix::MultiplyAndWeightedAdd(1, dmA, false, dmSparse.ColumnSlice(start, numCols), false, 0, dmExpected);
+    BOOST_CHECK(dmC.IsEqualTo(dmExpected, c_epsilonFloatE4));
+}
+
 BOOST_FIXTURE_TEST_CASE(CPUSparseMatrixDoGatherColumnsOf, RandomSeedFixture)
 {
     const size_t m = 100;
@@ -5,6 +5,8 @@
 #include "stdafx.h"
 #include <algorithm>
 #include <array>
+#include <cstdio>
+#include <fstream>
 #include <random>
 #include <numeric>
 #include <boost/random/normal_distribution.hpp>
@@ -371,6 +373,212 @@ BOOST_AUTO_TEST_CASE(ConvolutionBackwardKernel)
     }
 }
 
+// Direct and Winograd engines compared with the reference engine, does not require a GPU.
+BOOST_AUTO_TEST_CASE(ConvolutionDirectAndWinogradCpu)
+{
+    std::mt19937 rng(0);
+    boost::random::uniform_int_distribution<> batchSizeG(1, 8);
+    boost::random::normal_distribution<float> nd;
+
+    auto initMat = [&](SingleMatrix& buf, size_t r, size_t c, vec& data) -> SingleMatrix
+    {
+        data.resize(r * 3 * c);
+        std::fill(begin(data), end(data), std::numeric_limits<float>::quiet_NaN());
+        std::generate(begin(data) + r * c, begin(data) + 2 * r * c, [&] { return nd(rng); });
+        buf.SetValue(r, 3 * c, buf.GetDeviceId(), data.data());
+        // Get center slice.
+        return buf.ColumnSlice(c, c);
+    };
+
+    auto geometries = GenerateConvTestConfigs();
+    // Outputs of at least 8x8 use F(4x4, 3x3) in Winograd engine.
+    geometries.push_back(std::make_shared<ConvolveGeometry>(TensorShape(13, 11, 9),
+        TensorShape(3, 3, 9), TensorShape(17), TensorShape(1, 1, 9),
+        ConvolveGeometry::BoolVec{true}, ConvolveGeometry::BoolVec{true, true, false},
+        TensorShape(0), TensorShape(0)));
+    geometries.push_back(std::make_shared<ConvolveGeometry>(TensorShape(12, 12, 4),
+        TensorShape(3, 3, 4), TensorShape(8), TensorShape(1, 1, 4),
+        ConvolveGeometry::BoolVec{true}, ConvolveGeometry::BoolVec{false},
+        TensorShape(0), TensorShape(0)));
+    // Even kernel with different strides.
+    geometries.push_back(std::make_shared<ConvolveGeometry>(TensorShape(10, 9, 5),
+        TensorShape(5, 4, 5), TensorShape(9), TensorShape(2, 3, 5),
+        ConvolveGeometry::BoolVec{true}, ConvolveGeometry::BoolVec{true, false, false},
+        TensorShape(0), TensorShape(0)));
+    // 1D convolution.
+    geometries.push_back(std::make_shared<ConvolveGeometry>(TensorShape(20, 3),
+        TensorShape(5, 3), TensorShape(4), TensorShape(2, 3),
+        ConvolveGeometry::BoolVec{true}, ConvolveGeometry::BoolVec{true, false},
+        TensorShape(0), TensorShape(0)));
+
+    int deviceId = -1;
+    for (auto engKind : {ConvolutionEngineKind::Direct, ConvolutionEngineKind::Winograd})
+    {
+        for (size_t maxTempMem : {0, 3})
+        {
+            for (const auto& g : geometries)
+            {
+                // Geometries that the engine does not support fall back to the reference engine.
+                auto baseEng = ConvEng::Create(g, deviceId, ImageLayoutKind::CHW, 0, PoolKind::None, ConvolutionEngineKind::Reference);
+                auto testEng = ConvEng::Create(g, deviceId, ImageLayoutKind::CHW, maxTempMem, PoolKind::None,
+                                               (ConvolutionEngineKind)((int)engKind | (int)ConvolutionEngineKind::Reference));
+
+                size_t n = batchSizeG(rng);
+                vec buf;
+                buf.resize(g->InputShape().GetNumElements() * n);
+                std::generate(begin(buf), end(buf), [&] { return nd(rng); });
+                SingleMatrix in(g->InputShape().GetNumElements(), n, buf.data(), deviceId, matrixFlagNormal);
+
+                size_t mapCount = g->GetMapCount(g->InputShape().GetRank() - 1);
+                buf.resize(g->KernelShape().GetNumElements() * mapCount);
+                std::generate(begin(buf), end(buf), [&] { return nd(rng); });
+                SingleMatrix kernel(mapCount, g->KernelShape().GetNumElements(), buf.data(), deviceId, matrixFlagNormal);
+
+                buf.resize(g->OutputShape().GetNumElements() * n);
+                std::generate(begin(buf), end(buf), [&] { return nd(rng); });
+                SingleMatrix srcGrad(g->OutputShape().GetNumElements(), n, buf.data(), deviceId, matrixFlagNormal);
+
+                size_t crowOut = g->OutputShape().GetNumElements();
+                SingleMatrix outBuf(deviceId);
+                SingleMatrix out = initMat(outBuf, crowOut, n, buf);
+                SingleMatrix outB(out.DeepClone(), deviceId);
+
+                size_t crowIn = g->InputShape().GetNumElements();
+                SingleMatrix gradBuf(deviceId);
+                SingleMatrix grad = initMat(gradBuf, crowIn, n, buf);
+                SingleMatrix gradB(grad.DeepClone(), deviceId);
+
+                SingleMatrix kernelGradBuf(deviceId);
+                SingleMatrix kernelGrad = initMat(kernelGradBuf, mapCount, g->KernelShape().GetNumElements(), buf);
+                SingleMatrix kernelGradB(kernelGrad.DeepClone(), deviceId);
+
+                SingleMatrix workspace(deviceId);
+                SingleMatrix workspaceB(deviceId);
+
+                testEng->Forward(in, kernel, out, workspace);
+                baseEng->Forward(in, kernel, outB, workspaceB);
+                testEng->BackwardData(srcGrad, kernel, grad, true, workspace);
+                baseEng->BackwardData(srcGrad, kernel, gradB, true, workspaceB);
+                testEng->BackwardKernel(srcGrad, in, kernelGrad, true, false, workspace);
+                baseEng->BackwardKernel(srcGrad, in, kernelGradB, true, false, workspaceB);
+
+                std::stringstream tmsg;
+                tmsg << "Geometry: " << (std::string)(*g) << ", Engine: " << (int)engKind << ", Batch: " << n << ", MaxTempMem: " << maxTempMem;
+                std::string msg = " are not equal, " + tmsg.str();
+                std::string msgNotNan = " has buffer overflow/underflow, " + tmsg.str();
+
+                // Winograd transforms lose a few bits of precision, more so with larger tiles.
+                float scale = engKind == ConvolutionEngineKind::Winograd ? 64.0f : 4.0f;
+                float relErr = Err<float>::Rel * scale;
+                float absErr = Err<float>::Abs * scale * 16;
+                std::string emsg;
+
+                BOOST_REQUIRE_MESSAGE(CheckEqual(out, outB, emsg, relErr, absErr), "out" << msg << ". " << emsg);
+                BOOST_REQUIRE_MESSAGE(CountNans(outBuf) == crowOut * 2 * n, "out" << msgNotNan);
+                BOOST_REQUIRE_MESSAGE(CheckEqual(grad, gradB, emsg, relErr, absErr), "grad" << msg << ". " << emsg);
+                BOOST_REQUIRE_MESSAGE(CountNans(gradBuf) == crowIn * 2 * n, "grad" << msgNotNan);
+                BOOST_REQUIRE_MESSAGE(CheckEqual(kernelGrad, kernelGradB, emsg, relErr * 48, absErr * 2), "kernelGrad" << msg << ". " << emsg);
+                BOOST_REQUIRE_MESSAGE(CountNans(kernelGradBuf) == kernelGrad.GetNumElements() * 2, "kernelGrad" << msgNotNan);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ConvolutionAutotuningCpu)
+{
+    std::mt19937 rng(0);
+    boost::random::normal_distribution<float> nd;
+
+    std::string cacheFile = "ConvolutionTuningCache.txt";
+    std::wstring wcacheFile(cacheFile.begin(), cacheFile.end());
+    std::remove(cacheFile.c_str());
+    auto readCache = [&]() -> std::vector<std::string>
+    {
+        std::vector<std::string> lines;
+        std::ifstream f(cacheFile);
+        for (std::string line; std::getline(f, line);)
+            lines.push_back(line);
+        return lines;
+    };
+
+    // Supported by all CPU engines.
+    auto g = std::make_shared<ConvolveGeometry>(TensorShape(10, 9, 4),
+        TensorShape(3, 3, 4), TensorShape(6), TensorShape(1, 1, 4),
+        ConvolveGeometry::BoolVec{true}, ConvolveGeometry::BoolVec{true, true, false},
+        TensorShape(0), TensorShape(0));
+
+    int deviceId = -1;
+    size_t n = 3;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        // The second pass reloads the cache file instead of measuring the engines again.
+        SetCpuConvolutionAutotuning(true, pass == 0 ? wcacheFile : L"");
+        SetCpuConvolutionAutotuning(true, wcacheFile);
+
+        auto baseEng = ConvEng::Create(g, deviceId, ImageLayoutKind::CHW, 0, PoolKind::None, ConvolutionEngineKind::Reference);
+        auto testEng = ConvEng::Create(g, deviceId, ImageLayoutKind::CHW, 0, PoolKind::None, ConvolutionEngineKind::All);
+
+        vec buf(g->InputShape().GetNumElements() * n);
+        std::generate(begin(buf), end(buf), [&] { return nd(rng); });
+        SingleMatrix in(g->InputShape().GetNumElements(), n, buf.data(), deviceId, matrixFlagNormal);
+
+        size_t mapCount = g->GetMapCount(g->InputShape().GetRank() - 1);
+        buf.resize(g->KernelShape().GetNumElements() * mapCount);
+        std::generate(begin(buf), end(buf), [&] { return nd(rng); });
+        SingleMatrix kernel(mapCount, g->KernelShape().GetNumElements(), buf.data(), deviceId, matrixFlagNormal);
+
+        buf.resize(g->OutputShape().GetNumElements() * n);
+        std::generate(begin(buf), end(buf), [&] { return nd(rng); });
+        SingleMatrix srcGrad(g->OutputShape().GetNumElements(), n, buf.data(), deviceId, matrixFlagNormal);
+
+        SingleMatrix out(g->OutputShape().GetNumElements(), n, deviceId);
+        SingleMatrix outB(g->OutputShape().GetNumElements(), n, deviceId);
+        SingleMatrix grad(in.DeepClone(), deviceId);
+        SingleMatrix gradB(in.DeepClone(), deviceId);
+        SingleMatrix kernelGrad(kernel.DeepClone(), deviceId);
+        SingleMatrix kernelGradB(kernel.DeepClone(), deviceId);
+        SingleMatrix workspace(deviceId);
+        SingleMatrix workspaceB(deviceId);
+
+        testEng->Forward(in, kernel, out, workspace);
+        baseEng->Forward(in, kernel, outB, workspaceB);
+        testEng->BackwardData(srcGrad, kernel, grad, true, workspace);
+        baseEng->BackwardData(srcGrad, kernel, gradB, true, workspaceB);
+        testEng->BackwardKernel(srcGrad, in, kernelGrad, true, false, workspace);
+        baseEng->BackwardKernel(srcGrad, in, kernelGradB, true, false, workspaceB);
+
+        // Measurements must not change the results, tolerances allow for the Winograd engine.
+        float relErr = Err<float>::Rel * 64;
+        float absErr = Err<float>::Abs * 1024;
+        std::string emsg;
+        BOOST_REQUIRE_MESSAGE(CheckEqual(out, outB, emsg, relErr, absErr), "out are not equal. " << emsg);
+        BOOST_REQUIRE_MESSAGE(CheckEqual(grad, gradB, emsg, relErr, absErr), "grad are not equal. " << emsg);
+        BOOST_REQUIRE_MESSAGE(CheckEqual(kernelGrad, kernelGradB, emsg, relErr * 48, absErr * 2), "kernelGrad are not equal. " << emsg);
+
+        // One result per operation: CPU model, key, engine and workspace size.
+        auto lines = readCache();
+        BOOST_REQUIRE_EQUAL(lines.size(), 3);
+        for (const auto& line : lines)
+            BOOST_REQUIRE_EQUAL(std::count(line.begin(), line.end(), '\t'), 3);
+    }
+
+    // Deterministic algorithms get a fixed engine, so nothing is measured.
+    std::remove(cacheFile.c_str());
+    SetCpuConvolutionAutotuning(true, wcacheFile);
+    auto deterministicEng = ConvEng::Create(g, deviceId, ImageLayoutKind::CHW, 0, PoolKind::None, ConvolutionEngineKind::All, L"", true);
+    SingleMatrix in(g->InputShape().GetNumElements(), n, deviceId);
+    SingleMatrix kernel(g->GetMapCount(g->InputShape().GetRank() - 1), g->KernelShape().GetNumElements(), deviceId);
+    SingleMatrix out(g->OutputShape().GetNumElements(), n, deviceId);
+    SingleMatrix workspace(deviceId);
+    in.SetValue(1);
+    kernel.SetValue(1);
+    deterministicEng->Forward(in, kernel, out, workspace);
+    BOOST_REQUIRE(readCache().empty());
+
+    SetCpuConvolutionAutotuning(false);
+    std::remove(cacheFile.c_str());
+}
+
 BOOST_AUTO_TEST_CASE(PoolingForward)
 {
     std::mt19937 rng(0);
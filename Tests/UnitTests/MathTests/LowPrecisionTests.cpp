@@ -0,0 +1,108 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include <cmath>
+#include <limits>
+#include "../../../Source/Math/CPUMatrixLowPrecision.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+BOOST_AUTO_TEST_SUITE(LowPrecisionSuite)
+
+BOOST_AUTO_TEST_CASE(BFloat16Conversion)
+{
+    // exactly representable values round-trip
+    for (float f : { 0.0f, -0.0f, 1.0f, -2.5f, 3.0e38f, 1.0e-38f, std::numeric_limits<float>::infinity() })
+    {
+        float r = bfloat16(bfloat16(f));
+        if (f == 3.0e38f || f == 1.0e-38f) // not representable: relative error below 2^-9
+            BOOST_CHECK(std::abs(r - f) <= std::abs(f) / 512);
+        else
+            BOOST_CHECK_EQUAL(r, f);
+    }
+    // round to nearest, ties to even
+    BOOST_CHECK_EQUAL((float) bfloat16(1.0f + 1.0f / 256), 1.0f);                // tie, rounds down to even
+    BOOST_CHECK_EQUAL((float) bfloat16(1.0f + 3.0f / 256), 1.0f + 4.0f / 256);   // tie, rounds up to even
+    BOOST_CHECK_EQUAL((float) bfloat16(1.0f + 1.5f / 256), 1.0f + 2.0f / 256);   // above the tie
+    BOOST_CHECK(std::isnan((float) bfloat16(std::numeric_limits<float>::quiet_NaN())));
+}
+
+BOOST_AUTO_TEST_CASE(HalfConversion)
+{
+    // every float16 value converts to float and back unchanged
+    for (uint32_t bits = 0; bits < 0x10000; bits++)
+    {
+        float16 h;
+        h.m_bits = (uint16_t) bits;
+        float f = h;
+        if (std::isnan(f))
+            continue;
+        BOOST_REQUIRE_EQUAL(float16(f).m_bits, h.m_bits);
+    }
+    BOOST_CHECK_EQUAL((float) float16(65504.0f), 65504.0f);
+    BOOST_CHECK_EQUAL((float) float16(65519.0f), 65504.0f);
+    BOOST_CHECK(std::isinf((float) float16(65520.0f)));
+    BOOST_CHECK_EQUAL((float) float16(1.0f + 1.0f / 2048), 1.0f);               // tie, rounds down to even
+    BOOST_CHECK_EQUAL((float) float16(1.0f + 3.0f / 2048), 1.0f + 4.0f / 2048); // tie, rounds up to even
+    BOOST_CHECK_EQUAL((float) float16(std::ldexp(1.0f, -25)), 0.0f);            // half the smallest subnormal
+    BOOST_CHECK_EQUAL((float) float16(std::ldexp(1.5f, -25)), std::ldexp(1.0f, -24));
+    BOOST_CHECK_EQUAL((float) float16(std::ldexp(3.0f, -25)), std::ldexp(2.0f, -24)); // tie between subnormals
+    BOOST_CHECK(std::isnan((float) float16(std::numeric_limits<float>::quiet_NaN())));
+}
+
+template <class StorageType>
+static void TestLowPrecisionMultiply()
+{
+    const size_t m = 37, k = 300, n = 301; // n spans more than one panel
+    CPUMatrix<float> a(m, k), b(k, n), aT(k, m), bT(n, k);
+    a.SetUniformRandomValue(-1, 1, 1);
+    b.SetUniformRandomValue(-1, 1, 2);
+    aT.AssignTransposeOf(a);
+    bT.AssignTransposeOf(b);
+
+    CPUMatrix<StorageType> aLow, bLow, aTLow, bTLow;
+    AssignToLowPrecision(a, aLow);
+    AssignToLowPrecision(b, bLow);
+    AssignToLowPrecision(aT, aTLow);
+    AssignToLowPrecision(bT, bTLow);
+
+    // reference: float GEMM of the rounded operands
+    CPUMatrix<float> aRounded, bRounded;
+    AssignFromLowPrecision(aLow, aRounded);
+    AssignFromLowPrecision(bLow, bRounded);
+    for (size_t i = 0; i < a.GetNumElements(); i++)
+        BOOST_REQUIRE(std::abs(aRounded.Data()[i] - a.Data()[i]) <= std::abs(a.Data()[i]) / 256);
+
+    CPUMatrix<float> c0(m, n);
+    c0.SetUniformRandomValue(-1, 1, 3);
+    CPUMatrix<float> expected(c0);
+    CPUMatrix<float>::MultiplyAndWeightedAdd(0.5f, aRounded, false, bRounded, false, 2.0f, expected);
+
+    for (bool transposeA : { false, true })
+    {
+        for (bool transposeB : { false, true })
+        {
+            CPUMatrix<float> c(c0);
+            LowPrecisionMultiplyAndWeightedAdd(0.5f, transposeA ? aTLow : aLow, transposeA, transposeB ? bTLow : bLow, transposeB, 2.0f, c);
+            BOOST_CHECK(c.IsEqualTo(expected, 1e-4f));
+
+            CPUMatrix<float> cMixed(c0);
+            CPUMatrix<float> aFloat;
+            AssignFromLowPrecision(transposeA ? aTLow : aLow, aFloat);
+            LowPrecisionMultiplyAndWeightedAdd(0.5f, aFloat, transposeA, transposeB ? bTLow : bLow, transposeB, 2.0f, cMixed);
+            BOOST_CHECK(cMixed.IsEqualTo(expected, 1e-4f));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(LowPrecisionMultiplyAndWeightedAdd)
+{
+    TestLowPrecisionMultiply<bfloat16>();
+    TestLowPrecisionMultiply<float16>();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} } } }
@@ -5,6 +5,7 @@
 #include "stdafx.h"
 #include "../../../Source/Math/QuantizedOperations.h"
 #include "../../../Source/Math/Helpers.h"
+#include <random>
 
 using namespace Microsoft::MSR::CNTK;
 namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
@@ -50,6 +51,42 @@ BOOST_FIXTURE_TEST_CASE(MultiplyIntToShort, RandomSeedFixture)
         BOOST_CHECK_EQUAL(round(C_upd[i]), C_expected_upd[i]);
 }
 
+BOOST_FIXTURE_TEST_CASE(MultiplyBlocked, RandomSeedFixture)
+{
+    // Sizes that cover all block sizes of the multiplier (128, 64, 32, 16, 8 and the remainder)
+    // with both four rows and a single row at a time.
+    int m = 37, k = 128 + 64 + 32 + 16 + 8 + 3;
+    std::mt19937 rng(IncrementCounter());
+    std::uniform_real_distribution<float> dist(-1, 1);
+
+    std::vector<float> A(m*k);
+    for (auto& a : A)
+        a = dist(rng);
+
+    // The bit shifts keep the sums of uniformly distributed products within the range of 32-bit integers.
+    shared_ptr<QuantizerBase<float, short>> quantA(new SymmetricQuantizer<float, short>(3));
+    shared_ptr<QuantizerBase<float, short>> quantB(new SymmetricQuantizer<float, short>(3));
+    QuantizedMultiplier<float> mult(quantA, true, quantB, false);
+
+    for (int n : { 8, 1, 5 })
+    {
+        std::vector<float> B(k*n);
+        for (auto& b : B)
+            b = dist(rng);
+
+        std::vector<float> C(m*n);
+        mult.Multiply(m, n, k, A.data(), B.data(), C.data());
+
+        for (int i = 0; i < m; i++)
+            for (int j = 0; j < n; j++)
+            {
+                double expected = 0;
+                for (int l = 0; l < k; l++)
+                    expected += (double)A[i + l*m] * B[l + k*j];
+                BOOST_CHECK_SMALL(C[i + j*m] - expected, 0.01);
+            }
+    }
+}
 
 BOOST_AUTO_TEST_SUITE_END()
 
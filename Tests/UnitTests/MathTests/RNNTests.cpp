@@ -0,0 +1,194 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include "../../../Source/Math/Matrix.h"
+#include "../../../Source/Math/CPUMatrix.h"
+#include "../../../Source/Math/RNNCommon.h"
+#include "common.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+using dvec = std::vector<double>;
+
+// Straightforward per-sequence implementation of the cuDNN RNN equations on the cuDNN parameter layout.
+// Data is in the dense cuDNN packing described by numSequencesForFrame.
+static dvec ReferenceRNNForward(const dvec& x, const dvec& w, size_t xDim, const RnnAttributes& attr, const std::vector<size_t>& numSequencesForFrame)
+{
+    size_t H = attr.m_hiddenSize;
+    size_t dirs = attr.m_bidirectional ? 2 : 1;
+    size_t gates = attr.m_recurrentOp == L"lstm" ? 4 : attr.m_recurrentOp == L"gru" ? 3 : 1;
+    size_t T = numSequencesForFrame.size();
+    std::vector<size_t> offsets(T + 1, 0);
+    for (size_t t = 0; t < T; t++)
+        offsets[t + 1] = offsets[t] + numSequencesForFrame[t];
+    size_t N = offsets[T];
+
+    // offsets of the parameters: weights of all layers/directions, then biases
+    std::vector<size_t> wOffsets, bOffsets;
+    size_t pos = 0;
+    for (size_t l = 0; l < attr.m_numLayers; l++)
+        for (size_t d = 0; d < dirs; d++)
+        {
+            wOffsets.push_back(pos);
+            pos += gates * H * ((l == 0 ? xDim : dirs * H) + H);
+        }
+    for (size_t l = 0; l < attr.m_numLayers; l++)
+        for (size_t d = 0; d < dirs; d++)
+        {
+            bOffsets.push_back(pos);
+            pos += 2 * gates * H;
+        }
+
+    auto sigmoid = [](double v) { return 1 / (1 + std::exp(-v)); };
+    dvec in = x;
+    size_t inDim = xDim;
+    for (size_t l = 0; l < attr.m_numLayers; l++)
+    {
+        dvec out(dirs * H * N);
+        for (size_t d = 0; d < dirs; d++)
+        {
+            const double* W = &w[wOffsets[l * dirs + d]];
+            const double* R = W + gates * H * inDim;
+            const double* bW = &w[bOffsets[l * dirs + d]];
+            const double* bR = bW + gates * H;
+            for (size_t seq = 0; seq < numSequencesForFrame[0]; seq++)
+            {
+                size_t len = 0;
+                while (len < T && numSequencesForFrame[len] > seq)
+                    len++;
+                dvec h(H, 0), c(H, 0);
+                for (size_t s = 0; s < len; s++)
+                {
+                    size_t t = d == 0 ? s : len - 1 - s;
+                    const double* xt = &in[(offsets[t] + seq) * inDim];
+                    // pre-activations of the input and recurrent sides, per gate
+                    dvec wx(gates * H), rh(gates * H);
+                    for (size_t r = 0; r < gates * H; r++)
+                    {
+                        wx[r] = bW[r];
+                        for (size_t k = 0; k < inDim; k++)
+                            wx[r] += W[r * inDim + k] * xt[k];
+                        rh[r] = bR[r];
+                        for (size_t k = 0; k < H; k++)
+                            rh[r] += R[r * H + k] * h[k];
+                    }
+                    dvec hNew(H);
+                    for (size_t k = 0; k < H; k++)
+                    {
+                        if (attr.m_recurrentOp == L"lstm")
+                        {
+                            double i = sigmoid(wx[k] + rh[k]), f = sigmoid(wx[H + k] + rh[H + k]);
+                            double g = std::tanh(wx[2 * H + k] + rh[2 * H + k]), o = sigmoid(wx[3 * H + k] + rh[3 * H + k]);
+                            c[k] = f * c[k] + i * g;
+                            hNew[k] = o * std::tanh(c[k]);
+                        }
+                        else if (attr.m_recurrentOp == L"gru")
+                        {
+                            double r = sigmoid(wx[k] + rh[k]), z = sigmoid(wx[H + k] + rh[H + k]);
+                            double n = std::tanh(wx[2 * H + k] + r * rh[2 * H + k]);
+                            hNew[k] = (1 - z) * n + z * h[k];
+                        }
+                        else if (attr.m_recurrentOp == L"rnnTanh")
+                            hNew[k] = std::tanh(wx[k] + rh[k]);
+                        else
+                            hNew[k] = std::max(wx[k] + rh[k], 0.0);
+                    }
+                    h = hNew;
+                    std::copy(h.begin(), h.end(), &out[(offsets[t] + seq) * dirs * H + d * H]);
+                }
+            }
+        }
+        in = out;
+        inDim = dirs * H;
+    }
+    return in;
+}
+
+BOOST_AUTO_TEST_SUITE(RNNSuite)
+
+// Checks the CPU OptimizedRNNStack implementation against the reference forward, and its gradients
+// against finite differences of the forward pass.
+BOOST_AUTO_TEST_CASE(RNNStackCpu)
+{
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<double> ud(-0.5, 0.5);
+    const int deviceId = -1;
+    const size_t xDim = 5;
+    const size_t hidden = 4;
+    // frames of sequences with lengths 4, 3, 3, 1
+    const std::vector<size_t> numSequencesForFrame = { 4, 3, 3, 1 };
+    const size_t N = 11;
+
+    for (const wchar_t* op : { L"lstm", L"gru", L"rnnTanh", L"rnnReLU" })
+    {
+        for (bool bidirectional : { false, true })
+        {
+            RnnAttributes attr(bidirectional, 2, hidden, op, -1);
+            size_t yDim = (bidirectional ? 2 : 1) * hidden;
+            auto numParameters = attr.GetNumParameters(xDim);
+            size_t numW = numParameters.first * numParameters.second;
+
+            dvec xv(xDim * N), wv(numW), dyv(yDim * N);
+            for (auto* v : { &xv, &wv, &dyv })
+                std::generate(v->begin(), v->end(), [&] { return ud(rng); });
+
+            DoubleMatrix x(xDim, N, xv.data(), deviceId);
+            DoubleMatrix w(numParameters.first, numParameters.second, wv.data(), deviceId);
+            DoubleMatrix y(yDim, N, deviceId);
+            DoubleMatrix reserve(deviceId), workspace(deviceId);
+            y.RNNForward(x, w, xDim, yDim, numSequencesForFrame, attr, reserve, workspace);
+
+            std::string msg = "op = " + msra::strfun::utf8(op) + ", bidirectional = " + (bidirectional ? "true" : "false");
+            dvec refY = ReferenceRNNForward(xv, wv, xDim, attr, numSequencesForFrame);
+            for (size_t i = 0; i < refY.size(); i++)
+                BOOST_REQUIRE_MESSAGE(std::abs(y.Data()[i] - refY[i]) < 1e-10, "y[" << i << "] = " << y.Data()[i] << " instead of " << refY[i] << ", " << msg);
+
+            DoubleMatrix dy(yDim, N, dyv.data(), deviceId);
+            DoubleMatrix dx(xDim, N, deviceId);
+            DoubleMatrix dw(numParameters.first, numParameters.second, deviceId);
+            dw.SetValue(0);
+            y.RNNBackwardData(dy, w, dx, attr, reserve, workspace);
+            y.RNNBackwardWeights(x, y, dw, attr, reserve, workspace);
+
+            // loss = sum(dy .* y)
+            auto loss = [&](const dvec& xp, const dvec& wp)
+            {
+                dvec yp = ReferenceRNNForward(xp, wp, xDim, attr, numSequencesForFrame);
+                double sum = 0;
+                for (size_t i = 0; i < yp.size(); i++)
+                    sum += dyv[i] * yp[i];
+                return sum;
+            };
+            const double eps = 1e-6;
+            auto numericGradient = [&](dvec& v, size_t i)
+            {
+                double orig = v[i];
+                v[i] = orig + eps;
+                double lp = loss(xv, wv);
+                v[i] = orig - eps;
+                double lm = loss(xv, wv);
+                v[i] = orig;
+                return (lp - lm) / (2 * eps);
+            };
+            for (size_t i = 0; i < xv.size(); i++)
+            {
+                double expected = numericGradient(xv, i);
+                BOOST_REQUIRE_MESSAGE(std::abs(dx.Data()[i] - expected) < 1e-6, "dx[" << i << "] = " << dx.Data()[i] << " instead of " << expected << ", " << msg);
+            }
+            for (size_t i = 0; i < wv.size(); i += 3)
+            {
+                double expected = numericGradient(wv, i);
+                BOOST_REQUIRE_MESSAGE(std::abs(dw.Data()[i] - expected) < 1e-6, "dw[" << i << "] = " << dw.Data()[i] << " instead of " << expected << ", " << msg);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} } } }
@@ -85,6 +85,42 @@ BOOST_AUTO_TEST_CASE(BiasGradient2)
     });
 }
 
+BOOST_AUTO_TEST_CASE(ActivationOfSum)
+{
+    Test::TensorTest<float> tensorTester;
+
+    // fused op, activation, gradient of the activation from its output
+    const ElementWiseOperator ops[][3] =
+    {
+        { opLinearRectifierOfSum, opLinearRectifier, opElementwiseProductWithLinearRectifierDerivativeFromOutput },
+        { opSigmoidOfSum,         opSigmoid,         opElementwiseProductWithSigmoidDerivativeFromOutput },
+        { opTanhOfSum,            opTanh,            opElementwiseProductWithTanhDerivativeFromOutput },
+    };
+    for (const auto& op : ops)
+    {
+        // the fused op must match Sum followed by the activation, with a broadcast bias
+        let input = tensorTester.CreateTensor(TensorShape{ 64, 32 }, 1, CPUDEVICE);
+        let bias  = tensorTester.CreateTensor(TensorShape{ 64, 1 }, 2, CPUDEVICE);
+        auto fused    = tensorTester.CreateTensor(TensorShape{ 64, 32 }, 3, CPUDEVICE, true);
+        auto sum      = tensorTester.CreateTensor(TensorShape{ 64, 32 }, 4, CPUDEVICE);
+        auto separate = tensorTester.CreateTensor(TensorShape{ 64, 32 }, 5, CPUDEVICE);
+        fused.DoBinaryOpOf(0, input, bias, 1, op[0], opSum);
+        sum.AssignSumOf(input, bias);
+        separate.DoUnaryOpOf(0, sum, 1, op[1], opSum);
+        BOOST_CHECK(fused.GetSOB().IsEqualTo(separate.GetSOB(), 1e-6f));
+
+        // the bias gradient is computed from the fused output and reduced in the same pass
+        let gradient = tensorTester.CreateTensor(TensorShape{ 64, 32 }, 6, CPUDEVICE);
+        auto biasGradient = tensorTester.CreateTensor(TensorShape{ 64, 1 }, 7, CPUDEVICE);
+        auto sumGradient  = tensorTester.CreateTensor(TensorShape{ 64, 32 }, 8, CPUDEVICE);
+        auto expected     = tensorTester.CreateTensor(TensorShape{ 64, 1 }, 9, CPUDEVICE);
+        biasGradient.DoBinaryOpOf(0, gradient, fused, 1, op[2], opSum);
+        sumGradient.DoBinaryOpOf(0, gradient, separate, 1, op[2], opSum);
+        expected.AssignCopyOf(sumGradient);
+        BOOST_CHECK(biasGradient.GetSOB().IsEqualTo(expected.GetSOB(), 1e-5f));
+    }
+}
+
 BOOST_AUTO_TEST_CASE(ColumnSliceMultAndAdd)
 {
     ColumnSliceMultAndAddTest<float>(2048, 2048, 256, 0);
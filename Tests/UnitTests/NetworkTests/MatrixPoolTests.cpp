@@ -0,0 +1,184 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+
+#include "ComputationNetwork.h"
+#include "Globals.h"
+#include <algorithm>
+#include <memory>
+
+using namespace Microsoft::MSR::CNTK;
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// blocks that are in use at the same time must not share bytes
+static void CheckMemArenaPlan(const vector<MemArenaBlock>& blocks, size_t peak, size_t alignment)
+{
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        BOOST_CHECK_EQUAL(blocks[i].offset % alignment, 0);
+        BOOST_CHECK_EQUAL(blocks[i].size % alignment, 0);
+        BOOST_CHECK_LE(blocks[i].offset + blocks[i].size, peak);
+        for (size_t j = 0; j < i; j++)
+        {
+            if (OccupanciesOverlap(blocks[i].occupancy, blocks[j].occupancy))
+                BOOST_CHECK(blocks[i].offset + blocks[i].size <= blocks[j].offset || blocks[j].offset + blocks[j].size <= blocks[i].offset);
+        }
+    }
+}
+
+static bool AreDisjoint(const Matrix<float>& a, const Matrix<float>& b)
+{
+    return a.Data() + a.GetNumElements() <= b.Data() || b.Data() + b.GetNumElements() <= a.Data();
+}
+
+// enables the memory arena for the duration of a test
+struct MemoryArenaFixture
+{
+    MemoryArenaFixture() { Globals::SetMemoryArena(true); }
+    ~MemoryArenaFixture() { Globals::SetMemoryArena(false); }
+};
+
+BOOST_AUTO_TEST_SUITE(MatrixPoolTestSuite)
+
+BOOST_AUTO_TEST_CASE(PlanMemArenaBestFit)
+{
+    // 'wide' blocks live for the whole range of steps and 'early' ones only at the beginning,
+    // which leaves a gap of 384 bytes at offset 0 and one of 192 bytes at offset 640 from step 2 on.
+    vector<MemArenaBlock> blocks = {
+        MemArenaBlock(384, { { 0, 1 } }), // early, offset 0
+        MemArenaBlock(256, { { 0, 9 } }), // wide, offset 384
+        MemArenaBlock(150, { { 0, 1 } }), // early, rounded up to 192, offset 640
+        MemArenaBlock(128, { { 0, 9 } }), // wide, offset 832
+        MemArenaBlock(128, { { 5, 6 } }), // goes into the smaller gap that fits it
+    };
+    size_t peak = PlanMemArena(blocks, 64);
+    CheckMemArenaPlan(blocks, peak, 64);
+    BOOST_CHECK_EQUAL(blocks[0].offset, 0);
+    BOOST_CHECK_EQUAL(blocks[1].offset, 384);
+    BOOST_CHECK_EQUAL(blocks[2].size, 192);
+    BOOST_CHECK_EQUAL(blocks[2].offset, 640);
+    BOOST_CHECK_EQUAL(blocks[3].offset, 832);
+    BOOST_CHECK_EQUAL(blocks[4].offset, 640);
+    BOOST_CHECK_EQUAL(peak, 960);
+}
+
+BOOST_AUTO_TEST_CASE(PlanMemArenaMultipleIntervals)
+{
+    // A block that is reacquired has several intervals; it needs room in all of them.
+    vector<MemArenaBlock> blocks = {
+        MemArenaBlock(384, { { 0, 1 } }),
+        MemArenaBlock(256, { { 0, 9 } }),
+        MemArenaBlock(192, { { 0, 1 } }),
+        MemArenaBlock(128, { { 0, 9 } }),
+        MemArenaBlock(64, { { 2, 3 }, { 7, 8 } }), // only overlaps the wide blocks: best fit into the gap at 640
+        MemArenaBlock(64, { { 0, 0 }, { 5, 6 } }), // overlaps all blocks at step 0: goes on top
+    };
+    size_t peak = PlanMemArena(blocks, 64);
+    CheckMemArenaPlan(blocks, peak, 64);
+    BOOST_CHECK_EQUAL(blocks[4].offset, 640);
+    BOOST_CHECK_EQUAL(blocks[5].offset, 960);
+    BOOST_CHECK_EQUAL(peak, 1024);
+
+    // Without the second interval, the last block fits next to the others at step 5 and the peak is that of the wide and early blocks.
+    blocks.back() = MemArenaBlock(64, { { 5, 6 } });
+    peak = PlanMemArena(blocks, 64);
+    CheckMemArenaPlan(blocks, peak, 64);
+    BOOST_CHECK_EQUAL(peak, 960);
+}
+
+BOOST_AUTO_TEST_CASE(PlanMemArenaPeak)
+{
+    // Blocks that are never in use at the same time all start at offset 0, the peak is the largest of them.
+    vector<MemArenaBlock> blocks;
+    for (int step = 0; step < 8; step++)
+        blocks.push_back(MemArenaBlock(64 * (step % 3 + 1), { { 2 * step, 2 * step + 1 } }));
+    size_t peak = PlanMemArena(blocks, 64);
+    CheckMemArenaPlan(blocks, peak, 64);
+    BOOST_CHECK(std::all_of(blocks.begin(), blocks.end(), [](const MemArenaBlock& block) { return block.offset == 0; }));
+    BOOST_CHECK_EQUAL(peak, 192);
+
+    // With each block overlapping the next one, the peak is at least that of the largest pair in use at the same time,
+    // and well below what the blocks take without sharing.
+    for (int step = 0; step < 8; step++)
+        blocks[step].occupancy = { { 2 * step, 2 * step + 2 } };
+    peak = PlanMemArena(blocks, 64);
+    CheckMemArenaPlan(blocks, peak, 64);
+    BOOST_CHECK_GE(peak, 192 + 128);
+    BOOST_CHECK_LE(peak, 2 * 192);
+}
+
+BOOST_FIXTURE_TEST_CASE(UpdateMemArenaRebindsMatrices, MemoryArenaFixture)
+{
+    // a and c are not in use at the same time, b overlaps both of them
+    MatrixPool pool;
+    pool.ResetStepCounter();
+    shared_ptr<Matrix<float>> a, b, c;
+    pool.RequestAllocate(CPUDEVICE, &a, 0, true, false);
+    pool.RequestAllocate(CPUDEVICE, &b, 0, true, false);
+    pool.RequestRelease(&a);
+    pool.RequestAllocate(CPUDEVICE, &c, 0, true, false);
+    pool.RequestRelease(&b);
+    pool.RequestRelease(&c);
+    pool.OptimizedMemoryAllocation();
+    BOOST_REQUIRE_EQUAL(a.get(), c.get()); // one matrix per memory ID
+
+    // The first minibatch runs with the matrices of the memory IDs.
+    a->Resize(10, 7);
+    b->Resize(3, 5);
+    BOOST_CHECK(pool.IsMemArenaOutdated());
+    pool.UpdateMemArena(false);
+    BOOST_CHECK(!pool.IsMemArenaOutdated());
+
+    // Each request has a matrix of its own in the arena, with its dimensions kept and an aligned address.
+    BOOST_REQUIRE_NE(a.get(), c.get());
+    for (const auto& matrix : { a, b, c })
+    {
+        BOOST_CHECK(!matrix->OwnBuffer());
+        BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(matrix->Data()) % 64, 0);
+    }
+    BOOST_CHECK_EQUAL(a->GetNumRows(), 10);
+    BOOST_CHECK_EQUAL(a->GetNumCols(), 7);
+    BOOST_CHECK_EQUAL(b->GetNumRows(), 3);
+    BOOST_CHECK_EQUAL(b->GetNumCols(), 5);
+    BOOST_CHECK(AreDisjoint(*a, *b));
+    BOOST_CHECK(AreDisjoint(*c, *b));
+
+    // The values of a matrix are kept while the others that are in use at the same time are written.
+    b->SetValue(2);
+    a->SetValue(1);
+    c->Resize(10, 7);
+    c->SetValue(3);
+    BOOST_CHECK_EQUAL(b->SumOfElements(), 2 * 15);
+
+    // A matrix that outgrows its slot moves to a buffer of its own, and the arena has to be planned again.
+    b->Resize(3, 50);
+    BOOST_CHECK(b->OwnBuffer());
+    BOOST_CHECK(AreDisjoint(*a, *b));
+    BOOST_CHECK(pool.IsMemArenaOutdated());
+
+    pool.UpdateMemArena(false);
+    BOOST_CHECK(!pool.IsMemArenaOutdated());
+    BOOST_CHECK(!b->OwnBuffer());
+    BOOST_CHECK_EQUAL(b->GetNumCols(), 50);
+    BOOST_CHECK_GE(b->GetAllocatedSize(), 150);
+    BOOST_CHECK(AreDisjoint(*a, *b));
+    BOOST_CHECK(AreDisjoint(*c, *b));
+    b->SetValue(2);
+    a->SetValue(1);
+    BOOST_CHECK_EQUAL(b->SumOfElements(), 2 * 150);
+
+    // Without the option, nothing is outdated.
+    b->Resize(3, 100);
+    BOOST_CHECK(b->OwnBuffer());
+    Globals::SetMemoryArena(false);
+    BOOST_CHECK(!pool.IsMemArenaOutdated());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} } } }
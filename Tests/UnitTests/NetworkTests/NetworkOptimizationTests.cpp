@@ -0,0 +1,836 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// Tests that the optimizations of network evaluation and training compute the same values and gradients as the plain network.
+//
+
+#include "stdafx.h"
+
+#include "ComputationNetwork.h"
+#include "ComputationNetworkBuilder.h"
+#include "Globals.h"
+#include "LinearAlgebraNodes.h"
+#include "NodeProfiler.h"
+#include "RecurrentNodes.h"
+#include "TrainingNodes.h"
+#include "TestHelpers.h"
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <thread>
+
+using namespace Microsoft::MSR::CNTK;
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+typedef shared_ptr<ComputationNode<float>> FloatNodePtr;
+
+static vector<float> RandomValues(size_t count, unsigned int seed)
+{
+    mt19937 rng(seed);
+    uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+    vector<float> values(count);
+    for (auto& value : values)
+        value = distribution(rng);
+    return values;
+}
+
+static vector<float> ValueOf(const ComputationNodeBasePtr& node)
+{
+    const auto& value = dynamic_pointer_cast<ComputationNode<float>>(node)->Value();
+    return vector<float>(value.Data(), value.Data() + value.GetNumElements());
+}
+
+static vector<float> GradientOf(const ComputationNodeBasePtr& node)
+{
+    const auto& gradient = dynamic_pointer_cast<ComputationNode<float>>(node)->Gradient();
+    return vector<float>(gradient.Data(), gradient.Data() + gradient.GetNumElements());
+}
+
+// Builds a network from its description and sets the learnable parameters and inputs to the same random values for every build.
+// The input is a single sequence of 'numSteps' samples.
+struct TestNetwork
+{
+    ComputationNetworkPtr net;
+    ComputationNodeBasePtr criterion;
+    ComputationNodeBasePtr output;
+    size_t numSteps;
+    unsigned int inputSeed;
+
+    TestNetwork(const function<void(ComputationNetworkBuilder<float>&, TestNetwork&)>& build, size_t numSteps)
+        : net(make_shared<ComputationNetwork>(CPUDEVICE)), numSteps(numSteps)
+    {
+        ComputationNetworkBuilder<float> builder(*net);
+        build(builder, *this);
+        net->AddToNodeGroup(L"criterion", criterion);
+        net->AddToNodeGroup(L"output", output);
+        net->CompileNetwork();
+
+        unsigned int seed = 1;
+        for (const auto& node : net->GetAllNodes()) // (sorted by name)
+        {
+            auto floatNode = dynamic_pointer_cast<ComputationNode<float>>(node);
+            if (floatNode->OperationName() == L"LearnableParameter")
+            {
+                auto values = RandomValues(floatNode->GetSampleLayout().GetNumElements(), seed++);
+                floatNode->Value().SetValue(floatNode->GetAsMatrixNumRows(), floatNode->GetAsMatrixNumCols(), CPUDEVICE, values.data());
+            }
+        }
+        inputSeed = seed;
+        SetInputs();
+    }
+
+    // (again, e.g. after the network has been compiled once more)
+    void SetInputs()
+    {
+        auto layout = net->GetMBLayoutPtrOfNetwork();
+        layout->Init(1, numSteps);
+        layout->AddSequence(0, 0, 0, numSteps);
+        unsigned int seed = inputSeed;
+        for (const auto& node : net->InputNodes(criterion))
+        {
+            auto values = RandomValues(node->GetSampleLayout().GetNumElements() * numSteps, seed++);
+            dynamic_pointer_cast<ComputationNode<float>>(node)->Value().SetValue(node->GetSampleLayout().GetNumElements(), numSteps, CPUDEVICE, values.data());
+        }
+    }
+
+    void AllocateForTraining()
+    {
+        net->AllocateAllMatrices(vector<ComputationNodeBasePtr>{ output }, {}, criterion);
+    }
+
+    void AllocateForInference(const vector<ComputationNodeBasePtr>& outputs)
+    {
+        net->AllocateAllMatrices(outputs, {}, nullptr);
+    }
+
+    // the value of the node in inference, computed from scratch
+    vector<float> Evaluate(const ComputationNodeBasePtr& node)
+    {
+        ScopedNetworkOperationMode modeGuard(net, NetworkOperationMode::inferring);
+        net->StartEvaluateMinibatchLoop(node);
+        const auto& inputs = net->InputNodes(node);
+        ComputationNetwork::BumpEvalTimeStamp(vector<ComputationNodeBasePtr>(inputs.begin(), inputs.end()));
+        net->ForwardProp(node);
+        return ValueOf(node);
+    }
+
+    // one forward and backward pass; returns the output and criterion values followed by the gradients of the learnable
+    // parameters, or the values of those that are not learned, e.g. the running statistics of batch normalization
+    vector<vector<float>> Train()
+    {
+        ScopedNetworkOperationMode modeGuard(net, NetworkOperationMode::training);
+        net->StartEvaluateMinibatchLoop(vector<ComputationNodeBasePtr>{ criterion, output });
+        const auto& inputs = net->InputNodes(criterion);
+        ComputationNetwork::BumpEvalTimeStamp(vector<ComputationNodeBasePtr>(inputs.begin(), inputs.end()));
+        net->ForwardProp(criterion); // (through the nested network of the criterion, which runs tasks concurrently)
+        vector<vector<float>> result = { ValueOf(output), ValueOf(criterion) };
+        net->Backprop(criterion);
+        for (const auto& parameter : net->LearnableParameterNodes(criterion))
+            result.push_back(parameter->NeedsGradient() ? GradientOf(parameter) : ValueOf(parameter));
+        return result;
+    }
+
+    // the memory taken by the pooled value and gradient matrices of the nodes
+    size_t PooledMemorySize() const
+    {
+        set<const Matrix<float>*> matrices;
+        size_t size = 0;
+        for (const auto& node : net->GetAllNodes())
+        {
+            auto floatNode = dynamic_pointer_cast<ComputationNode<float>>(node);
+            if (node->IsLeaf() || !node->IsValueSharable())
+                continue;
+            for (const auto* matrix : { floatNode->ValuePtrRef().get(), floatNode->GradientPtrRef().get() })
+            {
+                if (matrix && matrices.insert(matrix).second)
+                    size += matrix->GetAllocatedSize();
+            }
+        }
+        return size;
+    }
+};
+
+static void CheckSameResults(const vector<vector<float>>& expected, const vector<vector<float>>& actual, float tolerance)
+{
+    BOOST_REQUIRE_EQUAL(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); i++)
+    {
+        BOOST_REQUIRE_EQUAL(expected[i].size(), actual[i].size());
+        BOOST_CHECK(AreEqual(expected[i].data(), actual[i].data(), expected[i].size(), tolerance));
+    }
+}
+
+// restores the global options that a test changes
+struct GlobalOptionsFixture
+{
+    bool m_shareNodeValueMatrices = Globals::ShouldEnableShareNodeValueMatrices();
+    int m_interOpThreads = Globals::GetInterOpThreads();
+    bool m_fuseElementwiseOps = Globals::ShouldFuseElementwiseOps();
+    bool m_hoistLoopInvariants = Globals::ShouldHoistLoopInvariants();
+    bool m_bucketMinibatchSizes = Globals::ShouldBucketMinibatchSizes();
+    ~GlobalOptionsFixture()
+    {
+        Globals::SetShareNodeValueMatrices(m_shareNodeValueMatrices);
+        Globals::SetInterOpThreads(m_interOpThreads);
+        Globals::SetElementwiseFusion(m_fuseElementwiseOps);
+        Globals::SetLoopInvariantHoisting(m_hoistLoopInvariants);
+        Globals::SetMinibatchSizeBucketing(m_bucketMinibatchSizes);
+    }
+};
+
+// Saves the network and loads it with the options that change the network turned off, and checks that the model has the
+// nodes of the plain network, with the parameters of the saved one.
+static void CheckSavedAsPlain(const ComputationNetworkPtr& saved, const ComputationNetworkPtr& plain)
+{
+    const wstring modelPath = L"NetworkOptimizationTests.model";
+    saved->Save(modelPath);
+    Globals::SetElementwiseFusion(false);
+    Globals::SetLoopInvariantHoisting(false);
+    auto loaded = make_shared<ComputationNetwork>(CPUDEVICE);
+    loaded->Load<float>(modelPath);
+    std::remove("NetworkOptimizationTests.model");
+    BOOST_REQUIRE_EQUAL(loaded->GetTotalNumberOfNodes(), plain->GetTotalNumberOfNodes());
+    for (const auto& node : plain->GetAllNodes())
+    {
+        auto loadedNode = loaded->GetNodeFromName(node->NodeName());
+        BOOST_CHECK(loadedNode->OperationName() == node->OperationName());
+        BOOST_REQUIRE_EQUAL(loadedNode->GetNumInputs(), node->GetNumInputs());
+        for (size_t i = 0; i < node->GetNumInputs(); i++)
+            BOOST_CHECK(loadedNode->Input(i)->NodeName() == node->Input(i)->NodeName());
+        if (node->OperationName() == L"LearnableParameter")
+            BOOST_CHECK(ValueOf(saved->GetNodeFromName(node->NodeName())) == ValueOf(loadedNode));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(NetworkOptimizationTestSuite)
+
+// A deep stack of layers, with a dropout node and a recurrent loop in the middle, which are never recomputed.
+static void BuildDeepNetwork(ComputationNetworkBuilder<float>& builder, TestNetwork& test)
+{
+    const size_t dim = 16;
+    auto x = builder.CreateInputNode(L"x", dim);
+    auto label = builder.CreateInputNode(L"label", dim);
+    FloatNodePtr h = x;
+    for (int i = 1; i <= 12; i++)
+    {
+        auto W = builder.CreateLearnableParameter(L"W" + to_wstring(i), dim, dim);
+        auto product = builder.Times(W, h, 1, L"product" + to_wstring(i));
+        h = i % 2 ? builder.Tanh(product, L"h" + to_wstring(i)) : builder.Sigmoid(product, L"h" + to_wstring(i));
+
+        if (i == 4)
+        {
+            h = builder.Dropout(h, L"dropout");
+            auto dropout = dynamic_pointer_cast<DropoutNode<float>>(h);
+            dropout->SetDropoutRate(0.5);
+            dropout->SetRngState(1234);
+        }
+        else if (i == 8)
+        {
+            // r = tanh(h + U * PastValue(r))
+            auto U = builder.CreateLearnableParameter(L"U", dim, dim);
+            auto previous = builder.PastValue(h, 0.0f, dim, 1, L"previous");
+            auto recurrence = builder.Tanh(builder.Plus(h, builder.Times(U, previous), L"recurrenceSum"), L"recurrence");
+            previous->AttachInputs({ recurrence });
+            h = recurrence;
+        }
+    }
+    test.output = h;
+    test.criterion = builder.SquareError(label, h, L"criterion");
+}
+
+BOOST_FIXTURE_TEST_CASE(ActivationCheckpointingGradients, GlobalOptionsFixture)
+{
+    Globals::SetShareNodeValueMatrices(true);
+    const size_t numSteps = 7;
+
+    TestNetwork plain(BuildDeepNetwork, numSteps);
+    plain.AllocateForTraining();
+    auto expected = plain.Train();
+
+    // automatic segments
+    TestNetwork automatic(BuildDeepNetwork, numSteps);
+    automatic.net->SetActivationCheckpointing(true);
+    automatic.AllocateForTraining();
+    CheckSameResults(expected, automatic.Train(), 1e-5f);
+    BOOST_CHECK_LT(automatic.PooledMemorySize(), plain.PooledMemorySize());
+
+    // named checkpoint nodes
+    TestNetwork named(BuildDeepNetwork, numSteps);
+    named.net->SetActivationCheckpointing(true, { L"h2", L"h6", L"h11" });
+    named.AllocateForTraining();
+    CheckSameResults(expected, named.Train(), 1e-5f);
+    BOOST_CHECK_LT(named.PooledMemorySize(), plain.PooledMemorySize());
+
+    // The next minibatch draws a new dropout mask, which is the same with and without recomputation.
+    CheckSameResults(plain.Train(), named.Train(), 1e-5f);
+}
+
+BOOST_FIXTURE_TEST_CASE(BFloat16CheckpointsGradients, GlobalOptionsFixture)
+{
+    Globals::SetShareNodeValueMatrices(true);
+    const size_t numSteps = 7;
+
+    TestNetwork plain(BuildDeepNetwork, numSteps);
+    plain.AllocateForTraining();
+    auto expected = plain.Train();
+
+    TestNetwork checkpointed(BuildDeepNetwork, numSteps);
+    checkpointed.net->SetActivationCheckpointing(true);
+    checkpointed.AllocateForTraining();
+    checkpointed.Train();
+
+    // The checkpoints are rounded to 8 bits of precision, which only perturbs the gradients below them.
+    TestNetwork rounded(BuildDeepNetwork, numSteps);
+    rounded.net->SetActivationCheckpointing(true, {}, /*bfloat16Checkpoints=*/true);
+    rounded.AllocateForTraining();
+    auto actual = rounded.Train();
+    CheckSameResults(expected, actual, 1e-2f);
+    BOOST_CHECK(expected[0] == actual[0] && expected[1] == actual[1]); // the output and criterion values are computed before
+    BOOST_CHECK(expected != actual);
+    BOOST_CHECK_LT(rounded.PooledMemorySize(), checkpointed.PooledMemorySize());
+}
+
+// Adds its inputs, and counts its forward props in its second input, with a read-modify-write that is slow enough
+// to lose counts if two such nodes that share the counter run at the same time.
+class CountingPlusNode : public PlusNode<float>
+{
+public:
+    CountingPlusNode(DEVICEID_TYPE deviceId, const wstring& name)
+        : PlusNode<float>(deviceId, name)
+    {
+    }
+
+    virtual void ForwardProp(const FrameRange& fr) override
+    {
+        PlusNode<float>::ForwardProp(fr);
+        auto& counter = Input(1)->Value();
+        float count = counter.Get00Element();
+        this_thread::sleep_for(chrono::milliseconds(10));
+        counter.SetValue(count + 1);
+    }
+
+    virtual bool ForwardPropUpdatesInput(size_t inputIndex) const override { return inputIndex == 1; }
+};
+
+// Independent branches that can run concurrently: two of them with batch normalization nodes that share their running
+// statistics, and two that share a counter which they update in place.
+static void BuildBranchyNetwork(ComputationNetworkBuilder<float>& builder, TestNetwork& test)
+{
+    const size_t dim = 16;
+    auto x = builder.CreateInputNode(L"x", dim);
+    auto label = builder.CreateInputNode(L"label", dim);
+    auto runMean = builder.CreateLearnableParameter(L"runMean", dim, 1);
+    auto runVariance = builder.CreateLearnableParameter(L"runVariance", dim, 1);
+    auto runCount = builder.CreateLearnableParameter(L"runCount", TensorShape(1));
+    auto counter = builder.CreateLearnableParameter(L"counter", TensorShape(1));
+    for (const auto& statistic : { runMean, runVariance, runCount, counter })
+        statistic->SetLearningRateMultiplier(0);
+
+    FloatNodePtr sum;
+    for (int i = 1; i <= 4; i++)
+    {
+        FloatNodePtr branch;
+        if (i <= 2)
+        {
+            auto scale = builder.CreateLearnableParameter(L"scale" + to_wstring(i), dim, 1);
+            auto bias = builder.CreateLearnableParameter(L"bias" + to_wstring(i), dim, 1);
+            branch = builder.Times(builder.CreateLearnableParameter(L"W" + to_wstring(i), dim, dim), x, 1, L"product" + to_wstring(i));
+            branch = builder.BatchNormalization(branch, scale, bias, runMean, runVariance, runCount, false, 100, 0, 1e-5, true, ImageLayoutKind::CHW, L"bn" + to_wstring(i));
+        }
+        else
+        {
+            // The counting nodes read x and keep their values to themselves, so that only the counter can order them.
+            auto counting = make_shared<CountingPlusNode>(CPUDEVICE, L"counting" + to_wstring(i));
+            test.net->AddNodeToNet(counting);
+            counting->AttachInputs({ x, counter });
+            static_pointer_cast<ComputationNodeBase>(counting)->MarkValueNonSharable();
+            branch = builder.Times(builder.CreateLearnableParameter(L"W" + to_wstring(i), dim, dim), counting, 1, L"product" + to_wstring(i));
+        }
+        branch = builder.Tanh(builder.Times(builder.CreateLearnableParameter(L"V" + to_wstring(i), dim, dim), builder.Sigmoid(branch)), L"branch" + to_wstring(i));
+        sum = sum ? builder.Plus(sum, branch) : branch;
+    }
+    test.output = sum;
+    test.criterion = builder.SquareError(label, sum, L"criterion");
+}
+
+BOOST_FIXTURE_TEST_CASE(InterOpParallelismMatchesSequential, GlobalOptionsFixture)
+{
+    Globals::SetShareNodeValueMatrices(true);
+    const size_t numSteps = 7;
+
+    Globals::SetInterOpThreads(1);
+    TestNetwork sequential(BuildBranchyNetwork, numSteps);
+    sequential.AllocateForTraining();
+
+    Globals::SetInterOpThreads(4);
+    TestNetwork concurrent(BuildBranchyNetwork, numSteps);
+    concurrent.AllocateForTraining();
+
+    // The running statistics and the counter are updated by two nodes in every minibatch.
+    auto counter = concurrent.net->GetNodeFromName(L"counter");
+    for (int minibatch = 0; minibatch < 3; minibatch++)
+    {
+        float count = ValueOf(counter)[0];
+        CheckSameResults(sequential.Train(), concurrent.Train(), 1e-5f);
+        BOOST_CHECK_EQUAL(ValueOf(counter)[0], count + 2);
+    }
+}
+
+// Layers with a bias and an activation, whose sums can be fused, and a sum with two consumers, which cannot.
+static void BuildLayerNetwork(ComputationNetworkBuilder<float>& builder, TestNetwork& test)
+{
+    const size_t dim = 16;
+    auto x = builder.CreateInputNode(L"x", dim);
+    auto label = builder.CreateInputNode(L"label", dim);
+    FloatNodePtr h = x;
+    for (int i = 1; i <= 3; i++)
+    {
+        auto W = builder.CreateLearnableParameter(L"W" + to_wstring(i), dim, dim);
+        auto b = builder.CreateLearnableParameter(L"b" + to_wstring(i), dim, 1);
+        auto z = builder.Plus(builder.Times(W, h, 1, L"product" + to_wstring(i)), b, L"z" + to_wstring(i));
+        auto name = L"h" + to_wstring(i);
+        h = i == 1 ? builder.RectifiedLinear(z, name) : i == 2 ? builder.Sigmoid(z, name) : builder.Tanh(z, name);
+    }
+    auto shared = builder.Plus(h, builder.CreateLearnableParameter(L"b4", dim, 1), L"z4");
+    auto output = builder.Plus(builder.Tanh(shared, L"h4"), shared, L"output");
+    test.output = output;
+    test.criterion = builder.SquareError(label, output, L"criterion");
+}
+
+BOOST_FIXTURE_TEST_CASE(ElementwiseFusionMatchesUnfused, GlobalOptionsFixture)
+{
+    Globals::SetShareNodeValueMatrices(true);
+    const size_t numSteps = 7;
+
+    // The sum z1 is requested as an output along with the network output. Having a consumer, it has to be in a node group.
+    Globals::SetElementwiseFusion(false);
+    TestNetwork plain([](ComputationNetworkBuilder<float>& builder, TestNetwork& test)
+    {
+        BuildLayerNetwork(builder, test);
+        test.net->AddToNodeGroup(L"output", test.net->GetNodeFromName(L"z1"));
+    }, numSteps);
+    auto plainSum = plain.net->GetNodeFromName(L"z1");
+    plain.net->AllocateAllMatrices(vector<ComputationNodeBasePtr>{ plain.output, plainSum }, {}, plain.criterion);
+
+    Globals::SetElementwiseFusion(true);
+    TestNetwork fused(BuildLayerNetwork, numSteps);
+    BOOST_CHECK(fused.net->GetNodeFromName(L"h1")->OperationName() == L"RectifiedLinearOfSum");
+    BOOST_CHECK(fused.net->GetNodeFromName(L"h2")->OperationName() == L"SigmoidOfSum");
+    BOOST_CHECK(fused.net->GetNodeFromName(L"h3")->OperationName() == L"TanhOfSum");
+    BOOST_CHECK(fused.net->GetNodeFromName(L"h4")->OperationName() == L"Tanh");
+    auto fusedSum = fused.net->GetNodeFromName(L"z1");
+    BOOST_CHECK(fusedSum->OperationName() == L"Plus");
+    fused.net->AllocateAllMatrices(vector<ComputationNodeBasePtr>{ fused.output, fusedSum }, {}, fused.criterion);
+
+    // Outputs and gradients are those of the unfused network; the fused sum that is requested by name is computed on its own.
+    for (int minibatch = 0; minibatch < 2; minibatch++)
+    {
+        CheckSameResults(plain.Train(), fused.Train(), 1e-5f);
+        CheckSameResults({ plain.Evaluate(plainSum) }, { fused.Evaluate(fusedSum) }, 1e-5f);
+    }
+
+    // The model has the unfused nodes, with the parameters of the fused network.
+    CheckSavedAsPlain(fused.net, plain.net);
+}
+
+// The sessions of the evaluation library are clones of the network that share its parameters, see IEvaluateModelExtended::CreateSession().
+BOOST_FIXTURE_TEST_CASE(CloneWithSharedParametersSharesValues, GlobalOptionsFixture)
+{
+    Globals::SetShareNodeValueMatrices(true);
+    Globals::SetInterOpThreads(4);
+    const size_t numSteps = 5;
+
+    TestNetwork original(BuildLayerNetwork, numSteps);
+    TestNetwork session = original;
+    session.net = original.net->CloneWithSharedParameters<float>();
+    session.criterion = session.net->GetNodeFromName(L"criterion");
+    session.output = session.net->GetNodeFromName(L"output");
+    session.SetInputs();
+    original.AllocateForInference({ original.output });
+    session.AllocateForInference({ session.output });
+
+    // The parameter values are the same matrix objects, the inputs are the session's own.
+    for (const auto& node : original.net->GetAllNodes())
+    {
+        auto sessionNode = session.net->GetNodeFromName(node->NodeName());
+        const auto& value = dynamic_pointer_cast<ComputationNode<float>>(node)->ValuePtrRef();
+        const auto& sessionValue = dynamic_pointer_cast<ComputationNode<float>>(sessionNode)->ValuePtrRef();
+        if (node->OperationName() == L"LearnableParameter")
+            BOOST_CHECK(sessionValue == value);
+        else if (node->OperationName() == L"InputValue")
+            BOOST_CHECK(sessionValue != value);
+    }
+
+    // Each network runs its nodes on an executor of its own, so that the two can evaluate at the same time.
+    vector<float> sessionOutput;
+    thread sessionThread([&]() { sessionOutput = session.Evaluate(session.output); });
+    auto output = original.Evaluate(original.output);
+    sessionThread.join();
+    BOOST_CHECK(sessionOutput == output);
+}
+
+typedef function<void(ComputationNetworkBuilder<float>&, TestNetwork&)> BuildFunction;
+
+// a batch normalization node with parameters and running statistics of its own
+static FloatNodePtr AddBatchNormalization(ComputationNetworkBuilder<float>& builder, const FloatNodePtr& input, size_t numChannels, bool spatial, const wstring& name)
+{
+    auto scale = builder.CreateLearnableParameter(name + L".scale", numChannels, 1);
+    auto shift = builder.CreateLearnableParameter(name + L".shift", numChannels, 1);
+    auto mean = builder.CreateLearnableParameter(name + L".mean", numChannels, 1);
+    auto variance = builder.CreateLearnableParameter(name + L".variance", numChannels, 1);
+    auto count = builder.CreateLearnableParameter(name + L".count", TensorShape(1));
+    return builder.BatchNormalization(input, scale, shift, mean, variance, count, spatial, 0, 0, 1e-5, true, ImageLayoutKind::CHW, name);
+}
+
+// x -> Times -> (bias Plus) -> batch normalization per element -> Tanh
+static void BuildDenseBatchNormalization(ComputationNetworkBuilder<float>& builder, TestNetwork& test, bool withBias)
+{
+    const size_t inputDim = 12, outputDim = 8;
+    auto x = builder.CreateInputNode(L"x", inputDim);
+    auto label = builder.CreateInputNode(L"label", outputDim);
+    FloatNodePtr h = builder.Times(builder.CreateLearnableParameter(L"W", outputDim, inputDim), x, 1, L"product");
+    if (withBias)
+        h = builder.Plus(h, builder.CreateLearnableParameter(L"b", outputDim, 1), L"sum");
+    h = AddBatchNormalization(builder, h, outputDim, /*spatial=*/false, L"bn");
+    auto output = builder.Tanh(h, L"output");
+    test.output = output;
+    test.criterion = builder.SquareError(label, output, L"criterion");
+}
+
+// image x -> Convolution in the CHW layout -> (bias Plus) -> batch normalization per channel -> Tanh
+static void BuildConvolutionBatchNormalization(ComputationNetworkBuilder<float>& builder, TestNetwork& test, bool withBias)
+{
+    const size_t width = 5, height = 4, inputChannels = 2, outputChannels = 3;
+    auto x = builder.CreateInputNode(L"x", TensorShape(width, height, inputChannels));
+    auto label = builder.CreateInputNode(L"label", TensorShape(width, height, outputChannels));
+    auto W = builder.CreateLearnableParameter(L"W", TensorShape(3, 3, inputChannels, outputChannels));
+    FloatNodePtr h = builder.Convolution(W, x, TensorShape(3, 3, inputChannels), TensorShape(outputChannels), TensorShape(1, 1, inputChannels),
+                                         vector<bool>{ true }, vector<bool>{ true, true, false }, TensorShape(0), TensorShape(0),
+                                         /*transpose=*/false, TensorShape(), ImageLayoutKind::CHW, 0, L"convolution");
+    if (withBias)
+        h = builder.Plus(h, builder.CreateLearnableParameter(L"b", TensorShape(1, 1, outputChannels)), L"sum");
+    h = AddBatchNormalization(builder, h, outputChannels, /*spatial=*/true, L"bn");
+    auto output = builder.Tanh(h, L"output");
+    test.output = output;
+    test.criterion = builder.SquareError(label, output, L"criterion");
+}
+
+// Times(Transpose(W), x) scaled by the product of two parameters, then another product with a transposed weight and
+// batch normalization
+static void BuildConstantNetwork(ComputationNetworkBuilder<float>& builder, TestNetwork& test)
+{
+    const size_t inputDim = 12, outputDim = 8;
+    auto x = builder.CreateInputNode(L"x", inputDim);
+    auto label = builder.CreateInputNode(L"label", outputDim);
+    auto transposed = builder.TransposeDimensions(builder.CreateLearnableParameter(L"W", inputDim, outputDim), 1, 2, L"transposed");
+    auto scale = builder.ElementTimes(builder.CreateLearnableParameter(L"s1", outputDim, 1), builder.CreateLearnableParameter(L"s2", outputDim, 1), L"scale");
+    auto h = builder.ElementTimes(builder.Times(transposed, x, 1, L"product"), scale, L"scaled");
+    auto transposed2 = builder.TransposeDimensions(builder.CreateLearnableParameter(L"V", outputDim, outputDim), 1, 2, L"transposed2");
+    auto output = builder.Tanh(AddBatchNormalization(builder, builder.Times(transposed2, h, 1, L"product2"), outputDim, false, L"bn"), L"output");
+    test.output = output;
+    test.criterion = builder.SquareError(label, output, L"criterion");
+}
+
+// The weight of the product before the batch normalization is also used by another product.
+static void BuildSharedWeightNetwork(ComputationNetworkBuilder<float>& builder, TestNetwork& test)
+{
+    const size_t dim = 8;
+    auto x = builder.CreateInputNode(L"x", dim);
+    auto label = builder.CreateInputNode(L"label", dim);
+    auto W = builder.CreateLearnableParameter(L"W", dim, dim);
+    auto normalized = AddBatchNormalization(builder, builder.Times(W, x, 1, L"product"), dim, false, L"bn");
+    auto output = builder.Plus(builder.Tanh(normalized), builder.Times(W, builder.Sigmoid(x), 1, L"product2"), L"output");
+    test.output = output;
+    test.criterion = builder.SquareError(label, output, L"criterion");
+}
+
+// Optimizes a network for inference and checks that its output, and the values of the named nodes, are those of the
+// network as it was. Returns the optimized network.
+static TestNetwork CheckOptimizeForInference(const BuildFunction& build, const vector<wstring>& names = {})
+{
+    const size_t numSteps = 5;
+    TestNetwork plain(build, numSteps), optimized(build, numSteps);
+    for (auto* test : { &plain, &optimized })
+    {
+        // running statistics as after training, with a positive variance
+        for (const auto& node : test->net->GetNodesWithType(L"BatchNormalization"))
+        {
+            auto& variance = dynamic_pointer_cast<ComputationNode<float>>(node->Input(4))->Value();
+            auto values = ValueOf(node->Input(4));
+            for (auto& value : values)
+                value = fabs(value) + 0.5f;
+            variance.SetValue(variance.GetNumRows(), variance.GetNumCols(), CPUDEVICE, values.data());
+            dynamic_pointer_cast<ComputationNode<float>>(node->Input(5))->Value().SetValue(100);
+        }
+    }
+    optimized.net->OptimizeForInference<float>();
+    optimized.SetInputs();
+
+    vector<ComputationNodeBasePtr> plainNodes = { plain.output }, optimizedNodes = { optimized.output };
+    for (const auto& name : names)
+    {
+        plainNodes.push_back(plain.net->GetNodeFromName(name));
+        optimizedNodes.push_back(optimized.net->GetNodeFromName(name));
+    }
+    plain.AllocateForInference(plainNodes);
+    optimized.AllocateForInference(optimizedNodes);
+    for (size_t i = 0; i < plainNodes.size(); i++)
+        CheckSameResults({ plain.Evaluate(plainNodes[i]) }, { optimized.Evaluate(optimizedNodes[i]) }, 1e-4f);
+    return optimized;
+}
+
+static wstring OperationOf(const TestNetwork& test, const wstring& name)
+{
+    return test.net->GetNodeFromName(name)->OperationName();
+}
+
+BOOST_AUTO_TEST_CASE(OptimizeForInferenceFoldsBatchNormalization)
+{
+    // Times, bias and batch normalization per element: the batch normalization becomes the bias of the scaled weights
+    auto dense = CheckOptimizeForInference([](ComputationNetworkBuilder<float>& builder, TestNetwork& test) { BuildDenseBatchNormalization(builder, test, true); });
+    BOOST_CHECK(dense.net->GetNodesWithType(L"BatchNormalization").empty());
+    BOOST_CHECK(OperationOf(dense, L"bn") == L"Plus");
+    BOOST_CHECK(dense.net->GetNodeFromName(L"bn")->Input(0)->NodeName() == L"product");
+    BOOST_CHECK(!dense.net->NodeNameExists(L"sum"));
+    BOOST_CHECK(!dense.net->NodeNameExists(L"b"));
+
+    // without a bias
+    dense = CheckOptimizeForInference([](ComputationNetworkBuilder<float>& builder, TestNetwork& test) { BuildDenseBatchNormalization(builder, test, false); });
+    BOOST_CHECK(OperationOf(dense, L"bn") == L"Plus");
+
+    // Convolution in the CHW layout and batch normalization per channel, with and without a bias
+    for (bool withBias : { true, false })
+    {
+        auto convolution = CheckOptimizeForInference([withBias](ComputationNetworkBuilder<float>& builder, TestNetwork& test)
+        {
+            BuildConvolutionBatchNormalization(builder, test, withBias);
+        });
+        BOOST_CHECK(OperationOf(convolution, L"bn") == L"Plus");
+        BOOST_CHECK(convolution.net->GetNodeFromName(L"bn")->Input(0)->NodeName() == L"convolution");
+    }
+
+    // A batch normalization that is in a node group is folded, and the Plus that replaces it computes its value.
+    dense = CheckOptimizeForInference([](ComputationNetworkBuilder<float>& builder, TestNetwork& test)
+    {
+        BuildDenseBatchNormalization(builder, test, true);
+        test.net->AddToNodeGroup(L"output", test.net->GetNodeFromName(L"bn"));
+    }, { L"bn" });
+    BOOST_CHECK(OperationOf(dense, L"bn") == L"Plus");
+}
+
+BOOST_AUTO_TEST_CASE(OptimizeForInferenceFoldsConstants)
+{
+    // The transposed weights and the product of the two parameters are computed once, and the second transposed weight,
+    // now a parameter, takes the batch normalization.
+    auto folded = CheckOptimizeForInference(BuildConstantNetwork);
+    for (const auto& name : { L"transposed", L"scale", L"transposed2" })
+        BOOST_CHECK(OperationOf(folded, name) == L"LearnableParameter");
+    for (const auto& name : { L"W", L"s1", L"s2", L"V" })
+        BOOST_CHECK(!folded.net->NodeNameExists(name));
+    BOOST_CHECK(OperationOf(folded, L"bn") == L"Plus");
+}
+
+BOOST_AUTO_TEST_CASE(OptimizeForInferenceKeepsSharedValues)
+{
+    // The weight is shared with another product, whose value would change with it.
+    auto shared = CheckOptimizeForInference(BuildSharedWeightNetwork);
+    BOOST_CHECK(OperationOf(shared, L"bn") == L"BatchNormalization");
+
+    // The product is in a node group, so its value has to stay what it is.
+    shared = CheckOptimizeForInference([](ComputationNetworkBuilder<float>& builder, TestNetwork& test)
+    {
+        BuildDenseBatchNormalization(builder, test, false);
+        test.net->AddToNodeGroup(L"output", test.net->GetNodeFromName(L"product"));
+    }, { L"product" });
+    BOOST_CHECK(OperationOf(shared, L"bn") == L"BatchNormalization");
+}
+
+// h = Tanh(W * [x; PastValue(h)] + b), with the input and the state projected by one product, as in LSTMs
+static void BuildRecurrentNetwork(ComputationNetworkBuilder<float>& builder, TestNetwork& test)
+{
+    const size_t inputDim = 6, dim = 8;
+    auto x = builder.CreateInputNode(L"x", inputDim);
+    auto label = builder.CreateInputNode(L"label", dim);
+    auto W = builder.CreateLearnableParameter(L"W", dim, inputDim + dim);
+    auto previous = builder.PastValue(label, 0.0f, dim, 1, L"previous");
+    auto product = builder.Times(W, builder.RowStack({ x, previous }, L"stack"), 1, L"product");
+    auto h = builder.Tanh(builder.Plus(product, builder.CreateLearnableParameter(L"b", dim, 1), L"sum"), L"h");
+    previous->AttachInputs({ h });
+    test.output = h;
+    test.criterion = builder.SquareError(label, h, L"criterion");
+}
+
+BOOST_FIXTURE_TEST_CASE(LoopInvariantHoistingMatchesUnsplit, GlobalOptionsFixture)
+{
+    Globals::SetShareNodeValueMatrices(true);
+    const size_t numSteps = 7;
+
+    Globals::SetLoopInvariantHoisting(false);
+    TestNetwork plain(BuildRecurrentNetwork, numSteps);
+    plain.AllocateForTraining();
+
+    // The product becomes the sum of the product with the input, outside the loop, and the one with the state, inside.
+    Globals::SetLoopInvariantHoisting(true);
+    TestNetwork hoisted(BuildRecurrentNetwork, numSteps);
+    BOOST_CHECK(OperationOf(hoisted, L"product") == L"Plus");
+    BOOST_CHECK(!hoisted.net->NodeNameExists(L"stack"));
+    BOOST_CHECK(!hoisted.net->GetNodeFromName(L"product.product.0")->IsPartOfLoop());
+    BOOST_CHECK(hoisted.net->GetNodeFromName(L"product.product.1")->IsPartOfLoop());
+    hoisted.AllocateForTraining();
+
+    // The outputs and the gradients of W, which now comes from the two slices, are those of the unsplit product.
+    for (int minibatch = 0; minibatch < 2; minibatch++)
+        CheckSameResults(plain.Train(), hoisted.Train(), 1e-5f);
+
+    // The model has the unsplit product.
+    CheckSavedAsPlain(hoisted.net, plain.net);
+}
+
+BOOST_FIXTURE_TEST_CASE(NodeProfilerTimesEveryNode, GlobalOptionsFixture)
+{
+    const size_t numMinibatches = 2;
+    const size_t numSteps = 5;
+    TestNetwork test(BuildDeepNetwork, numSteps);
+    test.AllocateForTraining();
+    test.net->EnableNodeProfiler(L"NodeProfilerTimesEveryNode", numMinibatches);
+    auto& profiler = *test.net->Environment().nodeProfiler;
+
+    // the reports are written when the minibatch after the last one starts
+    for (size_t minibatch = 0; minibatch <= numMinibatches; minibatch++)
+        test.Train();
+    BOOST_CHECK(!profiler.IsActive());
+    BOOST_CHECK(ifstream("NodeProfilerTimesEveryNode.txt").good());
+    BOOST_CHECK(ifstream("NodeProfilerTimesEveryNode.json").good());
+
+    // Each node is one call per phase and minibatch, also those of the recurrent loop, whose Backprop() continues in
+    // EndBackprop() into the inputs outside the loop.
+    size_t numLoopNodes = 0;
+    for (const auto& node : test.net->GetAllNodes())
+    {
+        if (node->IsLeaf())
+            continue;
+        const auto& name = node->NodeName();
+        numLoopNodes += node->IsPartOfLoop();
+        BOOST_CHECK_EQUAL(profiler.NumCalls(name, NodeProfiler::Phase::forward), numMinibatches);
+        BOOST_CHECK_EQUAL(profiler.NumCalls(name, NodeProfiler::Phase::backward), numMinibatches);
+        BOOST_CHECK(profiler.Time(name, NodeProfiler::Phase::forward) > NodeProfiler::Clock::duration::zero());
+        BOOST_CHECK(profiler.Time(name, NodeProfiler::Phase::backward) > NodeProfiler::Clock::duration::zero());
+    }
+    BOOST_CHECK_EQUAL(numLoopNodes, 4);
+
+    // and only once
+    remove("NodeProfilerTimesEveryNode.txt");
+    remove("NodeProfilerTimesEveryNode.json");
+    test.Train();
+    test.net->Environment().nodeProfiler.reset();
+    BOOST_CHECK(!ifstream("NodeProfilerTimesEveryNode.txt").good());
+    BOOST_CHECK(!ifstream("NodeProfilerTimesEveryNode.json").good());
+}
+
+// a = Tanh(W * x), output = Sigmoid(V * a), with V the same parameter as W unless 'separate'
+static void BuildTwiceUsedWeightNetwork(ComputationNetworkBuilder<float>& builder, TestNetwork& test, bool separate)
+{
+    const size_t dim = 6;
+    auto x = builder.CreateInputNode(L"x", dim);
+    auto label = builder.CreateInputNode(L"label", dim);
+    auto W = builder.CreateLearnableParameter(separate ? L"W1" : L"W", dim, dim);
+    auto V = separate ? builder.CreateLearnableParameter(L"W2", dim, dim) : W;
+    auto a = builder.Tanh(builder.Times(W, x, 1, L"product"), L"a");
+    auto output = builder.Sigmoid(builder.Times(V, a, 1, L"product2"), L"output");
+    test.output = output;
+    test.criterion = builder.SquareError(label, output, L"criterion");
+}
+
+// SGD updates, and keeps the smoothed gradient and the checkpoint entry of, each listed learnable parameter. A parameter
+// with several consumers is listed once, and its gradient is the sum of those it gets from each of them.
+BOOST_FIXTURE_TEST_CASE(SharedParameterIsListedOnce, GlobalOptionsFixture)
+{
+    const size_t numSteps = 4;
+    TestNetwork shared([](ComputationNetworkBuilder<float>& builder, TestNetwork& test) { BuildTwiceUsedWeightNetwork(builder, test, false); }, numSteps);
+    TestNetwork separate([](ComputationNetworkBuilder<float>& builder, TestNetwork& test) { BuildTwiceUsedWeightNetwork(builder, test, true); }, numSteps);
+    auto W = dynamic_pointer_cast<ComputationNode<float>>(shared.net->GetNodeFromName(L"W"));
+    auto W1 = dynamic_pointer_cast<ComputationNode<float>>(separate.net->GetNodeFromName(L"W1"));
+    auto W2 = dynamic_pointer_cast<ComputationNode<float>>(separate.net->GetNodeFromName(L"W2"));
+    W2->Value().SetValue(W1->Value());
+    separate.inputSeed = shared.inputSeed;
+    separate.SetInputs();
+    shared.AllocateForTraining();
+    separate.AllocateForTraining();
+
+    const auto& parameters = shared.net->LearnableParameterNodes(shared.criterion);
+    BOOST_REQUIRE_EQUAL(parameters.size(), 1);
+    BOOST_CHECK(parameters.front() == W);
+
+    auto expected = separate.Train();
+    auto actual = shared.Train();
+    BOOST_REQUIRE_EQUAL(expected.size(), 4);
+    BOOST_REQUIRE_EQUAL(actual.size(), 3);
+    CheckSameResults({ expected[0], expected[1] }, { actual[0], actual[1] }, 1e-6f);
+    vector<float> sum(expected[2].size());
+    for (size_t i = 0; i < sum.size(); i++)
+        sum[i] = expected[2][i] + expected[3][i];
+    CheckSameResults({ sum }, { actual[2] }, 1e-5f);
+
+    // the update of SGD without momentum, which is applied once
+    const float learningRate = 0.1f;
+    auto initial = ValueOf(W);
+    for (const auto& parameter : parameters)
+    {
+        auto node = dynamic_pointer_cast<ComputationNode<float>>(parameter);
+        Matrix<float>::ScaleAndAdd(-learningRate, node->Gradient(), node->Value());
+    }
+    vector<float> updated(initial.size());
+    for (size_t i = 0; i < updated.size(); i++)
+        updated[i] = initial[i] - learningRate * sum[i];
+    CheckSameResults({ updated }, { ValueOf(W) }, 1e-5f);
+}
+
+BOOST_FIXTURE_TEST_CASE(MinibatchSizeBucketingReusesAllocations, GlobalOptionsFixture)
+{
+    // each node has a value matrix of its own
+    Globals::SetShareNodeValueMatrices(false);
+
+    Globals::SetMinibatchSizeBucketing(false);
+    TestNetwork plain(BuildLayerNetwork, 1);
+    plain.AllocateForInference({ plain.output });
+
+    Globals::SetMinibatchSizeBucketing(true);
+    TestNetwork bucketed(BuildLayerNetwork, 1);
+    bucketed.AllocateForInference({ bucketed.output });
+    auto node = dynamic_pointer_cast<ComputationNode<float>>(bucketed.net->GetNodeFromName(L"h1"));
+    size_t numRows = node->GetSampleLayout().GetNumElements();
+
+    // (number of time steps, number of them allocated for)
+    // The allocation grows to the next power of two, and the shorter minibatches that follow reuse it.
+    const vector<pair<size_t, size_t>> minibatches = { { 5, 8 }, { 3, 8 }, { 8, 8 }, { 1, 8 }, { 9, 16 }, { 6, 16 } };
+    const float* data = nullptr;
+    size_t allocatedSteps = 0;
+    for (const auto& minibatch : minibatches)
+    {
+        plain.numSteps = bucketed.numSteps = minibatch.first;
+        plain.SetInputs();
+        bucketed.SetInputs();
+        BOOST_CHECK(plain.Evaluate(plain.output) == bucketed.Evaluate(bucketed.output));
+
+        // The value has the exact number of columns of the minibatch.
+        const auto& value = node->Value();
+        BOOST_CHECK_EQUAL(value.GetNumCols(), minibatch.first);
+        BOOST_CHECK_EQUAL(value.GetAllocatedSize(), numRows * minibatch.second);
+        if (minibatch.second == allocatedSteps)
+            BOOST_CHECK(value.Data() == data);
+        data = value.Data();
+        allocatedSteps = minibatch.second;
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} } } }
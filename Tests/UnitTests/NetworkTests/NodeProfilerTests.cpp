@@ -0,0 +1,65 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include "NodeProfiler.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+using namespace Microsoft::MSR::CNTK;
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+BOOST_AUTO_TEST_SUITE(NodeProfilerTests)
+
+static std::string ReadFile(const char* path)
+{
+    std::ifstream f(path);
+    std::stringstream s;
+    s << f.rdbuf();
+    return s.str();
+}
+
+BOOST_AUTO_TEST_CASE(AggregatesAndWritesReportsAfterTheLastMinibatch)
+{
+    typedef NodeProfiler::Clock Clock;
+    auto ms = [](int n) { return std::chrono::duration_cast<Clock::duration>(std::chrono::milliseconds(n)); };
+    {
+        NodeProfiler profiler(L"NodeProfilerTests", 2);
+        BOOST_CHECK(!profiler.IsActive());
+        auto start = Clock::now();
+        for (int minibatch = 0; minibatch < 2; minibatch++)
+        {
+            profiler.BeginMinibatch();
+            BOOST_CHECK(profiler.IsActive());
+            profiler.Record(L"W*x", L"Times", NodeProfiler::Phase::forward, start, ms(3), 1024 * 1024, 4 * 1024 * 1024);
+            profiler.Record(L"W*x", L"Times", NodeProfiler::Phase::backward, start, ms(5), 1024 * 1024, 2 * 1024 * 1024);
+            profiler.Record(L"h", L"Sigmoid", NodeProfiler::Phase::forward, start, ms(1), 0, 0, /*trace=*/false);
+            profiler.Record(L"\"quoted\"", L"Sigmoid", NodeProfiler::Phase::forward, start, ms(1), 0, 0);
+        }
+
+        // per minibatch, sorted by time, with the peak memory
+        auto table = profiler.FormatTable();
+        BOOST_CHECK(table.find("over 2 minibatches: 10.000 ms per minibatch in 3 nodes") != std::string::npos);
+        BOOST_CHECK(table.find("2.000        0.000    20.00     2.0        0.000      0.000  Sigmoid (2 nodes)") != std::string::npos);
+        BOOST_CHECK(table.find("3.000        5.000    80.00     2.0        2.000      4.000  W*x (Times)") != std::string::npos);
+        BOOST_CHECK_LT(table.find("W*x (Times)"), table.find("h (Sigmoid)"));
+
+        // the reports are written when the next minibatch would start
+        profiler.BeginMinibatch();
+        BOOST_CHECK(!profiler.IsActive());
+    }
+    BOOST_CHECK(ReadFile("NodeProfilerTests.txt").find("W*x (Times)") != std::string::npos);
+    auto trace = ReadFile("NodeProfilerTests.json");
+    BOOST_CHECK(trace.find("{\"name\":\"W*x\",\"cat\":\"backward\",\"ph\":\"X\"") != std::string::npos);
+    BOOST_CHECK(trace.find("\"name\":\"\\\"quoted\\\"\"") != std::string::npos);
+    BOOST_CHECK(trace.find("\"name\":\"h\"") == std::string::npos);
+    std::remove("NodeProfilerTests.txt");
+    std::remove("NodeProfilerTests.json");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} } } }
@@ -0,0 +1,106 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include "TaskGraphExecutor.h"
+#include "CPUMatrix.h"
+#include "CPUThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+using namespace Microsoft::MSR::CNTK;
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+BOOST_AUTO_TEST_SUITE(TaskGraphExecutorTests)
+
+// task 0 fans out to 'width' chains of length 'length' that join in the last task
+static TaskGraph BranchesGraph(size_t width, size_t length)
+{
+    TaskGraph graph;
+    graph.resize(2 + width * length);
+    size_t last = graph.size() - 1;
+    for (size_t b = 0; b < width; b++)
+    {
+        size_t previous = 0;
+        for (size_t i = 0; i < length; i++)
+        {
+            size_t task = 1 + b * length + i;
+            graph.AddDependency(previous, task);
+            previous = task;
+        }
+        graph.AddDependency(previous, last);
+    }
+    return graph;
+}
+
+BOOST_AUTO_TEST_CASE(RunsEachTaskOnceAfterItsPredecessors)
+{
+    TaskGraph graph = BranchesGraph(/*width=*/8, /*length=*/5);
+    graph.AddDependency(0, 1); // duplicates are ignored
+    BOOST_CHECK_EQUAL(graph.numPredecessors[1], 1);
+    BOOST_CHECK_EQUAL(graph.numPredecessors[graph.size() - 1], 8);
+
+    TaskGraphExecutor executor(4);
+    for (int run = 0; run < 20; run++)
+    {
+        std::atomic<size_t> clock(0);
+        std::vector<size_t> finished(graph.size(), SIZE_MAX);
+        std::vector<std::atomic<int>> calls(graph.size());
+        for (auto& c : calls)
+            c = 0;
+
+        executor.Run(graph, [&](size_t task)
+        {
+            calls[task]++;
+            finished[task] = clock++;
+        });
+
+        for (size_t task = 0; task < graph.size(); task++)
+        {
+            BOOST_CHECK_EQUAL(calls[task], 1);
+            for (size_t successor : graph.successors[task])
+                BOOST_CHECK_LT(finished[task], finished[successor]);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(RethrowsAndSkipsTheRest)
+{
+    TaskGraph graph = BranchesGraph(/*width=*/1, /*length=*/3); // a single chain 0 -> 1 -> 2 -> 3 -> 4
+    TaskGraphExecutor executor(2);
+    std::vector<int> ran(graph.size(), 0);
+    BOOST_CHECK_THROW(executor.Run(graph, [&](size_t task)
+    {
+        ran[task] = 1;
+        if (task == 2)
+            throw std::runtime_error("task failed");
+    }), std::runtime_error);
+    BOOST_CHECK_EQUAL(ran[1], 1);
+    BOOST_CHECK_EQUAL(ran[3], 0);
+    BOOST_CHECK_EQUAL(ran[4], 0);
+
+    // the executor is usable after a failed run
+    size_t count = 0;
+    executor.Run(graph, [&](size_t) { count++; });
+    BOOST_CHECK_EQUAL(count, graph.size());
+}
+
+// the kernels of the workers run on their share of the threads, and the calling thread gets all of them back afterwards
+BOOST_AUTO_TEST_CASE(WorkersShareTheKernelThreads)
+{
+    const int numKernelThreads = CPUThreadPool::Instance().NumThreads();
+    TaskGraphExecutor executor(2);
+    TaskGraph graph = BranchesGraph(/*width=*/4, /*length=*/2);
+    std::vector<int> seen(graph.size());
+    executor.Run(graph, [&](size_t i) { seen[i] = CPUMatrix<float>::GetMaxNumThreads(); });
+    for (int numThreads : seen)
+        BOOST_CHECK_EQUAL(numThreads, std::max(1, numKernelThreads / 2));
+    BOOST_CHECK_EQUAL(CPUMatrix<float>::GetMaxNumThreads(), numKernelThreads);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} } } }
@@ -0,0 +1,123 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#include "stdafx.h"
+
+#include "../../../Source/ComputationNetworkLib/LinearAlgebraNodes.h"
+#include "ComputationNetwork.h"
+#include "ComputationNetworkBuilder.h"
+#include "TestHelpers.h"
+#include <memory>
+#include <random>
+
+using namespace Microsoft::MSR::CNTK;
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// Extends the times node to tell whether it computes the product in fixed point.
+template <class ElemType>
+class TimesNodeTest : public TimesNode<ElemType>
+{
+public:
+    TimesNodeTest(DEVICEID_TYPE deviceId, const wstring& name)
+        : TimesNode<ElemType>(deviceId, name)
+    {
+    }
+
+    bool IsQuantized() const
+    {
+        return this->m_pQuantizedMultiplier != nullptr;
+    }
+};
+
+static vector<float> RandomValues(size_t count, unsigned int seed)
+{
+    mt19937 rng(seed);
+    uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+    vector<float> values(count);
+    for (auto& value : values)
+        value = distribution(rng);
+    return values;
+}
+
+// product of the column-major matrices a [m x k] and b [k x n]
+static vector<float> Product(const vector<float>& a, const vector<float>& b, size_t m, size_t k, size_t n)
+{
+    vector<float> c(m * n, 0.0f);
+    for (size_t j = 0; j < n; j++)
+        for (size_t l = 0; l < k; l++)
+            for (size_t i = 0; i < m; i++)
+                c[i + j * m] += a[i + l * m] * b[l + j * k];
+    return c;
+}
+
+BOOST_AUTO_TEST_SUITE(TimesNodeTestSuite)
+
+BOOST_AUTO_TEST_CASE(QuantizedTimesInInference)
+{
+    const size_t outputDim = 16, inputDim = 64, numSamples = 5;
+
+    auto net = make_shared<ComputationNetwork>(CPUDEVICE);
+    ComputationNetworkBuilder<float> builder(*net);
+    auto x = builder.CreateInputNode(L"x", inputDim);
+    auto W = builder.CreateLearnableParameter(L"W", outputDim, inputDim);
+    auto times = make_shared<TimesNodeTest<float>>(CPUDEVICE, L"Wx");
+    ComputationNodeBasePtr root = times;
+    net->AddNodeToNet(root);
+    times->AttachInputs({ W, x });
+    net->AddToNodeGroup(L"output", root);
+    net->CompileNetwork();
+    net->AllocateAllMatrices(vector<ComputationNodeBasePtr>{ root }, {}, nullptr);
+    net->SetQuantizeTimes(true);
+
+    auto layout = net->GetMBLayoutPtrOfNetwork();
+    layout->Init(1, numSamples);
+    layout->AddSequence(0, 0, 0, numSamples);
+    auto xValues = RandomValues(inputDim * numSamples, 1);
+    x->Value().SetValue(inputDim, numSamples, CPUDEVICE, xValues.data());
+
+    auto evaluate = [&](NetworkOperationMode mode, const vector<float>& weights) -> vector<float>
+    {
+        W->Value().SetValue(outputDim, inputDim, CPUDEVICE, const_cast<float*>(weights.data()));
+        ScopedNetworkOperationMode modeGuard(net, mode);
+        net->StartEvaluateMinibatchLoop(root);
+        ComputationNetwork::BumpEvalTimeStamp(vector<ComputationNodeBasePtr>{ x, W });
+        net->ForwardProp(root);
+        BOOST_REQUIRE_EQUAL(times->Value().GetNumElements(), outputDim * numSamples);
+        const float* output = times->Value().Data();
+        return vector<float>(output, output + outputDim * numSamples);
+    };
+
+    // In inference the product is computed in fixed point, close to the float product.
+    auto weights = RandomValues(outputDim * inputDim, 2);
+    auto expected = Product(weights, xValues, outputDim, inputDim, numSamples);
+    auto actual = evaluate(NetworkOperationMode::inferring, weights);
+    BOOST_REQUIRE(times->IsQuantized());
+    BOOST_REQUIRE(AreEqual(expected.data(), actual.data(), expected.size(), 0.005f));
+
+    // Leaving inference drops the multiplier with the quantized weights, e.g. for training or cross-validation,
+    // and computes the exact product.
+    weights = RandomValues(outputDim * inputDim, 3);
+    expected = Product(weights, xValues, outputDim, inputDim, numSamples);
+    actual = evaluate(NetworkOperationMode::training, weights);
+    BOOST_REQUIRE(!times->IsQuantized());
+    BOOST_REQUIRE(AreEqual(expected.data(), actual.data(), expected.size(), 1e-4f));
+
+    // Back in inference, the updated weights are quantized again.
+    actual = evaluate(NetworkOperationMode::inferring, weights);
+    BOOST_REQUIRE(times->IsQuantized());
+    BOOST_REQUIRE(AreEqual(expected.data(), actual.data(), expected.size(), 0.005f));
+
+    // Without the option, inference computes the exact product.
+    net->SetQuantizeTimes(false);
+    actual = evaluate(NetworkOperationMode::inferring, weights);
+    BOOST_REQUIRE(!times->IsQuantized());
+    BOOST_REQUIRE(AreEqual(expected.data(), actual.data(), expected.size(), 1e-4f));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+} } } }
@@ -17,6 +17,27 @@ struct CNTKBinaryReaderFixture : ReaderFixture
         : ReaderFixture("/Data/CNTKBinaryReader/")
     {
     }
+
+    // Runs the converter of the binary reader plugin on the 'convert' section of the given test section,
+    // the same way as the convertToBinary action does.
+    void ConvertToBinary(const string& configFileName, const string& testSectionName)
+    {
+        typedef void (*ConvertToBinaryProc)(const ConfigParameters* config);
+
+        std::wstring configFileCommand(L"configFile=" + std::wstring(configFileName.begin(), configFileName.end()));
+        std::wstring cntk(L"CNTK");
+        std::vector<wchar_t*> arg{ &cntk[0], &configFileCommand[0] };
+        ConfigParameters config;
+        const std::string rawConfigString = ConfigParameters::ParseCommandLine((int)arg.size(), &arg[0], config);
+        config.ResolveVariables(rawConfigString);
+        const ConfigParameters testConfig = config(testSectionName);
+        ConfigParameters convertConfig = testConfig("convert");
+        convertConfig.Insert("precision", testConfig("precision"));
+
+        Plugin plugin;
+        auto convert = (ConvertToBinaryProc)plugin.Load(std::string("Cntk.Deserializers.Binary"), "ConvertToCNTKBinaryFormat");
+        convert(&convertConfig);
+    }
 };
 
 BOOST_FIXTURE_TEST_SUITE(ReaderTestSuite, CNTKBinaryReaderFixture)
@@ -39,6 +60,63 @@ BOOST_AUTO_TEST_CASE(CNTKBinaryReader_Simple_dense)
         1);
 };
 
+BOOST_AUTO_TEST_CASE(CNTKBinaryReader_Simple_dense_v2)
+{
+    HelperRunReaderTest<float>(
+        testDataPath() + "/Config/CNTKBinaryReader/test.cntk",
+        testDataPath() + "/Control/CNTKTextFormatReader/Simple_dense.txt",
+        testDataPath() + "/Control/CNTKBinaryReader/Simple_dense_v2_Output.txt",
+        "Simple_v2",
+        "reader",
+        1000, // epoch size
+        250,  // mb size
+        10,   // num epochs 
+        1,
+        1,
+        0,
+        1);
+};
+
+// Reads only the labels of a version 2 file, which skips the blocks of the features on disk.
+BOOST_AUTO_TEST_CASE(CNTKBinaryReader_Simple_dense_v2_selected_streams)
+{
+    HelperRunReaderTest<float>(
+        testDataPath() + "/Config/CNTKBinaryReader/test.cntk",
+        testDataPath() + "/Control/CNTKBinaryReader/Simple_dense_labels.txt",
+        testDataPath() + "/Control/CNTKBinaryReader/Simple_dense_labels_Output.txt",
+        "Simple_v2_labels_only",
+        "reader",
+        1000, // epoch size
+        250,  // mb size
+        1,    // num epochs
+        0,    // no features
+        1,
+        0,
+        1);
+};
+
+// Converts the text format version of Simple_dense.bin and reads it back.
+BOOST_AUTO_TEST_CASE(CNTKBinaryReader_Simple_dense_converted)
+{
+    boost::filesystem::remove("Simple_dense_converted.bin");
+    BOOST_SCOPE_EXIT(void) { boost::filesystem::remove("Simple_dense_converted.bin"); } BOOST_SCOPE_EXIT_END
+
+    ConvertToBinary(testDataPath() + "/Config/CNTKBinaryReader/test.cntk", "Simple_converted");
+    HelperRunReaderTest<float>(
+        testDataPath() + "/Config/CNTKBinaryReader/test.cntk",
+        testDataPath() + "/Control/CNTKTextFormatReader/Simple_dense.txt",
+        testDataPath() + "/Control/CNTKBinaryReader/Simple_dense_converted_Output.txt",
+        "Simple_converted",
+        "reader",
+        1000, // epoch size
+        250,  // mb size
+        10,   // num epochs
+        1,
+        1,
+        0,
+        1);
+};
+
 BOOST_AUTO_TEST_CASE(CNTKBinaryReader_MNIST_dense)
 {
     HelperRunReaderTest<double>(
@@ -131,6 +209,29 @@ BOOST_AUTO_TEST_CASE(CNTKBinaryReader_50x20_jagged_sequences_sparse)
         true);
 };
 
+// Converts the text format version of 50x20_jagged_sequences_sparse.bin and reads it back.
+BOOST_AUTO_TEST_CASE(CNTKBinaryReader_50x20_jagged_sequences_sparse_converted)
+{
+    boost::filesystem::remove("50x20_jagged_sequences_sparse_converted.bin");
+    BOOST_SCOPE_EXIT(void) { boost::filesystem::remove("50x20_jagged_sequences_sparse_converted.bin"); } BOOST_SCOPE_EXIT_END
+
+    ConvertToBinary(testDataPath() + "/Config/CNTKBinaryReader/test.cntk", "50x20_jagged_sequences_sparse_converted");
+    HelperRunReaderTest<float>(
+        testDataPath() + "/Config/CNTKBinaryReader/test.cntk",
+        testDataPath() + "/Control/CNTKTextFormatReader/50x20_jagged_sequences_sparse.txt",
+        testDataPath() + "/Control/CNTKBinaryReader/50x20_jagged_sequences_sparse_converted_Output.txt",
+        "50x20_jagged_sequences_sparse_converted",
+        "reader",
+        564,  // epoch size
+        564,  // mb size 
+        1,  // num epochs
+        1,
+        0,
+        0,
+        1,
+        true);
+};
+
 BOOST_AUTO_TEST_SUITE_END()
 
 } } } }
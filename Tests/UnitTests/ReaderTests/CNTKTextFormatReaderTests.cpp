@@ -895,6 +895,93 @@ BOOST_AUTO_TEST_CASE(CNTKTextFormatReader_extra_input_should_be_ignored)
     }
 };
 
+BOOST_AUTO_TEST_CASE(CNTKTextFormatReader_parallel_and_cached_index)
+{
+    typedef std::tuple<size_t, size_t, uint32_t, uint32_t> Sequence; // key, offset, size, samples
+    auto buildIndex = [](const string& filename, bool useCache, size_t numThreads)
+    {
+        vector<Sequence> result;
+        auto file = std::unique_ptr<FILE, int(*)(FILE*)>(fopenOrDie(filename, "rbS"), fclose);
+        Indexer indexer(file.get(), true, false, '|', 1024);
+        if (useCache || numThreads != 1)
+            indexer.SetInputFile(wstring(filename.begin(), filename.end()), useCache, numThreads);
+        indexer.Build(std::make_shared<CorpusDescriptor>(true));
+        for (const auto& chunk : indexer.GetIndex().Chunks())
+            for (const auto& s : chunk.Sequences())
+                result.push_back(Sequence(s.m_key, chunk.m_offset + s.OffsetInChunk(), s.SizeInBytes(), s.m_numberOfSamples));
+        return result;
+    };
+
+    for (const string filename : { "50x20_jagged_sequences_dense.txt", "100x1_dense.txt", "missing_trailing_newline.txt" })
+    {
+        boost::filesystem::remove(filename + ".idx");
+        auto expected = buildIndex(filename, false, 1);
+
+        for (size_t numThreads : { 2, 3, 8 })
+            BOOST_REQUIRE(expected == buildIndex(filename, false, numThreads));
+
+        // The first build writes the cache, the second one reads it.
+        BOOST_REQUIRE(expected == buildIndex(filename, true, 4));
+        BOOST_REQUIRE(boost::filesystem::exists(filename + ".idx"));
+        BOOST_REQUIRE(expected == buildIndex(filename, true, 1));
+        boost::filesystem::remove(filename + ".idx");
+    }
+};
+
+BOOST_AUTO_TEST_CASE(CNTKTextFormatReader_stale_index_cache)
+{
+    typedef std::tuple<size_t, size_t, uint32_t, uint32_t> Sequence; // key, offset, size, samples
+    auto buildIndex = [](const string& filename, bool useCache)
+    {
+        vector<Sequence> result;
+        auto file = std::unique_ptr<FILE, int(*)(FILE*)>(fopenOrDie(filename, "rbS"), fclose);
+        Indexer indexer(file.get(), true, false, '|', 1024);
+        if (useCache)
+            indexer.SetInputFile(wstring(filename.begin(), filename.end()), useCache, 1);
+        indexer.Build(std::make_shared<CorpusDescriptor>(true));
+        for (const auto& chunk : indexer.GetIndex().Chunks())
+            for (const auto& s : chunk.Sequences())
+                result.push_back(Sequence(s.m_key, chunk.m_offset + s.OffsetInChunk(), s.SizeInBytes(), s.m_numberOfSamples));
+        return result;
+    };
+
+    auto writeInput = [](const string& filename, const string& input)
+    {
+        std::ofstream file(filename, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+        file << input;
+    };
+
+    string filename = "index_cache_input.txt";
+    string idxFilename = filename + ".idx";
+    BOOST_SCOPE_EXIT(&filename, &idxFilename)
+    {
+        boost::filesystem::remove(filename);
+        boost::filesystem::remove(idxFilename);
+    } BOOST_SCOPE_EXIT_END
+
+    // Same size, different sequences: two sequences of one sample vs. one sequence of two.
+    writeInput(filename, "0 |A 1\n1 |A 2\n");
+    boost::filesystem::remove(idxFilename);
+    auto original = buildIndex(filename, true);
+    BOOST_REQUIRE_EQUAL(original.size(), 2);
+    BOOST_REQUIRE(boost::filesystem::exists(idxFilename));
+
+    // A content change that keeps the size and the modification time only shows in the content hash,
+    // the rejected cache must not affect the index that is built instead.
+    auto modificationTime = boost::filesystem::last_write_time(filename);
+    writeInput(filename, "0 |A 1\n0 |A 2\n");
+    boost::filesystem::last_write_time(filename, modificationTime);
+    auto changed = buildIndex(filename, false);
+    BOOST_REQUIRE_EQUAL(changed.size(), 1);
+    BOOST_REQUIRE(changed == buildIndex(filename, true));
+    BOOST_REQUIRE(changed == buildIndex(filename, true));
+
+    // A truncated cache is ignored and rebuilt as well.
+    boost::filesystem::resize_file(idxFilename, boost::filesystem::file_size(idxFilename) - 8);
+    BOOST_REQUIRE(changed == buildIndex(filename, true));
+    BOOST_REQUIRE(changed == buildIndex(filename, true));
+};
+
 // 100 sequences with N samples for each of 3 inputs, where N is chosen at random
 // from [1, 100] for each sequence
 BOOST_AUTO_TEST_CASE(CNTKTextFormatReader_100x100x3)
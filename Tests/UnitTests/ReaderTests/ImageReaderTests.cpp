@@ -85,6 +85,81 @@ BOOST_AUTO_TEST_CASE(ImageSimpleCompositeAndBase64)
         L"DeserializerType=\"Base64ImageDeserializer\"",
         L"useNumericSequenceKeys=true"
     });
+
+    // Reduced resolution decoding, the images are too small to be reduced, so the output is the same.
+    test({ L"ReducedResolutionDecode=true" });
+    test(
+    {
+        L"MapFile=\"$RootDir$/Base64ImageReaderSimple_map.txt\"",
+        L"DeserializerType=\"Base64ImageDeserializer\"",
+        L"useNumericSequenceKeys=true",
+        L"ReducedResolutionDecode=true"
+    });
+};
+
+BOOST_AUTO_TEST_CASE(ImageReaderReducedResolutionDecode)
+{
+    auto test = [this](std::vector<std::wstring> additionalParameters)
+    {
+        HelperRunReaderTest<float>(
+            testDataPath() + "/Config/ImageReaderSimple_Config.cntk",
+            testDataPath() + "/Control/ImageReaderReducedResolution_Control.txt",
+            testDataPath() + "/Control/ImageReaderReducedResolution_Output.txt",
+            "ReducedResolution_Test",
+            "reader",
+            4,
+            4,
+            1,
+            1,
+            1,
+            0,
+            1,
+            false,
+            true,
+            true,
+            additionalParameters);
+    };
+
+    // The 4x8 images are scaled to 1x2, so they are decoded at 2x4 when reduced resolution decoding is on.
+    // The images have a single color, which has to come out the same as after decoding at the full resolution.
+    test({});
+    test({ L"ReducedResolutionDecode=true" });
+    test(
+    {
+        L"MapFile=\"$RootDir$/Base64ImageReaderSimple_map.txt\"",
+        L"DeserializerType=\"Base64ImageDeserializer\"",
+        L"useNumericSequenceKeys=true",
+        L"ReducedResolutionDecode=true"
+    });
+};
+
+BOOST_AUTO_TEST_CASE(ImageReaderMeanTranspose)
+{
+    auto test = [this](std::vector<std::wstring> additionalParameters)
+    {
+        HelperRunReaderTest<float>(
+            testDataPath() + "/Config/ImageReaderSimple_Config.cntk",
+            testDataPath() + "/Control/ImageReaderMeanTranspose_Control.txt",
+            testDataPath() + "/Control/ImageReaderMeanTranspose_Output.txt",
+            "MeanTranspose_Test",
+            "reader",
+            4,
+            4,
+            1,
+            1,
+            1,
+            0,
+            1,
+            false,
+            true,
+            true,
+            additionalParameters);
+    };
+
+    // The mean differs per pixel and channel, so subtracting it while transposing has to match
+    // the separate Mean transform element by element.
+    test({ L"MeanTransformFile=\"$RootDir$/ImageReaderSimple_mean.xml\"" });
+    test({ L"TransposeMeanFile=\"$RootDir$/ImageReaderSimple_mean.xml\"" });
 };
 
 BOOST_AUTO_TEST_CASE(InvalidImageSimpleCompositeAndBase64)
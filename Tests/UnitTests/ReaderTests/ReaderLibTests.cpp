@@ -12,6 +12,7 @@
 #include "CorpusDescriptor.h"
 #include "FramePacker.h"
 #include "SequencePacker.h"
+#include "BucketingSequencePacker.h"
 #include "TruncatedBpttPacker.h"
 #include "CudaMemoryProvider.h"
 #include "HeapMemoryProvider.h"
@@ -2075,6 +2076,187 @@ BOOST_AUTO_TEST_CASE(SequencePackerSmallChunksWithSequences)
     }
 }
 
+BOOST_AUTO_TEST_CASE(BucketingSequencePackerWithSequences)
+{
+    size_t chunkSizeInSamples = 998;
+    size_t sweepNumberOfSamples = 21335;
+    uint32_t maxSequenceLength = 300;
+    size_t randomizationWindow = chunkSizeInSamples * 5;
+
+    auto deserializer = make_shared<SequentialDeserializer>(0, chunkSizeInSamples, sweepNumberOfSamples, maxSequenceLength);
+
+    {
+        auto blockRandomizer = make_shared<BlockRandomizer>(0, randomizationWindow, deserializer, true);
+        PackerPtr packer = std::make_shared<BucketingSequencePacker>(blockRandomizer, deserializer->GetStreamDescriptions(), 8, 1, true);
+
+        CheckPackerOnDataSet(packer, blockRandomizer, deserializer, 1, sweepNumberOfSamples * 2, 2, sweepNumberOfSamples, 640, false);
+        CheckPackerOnDataSet(packer, blockRandomizer, deserializer, 5, sweepNumberOfSamples * 2 / 5, 2, sweepNumberOfSamples, 310, false);
+    }
+
+    {
+        auto noRandomizer = make_shared<NoRandomizer>(deserializer, true);
+        PackerPtr packer = std::make_shared<BucketingSequencePacker>(noRandomizer, deserializer->GetStreamDescriptions(), 8, 1, true);
+
+        CheckPackerOnDataSet(packer, noRandomizer, deserializer, 1, sweepNumberOfSamples * 2, 2, sweepNumberOfSamples, 640, false);
+        CheckPackerOnDataSet(packer, noRandomizer, deserializer, 5, sweepNumberOfSamples * 2 / 5, 2, sweepNumberOfSamples, 310, false);
+    }
+}
+
+// Returns the number of samples and gaps in minibatches of a single sweep.
+std::pair<size_t, size_t> GetSamplesAndGapsInSweep(PackerPtr packer, SequenceEnumeratorPtr randomizer, size_t sweepSize, size_t minibatchSize)
+{
+    EpochConfiguration config;
+    config.m_numberOfWorkers = 1;
+    config.m_workerRank = 0;
+    config.m_minibatchSizeInSamples = minibatchSize;
+    config.m_truncationSize = 0;
+    config.m_totalEpochSizeInSamples = sweepSize;
+    config.m_epochIndex = 0;
+
+    randomizer->StartEpoch(config);
+    packer->SetConfiguration(config, std::vector<MemoryProviderPtr> { std::make_shared<HeapMemoryProvider>() });
+
+    size_t numSamples = 0, numGaps = 0;
+    while (true)
+    {
+        auto minibatch = packer->ReadMinibatch();
+        if (!minibatch.m_data.empty())
+        {
+            const auto& layout = minibatch.m_data.front()->m_layout;
+            numSamples += layout->GetActualNumSamples();
+            numGaps += layout->GetNumCols() - layout->GetActualNumSamples();
+        }
+
+        if (minibatch.m_endOfEpoch)
+            break;
+    }
+
+    return std::make_pair(numSamples, numGaps);
+}
+
+BOOST_AUTO_TEST_CASE(BucketingSequencePackerReducesPadding)
+{
+    size_t chunkSizeInSamples = 998;
+    size_t sweepNumberOfSamples = 21335;
+    uint32_t maxSequenceLength = 300;
+    size_t randomizationWindow = chunkSizeInSamples * 5;
+    size_t minibatchSize = 2000;
+
+    auto deserializer = make_shared<SequentialDeserializer>(0, chunkSizeInSamples, sweepNumberOfSamples, maxSequenceLength);
+
+    auto randomizer = make_shared<BlockRandomizer>(0, randomizationWindow, deserializer, true);
+    auto sequencePacker = std::make_shared<SequencePacker>(randomizer, deserializer->GetStreamDescriptions(), 1, true);
+    auto expected = GetSamplesAndGapsInSweep(sequencePacker, randomizer, sweepNumberOfSamples, minibatchSize);
+
+    auto bucketingPacker = std::make_shared<BucketingSequencePacker>(randomizer, deserializer->GetStreamDescriptions(), 8, 1, true);
+    auto actual = GetSamplesAndGapsInSweep(bucketingPacker, randomizer, sweepNumberOfSamples, minibatchSize);
+
+    BOOST_REQUIRE_EQUAL(expected.first, sweepNumberOfSamples);
+    BOOST_REQUIRE_EQUAL(actual.first, sweepNumberOfSamples);
+    BOOST_REQUIRE_LT(actual.second * 2, expected.second);
+}
+
+// Reads up to maxMinibatches minibatches and adds the first values of their sequences to the result.
+// Returns true at the end of the epoch.
+bool ReadSequenceStarts(PackerPtr packer, size_t maxMinibatches, std::multiset<float>& result)
+{
+    for (size_t i = 0; i < maxMinibatches; ++i)
+    {
+        auto minibatch = packer->ReadMinibatch();
+        if (!minibatch.m_data.empty())
+        {
+            auto layout = minibatch.m_data.front()->m_layout;
+            auto data = (float*)minibatch.m_data.front()->m_data;
+            for (const auto& s : layout->GetAllSequences())
+            {
+                if (s.seqId != GAP_SEQUENCE_ID)
+                    result.insert(data[layout->GetNumParallelSequences() * s.tBegin + s.s]);
+            }
+        }
+
+        if (minibatch.m_endOfEpoch)
+            return true;
+    }
+    return false;
+}
+
+BOOST_AUTO_TEST_CASE(BucketingSequencePackerRestoresPosition)
+{
+    size_t chunkSizeInSamples = 998;
+    size_t sweepNumberOfSamples = 21335;
+    uint32_t maxSequenceLength = 300;
+    size_t randomizationWindow = chunkSizeInSamples * 5;
+    size_t minibatchSize = 1000;
+
+    auto deserializer = make_shared<SequentialDeserializer>(0, chunkSizeInSamples, sweepNumberOfSamples, maxSequenceLength);
+    std::multiset<float> expected;
+    for (const auto& s : deserializer->Corpus())
+        expected.insert(s.second.startingValue);
+
+    EpochConfiguration config;
+    config.m_numberOfWorkers = 1;
+    config.m_workerRank = 0;
+    config.m_minibatchSizeInSamples = minibatchSize;
+    config.m_truncationSize = 0;
+    config.m_totalEpochSizeInSamples = sweepNumberOfSamples;
+    config.m_epochIndex = 0;
+    auto memoryProviders = std::vector<MemoryProviderPtr> { std::make_shared<HeapMemoryProvider>() };
+
+    // Restores the position of the reader after every few minibatches, inside of the windows of 8 minibatches,
+    // optionally with a different minibatch size, as the ReaderBase does. Every sequence has to be returned exactly once.
+    for (size_t newMinibatchSize : { minibatchSize, minibatchSize / 2, minibatchSize * 3 })
+    {
+        auto randomizer = make_shared<BlockRandomizer>(0, randomizationWindow, deserializer, true);
+        PackerPtr packer = std::make_shared<BucketingSequencePacker>(randomizer, deserializer->GetStreamDescriptions(), 8, 1, true);
+        randomizer->StartEpoch(config);
+        packer->SetConfiguration(config, memoryProviders);
+
+        std::multiset<float> actual;
+        size_t numRestores = 0;
+        while (!ReadSequenceStarts(packer, 3, actual))
+        {
+            size_t position = packer->GetCurrentSamplePosition();
+            if (numRestores++ % 2 == 0)
+            {
+                ReaderConfiguration newConfig = config;
+                newConfig.m_minibatchSizeInSamples = numRestores % 4 == 1 ? newMinibatchSize : minibatchSize;
+                packer->SetConfiguration(newConfig, memoryProviders);
+            }
+
+            randomizer->SetCurrentSamplePosition(position);
+            packer->Reset();
+            BOOST_REQUIRE_EQUAL(packer->GetCurrentSamplePosition(), position);
+        }
+
+        BOOST_REQUIRE_GT(numRestores, 2);
+        BOOST_REQUIRE_EQUAL_COLLECTIONS(expected.begin(), expected.end(), actual.begin(), actual.end());
+    }
+
+    // A new reader restored to the position inside of a window reads the whole window again, but skips nothing.
+    {
+        auto randomizer = make_shared<BlockRandomizer>(0, randomizationWindow, deserializer, true);
+        PackerPtr packer = std::make_shared<BucketingSequencePacker>(randomizer, deserializer->GetStreamDescriptions(), 8, 1, true);
+        randomizer->StartEpoch(config);
+        packer->SetConfiguration(config, memoryProviders);
+
+        std::multiset<float> actual;
+        ReadSequenceStarts(packer, 11, actual);
+        size_t position = packer->GetCurrentSamplePosition();
+
+        auto newRandomizer = make_shared<BlockRandomizer>(0, randomizationWindow, deserializer, true);
+        PackerPtr newPacker = std::make_shared<BucketingSequencePacker>(newRandomizer, deserializer->GetStreamDescriptions(), 8, 1, true);
+        newRandomizer->StartEpoch(config);
+        newPacker->SetConfiguration(config, memoryProviders);
+        newRandomizer->SetCurrentSamplePosition(position);
+        newPacker->Reset();
+        while (!ReadSequenceStarts(newPacker, 1, actual));
+
+        for (float value : expected)
+            BOOST_REQUIRE_GE(actual.count(value), 1);
+        BOOST_REQUIRE_GT(actual.size(), expected.size());
+    }
+}
+
 BOOST_AUTO_TEST_CASE(TestTruncatedBpttPacker)
 {
     size_t chunkSizeInSamples = 100;